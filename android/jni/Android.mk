@@ -48,6 +48,7 @@ CRENGINE_SRC_FILES := \
     ../../crengine/src/lvstsheet.cpp \
     ../../crengine/src/txtselector.cpp \
     ../../crengine/src/crtest.cpp \
+    ../../crengine/src/crprofiler.cpp \
     ../../crengine/src/lvbmpbuf.cpp \
     ../../crengine/src/lvfnt.cpp \
     ../../crengine/src/hyphman.cpp \
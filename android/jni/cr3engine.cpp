@@ -504,6 +504,7 @@ static JNINativeMethod sDocViewMethods[] = {
   {"createInternal", "()V", (void*)Java_org_coolreader_crengine_DocView_createInternal},
   {"destroyInternal", "()V", (void*)Java_org_coolreader_crengine_DocView_destroyInternal},
   {"getPageImageInternal", "(Landroid/graphics/Bitmap;)V", (void*)Java_org_coolreader_crengine_DocView_getPageImageInternal},
+  {"updatePageImageInternal", "(Landroid/graphics/Bitmap;)[I", (void*)Java_org_coolreader_crengine_DocView_updatePageImageInternal},
   {"loadDocumentInternal", "(Ljava/lang/String;)Z", (void*)Java_org_coolreader_crengine_DocView_loadDocumentInternal},
   {"getSettingsInternal", "()Ljava/util/Properties;", (void*)Java_org_coolreader_crengine_DocView_getSettingsInternal},
   {"applySettingsInternal", "(Ljava/util/Properties;)Z", (void*)Java_org_coolreader_crengine_DocView_applySettingsInternal},
@@ -525,6 +526,7 @@ static JNINativeMethod sDocViewMethods[] = {
   {"goLinkInternal", "(Ljava/lang/String;)I", (void*)Java_org_coolreader_crengine_DocView_goLinkInternal},
   {"moveSelectionInternal", "(Lorg/coolreader/crengine/Selection;II)Z", (void*)Java_org_coolreader_crengine_DocView_moveSelectionInternal},
   {"swapToCacheInternal", "()I", (void*)Java_org_coolreader_crengine_DocView_swapToCacheInternal},
+  {"predecodeImagesInternal", "()I", (void*)Java_org_coolreader_crengine_DocView_predecodeImagesInternal},
 };
 
 /*
@@ -234,6 +234,13 @@ public:
 	    //CRLog::trace("JNIGraphicsLib::lock pixels locked!" );
 		return new LVColorDrawBufEx( width, height, pixels, bpp );
     } 
+    virtual LVDrawBuf * lockForUpdate(JNIEnv* env, jobject jbitmap) {
+    	LVColorDrawBufEx * bmp = (LVColorDrawBufEx*)lock(env, jbitmap);
+    	// conversion is symmetric: restore engine pixel format
+    	if ( bmp )
+    		bmp->convert();
+    	return bmp;
+    }
     virtual void unlock(JNIEnv* env, jobject jbitmap, LVDrawBuf * buf ) {
     	LVColorDrawBufEx * bmp = (LVColorDrawBufEx*)buf;
     	bmp->convert();
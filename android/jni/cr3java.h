@@ -46,6 +46,8 @@ typedef struct {
 class BitmapAccessorInterface {
 public:
     virtual LVDrawBuf * lock(JNIEnv* env, jobject jbitmap) = 0;
+    /// lock bitmap keeping its current content, for partial update; returns NULL if not supported
+    virtual LVDrawBuf * lockForUpdate(JNIEnv* env, jobject jbitmap) { return NULL; }
     virtual void unlock(JNIEnv* env, jobject jbitmap, LVDrawBuf * buf ) = 0;
 	static BitmapAccessorInterface * getInstance(); 
 };
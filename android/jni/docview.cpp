@@ -675,6 +675,42 @@ JNIEXPORT void JNICALL Java_org_coolreader_crengine_DocView_getPageImageInternal
     //CRLog::trace("getPageImageInternal exiting");
 }
 
+/*
+ * Class:     org_coolreader_crengine_DocView
+ * Method:    updatePageImageInternal
+ * Signature: (Landroid/graphics/Bitmap;)[I
+ */
+JNIEXPORT jintArray JNICALL Java_org_coolreader_crengine_DocView_updatePageImageInternal
+  (JNIEnv * env, jobject view, jobject bitmap)
+{
+    DocViewNative * p = getNative(env, view);
+	DocViewCallback callback( env, p->_docview, view );
+	LVDrawBuf * drawbuf = BitmapAccessorInterface::getInstance()->lockForUpdate(env, bitmap);
+	bool canUpdate = drawbuf!=NULL;
+	if ( !canUpdate ) // bitmap content is not accessible: full redraw
+		drawbuf = BitmapAccessorInterface::getInstance()->lock(env, bitmap);
+	if ( drawbuf==NULL ) {
+		CRLog::error("bitmap accessor is invalid");
+		return NULL;
+	}
+	drawbuf->clearDamage();
+	if ( canUpdate )
+		p->_docview->updatePageImage( *drawbuf );
+	else
+		p->_docview->Draw( *drawbuf );
+	// changed rectangles as flat left, top, right, bottom list
+	const LVArray<lvRect> & rects = drawbuf->getDamageRects();
+	jintArray res = env->NewIntArray( rects.length() * 4 );
+	if ( res!=NULL ) {
+		for ( int i=0; i<rects.length(); i++ ) {
+			jint rc[4] = { rects[i].left, rects[i].top, rects[i].right, rects[i].bottom };
+			env->SetIntArrayRegion( res, i * 4, 4, rc );
+		}
+	}
+	BitmapAccessorInterface::getInstance()->unlock(env, bitmap, drawbuf);
+	return res;
+}
+
 /*
  * Class:     org_coolreader_crengine_DocView
  * Method:    loadDocument
@@ -1036,6 +1072,20 @@ JNIEXPORT jint JNICALL Java_org_coolreader_crengine_DocView_swapToCacheInternal
     return p->_docview->updateCache(_timeoutControl);
 }
 
+/*
+ * Class:     org_coolreader_crengine_DocView
+ * Method:    predecodeImagesInternal
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_org_coolreader_crengine_DocView_predecodeImagesInternal
+(JNIEnv * _env, jobject _this)
+{
+    CRJNIEnv env(_env);
+    DocViewNative * p = getNative(_env, _this);
+    CRTimerUtil timeout(100); // short step to not delay page drawing tasks queued after it
+    return p->_docview->predecodeImages(timeout);
+}
+
 
 /*
  * Class:     org_coolreader_crengine_DocView
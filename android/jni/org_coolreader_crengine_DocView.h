@@ -39,6 +39,14 @@ extern "C" {
 JNIEXPORT void JNICALL Java_org_coolreader_crengine_DocView_getPageImageInternal
   (JNIEnv *, jobject, jobject);
 
+/*
+ * Class:     org_coolreader_crengine_DocView
+ * Method:    updatePageImageInternal
+ * Signature: (Landroid/graphics/Bitmap;)[I
+ */
+JNIEXPORT jintArray JNICALL Java_org_coolreader_crengine_DocView_updatePageImageInternal
+  (JNIEnv *, jobject, jobject);
+
 /*
  * Class:     org_coolreader_crengine_DocView
  * Method:    createInternal
@@ -223,6 +231,14 @@ JNIEXPORT jboolean JNICALL Java_org_coolreader_crengine_DocView_moveSelectionInt
 JNIEXPORT jint JNICALL Java_org_coolreader_crengine_DocView_swapToCacheInternal
   (JNIEnv *, jobject);
 
+/*
+ * Class:     org_coolreader_crengine_DocView
+ * Method:    predecodeImagesInternal
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_org_coolreader_crengine_DocView_predecodeImagesInternal
+  (JNIEnv *, jobject);
+
 #define SEL_CMD_SELECT_FIRST_SENTENCE_ON_PAGE 1
 #define SEL_CMD_NEXT_SENTENCE 2
 #define SEL_CMD_PREV_SENTENCE 3
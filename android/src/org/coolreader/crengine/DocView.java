@@ -40,6 +40,14 @@ public class DocView {
 		return swapToCacheInternal();
 	}
 
+	/**
+	 * Decode and scale some of images of next and previous pages, for short time.
+	 * @return SWAP_TIMEOUT if there are more images to decode, SWAP_DONE otherwise
+	 */
+	public int predecodeImages() {
+		return predecodeImagesInternal();
+	}
+
 	/**
 	 * Follow link.
 	 * @param link
@@ -228,6 +236,16 @@ public class DocView {
 	public void getPageImage(Bitmap bitmap) {
 		getPageImageInternal(bitmap);
 	}
+
+	/**
+	 * Update page image previously drawn to bitmap by getPageImage(),
+	 * redrawing only changed parts (page header, selection) when possible.
+	 * @param bitmap is buffer with previous page image.
+	 * @return changed rectangles as flat array of left, top, right, bottom values
+	 */
+	public int[] updatePageImage(Bitmap bitmap) {
+		return updatePageImageInternal(bitmap);
+	}
 	
 	//========================================================================================
 	// Native functions
@@ -235,6 +253,8 @@ public class DocView {
 	//========================================================================================
 	private native void getPageImageInternal(Bitmap bitmap);
 
+	private native int[] updatePageImageInternal(Bitmap bitmap);
+
 	private native void createInternal();
 
 	private native void destroyInternal();
@@ -286,6 +306,9 @@ public class DocView {
 	// / returns either SWAP_DONE, SWAP_TIMEOUT or SWAP_ERROR
 	private native int swapToCacheInternal();
 
+	// / returns either SWAP_DONE or SWAP_TIMEOUT
+	private native int predecodeImagesInternal();
+
 	private int mNativeObject; // used from JNI
 
 	private ReaderCallback readerCallback;
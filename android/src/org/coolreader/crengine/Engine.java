@@ -986,10 +986,10 @@ public class Engine {
 			throw new IllegalStateException("Already initialized");
 		String[] fonts = findFonts();
 		findExternalHyphDictionaries();
+		// Initialization of cache directory: before fonts registration, to read font registry cache from it
+		initCacheDirectory();
 		if (!initInternal(fonts))
 			throw new IOException("Cannot initialize CREngine JNI");
-		// Initialization of cache directory
-		initCacheDirectory();
 		initialized = true;
 	}
 
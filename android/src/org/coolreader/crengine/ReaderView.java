@@ -2309,6 +2309,7 @@ public class ReaderView extends SurfaceView implements android.view.SurfaceHolde
    			if ( doneHandler!=null )
    				doneHandler.run();
    			scheduleGc();
+   			schedulePredecodeTask();
 		}
 		@Override
 		public void fail(Exception e) {
@@ -3905,6 +3906,7 @@ public class ReaderView extends SurfaceView implements android.view.SurfaceHolde
     	if ( !mOpened )
     		return;
 		cancelSwapTask();
+		cancelPredecodeTask();
 		//save();
     	post( new Task() {
     		public void work() {
@@ -4074,6 +4076,7 @@ public class ReaderView extends SurfaceView implements android.view.SurfaceHolde
 		}
 		public void OnLoadFileStart(String filename) {
 			cancelSwapTask();
+			cancelPredecodeTask();
 			BackgroundThread.ensureBackground();
 	    	log.d("readerCallback.OnLoadFileStart " + filename);
 		}
@@ -4129,6 +4132,40 @@ public class ReaderView extends SurfaceView implements android.view.SurfaceHolde
 		
     }
     
+    private volatile PredecodeImagesTask currentPredecodeTask;
+	private void schedulePredecodeTask() {
+		currentPredecodeTask = new PredecodeImagesTask();
+		currentPredecodeTask.reschedule();
+	}
+	private void cancelPredecodeTask() {
+		currentPredecodeTask = null;
+	}
+    private class PredecodeImagesTask extends Task {
+    	boolean isTimeout;
+    	public void reschedule() {
+    		if ( this!=currentPredecodeTask )
+    			return;
+			BackgroundThread.instance().postGUI( new Runnable() {
+				@Override
+				public void run() {
+					post(PredecodeImagesTask.this);
+				}
+			}, 100);
+    	}
+		@Override
+		public void work() throws Exception {
+    		if ( this!=currentPredecodeTask )
+    			return;
+			isTimeout = doc.predecodeImages()==DocView.SWAP_TIMEOUT;
+		}
+		@Override
+		public void done() {
+			if ( isTimeout )
+				reschedule();
+		}
+		
+    }
+    
     private boolean invalidImages = true;
     private void clearImageCache()
     {
@@ -2397,6 +2397,12 @@ int InitDoc(const char *exename, char *fileName)
     fontDirs.add(lString16(L""USERFONTDIR));
     fontDirs.add(lString16(L""SYSTEMFONTDIR));
     CRLog::info("INIT...");
+    // init document cache before fonts registration: it contains font registry cache
+    ldomDocCache::init(lString16(L""STATEPATH"/cr3/.cache"), PB_CR3_CACHE_SIZE);
+    if (!ldomDocCache::enabled())
+        ldomDocCache::init(lString16(L""USERDATA2"/share/cr3/.cache"), PB_CR3_CACHE_SIZE);
+    if (!ldomDocCache::enabled())
+        ldomDocCache::init(lString16(L""USERDATA"/share/cr3/.cache"), PB_CR3_CACHE_SIZE);
     if (!InitCREngine(exename, fontDirs))
         return 0;
 
@@ -2418,11 +2424,6 @@ int InitDoc(const char *exename, char *fileName)
             if (!wm->loadSkin(lString16(L""USERDATA2"/share/cr3/skin")))
                 wm->loadSkin(lString16(L""USERDATA"/share/cr3/skin"));
 
-        ldomDocCache::init(lString16(L""STATEPATH"/cr3/.cache"), PB_CR3_CACHE_SIZE);
-        if (!ldomDocCache::enabled())
-            ldomDocCache::init(lString16(L""USERDATA2"/share/cr3/.cache"), PB_CR3_CACHE_SIZE);
-        if (!ldomDocCache::enabled())
-            ldomDocCache::init(lString16(L""USERDATA"/share/cr3/.cache"), PB_CR3_CACHE_SIZE);
         CRLog::trace("creating main window...");
         main_win = new CRPocketBookDocView(wm, lString16(L""USERDATA"/share/cr3"));
         CRLog::trace("setting colors...");
@@ -395,6 +395,8 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 	lString16Collection fontDirs;
 	//fontDirs.add( fontdir );
     fontDirs.add( exedir + L"fonts" );
+	// same directory is passed to ldomDocCache::init() below, but font registry cache should be read before fonts are registered
+	SetFontRegistryCacheFile( exedir + L"cache\\cr3fonts.inx" );
 	InitCREngine( exe_fn, fontDirs );
     const char * fontnames[] = {
 #if 1
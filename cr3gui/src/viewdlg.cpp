@@ -677,6 +677,7 @@ void CRViewDialog::draw( int pageOffset )
     if ( !pageImage.isNull() ) {
         LVDrawBuf * pagedrawbuf = pageImage->getDrawBuf();
         _wm->getScreen()->draw( pagedrawbuf, clientRect.left, clientRect.top );
+        pagedrawbuf->clearDamage();
     }
 }
 
@@ -301,6 +301,9 @@ CR3View::CR3View( QWidget *parent)
     _data->_props = LVCreatePropsContainer();
     _docview = new LVDocView();
     _docview->setCallback( this );
+    _predecodeTimer = new QTimer( this );
+    _predecodeTimer->setSingleShot( true );
+    connect( _predecodeTimer, SIGNAL(timeout()), this, SLOT(predecodeImagesStep()) );
     _selStart = ldomXPointer();
     _selEnd = ldomXPointer();
     _selText.clear();
@@ -573,6 +576,18 @@ void CR3View::paintEvent ( QPaintEvent * event )
         }
     }
     updateScroll();
+    // zero timeout timer fires when event queue is empty
+    _predecodeTimer->start( 0 );
+}
+
+/// max time of single image pre-decoding step, milliseconds
+#define PREDECODE_STEP_TIMEOUT 50
+
+void CR3View::predecodeImagesStep()
+{
+    CRTimerUtil timeout( PREDECODE_STEP_TIMEOUT );
+    if ( _docview->predecodeImages( timeout )==CR_TIMEOUT )
+        _predecodeTimer->start( 0 );
 }
 
 void CR3View::updateScroll()
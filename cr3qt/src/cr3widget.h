@@ -3,6 +3,7 @@
 
 #include <qwidget.h>
 #include <QScrollBar>
+#include <QTimer>
 #include "crqtutil.h"
 
 class LVDocView;
@@ -158,6 +159,8 @@ class CR3View : public QWidget, public LVDocViewCallback
         virtual void refreshPropFromView( const char * propName );
 
     private slots:
+        /// pre-decodes images of next and previous pages, step by step while application is idle
+        void predecodeImagesStep();
 
     private:
         void updateDefProps();
@@ -169,6 +172,7 @@ class CR3View : public QWidget, public LVDocViewCallback
         DocViewData * _data; // to hide non-qt implementation
         LVDocView * _docview;
         QScrollBar * _scroll;
+        QTimer * _predecodeTimer;
         PropsChangeCallback * _propsCallback;
         QStringList _hyphDicts;
         QCursor _normalCursor;
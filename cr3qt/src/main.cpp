@@ -320,6 +320,13 @@ bool InitCREngine( const char * exename, lString16Collection & fontDirs )
 
     lString8 fontDir8 = UnicodeToLocal(fontDir);
     //const char * fontDir8s = fontDir8.c_str();
+    // font registry cache is in document cache directory (see MainWindow), it's read before fonts are registered
+#ifdef _LINUX
+    QString cacheDir = QDir::toNativeSeparators(QDir::homePath() + "/.cr3/cache/");
+#else
+    QString cacheDir = QDir::toNativeSeparators(QDir::homePath() + "/cr3/cache/");
+#endif
+    SetFontRegistryCacheFile( qt2cr( cacheDir ) + L"cr3fonts.inx" );
     //InitFontManager( fontDir8 );
     InitFontManager( lString8() );
 
@@ -0,0 +1,509 @@
+/** \file crbench.cpp
+    \brief headless load/render/draw/search benchmark
+
+    Loads documents from files or directories into LVDocView with fixed
+    page size, renders, draws every page into LVGrayDrawBuf and runs
+    several searches. Every document is measured twice: cold (empty
+    document cache) and warm (document loaded from ldomDocCache).
+    With -a, LVStyleSheet::apply() over all elements of every document
+    is measured separately, using stylesheet from specified file.
+    With -r, only draw buffer rotation and color conversion are measured
+    for panel sizes from 600x800 to 1404x1872.
+
+    Usage: crbench [options] <file or directory>...
+
+    CoolReader Engine
+
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+*/
+
+#include "crengine.h"
+#include "crprofiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// measured values for single document load
+struct BenchResult {
+    lInt64 loadUs;
+    lInt64 renderUs;
+    lInt64 drawUs;
+    lInt64 searchUs;
+    int pages;
+    int found;
+    int peakRssKb;
+    bool ok;
+    BenchResult() : loadUs(0), renderUs(0), drawUs(0), searchUs(0), pages(0), found(0), peakRssKb(0), ok(false) { }
+    void add( const BenchResult & v )
+    {
+        loadUs += v.loadUs;
+        renderUs += v.renderUs;
+        drawUs += v.drawUs;
+        searchUs += v.searchUs;
+        pages += v.pages;
+        found += v.found;
+        if ( peakRssKb < v.peakRssKb )
+            peakRssKb = v.peakRssKb;
+    }
+};
+
+/// totals per document format (file extension)
+struct BenchFormatStats {
+    lString8 format;
+    int files;
+    BenchResult cold;
+    BenchResult warm;
+    BenchFormatStats( lString8 fmt ) : format(fmt), files(0) { }
+};
+
+static int benchWidth = 600;
+static int benchHeight = 800;
+static int benchBpp = 2;
+static bool benchWarm = true;
+static bool benchProfile = false;
+static lString16 benchCssDir;
+static lString16 benchCacheDir( L"/tmp/crbench-cache" );
+static lString16Collection benchPatterns;
+static lString8 benchApplyCss;
+
+/// resets peak RSS counter (VmHWM) of current process, Linux 4.0+
+static void resetPeakRss()
+{
+    FILE * f = fopen( "/proc/self/clear_refs", "w" );
+    if ( !f )
+        return;
+    fputs( "5", f );
+    fclose( f );
+}
+
+/// returns peak RSS of current process, in kilobytes
+static int getPeakRss()
+{
+    FILE * f = fopen( "/proc/self/status", "r" );
+    if ( !f )
+        return 0;
+    char buf[256];
+    int res = 0;
+    while ( fgets( buf, sizeof(buf), f ) ) {
+        if ( !strncmp( buf, "VmHWM:", 6 ) ) {
+            res = atoi( buf + 6 );
+            break;
+        }
+    }
+    fclose( f );
+    return res;
+}
+
+/// selects per format stylesheet, the same way as cr3gui does
+class BenchDocViewCallback : public LVDocViewCallback {
+    LVDocView * _view;
+public:
+    BenchDocViewCallback( LVDocView * view ) : _view(view) { }
+    virtual void OnLoadFileFormatDetected( doc_format_t fileFormat )
+    {
+        if ( benchCssDir.empty() )
+            return;
+        lString16 filename = L"fb2.css";
+        switch ( fileFormat ) {
+        case doc_format_txt:
+            filename = L"txt.css";
+            break;
+        case doc_format_rtf:
+            filename = L"rtf.css";
+            break;
+        case doc_format_epub:
+            filename = L"epub.css";
+            break;
+        case doc_format_html:
+            filename = L"htm.css";
+            break;
+        case doc_format_chm:
+            filename = L"chm.css";
+            break;
+        case doc_format_doc:
+            filename = L"doc.css";
+            break;
+        default:
+            break;
+        }
+        lString8 css;
+        if ( LVLoadStylesheetFile( benchCssDir + filename, css ) || LVLoadStylesheetFile( benchCssDir + L"fb2.css", css ) )
+            _view->setStyleSheet( css );
+    }
+};
+
+static void collectElements( ldomNode * node, LVArray<ldomNode*> & elements )
+{
+    if ( !node->isElement() )
+        return;
+    elements.add( node );
+    int cnt = node->getChildCount();
+    for ( int i=0; i<cnt; i++ )
+        collectElements( node->getChildNode(i), elements );
+}
+
+/// stylesheet selector matching micro-benchmark
+static void runApply( ldomDocument * doc )
+{
+    lInt64 t = CRProfiler::getTimeMicros();
+    LVStyleSheet sheet( doc );
+    sheet.parse( benchApplyCss.c_str() );
+    lInt64 parseUs = CRProfiler::getTimeMicros() - t;
+    LVArray<ldomNode*> elements;
+    collectElements( doc->getRootNode(), elements );
+    if ( !elements.length() )
+        return;
+    // repeat until enough time is spent to get stable numbers
+    int passes = 0;
+    lInt64 applyUs = 0;
+    t = CRProfiler::getTimeMicros();
+    while ( passes<1000 && (passes<3 || applyUs<300000) ) {
+        for ( int i=0; i<elements.length(); i++ ) {
+            css_style_rec_t style;
+            sheet.apply( elements[i], &style );
+        }
+        passes++;
+        applyUs = CRProfiler::getTimeMicros() - t;
+    }
+    printf( "  apply parse %6.2f ms  %d elements x %d passes  %8.1f ns/element\n",
+            parseUs / 1000.0, elements.length(), passes, applyUs * 1000.0 / passes / elements.length() );
+}
+
+/// returns new gray or color draw buffer filled with pseudo-random pixels
+static LVDrawBuf * createNoiseBuf( int dx, int dy, int bpp )
+{
+    LVDrawBuf * buf = bpp<=8 ? (LVDrawBuf*)new LVGrayDrawBuf( dx, dy, bpp ) : (LVDrawBuf*)new LVColorDrawBuf( dx, dy, bpp );
+    lUInt32 seed = 1;
+    for ( int y=0; y<dy; y++ ) {
+        lUInt8 * row = buf->GetScanLine( y );
+        for ( int i=0; i<buf->GetRowSize(); i++ ) {
+            seed = seed * 1103515245 + 12345;
+            row[i] = (lUInt8)(seed >> 16);
+        }
+    }
+    return buf;
+}
+
+/// LVDrawBuf::Rotate and LVColorDrawBuf::DrawTo micro-benchmark for typical panel sizes
+static void runRotateBench()
+{
+    static const int sizes[4][2] = { {600, 800}, {758, 1024}, {1072, 1448}, {1404, 1872} };
+    static const int bpps[6] = { 1, 2, 4, 8, 16, 32 };
+    printf( "crbench: rotation, us per call\n" );
+    printf( "  %-10s %4s %10s %10s\n", "panel", "bpp", "90/270", "180" );
+    for ( int s=0; s<4; s++ ) {
+        for ( int b=0; b<6; b++ ) {
+            LVDrawBuf * buf = createNoiseBuf( sizes[s][0], sizes[s][1], bpps[b] );
+            lInt64 us[2];
+            for ( int k=0; k<2; k++ ) {
+                // repeat until enough time is spent to get stable numbers; 90 and 270 alternate to keep size
+                int passes = 0;
+                us[k] = 0;
+                lInt64 t = CRProfiler::getTimeMicros();
+                while ( passes<1000 && (passes<4 || us[k]<300000) ) {
+                    buf->Rotate( k ? CR_ROTATE_ANGLE_180 : ((passes & 1) ? CR_ROTATE_ANGLE_270 : CR_ROTATE_ANGLE_90) );
+                    passes++;
+                    us[k] = CRProfiler::getTimeMicros() - t;
+                }
+                us[k] /= passes;
+            }
+            printf( "  %4dx%-5d %4d %10d %10d\n", sizes[s][0], sizes[s][1], bpps[b], (int)us[0], (int)us[1] );
+            delete buf;
+        }
+    }
+    printf( "crbench: color buffer DrawTo, us per call\n" );
+    printf( "  %-10s %4s %8s %8s %8s %8s\n", "panel", "bpp", "to 2bpp", "to 8bpp", "to 16", "to 32" );
+    static const int dstBpps[4] = { 2, 8, 16, 32 };
+    for ( int s=0; s<4; s++ ) {
+        for ( int b=4; b<6; b++ ) {
+            LVDrawBuf * src = createNoiseBuf( sizes[s][0], sizes[s][1], bpps[b] );
+            printf( "  %4dx%-5d %4d", sizes[s][0], sizes[s][1], bpps[b] );
+            for ( int d=0; d<4; d++ ) {
+                if ( bpps[b]==32 && dstBpps[d]==16 ) {
+                    printf( " %8s", "-" );
+                    continue;
+                }
+                LVDrawBuf * dst = createNoiseBuf( sizes[s][0], sizes[s][1], dstBpps[d] );
+                int passes = 0;
+                lInt64 us = 0;
+                lInt64 t = CRProfiler::getTimeMicros();
+                while ( passes<1000 && (passes<4 || us<300000) ) {
+                    src->DrawTo( dst, 0, 0, 0, NULL );
+                    passes++;
+                    us = CRProfiler::getTimeMicros() - t;
+                }
+                printf( " %8d", (int)(us / passes) );
+                delete dst;
+            }
+            printf( "\n" );
+            delete src;
+        }
+    }
+}
+
+static bool runDocument( const lString16 & fileName, BenchResult & res, bool measureApply )
+{
+    resetPeakRss();
+    LVDocView * view = new LVDocView( benchBpp );
+    BenchDocViewCallback callback( view );
+    view->setCallback( &callback );
+    view->setViewMode( DVM_PAGES, 1 );
+    view->Resize( benchWidth, benchHeight );
+    CRProfiler::reset();
+
+    lInt64 t = CRProfiler::getTimeMicros();
+    res.ok = view->LoadDocument( fileName.c_str() );
+    res.loadUs = CRProfiler::getTimeMicros() - t;
+    if ( res.ok ) {
+        t = CRProfiler::getTimeMicros();
+        view->checkRender();
+        res.renderUs = CRProfiler::getTimeMicros() - t;
+
+        res.pages = view->getPageCount();
+        LVGrayDrawBuf buf( benchWidth, benchHeight, benchBpp );
+        t = CRProfiler::getTimeMicros();
+        for ( int i=0; i<res.pages; i++ ) {
+            view->goToPage( i );
+            view->Draw( buf );
+        }
+        res.drawUs = CRProfiler::getTimeMicros() - t;
+
+        t = CRProfiler::getTimeMicros();
+        for ( int i=0; i<(int)benchPatterns.length(); i++ ) {
+            LVArray<ldomWord> words;
+            if ( view->getDocument()->findText( benchPatterns[i], true, false, -1, -1, words, 1000, 0 ) )
+                res.found += words.length();
+        }
+        res.searchUs = CRProfiler::getTimeMicros() - t;
+        if ( measureApply )
+            runApply( view->getDocument() );
+        // write cache file for warm run
+        view->swapToCache();
+    }
+    if ( benchProfile )
+        printf( "  profile: %s\n", view->getProfilerStats().c_str() );
+    view->setCallback( NULL );
+    delete view;
+    res.peakRssKb = getPeakRss();
+    return res.ok;
+}
+
+static void printResult( const char * title, const BenchResult & r )
+{
+    printf( "  %-5s load %8.1f ms  render %8.1f ms  draw %8.1f ms (%5d pages, %6.2f ms/page)  search %8.1f ms (%d found)  peak RSS %6d KB\n",
+            title, r.loadUs / 1000.0, r.renderUs / 1000.0, r.drawUs / 1000.0, r.pages,
+            r.pages ? r.drawUs / 1000.0 / r.pages : 0.0, r.searchUs / 1000.0, r.found, r.peakRssKb );
+}
+
+static bool isSupportedFile( const lString16 & fileName )
+{
+    static const lChar16 * exts[] = {
+        L".fb2", L".epub", L".txt", L".rtf", L".chm", L".doc",
+        L".htm", L".html", L".pdb", L".prc", L".mobi", L".zip", NULL
+    };
+    lString16 lc = fileName;
+    lc.lowercase();
+    for ( int i=0; exts[i]; i++ )
+        if ( lc.endsWith( exts[i] ) )
+            return true;
+    return false;
+}
+
+static lString8 getFormatName( const lString16 & fileName )
+{
+    lString16 name = LVExtractFilename( fileName );
+    lString16 base = LVExtractFilenameWithoutExtension( fileName );
+    if ( base.length() + 1 >= name.length() )
+        return lString8("unknown");
+    lString16 ext = name.substr( base.length() + 1 );
+    ext.lowercase();
+    return UnicodeToUtf8( ext );
+}
+
+static void collectFiles( const lString16 & path, lString16Collection & files, const lString16Collection & exts, bool filterByExtension )
+{
+    LVContainerRef dir = LVOpenDirectory( path.c_str() );
+    if ( dir.isNull() ) {
+        if ( !filterByExtension || isSupportedFile( path ) )
+            files.add( path );
+        return;
+    }
+    lString16 base = path;
+    LVAppendPathDelimiter( base );
+    for ( int i=0; i < dir->GetObjectCount(); i++ ) {
+        const LVContainerItemInfo * item = dir->GetObjectInfo(i);
+        lString16 name = item->GetName();
+        if ( item->IsContainer() ) {
+            if ( name!=L"." && name!=L".." )
+                collectFiles( base + name, files, exts, filterByExtension );
+            continue;
+        }
+        if ( exts.length() ) {
+            lString16 lc = name;
+            lc.lowercase();
+            for ( int j=0; j<(int)exts.length(); j++ ) {
+                if ( lc.endsWith( exts[j] ) ) {
+                    files.add( base + name );
+                    break;
+                }
+            }
+        } else if ( isSupportedFile( name ) ) {
+            files.add( base + name );
+        }
+    }
+}
+
+static void usage()
+{
+    printf( "usage: crbench [options] <file or directory>...\n"
+            "  -w <width>      page width, default 600\n"
+            "  -h <height>     page height, default 800\n"
+            "  -b <bpp>        gray draw buffer bits per pixel (1,2,3,4,8), default 2\n"
+            "  -f <dir>        font directory to scan for .ttf/.otf files (may be repeated)\n"
+            "  -c <dir>        directory with fb2.css, epub.css, txt.css... stylesheets\n"
+            "  -k <dir>        document cache directory, default /tmp/crbench-cache\n"
+            "  -s <text>       search pattern (may be repeated), default: the, and, love\n"
+            "  -n              cold runs only, skip warm (cached) runs\n"
+            "  -p              print profiler stats after every run (needs ENABLE_CR_PROFILER=1 build)\n"
+            "  -a <css file>   measure stylesheet apply() over all elements, for cold runs\n"
+            "  -r              run draw buffer rotation and conversion micro-benchmark only\n" );
+}
+
+int main( int argc, char ** argv )
+{
+    CRLog::setStdoutLogger();
+    CRLog::setLogLevel( CRLog::LL_ERROR );
+
+    lString16Collection fontDirs;
+    lString16Collection inputs;
+    for ( int i=1; i<argc; i++ ) {
+        const char * arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ( !strcmp( arg, "-w" ) && hasValue )
+            benchWidth = atoi( argv[++i] );
+        else if ( !strcmp( arg, "-h" ) && hasValue )
+            benchHeight = atoi( argv[++i] );
+        else if ( !strcmp( arg, "-b" ) && hasValue )
+            benchBpp = atoi( argv[++i] );
+        else if ( !strcmp( arg, "-f" ) && hasValue )
+            fontDirs.add( LocalToUnicode( lString8( argv[++i] ) ) );
+        else if ( !strcmp( arg, "-c" ) && hasValue ) {
+            benchCssDir = LocalToUnicode( lString8( argv[++i] ) );
+            LVAppendPathDelimiter( benchCssDir );
+        } else if ( !strcmp( arg, "-k" ) && hasValue )
+            benchCacheDir = LocalToUnicode( lString8( argv[++i] ) );
+        else if ( !strcmp( arg, "-s" ) && hasValue )
+            benchPatterns.add( Utf8ToUnicode( lString8( argv[++i] ) ) );
+        else if ( !strcmp( arg, "-n" ) )
+            benchWarm = false;
+        else if ( !strcmp( arg, "-p" ) )
+            benchProfile = true;
+        else if ( !strcmp( arg, "-r" ) ) {
+            runRotateBench();
+            return 0;
+        }
+        else if ( !strcmp( arg, "-a" ) && hasValue ) {
+            if ( !LVLoadStylesheetFile( LocalToUnicode( lString8( argv[++i] ) ), benchApplyCss ) ) {
+                printf( "cannot read stylesheet %s\n", argv[i] );
+                return 1;
+            }
+        }
+        else if ( arg[0]=='-' ) {
+            usage();
+            return 1;
+        } else
+            inputs.add( LocalToUnicode( lString8( arg ) ) );
+    }
+    if ( !inputs.length() || benchWidth<=0 || benchHeight<=0 ) {
+        usage();
+        return 1;
+    }
+    if ( !benchPatterns.length() ) {
+        benchPatterns.add( lString16(L"the") );
+        benchPatterns.add( lString16(L"and") );
+        benchPatterns.add( lString16(L"love") );
+    }
+
+    // document cache is initialized first to let font manager use font registry cache in it
+    LVCreateDirectory( benchCacheDir );
+    if ( !ldomDocCache::init( benchCacheDir, 0x100000 * 256 ) )
+        printf( "cannot init document cache in %s: warm runs will not hit cache\n", LCSTR(benchCacheDir) );
+
+    InitFontManager( lString8() );
+    if ( !fontDirs.length() ) {
+        fontDirs.add( lString16(L"/usr/share/fonts") );
+        fontDirs.add( lString16(L"/usr/local/share/fonts") );
+    }
+    lString16Collection fontExts;
+    fontExts.add( lString16(L".ttf") );
+    fontExts.add( lString16(L".otf") );
+    lString16Collection fonts;
+    for ( int i=0; i<(int)fontDirs.length(); i++ )
+        collectFiles( fontDirs[i], fonts, fontExts, false );
+    for ( int i=0; i<(int)fonts.length(); i++ )
+        fontMan->RegisterFont( UnicodeToLocal( fonts[i] ) );
+    if ( !fontMan->GetFontCount() ) {
+        printf( "no fonts found, use -f <dir>\n" );
+        return 2;
+    }
+
+    lString16Collection files;
+    for ( int i=0; i<(int)inputs.length(); i++ )
+        collectFiles( inputs[i], files, lString16Collection(), true );
+
+    printf( "crbench: %d files, page %dx%d, %d bpp, %d fonts\n", (int)files.length(), benchWidth, benchHeight, benchBpp, fontMan->GetFontCount() );
+
+    LVPtrVector<BenchFormatStats> formats;
+    BenchResult totalCold;
+    BenchResult totalWarm;
+    int failed = 0;
+    for ( int i=0; i<(int)files.length(); i++ ) {
+        printf( "%s\n", LCSTR(files[i]) );
+        ldomDocCache::clear();
+        BenchResult cold;
+        if ( !runDocument( files[i], cold, !benchApplyCss.empty() ) ) {
+            printf( "  failed to load\n" );
+            failed++;
+            continue;
+        }
+        printResult( "cold", cold );
+        BenchResult warm;
+        if ( benchWarm ) {
+            runDocument( files[i], warm, false );
+            printResult( "warm", warm );
+        }
+        lString8 fmt = getFormatName( files[i] );
+        BenchFormatStats * stats = NULL;
+        for ( int j=0; j<formats.length(); j++ )
+            if ( formats[j]->format==fmt )
+                stats = formats[j];
+        if ( !stats ) {
+            stats = new BenchFormatStats( fmt );
+            formats.add( stats );
+        }
+        stats->files++;
+        stats->cold.add( cold );
+        stats->warm.add( warm );
+        totalCold.add( cold );
+        totalWarm.add( warm );
+    }
+
+    printf( "\nper format totals:\n" );
+    for ( int i=0; i<formats.length(); i++ ) {
+        printf( "%s: %d files\n", formats[i]->format.c_str(), formats[i]->files );
+        printResult( "cold", formats[i]->cold );
+        if ( benchWarm )
+            printResult( "warm", formats[i]->warm );
+    }
+    printf( "all: %d files, %d failed\n", (int)files.length(), failed );
+    printResult( "cold", totalCold );
+    if ( benchWarm )
+        printResult( "warm", totalWarm );
+
+    ldomDocCache::close();
+    ShutdownFontManager();
+    return failed ? 3 : 0;
+}
@@ -447,6 +447,8 @@ class CRGUIWindow
         virtual void setRect( const lvRect & rc ) = 0;
         /// draws content of window to screen
         virtual void flush() = 0;
+        /// returns areas of screen changed by last flush() call
+        virtual void getDamageRects( LVArray<lvRect> & rects ) { rects.add( getRect() ); }
         /// called if window gets focus
         virtual void activated() { setDirty(); }
         virtual void reactivated() {}
@@ -454,6 +456,8 @@ class CRGUIWindow
         virtual void covered() { }
         /// called if window is being closed
         virtual void closing() { }
+        /// called while event queue is empty: do small step of background work, return true if there is more to do
+        virtual bool onIdle() { return false; }
         /// returns window manager
         virtual CRGUIWindowManager * getWindowManager() = 0;
         /// destroys window
@@ -480,6 +484,8 @@ class CRGUIWindowManager : public CRGUIStringTranslator
         cr_rotate_angle_t _orientation;
         LVRefVec<LVImageSource> m_batteryIcons;
         bool _stopFlag;
+        /// draw window and add changed parts of it (whole window if full==true) to screen update area
+        void invalidateWindow( CRGUIWindow * window, bool full );
     public:
         /// forward events from system queue to application queue
         virtual void forwardSystemEvents( bool waitForEvent ) { }
@@ -816,6 +822,9 @@ class CRGUIScreenBase : public CRGUIScreen
         virtual void invalidateRect( const lvRect & rc )
         {
             _updateRect.extend( rc );
+            // exact list of changed areas is available for update() via canvas
+            if ( !_canvas.isNull() )
+                _canvas->invalidateRect( rc );
         }
         CRGUIScreenBase( int width, int height, bool doublebuffer  )
         : _width( width ), _height( height ), _canvas(NULL), _front(NULL)
@@ -912,6 +921,8 @@ class CRDocViewWindow : public CRGUIWindowBase
     protected:
         LVDocView * _docview;
 	    CRWindowSkinRef _skin;
+        /// screen areas changed by last draw() call
+        LVArray<lvRect> _damage;
         virtual void draw();
     public:
         LVDocView * getDocView()
@@ -939,11 +950,28 @@ class CRDocViewWindow : public CRGUIWindowBase
         /// returns true if command is processed
         virtual bool onCommand( int command, int params );
 
+        /// pre-decodes images of next and previous pages, step by step
+        virtual bool onIdle();
+
 		/// returns true if window is changed but now drawn
         virtual bool isDirty()
         {
-            return _dirty || !_docview->isPageImageReady( 0 );
+            if ( _dirty || !_docview->isPageImageReady( 0 ) )
+                return true;
+            // page image may be updated partially (clock, selection) without invalidation
+            LVDocImageRef pageImage = _docview->getPageImage( 0 );
+            return !pageImage.isNull() && pageImage->getDrawBuf()->getDamageRects().length() > 0;
+        }
+
+        /// draws window; draw() implementation may narrow changed area
+        virtual void flush()
+        {
+            _damage.clear();
+            _damage.add( _rect );
+            CRGUIWindowBase::flush();
         }
+        /// returns areas of screen changed by last flush() call
+        virtual void getDamageRects( LVArray<lvRect> & rects ) { rects.add( _damage ); }
 };
 
 
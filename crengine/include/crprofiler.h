@@ -0,0 +1,99 @@
+/** \file crprofiler.h
+    \brief lightweight load/render profiler
+
+    Scoped timers and counters for main document processing stages.
+    Instrumentation is compiled in only when CR_PROFILER_ENABLED==1
+    (cmake -D ENABLE_CR_PROFILER=1), otherwise macros expand to nothing.
+
+    CoolReader Engine
+
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+*/
+
+#ifndef __CRPROFILER_H_INCLUDED__
+#define __CRPROFILER_H_INCLUDED__
+
+#include "crsetup.h"
+#include "lvtypes.h"
+#include "lvstring.h"
+
+/// profiled stages
+enum cr_profiler_stage_t {
+    CRPROF_LOAD_DOCUMENT,   ///< LVDocView::LoadDocument
+    CRPROF_PARSE,           ///< LVDocView::ParseDocument
+    CRPROF_RENDER,          ///< LVDocView::Render
+    CRPROF_INIT_STYLES,     ///< ldomNode::initNodeStyleRecursive, items = styled nodes
+    CRPROF_FONT_LOOKUP,     ///< getFont(css_style_rec_t*)
+    CRPROF_FORMAT_TEXT,     ///< LFormattedText::Format, items = formatted lines
+    CRPROF_PAGE_SPLIT,      ///< LVRendPageContext::Finalize, items = pages
+    CRPROF_CACHE_SAVE,      ///< ldomDocument::saveChanges
+    CRPROF_CACHE_LOAD,      ///< ldomDocument::openFromCache
+    CRPROF_CHUNK_PACK,      ///< ldomPack, items = source bytes
+    CRPROF_CHUNK_UNPACK,    ///< ldomUnpack, items = unpacked bytes
+    CRPROF_STAGE_COUNT
+};
+
+/// accumulated statistics for single stage
+struct CRProfilerStageStats {
+    lInt64 calls;   ///< number of outermost scope entries
+    lInt64 totalUs; ///< total time, microseconds
+    lInt64 maxUs;   ///< longest single call, microseconds
+    lInt64 items;   ///< stage specific counter (nodes, lines, bytes...)
+};
+
+/// global profiler statistics (not thread safe: counters may be slightly off when used from several threads)
+class CRProfiler {
+    static CRProfilerStageStats _stats[CRPROF_STAGE_COUNT];
+    static int _depth[CRPROF_STAGE_COUNT];
+public:
+    /// returns true if instrumentation is compiled in
+    static bool isEnabled() { return CR_PROFILER_ENABLED==1; }
+    /// returns current time in microseconds
+    static lInt64 getTimeMicros();
+    /// returns name of stage, used as JSON key
+    static const char * getStageName( int stage );
+    /// returns statistics for stage
+    static const CRProfilerStageStats & getStats( int stage ) { return _stats[stage]; }
+    /// enter stage scope; returns true if this is outermost (timed) scope of stage
+    static bool enter( int stage ) { return _depth[stage]++ == 0; }
+    /// leave stage scope; elapsed time is accounted only for outermost scope
+    static void leave( int stage, bool outermost, lInt64 elapsedUs );
+    /// increment stage items counter
+    static void addItems( int stage, lInt64 count ) { _stats[stage].items += count; }
+    /// clears all counters
+    static void reset();
+    /// returns all statistics as JSON object
+    static lString8 toJSON();
+};
+
+/// measures time spent in enclosing scope
+class CRProfilerScope {
+    int _stage;
+    bool _outermost;
+    lInt64 _start;
+public:
+    CRProfilerScope( int stage ) : _stage(stage)
+    {
+        _outermost = CRProfiler::enter( stage );
+        _start = _outermost ? CRProfiler::getTimeMicros() : 0;
+    }
+    ~CRProfilerScope()
+    {
+        CRProfiler::leave( _stage, _outermost, _outermost ? CRProfiler::getTimeMicros() - _start : 0 );
+    }
+};
+
+#if (CR_PROFILER_ENABLED==1)
+/// time enclosing scope as stage
+#define CR_PROFILE_SCOPE(stage) CRProfilerScope cr_profiler_scope_( stage )
+/// add n to items counter of stage
+#define CR_PROFILE_ITEMS(stage, n) CRProfiler::addItems( stage, n )
+#else
+#define CR_PROFILE_SCOPE(stage)
+#define CR_PROFILE_ITEMS(stage, n) ((void)0)
+#endif
+
+#endif // __CRPROFILER_H_INCLUDED__
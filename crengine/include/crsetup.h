@@ -45,6 +45,7 @@
 #define USE_GIF                              1
 #define USE_FREETYPE                         1
 #define GLYPH_CACHE_SIZE                     0x20000
+#define GLYPH_CACHE_BPP                      4
 #define ZIP_STREAM_BUFFER_SIZE               0x80000
 #define FILE_STREAM_BUFFER_SIZE              0x40000
 #endif
@@ -69,6 +70,15 @@
 #ifndef ANDROID
 #define USE_FONTCONFIG						 1
 #endif
+#if !defined(ANDROID) && !defined(SMOOTH_IMAGE_SCALING_DEFAULT)
+#define SMOOTH_IMAGE_SCALING_DEFAULT         1
+#endif
+#if !defined(ANDROID) && !defined(PNG_INTERLACED_DECODE_BUFFER_SIZE)
+#define PNG_INTERLACED_DECODE_BUFFER_SIZE    0x1000000
+#endif
+#if !defined(ANDROID) && !defined(PNG_INTERLACED_DECODE_MAX_PASSES)
+#define PNG_INTERLACED_DECODE_MAX_PASSES     4
+#endif
 #define ALLOW_KERNING                        1
 #define GLYPH_CACHE_SIZE                     0x40000
 #define ZIP_STREAM_BUFFER_SIZE               0x40000
@@ -88,6 +98,15 @@
 #ifndef MAX_IMAGE_SCALE_MUL
 #define MAX_IMAGE_SCALE_MUL                  1
 #endif
+#ifndef SMOOTH_IMAGE_SCALING_DEFAULT
+#define SMOOTH_IMAGE_SCALING_DEFAULT         1
+#endif
+#ifndef PNG_INTERLACED_DECODE_BUFFER_SIZE
+#define PNG_INTERLACED_DECODE_BUFFER_SIZE    0x1000000
+#endif
+#ifndef PNG_INTERLACED_DECODE_MAX_PASSES
+#define PNG_INTERLACED_DECODE_MAX_PASSES     4
+#endif
 #if defined(CYGWIN)
 #define USE_FREETYPE                         0
 #else
@@ -106,6 +125,12 @@
 #define GLYPH_CACHE_SIZE 0x40000
 #endif
 
+#ifndef GLYPH_CACHE_BPP
+/// bits per pixel of glyph coverage stored in glyph cache, 8 or 4
+/// (4 is enough for 1 and 2 bpp gray and 16 bpp color draw buffers)
+#define GLYPH_CACHE_BPP 8
+#endif
+
 
 // disable some features for SYMBIAN
 #if defined(__SYMBIAN32__)
@@ -254,6 +279,39 @@
 #endif
 
 
+/// 1 to resample document images with area averaging / bilinear filter by default, 0 for nearest neighbour
+#ifndef SMOOTH_IMAGE_SCALING_DEFAULT
+#define SMOOTH_IMAGE_SCALING_DEFAULT 0
+#endif
+
+/// dithering of images on 1..4 bpp gray buffers: 0=simple per pixel, 1=ordered 8x8 Bayer, 2=Floyd-Steinberg
+#ifndef IMAGE_DITHERING_DEFAULT
+#define IMAGE_DITHERING_DEFAULT 0
+#endif
+
+/// gamma level index (see gammatbl.h: 15 means 1.0, 30 means 1.9) for ordered and error diffusion image dithering
+#ifndef IMAGE_DITHERING_GAMMA_DEFAULT
+#define IMAGE_DITHERING_GAMMA_DEFAULT 30
+#endif
+
+/// byte budget of decoded and scaled document images cache (LVScaledImageCache), 0 to disable
+#ifndef SCALED_IMAGE_CACHE_SIZE
+#define SCALED_IMAGE_CACHE_SIZE 0x800000 // 8Mb
+#endif
+
+/// max size of row window used to decode interlaced PNG images (bigger images are decoded in several passes);
+/// may be exceeded only if PNG_INTERLACED_DECODE_MAX_PASSES is set
+#ifndef PNG_INTERLACED_DECODE_BUFFER_SIZE
+#define PNG_INTERLACED_DECODE_BUFFER_SIZE 0x100000 // 1Mb
+#endif
+
+/// if non-zero, max number of times interlaced PNG image is decoded: row window grows beyond PNG_INTERLACED_DECODE_BUFFER_SIZE
+/// to keep this bound (trades memory for decoding time, set for desktop platforms only); 0 - buffer size is a hard limit
+#ifndef PNG_INTERLACED_DECODE_MAX_PASSES
+#define PNG_INTERLACED_DECODE_MAX_PASSES 0
+#endif
+
+
 // Caching and MMAP options
 
 /// minimal document size to enable caching for
@@ -283,4 +341,19 @@
 #define MAX_IMAGE_SCALE_MUL 2
 #endif
 
+/// set to 1 to compile in load/render stage profiler (see crprofiler.h)
+#ifndef CR_PROFILER_ENABLED
+#define CR_PROFILER_ENABLED 0
+#endif
+
+/// set to 0 to draw glyphs with plain C++ loops instead of SSE2/NEON span kernels
+#ifndef CR_SIMD_BLEND_ENABLED
+#define CR_SIMD_BLEND_ENABLED 1
+#endif
+
+/// number of threads to rotate large draw buffers with (used only when CR_USE_THREADS==1)
+#ifndef CR_ROTATE_THREADS
+#define CR_ROTATE_THREADS 1
+#endif
+
 #endif//CRSETUP_H_INCLUDED
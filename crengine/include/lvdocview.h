@@ -20,6 +20,7 @@
 #include "lvdrawbuf.h"
 #include "hist.h"
 #include "lvthread.h"
+#include "crprofiler.h"
 
 // standard properties supported by LVDocView
 #define PROP_FONT_GAMMA              "font.gamma" // currently supported: 0.65 .. 1.35, see gammatbl.h
@@ -63,6 +64,7 @@
 #define PROP_SHOW_PAGE_NUMBER        "window.status.pos.page.number"
 #define PROP_SHOW_BATTERY_PERCENT    "window.status.battery.percent"
 #define PROP_FONT_KERNING_ENABLED    "font.kerning.enabled"
+#define PROP_FONT_LIGATURES_ENABLED  "font.ligatures.enabled"
 #define PROP_LANDSCAPE_PAGES         "window.landscape.pages"
 #define PROP_HYPHENATION_DICT        "crengine.hyphenation.directory"
 #define PROP_AUTOSAVE_BOOKMARKS      "crengine.autosave.bookmarks"
@@ -88,6 +90,14 @@
 #define PROP_IMG_SCALING_ZOOMIN_BLOCK_SCALE  "crengine.image.scaling.zoomin.block.scale"
 #define PROP_IMG_SCALING_ZOOMOUT_BLOCK_MODE "crengine.image.scaling.zoomout.block.mode"
 #define PROP_IMG_SCALING_ZOOMOUT_BLOCK_SCALE "crengine.image.scaling.zoomout.block.scale"
+#define PROP_IMG_SCALING_ZOOMIN_INLINE_QUALITY  "crengine.image.scaling.zoomin.inline.quality"
+#define PROP_IMG_SCALING_ZOOMOUT_INLINE_QUALITY "crengine.image.scaling.zoomout.inline.quality"
+#define PROP_IMG_SCALING_ZOOMIN_BLOCK_QUALITY  "crengine.image.scaling.zoomin.block.quality"
+#define PROP_IMG_SCALING_ZOOMOUT_BLOCK_QUALITY "crengine.image.scaling.zoomout.block.quality"
+// dithering of images on 1..4 bpp gray buffers: 0=simple, 1=ordered (8x8 Bayer), 2=error diffusion (Floyd-Steinberg)
+#define PROP_IMG_DITHERING "crengine.image.dithering"
+// gamma used for ordered and error diffusion image dithering, nearest level from gammatbl.h is used (0.3 .. 1.9)
+#define PROP_IMG_DITHERING_GAMMA "crengine.image.dithering.gamma"
 
 const lChar16 * getDocFormatName( doc_format_t fmt );
 
@@ -192,6 +202,20 @@ class LVDocViewImageCache
                 return LVDocImageRef( new LVDocImageHolder(getWithoutLock( offset, page ), _mutex) );
             return LVDocImageRef( NULL );
         }
+        /// return page image from cache slot (0..1), wait until ready; call with getMutex() locked
+        LVRef<LVDrawBuf> getSlotWithoutLock( int index, int & page )
+        {
+            Item & item = _items[index];
+            if ( !item._valid )
+                return LVRef<LVDrawBuf>();
+            if ( !item._ready ) {
+                item._thread->join();
+                item._thread = NULL;
+                item._ready = true;
+            }
+            page = item._page;
+            return item._drawbuf;
+        }
         bool has( int offset, int page )
         {
             _mutex.lock();
@@ -353,6 +377,13 @@ typedef LVArray<int> LVBookMarkPercentInfo;
 
 #define DEF_COLOR_BUFFER_BPP 32
 
+/// final block with images on page adjacent to current one, and vertical range of that page in document coordinates
+struct LVImagePredecodeItem {
+    ldomNode * node;
+    int top;
+    int bottom;
+};
+
 /**
     \brief XML document view
 
@@ -396,6 +427,8 @@ private:
     lUInt32 m_backgroundColor;
     lUInt32 m_textColor;
     lUInt32 m_statusColor;
+    img_dithering_t m_imageDithering;
+    int m_imageDitheringGamma;
     font_ref_t     m_font;
     font_ref_t     m_infoFont;
     LVFontRef      m_batteryFont;
@@ -475,6 +508,33 @@ private:
 
     CRPageSkinRef _pageSkin;
 
+    /// incremented on each clearImageCache() call
+    int m_imageGeneration;
+    /// state of last Draw(LVDrawBuf&), to check whether updatePageImage() may keep buffer contents
+    int m_drawnGeneration;
+    int m_drawnPage;
+    int m_drawnDx;
+    int m_drawnDy;
+    /// changes not yet applied to buffer drawn by Draw(LVDrawBuf&): page header, document rectangles
+    bool m_headerDamaged;
+    LVArray<lvRect> m_damagedDocRects;
+    /// document rectangles of m_markRanges and m_bmkRanges items
+    LVArray<lvRect> m_markRects;
+    LVArray<lvRect> m_bmkRects;
+    /// pixel format of buffer drawn by last Draw() call, 0 if nothing is drawn yet
+    int m_drawnBpp;
+    /// images pre-decoding state: work list is valid for m_predecodeGeneration and page (or scroll position) m_predecodePos
+    int m_predecodeGeneration;
+    int m_predecodePos;
+    int m_predecodeIndex;
+    LVArray<LVImagePredecodeItem> m_predecodeItems;
+    /// 1x1 buffer of m_drawnBpp pixel format, used as image cache key when pre-decoding
+    LVRef<LVDrawBuf> m_predecodeBuf;
+    /// builds list of final blocks with images on next and previous pages
+    void buildImagePredecodeList();
+    /// pre-decodes images of one block of work list, returns false if nothing left to do
+    bool predecodeNextImages();
+
     /// sets current document format
     void setDocFormat( doc_format_t fmt );
 
@@ -519,12 +579,24 @@ protected:
     bool getCursorDocRect( ldomXPointer ptr, lvRect & rc );
     /// get screen rectangle for specified cursor position, returns false if not visible
     bool getCursorRect( ldomXPointer ptr, lvRect & rc, bool scrollToCursor = false );
+    /// returns true if page header and marks changes may be applied to already drawn page images
+    bool canUpdatePageImage();
+    /// register changed parts of page: header and/or document rectangles; updates cached page images
+    void invalidatePageImage( bool header, const LVArray<lvRect> & docRects );
+    /// redraw changed parts of page (and next page in two pages mode) to buffer containing its image
+    void redrawPageDamage( LVDrawBuf & drawbuf, int page, bool header, const LVArray<lvRect> & docRects );
+    /// convert changed document rectangles to screen rectangles of page
+    void getPageDamageRects( LVRendPageInfo & page, const lvRect & pageRect, const LVArray<lvRect> & docRects, LVArray<lvRect> & screenRects );
 public:
     LVFontRef getBatteryFont() { return m_batteryFont; }
     void setBatteryFont( LVFontRef font ) { m_batteryFont=font; }
 
     /// draw current page to specified buffer
     void Draw( LVDrawBuf & drawbuf );
+    /// update buffer drawn by last Draw(drawbuf) call redrawing only changed parts (see LVDrawBuf::getDamageRects()); returns false if whole page is redrawn
+    bool updatePageImage( LVDrawBuf & drawbuf );
+    /// request redraw of page header only (clock, battery state)
+    void invalidatePageHeader();
     
     /// close document
     void close();
@@ -549,6 +621,8 @@ public:
     ContinuousOperationResult updateCache(CRTimerUtil & maxTime);
     /// save unsaved data to cache file (if one is created), w/o timeout
     ContinuousOperationResult updateCache();
+    /// decode and scale images of next and previous pages into image cache, with timeout option (call when reader is idle)
+    ContinuousOperationResult predecodeImages(CRTimerUtil & maxTime);
 
     /// returns selected (marked) ranges
     ldomMarkedRangeList * getMarkedRanges() { return &m_markRanges; }
@@ -605,8 +679,8 @@ public:
     LVImageSourceRef getBackgroundImage() const { return m_backgroundImage; }
     /// set background image
     void setBackgroundImage(LVImageSourceRef bgImage, bool tiled=true) { m_backgroundImage = bgImage; m_backgroundTiled=tiled; m_backgroundImageScaled.Clear(); clearImageCache(); }
-    /// clears page background
-    void drawPageBackground( LVDrawBuf & drawbuf, int offsetX, int offsetY );
+    /// clears page background (only specified area of it, if area is not NULL)
+    void drawPageBackground( LVDrawBuf & drawbuf, int offsetX, int offsetY, const lvRect * area = NULL );
 
     // callback functions
     /// set callback
@@ -814,6 +888,10 @@ public:
 
     /// returns document
     ldomDocument * getDocument() { return m_doc; }
+    /// returns load/render stage timings and counters as JSON (all zero unless built with CR_PROFILER_ENABLED==1)
+    lString8 getProfilerStats() { return CRProfiler::toJSON(); }
+    /// clears load/render stage timings and counters
+    void resetProfilerStats() { CRProfiler::reset(); }
     /// return document properties
     CRPropRef getDocProps() { return m_doc_props; }
     /// returns book title
@@ -837,8 +915,8 @@ public:
     /// export to WOL format
     bool exportWolFile( LVStream * stream, bool flgGray, int levels );
 
-    /// draws page to image buffer
-    void drawPageTo( LVDrawBuf * drawBuf, LVRendPageInfo & page, lvRect * pageRect, int pageCount, int basePage);
+    /// draws page to image buffer (only specified area of it, if area is not NULL)
+    void drawPageTo( LVDrawBuf * drawBuf, LVRendPageInfo & page, lvRect * pageRect, int pageCount, int basePage, const lvRect * area = NULL );
     /// draws coverpage to image buffer
     void drawCoverTo( LVDrawBuf * drawBuf, lvRect & rc );
     /// returns cover page image source, if any
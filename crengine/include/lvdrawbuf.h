@@ -27,6 +27,7 @@ extern "C" {
 
 #include "lvtypes.h"
 #include "lvimg.h"
+#include "lvthread.h"
 
 enum cr_rotate_angle_t {
     CR_ROTATE_ANGLE_0 = 0,
@@ -35,8 +36,26 @@ enum cr_rotate_angle_t {
     CR_ROTATE_ANGLE_270,
 };
 
+/// dithering of images drawn on gray buffers with less than 8 bits per pixel
+enum img_dithering_t {
+    IMG_DITHERING_SIMPLE = 0,       ///< per pixel threshold matrix applied to gray value
+    IMG_DITHERING_ORDERED,          ///< 8x8 Bayer matrix, gamma correct
+    IMG_DITHERING_ERROR_DIFFUSION,  ///< Floyd-Steinberg error diffusion, gamma correct
+};
+
 class LVFont;
 
+/// glyph bitmap placed by LVDrawBuf::DrawGlyphRun()
+struct LVDrawBufGlyph
+{
+    const lUInt8 * bitmap; ///< 8 bit coverage, width*height bytes
+    int x;                 ///< left position
+    int y;                 ///< top position
+    int width;             ///< bitmap width
+    int height;            ///< bitmap height
+    lUInt32 color;         ///< text color to draw glyph with
+};
+
 /// Abstract drawing buffer
 class LVDrawBuf
 {
@@ -61,6 +80,18 @@ public:
     virtual void SetClipRect( const lvRect * clipRect ) = 0;
     /// set to true for drawing in Paged mode, false for Scroll mode
     virtual void setHidePartialGlyphs( bool hide ) = 0;
+    /// set resampling quality for images drawn with size different from image size
+    virtual void setImageScalingQuality( img_scaling_quality_t quality ) = 0;
+    /// returns resampling quality for scaled images
+    virtual img_scaling_quality_t getImageScalingQuality() = 0;
+    /// set dithering kernel for images drawn on gray buffers with less than 8 bpp
+    virtual void setImageDithering( img_dithering_t dithering ) = 0;
+    /// returns dithering kernel for images
+    virtual img_dithering_t getImageDithering() = 0;
+    /// set index of gamma level from gammatbl.h used for gamma correct image dithering
+    virtual void setImageDitheringGamma( int gammaIndex ) = 0;
+    /// returns index of gamma level used for image dithering
+    virtual int getImageDitheringGamma() = 0;
     /// invert image
     virtual void  Invert() = 0;
     /// get buffer width, pixels
@@ -118,14 +149,26 @@ public:
     virtual void Resize( int dx, int dy ) = 0;
     /// draws bitmap (1 byte per pixel) using specified palette
     virtual void Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * palette ) = 0;
+    /// draws list of glyph bitmaps (1 byte per pixel), each with its own color; default implementation calls Draw() per glyph
+    virtual void DrawGlyphRun( const LVDrawBufGlyph * glyphs, int count );
     /// draws image
     virtual void Draw( LVImageSourceRef img, int x, int y, int width, int height, bool dither=true ) = 0;
+    /// decodes image scaled to specified size into image cache without drawing it; returns false if image cannot be cached
+    virtual bool PrepareImage( LVImageSourceRef img, int width, int height, bool dither=true ) = 0;
     /// draws buffer content to another buffer doing color conversion if necessary
     virtual void DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32 * palette ) = 0;
 #if !defined(__SYMBIAN32__) && defined(_WIN32)
     /// draws buffer content to another buffer doing color conversion if necessary
     virtual void DrawTo( HDC dc, int x, int y, int options, lUInt32 * palette ) = 0;
 #endif
+    /// adds rectangle to list of changed areas, to allow partial update of screen
+    virtual void invalidateRect( const lvRect & rc ) = 0;
+    /// returns list of areas changed since last clearDamage() call
+    virtual const LVArray<lvRect> & getDamageRects() = 0;
+    /// returns bounding box of changed areas, false if nothing is changed
+    virtual bool getDamageBounds( lvRect & rc ) = 0;
+    /// clears list of changed areas
+    virtual void clearDamage() = 0;
     /// draws text string
     /*
     virtual void DrawTextString( int x, int y, LVFont * pfont,
@@ -155,8 +198,18 @@ protected:
     lUInt32 _backgroundColor;
     lUInt32 _textColor;
     bool _hidePartialGlyphs;
+    img_scaling_quality_t _imageScalingQuality;
+    img_dithering_t _imageDithering;
+    int _imageDitheringGamma;
+    LVArray<lvRect> _damage;
 public:
     virtual void setHidePartialGlyphs( bool hide ) { _hidePartialGlyphs = hide; }
+    virtual void setImageScalingQuality( img_scaling_quality_t quality ) { _imageScalingQuality = quality; }
+    virtual img_scaling_quality_t getImageScalingQuality() { return _imageScalingQuality; }
+    virtual void setImageDithering( img_dithering_t dithering ) { _imageDithering = dithering; }
+    virtual img_dithering_t getImageDithering() { return _imageDithering; }
+    virtual void setImageDitheringGamma( int gammaIndex ) { _imageDitheringGamma = gammaIndex; }
+    virtual int getImageDitheringGamma() { return _imageDitheringGamma; }
     /// returns current background color
     virtual lUInt32 GetBackgroundColor() { return _backgroundColor; }
     /// sets current background color
@@ -175,6 +228,14 @@ public:
     virtual int  GetHeight();
     /// get row size (bytes)
     virtual int  GetRowSize() { return _rowsize; }
+    /// adds rectangle to list of changed areas, to allow partial update of screen
+    virtual void invalidateRect( const lvRect & rc );
+    /// returns list of areas changed since last clearDamage() call
+    virtual const LVArray<lvRect> & getDamageRects() { return _damage; }
+    /// returns bounding box of changed areas, false if nothing is changed
+    virtual bool getDamageBounds( lvRect & rc );
+    /// clears list of changed areas
+    virtual void clearDamage() { _damage.clear(); }
     /// draws text string
     /*
     virtual void DrawTextString( int x, int y, LVFont * pfont,
@@ -184,8 +245,12 @@ public:
     */
     /// draws formatted text
     //virtual void DrawFormattedText( formatted_text_fragment_t * text, int x, int y );
+    /// decodes image scaled to specified size into image cache without drawing it; returns false if image cannot be cached
+    virtual bool PrepareImage( LVImageSourceRef img, int width, int height, bool dither=true );
     
-    LVBaseDrawBuf() : _dx(0), _dy(0), _rowsize(0), _data(NULL), _hidePartialGlyphs(true) { }
+    LVBaseDrawBuf() : _dx(0), _dy(0), _rowsize(0), _data(NULL), _hidePartialGlyphs(true)
+        , _imageScalingQuality( (SMOOTH_IMAGE_SCALING_DEFAULT==1) ? IMG_SCALING_QUALITY_SMOOTH : IMG_SCALING_QUALITY_FAST )
+        , _imageDithering( (img_dithering_t)IMAGE_DITHERING_DEFAULT ), _imageDitheringGamma( IMAGE_DITHERING_GAMMA_DEFAULT ) { }
     virtual ~LVBaseDrawBuf() { }
 };
 
@@ -281,6 +346,8 @@ public:
     virtual void Draw( LVImageSourceRef img, int x, int y, int width, int height, bool dither );
     /// draws bitmap (1 byte per pixel) using specified palette
     virtual void Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * palette );
+    /// draws list of glyph bitmaps (1 byte per pixel), each with its own color
+    virtual void DrawGlyphRun( const LVDrawBufGlyph * glyphs, int count );
     /// constructor
     LVGrayDrawBuf(int dx, int dy, int bpp=2, void * auxdata = NULL );
     /// destructor
@@ -345,6 +412,8 @@ public:
     virtual void Draw( LVImageSourceRef img, int x, int y, int width, int height, bool dither );
     /// draws bitmap (1 byte per pixel) using specified palette
     virtual void Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * palette );
+    /// draws list of glyph bitmaps (1 byte per pixel), each with its own color
+    virtual void DrawGlyphRun( const LVDrawBufGlyph * glyphs, int count );
     /// returns scanline pointer
     virtual lUInt8 * GetScanLine( int y );
 
@@ -363,6 +432,45 @@ public:
 };
 
 
+class LVScaledImageCacheItem;
+
+/// LRU cache of decoded images, scaled to drawing size and converted to pixel format of draw buffer
+/**
+    Used by LVDrawBuf::Draw(LVImageSourceRef...) for images which return non-NULL
+    LVImageSource::GetCacheOwner() (document images), to avoid reopening, decoding
+    and scaling of the same picture on each page redraw.
+    Items are keyed by (owner, name, width, height, bpp, dither, dithering kernel and gamma, resampling quality).
+    Images with semi-transparent pixels are kept as scaled ARGB and blended with background on each draw.
+    Access is serialized by static mutex: besides page drawing, images are put to cache by LVDocView::predecodeImages(),
+    which frontends call in short steps from idle handlers, and pages may be drawn by background thread.
+*/
+class LVScaledImageCache
+{
+    static LVPtrVector<LVScaledImageCacheItem> _items; // most recently used first
+    static int _maxSize;
+    static int _size;
+    static LVMutex _mutex;
+    static void reduce( int maxSize );
+    static LVScaledImageCacheItem * getItem( LVBaseDrawBuf * buf, LVImageSourceRef img, int width, int height, bool dither );
+public:
+    /// draws image using cached copy, decodes and adds it to cache if necessary; returns false if image cannot be cached
+    static bool draw( LVBaseDrawBuf * buf, LVImageSourceRef img, int x, int y, int width, int height, bool dither );
+    /// decodes image and adds it to cache if it's not cached yet, using pixel format of buf; returns false if image cannot be cached
+    static bool prepare( LVBaseDrawBuf * buf, LVImageSourceRef img, int width, int height, bool dither );
+    /// sets byte budget of cache, 0 to disable caching
+    static void setMaxSize( int bytes );
+    /// returns byte budget of cache
+    static int getMaxSize() { return _maxSize; }
+    /// returns number of bytes used by cached images
+    static int getSize() { return _size; }
+    /// returns number of cached items
+    static int getItemCount() { return _items.length(); }
+    /// removes all images of specified owner (call when document is closed)
+    static void removeOwner( const void * owner );
+    /// removes all images
+    static void clear();
+};
+
 
 #endif
 
@@ -16,14 +16,17 @@
 #define __LV_FNT_MAN_H_INCLUDED__
 
 #include <stdlib.h>
+#include <stddef.h>
 #include "crsetup.h"
 #include "lvfnt.h"
 #include "cssdef.h"
 #include "lvstring.h"
 #include "lvref.h"
 #include "lvptrvec.h"
+#include "lvarray.h"
 #include "hyphman.h"
 #include "lvdrawbuf.h"
+#include "lvthread.h"
 
 #if !defined(__SYMBIAN32__) && defined(_WIN32)
 extern "C" {
@@ -34,93 +37,185 @@ extern "C" {
 class LVDrawBuf;
 
 struct LVFontGlyphCacheItem;
+class LVFontLocalGlyphCache;
 
+/// block of memory glyph cache items are packed into
+struct LVFontGlyphSlab
+{
+    LVFontGlyphSlab * next; ///< newer slab, or next retired slab
+    int size;               ///< bytes available for items
+    int used;               ///< bytes occupied by items
+    lUInt8 * data() { return (lUInt8 *)(this + 1); }
+};
+
+/** \brief glyph atlas shared by all font instances, limited by total size
+
+    Glyph items are packed one after another into large slabs instead of
+    separate allocations. When size limit is reached, the oldest slab is
+    dropped as a whole; glyphs looked up since it was filled get second
+    chance and are moved to the newest slab.
+
+    Items are looked up without locking (see LVFontLocalGlyphCache::get()),
+    so dropped slabs are not freed immediately but retired until there are
+    no readers inside LVFontGlyphCacheReadScope.
+*/
 class LVFontGlobalGlyphCache
 {
 private:
-    LVFontGlyphCacheItem * head;
-    LVFontGlyphCacheItem * tail;
+    LVFontGlyphSlab * oldest;
+    LVFontGlyphSlab * newest;
+    LVFontGlyphSlab * retired; // dropped slabs waiting for readers to finish
     int size;
     int max_size;
+    int slab_size;
+    volatile int readers;
+    LVMutex mutex;
+    void evictSlab();
+    void freeRetired();
 public:
     LVFontGlobalGlyphCache( int maxSize )
-        : head(NULL), tail(NULL), size(0), max_size(maxSize )
+        : oldest(NULL), newest(NULL), retired(NULL), size(0), max_size(maxSize), readers(0)
     {
+        slab_size = maxSize / 8;
+        if ( slab_size < 1024 )
+            slab_size = 1024;
+        else if ( slab_size > 65536 )
+            slab_size = 65536;
     }
-    ~LVFontGlobalGlyphCache()
-    {
-        clear();
-    }
-    void put( LVFontGlyphCacheItem * item );
-    void remove( LVFontGlyphCacheItem * item );
-    void refresh( LVFontGlyphCacheItem * item );
+    ~LVFontGlobalGlyphCache();
+    /// guards atlas and local cache indexes; lookups don't need it
+    LVMutex & getMutex() { return mutex; }
+    /// allocates item in atlas, to be called with getMutex() locked, until item is put to local cache
+    LVFontGlyphCacheItem * allocItem( lChar16 ch, int w, int h );
+    /// returns total size of slabs, in bytes
+    int getSize() { return size; }
     void clear();
+    void beginRead() { crAtomicAdd( &readers, 1 ); }
+    void endRead();
 };
 
+/// keeps glyph items returned by fonts of global cache valid while in scope
+class LVFontGlyphCacheReadScope
+{
+    LVFontGlobalGlyphCache * _cache;
+public:
+    LVFontGlyphCacheReadScope( LVFontGlobalGlyphCache * cache ) : _cache(cache) { _cache->beginRead(); }
+    ~LVFontGlyphCacheReadScope() { _cache->endRead(); }
+};
+
+/// max number of subpixel glyph positions
+#define GLYPH_SUBPIXEL_MAX_PHASES 4
+
+#define GLYPH_INDEX_PAGE_SHIFT 9
+#define GLYPH_INDEX_PAGE_SIZE (1<<GLYPH_INDEX_PAGE_SHIFT)
+#define GLYPH_INDEX_PAGE_COUNT (0x10000>>GLYPH_INDEX_PAGE_SHIFT)
+
+/// glyphs of single font instance
 class LVFontLocalGlyphCache
 {
 private:
-    LVFontGlyphCacheItem * head;
-    LVFontGlyphCacheItem * tail;
     LVFontGlobalGlyphCache * global_cache;
-    int size;
+    // char code to item table, published pages are never freed until destruction
+    LVFontGlyphCacheItem ** volatile char_index[GLYPH_INDEX_PAGE_COUNT];
+    LVFontGlyphCacheItem ** getSlot( lChar16 ch ) { return char_index[ ch >> GLYPH_INDEX_PAGE_SHIFT ] + (ch & (GLYPH_INDEX_PAGE_SIZE-1)); }
 public:
     LVFontLocalGlyphCache( LVFontGlobalGlyphCache * globalCache )
-        : head(NULL), tail(NULL), global_cache( globalCache )
-    { }
-    ~LVFontLocalGlyphCache()
+        : global_cache( globalCache )
     {
-        clear();
+        memset( (void*)char_index, 0, sizeof(char_index) );
     }
+    ~LVFontLocalGlyphCache();
     void clear();
-    LVFontGlyphCacheItem * get( lUInt16 ch );
-    void put( LVFontGlyphCacheItem * item );
+    /// find glyph, lock free
+    LVFontGlyphCacheItem * get( lUInt16 ch )
+    {
+        LVFontGlyphCacheItem ** page = char_index[ ch >> GLYPH_INDEX_PAGE_SHIFT ];
+        if ( !page )
+            return NULL;
+        LVFontGlyphCacheItem * item = page[ ch & (GLYPH_INDEX_PAGE_SIZE-1) ];
+        if ( item )
+            markUsed( item );
+        return item;
+    }
+    /// publish item allocated by LVFontGlyphCacheItem::newItem(); if another thread has already added glyph for the same char, returns existing one
+    LVFontGlyphCacheItem * put( LVFontGlyphCacheItem * item );
+    /// remove item from index (called by atlas when slab is dropped)
     void remove( LVFontGlyphCacheItem * item );
+    /// replace item with its moved copy (called by atlas when slab is dropped)
+    void replace( LVFontGlyphCacheItem * item, LVFontGlyphCacheItem * copy );
+    LVFontGlobalGlyphCache * getGlobalCache() { return global_cache; }
+    static void markUsed( LVFontGlyphCacheItem * item );
 };
 
+/// glyph cache item, allocated in LVFontGlobalGlyphCache slab
 struct LVFontGlyphCacheItem
 {
-    LVFontGlyphCacheItem * prev_global;
-    LVFontGlyphCacheItem * next_global;
-    LVFontGlyphCacheItem * prev_local;
-    LVFontGlyphCacheItem * next_local;
-    LVFontLocalGlyphCache * local_cache;
+    LVFontLocalGlyphCache * local_cache; // NULL if item is not in local cache index anymore
     lChar16 ch;
     lUInt8 bmp_width;
     lUInt8 bmp_height;
     lInt8  origin_x;
     lInt8  origin_y;
     lUInt8 advance;
-    lUInt8 bmp[1];
+    lUInt8 used; // set on lookup, cleared when item is moved by atlas
+    lUInt8 bmp[1]; // coverage, GLYPH_CACHE_BPP bits per pixel, rows are byte aligned
     //=======================================================================
-    int getSize()
+    static int getRowSize( int w )
     {
-        return sizeof(LVFontGlyphCacheItem)
-            + (bmp_width * bmp_height - 1) * sizeof(lUInt8);
+        return GLYPH_CACHE_BPP==4 ? (w + 1) >> 1 : w;
     }
-    static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lChar16 ch, int w, int h )
+    /// returns size of item in atlas, including alignment
+    static int getItemSize( int w, int h )
     {
-        LVFontGlyphCacheItem * item = (LVFontGlyphCacheItem *)malloc( sizeof(LVFontGlyphCacheItem)
-            + (w*h - 1)*sizeof(lUInt8) );
-        item->ch = ch;
-        item->bmp_width = w;
-        item->bmp_height = h;
-        item->origin_x =   0;
-        item->origin_y =   0;
-        item->advance =    0;
-        item->prev_global = NULL;
-        item->next_global = NULL;
-        item->prev_local = NULL;
-        item->next_local = NULL;
-        item->local_cache = local_cache;
-        return item;
+        int sz = (int)offsetof(LVFontGlyphCacheItem, bmp) + getRowSize(w) * h;
+        return (sz + sizeof(void*) - 1) & ~(int)(sizeof(void*) - 1);
     }
-    static void freeItem( LVFontGlyphCacheItem * item )
+    int getSize()
+    {
+        return getItemSize( bmp_width, bmp_height );
+    }
+    /// store 8 bit coverage bitmap [bmp_width*bmp_height]
+    void setBitmap( const lUInt8 * coverage );
+    /// returns 8 bit coverage bitmap, unpacked to buf [bmp_width*bmp_height] if stored with less bits
+    const lUInt8 * getBitmap( lUInt8 * buf ) const;
+    /// allocates item in atlas, to be called with global cache mutex locked
+    static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lChar16 ch, int w, int h )
     {
-        free( item );
+        return local_cache->getGlobalCache()->allocItem( ch, w, h );
     }
 };
 
+inline void LVFontLocalGlyphCache::markUsed( LVFontGlyphCacheItem * item )
+{
+    if ( !item->used )
+        item->used = 1;
+}
+
+/** \brief glyphs of several text strings, drawn at once by LVDrawBuf::DrawGlyphRun()
+
+    Glyph items are kept valid by read scope of their glyph cache until flush().
+    Things drawn over text (fills, images) must be drawn after flush() to keep drawing order.
+*/
+class LVFontGlyphRun
+{
+    LVDrawBuf * _buf;
+    LVFontGlobalGlyphCache * _cache; // cache glyphs are read from, while run is not empty
+    LVArray<LVDrawBufGlyph> _glyphs;
+#if (GLYPH_CACHE_BPP!=8)
+    LVArray<lUInt8> _bitmaps; // unpacked glyph bitmaps
+    LVArray<int> _offsets;    // offsets of glyph bitmaps in _bitmaps
+#endif
+public:
+    LVFontGlyphRun( LVDrawBuf * buf ) : _buf(buf), _cache(NULL) { }
+    ~LVFontGlyphRun() { flush(); }
+    /// returns buffer run is drawn to
+    LVDrawBuf * getDrawBuf() { return _buf; }
+    /// queue glyph of global cache to draw at x, y (top left corner of glyph bitmap)
+    void add( LVFontGlobalGlyphCache * cache, LVFontGlyphCacheItem * glyph, int x, int y, lUInt32 color );
+    /// draws queued glyphs
+    void flush();
+};
+
 
 /** \brief base class for fonts
 
@@ -195,6 +290,10 @@ public:
         \return glyph pointer if glyph was found, NULL otherwise
     */
     virtual LVFontGlyphCacheItem * getGlyph(lUInt16 ch, lChar16 def_char=0) = 0;
+    /** \brief renders glyph dilated by hShift x vShift pixels directly into glyph cache of synthetic bold font
+        \return NULL if font cannot render glyph this way, and regular glyph should be emboldened instead
+    */
+    virtual LVFontGlyphCacheItem * getEmboldenedGlyph( LVFontLocalGlyphCache * cache, lUInt16 ch, int hShift, int vShift ) { return NULL; }
     /// returns font baseline offset
     virtual int getBaseline() = 0;
     /// returns font height including normal interline space
@@ -207,6 +306,8 @@ public:
     virtual int getItalic() const = 0;
     /// returns char width
     virtual int getCharWidth( lChar16 ch, lChar16 def_char=0 ) = 0;
+    /// returns char advance width, in 1/64 pixels (26.6 fixed point)
+    virtual int getCharAdvance( lChar16 ch, lChar16 def_char=0 ) { return getCharWidth( ch, def_char ) << 6; }
     /// retrieves font handle
     virtual void * GetHandle() = 0;
     /// returns font typeface name
@@ -218,6 +319,17 @@ public:
                        const lChar16 * text, int len, 
                        lChar16 def_char, lUInt32 * palette = NULL, bool addHyphen = false,
                        lUInt32 flags=0, int letter_spacing=0 ) = 0;
+    /** \brief adds glyphs of text string to glyph run, to be drawn together with other strings
+        Text decorations are drawn immediately. Default implementation draws whole string immediately.
+    */
+    virtual void DrawTextRun( LVFontGlyphRun * run, int x, int y,
+                       const lChar16 * text, int len,
+                       lChar16 def_char, bool addHyphen = false,
+                       lUInt32 flags=0, int letter_spacing=0 )
+    {
+        run->flush();
+        DrawTextString( run->getDrawBuf(), x, y, text, len, def_char, NULL, addHyphen, flags, letter_spacing );
+    }
     /// constructor
     LVFont() : _visual_alignment_width(-1), _hash(0) { }
 
@@ -230,6 +342,20 @@ public:
     virtual bool getKerning() const { return false; }
     /// get kerning mode: true==ON, false=OFF
     virtual void setKerning( bool ) { }
+    /// returns kerning offset to add before ch2 following ch1, in 1/64 pixels; 0 if kerning is off
+    virtual int getKerningOffset( lChar16 ch1, lChar16 ch2 ) { return 0; }
+
+    /// get ligatures mode: true==ON, false=OFF
+    virtual bool getLigatures() const { return false; }
+    /// set ligatures mode: true==ON, false=OFF
+    virtual void setLigatures( bool ) { }
+    /// returns number of chars at start of text to be drawn as single ligature glyph lig, 0 if there is no ligature
+    virtual int getLigature( const lChar16 * text, int len, lChar16 & lig ) { return 0; }
+
+    /// returns number of subpixel glyph positions used (1 if glyphs are aligned to whole pixels)
+    virtual int getSubpixelPhases() const { return 1; }
+    /// set number of subpixel glyph positions (1, 2 or 4)
+    virtual void setSubpixelPhases( int ) { }
 
     /// returns true if font is empty
     virtual bool IsNull() const = 0;
@@ -258,6 +384,8 @@ class LVFontManager
 protected:
     int _antialiasMode;
     bool _allowKerning;
+    bool _allowLigatures;
+    int _subpixelPhases;
 public:
     /// garbage collector frees unused fonts
     virtual void gc() = 0;
@@ -275,6 +403,8 @@ public:
     virtual bool Init( lString8 path ) = 0;
     /// get count of registered fonts
     virtual int GetFontCount() = 0;
+    /// sets file to cache properties of registered font files in, to avoid reading them on next start
+    virtual bool SetRegistryCacheFile( lString16 fileName ) { return false; }
     /// get hash of installed fonts and fallback font
     virtual lUInt32 GetFontListHash() { return 0; }
     /// clear glyph cache
@@ -290,8 +420,18 @@ public:
     /// get kerning mode: true==ON, false=OFF
     virtual void setKerning( bool kerningEnabled ) { _allowKerning = kerningEnabled; gc(); clearGlyphCache(); }
 
+    /// get ligatures mode: true==ON, false=OFF
+    virtual bool getLigatures() { return _allowLigatures; }
+    /// set ligatures mode: common Latin ligatures (ff, fi, fl, ffi, ffl) are drawn if font has glyphs for them
+    virtual void setLigatures( bool ligaturesEnabled ) { _allowLigatures = ligaturesEnabled; gc(); clearGlyphCache(); }
+
+    /// returns number of subpixel glyph positions (1 = glyphs are aligned to whole pixels)
+    virtual int GetSubpixelPhases() { return _subpixelPhases; }
+    /// set number of subpixel glyph positions: 1 (off), 2 or 4; antialiased fonts use unhinted advances when enabled
+    virtual void SetSubpixelPhases( int phases ) { _subpixelPhases = phases; gc(); clearGlyphCache(); }
+
     /// constructor
-    LVFontManager() : _antialiasMode(font_aa_all), _allowKerning(false) { }
+    LVFontManager() : _antialiasMode(font_aa_all), _allowKerning(ALLOW_KERNING==1), _allowLigatures(false), _subpixelPhases(1) { }
     /// destructor
     virtual ~LVFontManager() { }
     /// returns available typefaces
@@ -710,6 +850,9 @@ bool InitFontManager( lString8 path );
 /// deletes font manager
 bool ShutdownFontManager();
 
+/// sets font registry cache file for current and next created font managers (called by ldomDocCache::init)
+void SetFontRegistryCacheFile( lString16 fileName );
+
 LVFontRef LoadFontFromFile( const char * fname );
 
 /// to compare two fonts
@@ -30,6 +30,10 @@ public:
     virtual void OnStartDecode( LVImageSource * obj ) = 0;
     virtual bool OnLineDecoded( LVImageSource * obj, int y, lUInt32 * data ) = 0;
     virtual void OnEndDecode( LVImageSource * obj, bool errors ) = 0;
+    /// returns size image is going to be scaled to, to let decoder produce smaller image which is still not less than this size; 0 means full size is required
+    virtual void GetTargetSize( int & dx, int & dy ) { dx = dy = 0; }
+    /// called before first decoded line if decoder produces lines of size other than image GetWidth() x GetHeight() (only when GetTargetSize() returns nonzero size)
+    virtual void OnDecodedSize( LVImageSource * obj, int dx, int dy ) { }
 };
 
 class LVImageSource
@@ -41,6 +45,10 @@ public:
     virtual int    GetWidth() = 0;
     virtual int    GetHeight() = 0;
     virtual bool   Decode( LVImageDecoderCallback * callback ) = 0;
+    /// returns owner of image (e.g. document) for LVScaledImageCache, NULL if decoded image should not be cached
+    virtual const void * GetCacheOwner() { return NULL; }
+    /// returns name which identifies image inside its owner
+    virtual lString16 GetCacheName() { return lString16(); }
     virtual ~LVImageSource();
 };
 
@@ -54,6 +62,12 @@ enum ImageTransform {
     IMG_TRANSFORM_TILE,    // tile image
 };
 
+/// quality of image resampling
+typedef enum {
+    IMG_SCALING_QUALITY_FAST,   /// nearest neighbour
+    IMG_SCALING_QUALITY_SMOOTH, /// area averaging for zoom out, bilinear interpolation for zoom in
+} img_scaling_quality_t;
+
 /// creates image which stretches source image by filling center with pixels at splitX, splitY
 LVImageSourceRef LVCreateStretchFilledTransform( LVImageSourceRef src, int newWidth, int newHeight, ImageTransform hTransform=IMG_TRANSFORM_SPLIT, ImageTransform vTransform=IMG_TRANSFORM_SPLIT, int splitX=-1, int splitY=-1 );
 /// creates image which fills area with tiled copy
@@ -36,6 +36,8 @@ int renderBlockElement( LVRendPageContext & context, ldomNode * node, int x, int
 int renderTable( LVRendPageContext & context, ldomNode * element, int x, int y, int width );
 /// sets node style
 void setNodeStyle( ldomNode * node, css_style_ref_t parent_style, LVFontRef parent_font );
+/// converts CSS length to pixels
+int lengthToPx( css_length_t val, int base_px, int base_em );
 
 /// draws formatted document to drawing buffer
 void DrawDocument( LVDrawBuf & drawbuf, ldomNode * node, int x0, int y0, int dx, int dy, int doc_x, int doc_y, int page_height, ldomMarkedRangeList * marks,
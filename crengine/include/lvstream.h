@@ -788,5 +788,7 @@ bool LVSplitArcName( lString16 fullPathName, lString16 & arcPathName, lString16
 bool LVFileExists( const lString16 & pathName );
 /// returns true if specified directory exists
 bool LVDirectoryExists( const lString16 & pathName );
+/// gets size and last modification time (seconds since epoch) of file, returns false if file does not exist
+bool LVGetFileInfo( const lString16 & pathName, lvsize_t & size, lUInt32 & modTime );
 
 #endif // __LVSTREAM_H_INCLUDED__
@@ -46,6 +46,7 @@
 
 #include "cssdef.h"
 #include "lvstyles.h"
+#include "lvhashtable.h"
 
 class lxmlDocBase;
 class ldomNode;
@@ -116,6 +117,10 @@ public:
     LVCssSelectorRule( LVCssSelectorRule & v );
     void setId( lUInt16 id ) { _id = id; }
     void setAttr( lUInt16 id, lString16 value ) { _attrid = id; _value = value; }
+    LVCssSelectorRuleType getType() const { return _type; }
+    lUInt16 getId() const { return _id; }
+    lUInt16 getAttrId() const { return _attrid; }
+    const lString16 & getValue() const { return _value; }
     LVCssSelectorRule * getNext() { return _next; }
     void setNext(LVCssSelectorRule * next) { _next = next; }
     ~LVCssSelectorRule() { if (_next) delete _next; }
@@ -159,9 +164,73 @@ public:
     int getSpecificity() { return _specificity; }
     LVCssSelector * getNext() { return _next; }
     void setNext(LVCssSelector * next) { _next = next; }
+    LVCssSelectorRule * getRules() { return _rules; }
     lUInt32 getHash();
 };
 
+/// rules of element depend on parent or ancestor elements
+#define CSS_DEP_ANCESTORS 1
+/// rules of element depend on preceding sibling elements
+#define CSS_DEP_SIBLINGS  2
+
+/// summary of node properties which stylesheet rules for element name check
+struct LVCssElementDeps {
+    int flags;               ///< CSS_DEP_* flags
+    LVArray<lUInt16> attrs;  ///< ids of attributes checked on element itself
+    LVCssElementDeps() : flags(0) { }
+};
+
+
+/// bloom filter of element name ids, used to reject selectors with ancestor rules without walking the tree
+struct LVCssAncestorFilter {
+    lUInt32 bits[4];
+    LVCssAncestorFilter() { clear(); }
+    void clear() { bits[0] = bits[1] = bits[2] = bits[3] = 0; }
+    bool empty() const { return (bits[0] | bits[1] | bits[2] | bits[3]) == 0; }
+    void add( lUInt16 id )
+    {
+        lUInt32 h1 = id & 127;
+        lUInt32 h2 = (id * 37 + (id >> 7)) & 127;
+        bits[h1 >> 5] |= 1 << (h1 & 31);
+        bits[h2 >> 5] |= 1 << (h2 & 31);
+    }
+    /// returns false if some of ids added to v were definitely not added to this filter
+    bool mayContainAll( const LVCssAncestorFilter & v ) const
+    {
+        return (bits[0] & v.bits[0]) == v.bits[0] && (bits[1] & v.bits[1]) == v.bits[1]
+            && (bits[2] & v.bits[2]) == v.bits[2] && (bits[3] & v.bits[3]) == v.bits[3];
+    }
+};
+
+/// selector reference in stylesheet index
+struct LVCssSelectorIndexItem {
+    LVCssSelector * selector;
+    lInt64 order;                  ///< application order: specificity, element chain before universal chain, position
+    LVCssAncestorFilter ancestors; ///< element name ids which selector requires among ancestors
+    LVCssSelectorIndexItem() : selector(NULL), order(0) { }
+};
+
+typedef LVArray<LVCssSelectorIndexItem> LVCssSelectorIndexList;
+
+/// selectors of single stylesheet chain, bucketed by class or id value element itself must have
+class LVCssSelectorIndex {
+    LVCssSelectorIndexList _generic;
+    LVPtrVector<LVCssSelectorIndexList> _buckets;
+    LVHashTable<lString16, int> _classBuckets; // class value to _buckets index + 1
+    LVHashTable<lString16, int> _idBuckets;    // id value to _buckets index + 1
+    void add( LVHashTable<lString16, int> & map, const lString16 & key, LVCssSelectorIndexItem & item );
+    const LVCssSelectorIndexList * find( LVHashTable<lString16, int> & map, const lString16 & key );
+public:
+    LVCssSelectorIndex( LVCssSelector * chain, bool universal );
+    /// selectors without class or id conditions
+    const LVCssSelectorIndexList & getGeneric() const { return _generic; }
+    /// selectors for element with class (lowercased) attribute value, NULL if none
+    const LVCssSelectorIndexList * findClass( const lString16 & value ) { return find( _classBuckets, value ); }
+    /// selectors for element with id attribute value, NULL if none
+    const LVCssSelectorIndexList * findId( const lString16 & value ) { return find( _idBuckets, value ); }
+    bool hasClassBuckets() { return _classBuckets.length() > 0; }
+    bool hasIdBuckets() { return _idBuckets.length() > 0; }
+};
 
 /** \brief stylesheet
     
@@ -177,6 +246,13 @@ class LVStyleSheet {
     LVPtrVector <LVCssSelector> _selectors;
 
     LVPtrVector <LVPtrVector <LVCssSelector> > _stack;
+    LVPtrVector <LVCssElementDeps> _deps;
+    LVPtrVector <LVCssSelectorIndex> _index;
+    lUInt32 _generation;
+    /// drops cached rule summaries and indexes, to be called on every change of rules
+    void changed() { _deps.clear(); _index.clear(); _generation++; }
+    /// returns index of selectors chain for element name id (0 for universal selectors)
+    LVCssSelectorIndex * getIndex( lUInt16 id );
     LVPtrVector <LVCssSelector> * dup()
     {
         LVPtrVector <LVCssSelector> * res = new LVPtrVector <LVCssSelector>();
@@ -211,17 +287,21 @@ public:
     }
 
     /// remove all rules from stylesheet
-    void clear() { _selectors.clear(); }
+    void clear() { _selectors.clear(); changed(); }
     /// set document to retrieve ID values from
     void setDocument( lxmlDocBase * doc ) { _doc = doc; }
     /// constructor
-    LVStyleSheet( lxmlDocBase * doc = NULL ) : _doc(doc) { }
+    LVStyleSheet( lxmlDocBase * doc = NULL ) : _doc(doc), _generation(0) { }
     /// copy constructor
     LVStyleSheet( LVStyleSheet & sheet );
     /// parse stylesheet, compile and add found rules to sheet
     bool parse( const char * str );
     /// apply stylesheet to node style
     void apply( const ldomNode * node, css_style_rec_t * style );
+    /// returns counter which is changed every time rules are modified
+    lUInt32 getGeneration() const { return _generation; }
+    /// returns what rules for element name depend on, besides element name itself
+    const LVCssElementDeps * getElementDeps( lUInt16 id );
     /// calculate hash
     lUInt32 getHash();
 };
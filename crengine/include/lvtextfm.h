@@ -162,6 +162,10 @@ typedef struct
    lInt32                img_zoom_out_scale_block; /**< max scale for block images zoom out: 1, 2, 3 */
    lInt32                img_zoom_out_mode_inline; /**< can zoom out inline images: 0=disabled, 1=integer scale, 2=free scale */
    lInt32                img_zoom_out_scale_inline; /**< max scale for inline images zoom out: 1, 2, 3 */
+   lInt32                img_zoom_in_quality_block; /**< resampling quality for block images zoom in: 0=nearest neighbour, 1=smooth */
+   lInt32                img_zoom_in_quality_inline; /**< resampling quality for inline images zoom in: 0=nearest neighbour, 1=smooth */
+   lInt32                img_zoom_out_quality_block; /**< resampling quality for block images zoom out: 0=nearest neighbour, 1=smooth */
+   lInt32                img_zoom_out_quality_inline; /**< resampling quality for inline images zoom out: 0=nearest neighbour, 1=smooth */
    lInt32                min_space_condensing_percent; /**< min size of space (relative to normal size) to allow fitting line by reducing of spaces */
 } formatted_text_fragment_t;
 
@@ -300,6 +304,9 @@ public:
 
     void Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList * marks,  ldomMarkedRangeList *bookmarks = NULL );
 
+    /// decodes images of lines intersecting [top, bottom) (relative to text top) into image cache of buf without drawing; returns number of cached images
+    int PrepareImages( LVDrawBuf * buf, int top, int bottom );
+
     LFormattedText() { m_pbuffer = lvtextAllocFormatter( 0 ); }
 
     ~LFormattedText() { lvtextFreeFormatter( m_pbuffer ); }
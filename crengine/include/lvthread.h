@@ -75,7 +75,12 @@ private:
 public:
     LVMutex()
     {
-        _valid = ( pthread_mutex_init(&_mutex, NULL) !=0 );
+        // recursive: font and glyph cache methods may call each other with lock held
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init( &attr );
+        pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+        _valid = ( pthread_mutex_init(&_mutex, &attr) == 0 );
+        pthread_mutexattr_destroy( &attr );
     }
     ~LVMutex()
     {
@@ -153,43 +158,34 @@ class LVThread {
         }
 };
 
+/// in-process lock: critical section is cheaper than kernel mutex object, and is recursive as well
 class LVMutex {
     private:
-        HANDLE _mutex;
-        bool _valid;
+        CRITICAL_SECTION _cs;
     public:
         LVMutex()
         {
-            _mutex = CreateMutex( NULL, FALSE, NULL );
-            _valid = (_mutex != NULL);
+            InitializeCriticalSection( &_cs );
         }
         ~LVMutex()
         {
-            if ( _valid )
-                CloseHandle( _mutex );
+            DeleteCriticalSection( &_cs );
         }
         bool lock()
         {
-            if ( _valid ) {
-                return WaitForSingleObject( _mutex, INFINITE ) == WAIT_OBJECT_0;
-            }
-            return false;
+            EnterCriticalSection( &_cs );
+            return true;
         }
         bool trylock()
         {
-            if ( _valid ){
-                return WaitForSingleObject( _mutex, 0 ) == WAIT_OBJECT_0;
-            }
-            return false;
+            return TryEnterCriticalSection( &_cs ) != FALSE;
         }
         void unlock()
         {
-            if ( _valid )
-                ReleaseMutex( _mutex );
+            LeaveCriticalSection( &_cs );
         }
 };
 
-
 #endif
 
 #else // CR_USE_THREADS
@@ -244,6 +240,34 @@ class LVMutex {
 
 #endif
 
+/*
+    Atomic operations for lock-free readers:
+    crAtomicAdd( value, delta ) - atomically adds delta to value, returns new value
+    crAtomicCasPtr( ptr, oldValue, newValue ) - sets *ptr to newValue if it's equal to oldValue, returns true if swapped
+    crMemoryBarrier() - full memory barrier
+*/
+#if (CR_USE_THREADS==1) && defined(_LINUX)
+inline int crAtomicAdd( volatile int * value, int delta ) { return __sync_add_and_fetch( value, delta ); }
+inline bool crAtomicCasPtr( void * volatile * ptr, void * oldValue, void * newValue ) { return __sync_bool_compare_and_swap( ptr, oldValue, newValue ); }
+inline void crMemoryBarrier() { __sync_synchronize(); }
+#elif (CR_USE_THREADS==1) && defined(_WIN32)
+inline int crAtomicAdd( volatile int * value, int delta ) { return InterlockedExchangeAdd( (volatile LONG *)value, delta ) + delta; }
+inline bool crAtomicCasPtr( void * volatile * ptr, void * oldValue, void * newValue ) { return InterlockedCompareExchangePointer( ptr, newValue, oldValue ) == oldValue; }
+inline void crMemoryBarrier() { MemoryBarrier(); }
+#elif (CR_USE_THREADS==1)
+#error atomic operations are not implemented for this platform: plain fallbacks below are not thread safe
+#else
+inline int crAtomicAdd( volatile int * value, int delta ) { return *value += delta; }
+inline bool crAtomicCasPtr( void * volatile * ptr, void * oldValue, void * newValue )
+{
+    if ( *ptr != oldValue )
+        return false;
+    *ptr = newValue;
+    return true;
+}
+inline void crMemoryBarrier() { }
+#endif
+
 class LVLock {
     private:
         LVMutex &_mutex;
@@ -127,6 +127,8 @@ typedef enum {
 struct img_scaling_option_t {
     img_scaling_mode_t mode;
     int max_scale;
+    /// resampling quality, affects drawing only: not included into hash
+    img_scaling_quality_t quality;
     int getHash() { return (int)mode * 33 + max_scale; }
     // creates default option value
     img_scaling_option_t();
@@ -366,6 +368,30 @@ public:
 // forward declaration
 class ldomNode;
 
+/// signature of element for computed styles memo, see ldomNode::initNodeStyle()
+struct ldomStyleMemoKey {
+    lUInt16 id;          ///< element name id
+    lUInt16 parentStyle; ///< style index of parent element
+    lUInt32 parentNode;  ///< parent data index if rules check ancestors, 0 otherwise
+    lString16 attrs;     ///< values of element attributes checked by rules
+    ldomStyleMemoKey() : id(0), parentStyle(0), parentNode(0) { }
+    bool operator == ( const ldomStyleMemoKey & v ) const
+    {
+        return id==v.id && parentStyle==v.parentStyle && parentNode==v.parentNode && attrs==v.attrs;
+    }
+};
+
+inline lUInt32 getHash( const ldomStyleMemoKey & key )
+{
+    return ((((lUInt32)key.id * 31 + key.parentStyle) * 31) + key.parentNode) * 31 + key.attrs.getHash();
+}
+
+/// computed styles memo item
+struct ldomStyleMemoValue {
+    css_style_ref_t parentStyle; ///< parent style the item was computed for
+    css_style_ref_t style;       ///< resulting element style
+};
+
 #define TNC_PART_COUNT 1024
 #define TNC_PART_SHIFT 10
 #define TNC_PART_INDEX_SHIFT (TNC_PART_SHIFT+4)
@@ -420,6 +446,8 @@ protected:
     LVStyleSheet  _stylesheet;
 
     LVHashTable<lUInt16, lUInt16> _fontMap; // style index to font index
+    LVHashTable<ldomStyleMemoKey, ldomStyleMemoValue> _styleMemo; // element signature to computed style
+    lUInt32 _styleMemoGeneration; // stylesheet generation _styleMemo items are valid for
 
     /// checks buffer sizes, compacts most unused chunks
     ldomBlobCache _blobCache;
@@ -1065,6 +1093,7 @@ protected:
     lString16HashedCollection _attrValueTable;
     LVHashTable<lUInt16,lInt32> _idNodeMap; // id to data index map
     LVHashTable<lString16,LVImageSourceRef> _urlImageMap; // url to image source map
+    LVHashTable<lString16,lvPoint> _imageSizeMap; // url to image size map, saved to cache file
     lUInt16 _idAttrId; // Id for "id" attribute name
     lUInt16 _nameAttrId; // Id for "name" attribute name
 
@@ -1757,8 +1786,8 @@ public:
 #if BUILD_LITE!=1
     /// fill text selection list by splitting text into monotonic flags ranges
     void splitText( ldomMarkedTextList &dst, ldomNode * textNodeToSplit );
-    /// fill marked ranges list
-    void getRanges( ldomMarkedRangeList &dst );
+    /// fill marked ranges list; if rects is specified, fills it with document rectangle of each added range (empty if unknown)
+    void getRanges( ldomMarkedRangeList &dst, LVArray<lvRect> * rects = NULL );
 #endif
     /// split into subranges using intersection
     void split( ldomXRange * r );
@@ -2054,6 +2083,8 @@ public:
 
 class ldomDocumentWriter;
 
+class ldomBase64Decoder;
+
 class ldomElementWriter
 {
     ldomElementWriter * _parent;
@@ -2069,6 +2100,7 @@ class ldomElementWriter
     bool _stylesheetIsSet;
     bool _bodyEnterCalled;
     lUInt32 _flags;
+    ldomBase64Decoder * _base64; // content of FB2 <binary>, which is stored as blob instead of text
     lUInt32 getFlags();
     void updateTocItem();
     void onBodyEnter();
@@ -2079,6 +2111,7 @@ class ldomElementWriter
     }
     lString16 getPath();
     void onText( const lChar16 * text, int len, lUInt32 flags );
+    void onBinaryEnd();
     void addAttribute( lUInt16 nsid, lUInt16 id, const wchar_t * value );
     //lxmlElementWriter * pop( lUInt16 id );
 
@@ -25,6 +25,8 @@
 
 // if 1, full page (e.g. 8 items) is scrolled even if on next page would be less items (show empty space)
 #define FULL_SCROLL 1
+/// max time of single background work step done while there are no events, milliseconds
+#define IDLE_STEP_TIMEOUT 50
 
 const char * cr_default_skin =
 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
@@ -234,6 +236,24 @@ void CRGUIWindowManager::reconfigure( int dx, int dy, cr_rotate_angle_t orientat
     }
 }
 
+/// draw window and add changed parts of it to screen update area
+void CRGUIWindowManager::invalidateWindow( CRGUIWindow * w, bool full )
+{
+    if ( !w->isVisible() ) {
+        _screen->invalidateRect( w->getRect() );
+        return;
+    }
+    w->flush();
+    if ( full ) {
+        _screen->invalidateRect( w->getRect() );
+        return;
+    }
+    LVArray<lvRect> rects;
+    w->getDamageRects( rects );
+    for ( int i=0; i<rects.length(); i++ )
+        _screen->invalidateRect( rects[i] );
+}
+
 /// redraw one window
 void CRGUIWindowManager::updateWindow( CRGUIWindow * window )
 {
@@ -257,11 +277,8 @@ void CRGUIWindowManager::updateWindow( CRGUIWindow * window )
     }
     while ( !drawList.empty()  ) {
         CRGUIWindow * w = drawList.pop();
-        if ( w->isDirty() ) {
-            if ( w->isVisible() )
-                w->flush();
-            _screen->invalidateRect( w->getRect() );
-        }
+        if ( w->isDirty() )
+            invalidateWindow( w, false );
     }
 /// invalidates rectangle: add it to bounding box of next partial update
     _screen->flush( false );
@@ -286,11 +303,8 @@ void CRGUIWindowManager::update( bool fullScreenUpdate, bool forceFlushScreen )
     }
     while ( !drawList.empty()  ) {
         CRGUIWindow * w = drawList.pop();
-        if ( w->isDirty() || fullScreenUpdate ) {
-            if ( w->isVisible() )
-                w->flush();
-            _screen->invalidateRect( w->getRect() );
-        }
+        if ( w->isDirty() || fullScreenUpdate )
+            invalidateWindow( w, fullScreenUpdate );
     }
     _lastProgressPercent = -1;
     if ( !forceFlushScreen ) {
@@ -364,7 +378,12 @@ bool CRGUIWindowManager::handleAllEvents( bool waitForEvent )
     bool handled = false;
     if ( _events.empty() && waitForEvent ) {
         idle();
-        forwardSystemEvents( true );
+        // background work of top window is done step by step until some event arrives
+        CRGUIWindow * wnd = getTopVisibleWindow();
+        while ( wnd && _events.empty() && wnd->onIdle() )
+            forwardSystemEvents( false );
+        if ( _events.empty() )
+            forwardSystemEvents( true );
     }
     for (CRGUIEvent * event=getEvent(); event; event=getEvent() ) {
         handleEvent( event );
@@ -507,6 +526,7 @@ void CRGUIScreenBase::flush( bool full )
         if ( rc.isEmpty() ) {
             // no actual changes
             _updateRect.clear();
+            _canvas->clearDamage();
             return;
         }
         _updateRect.top = rc.top;
@@ -518,10 +538,13 @@ void CRGUIScreenBase::flush( bool full )
         // copy full screen to front buffer
         _canvas->DrawTo( _front.get(), 0, 0, 0, NULL );
     }
-    if ( full )
+    if ( full ) {
         _updateRect = getRect();
+        _canvas->invalidateRect( _updateRect );
+    }
     update( _updateRect, full );
     _updateRect.clear();
+    _canvas->clearDamage();
 }
 
 /// calculates title rectangle for specified window rectangle
@@ -884,17 +907,39 @@ bool CRGUIWindowBase::onKeyPressed( int key, int flags )
 
 void CRDocViewWindow::draw()
 {
+    _damage.clear();
     lvRect clientRect = _rect;
     if ( !_skin.isNull() ) {
         if ( getClientRect( clientRect ) ) {
             _skin->draw( *_wm->getScreen()->getCanvas(), _rect );
             drawTitleBar();
             drawStatusBar();
+            lvRect rc;
+            if ( getTitleRect( rc ) )
+                _damage.add( rc );
+            if ( getStatusRect( rc ) )
+                _damage.add( rc );
         }
     }
     LVDocImageRef pageImage = _docview->getPageImage(0);
     LVDrawBuf * drawbuf = pageImage->getDrawBuf();
     _wm->getScreen()->draw( drawbuf, clientRect.left, clientRect.top );
+    if ( _dirty ) {
+        _damage.clear();
+        _damage.add( _rect );
+    } else {
+        // only parts of page image redrawn since it has been shown last time
+        const LVArray<lvRect> & rects = drawbuf->getDamageRects();
+        for ( int i=0; i<rects.length(); i++ ) {
+            lvRect rc = rects[i];
+            rc.left += clientRect.left;
+            rc.right += clientRect.left;
+            rc.top += clientRect.top;
+            rc.bottom += clientRect.top;
+            _damage.add( rc );
+        }
+    }
+    drawbuf->clearDamage();
 }
 
 void CRDocViewWindow::setRect( const lvRect & rc )
@@ -909,6 +954,13 @@ void CRDocViewWindow::setRect( const lvRect & rc )
     setDirty();
 }
 
+/// pre-decodes images of next and previous pages, step by step
+bool CRDocViewWindow::onIdle()
+{
+    CRTimerUtil timeout( IDLE_STEP_TIMEOUT );
+    return _docview->predecodeImages( timeout )==CR_TIMEOUT;
+}
+
 
 void CRMenuItem::Draw( LVDrawBuf & buf, lvRect & rc, CRRectSkinRef skin, CRRectSkinRef valueSkin, bool selected )
 {
@@ -0,0 +1,87 @@
+/** \file crprofiler.cpp
+    \brief lightweight load/render profiler implementation
+
+    CoolReader Engine
+
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+*/
+
+#include "../include/crprofiler.h"
+#include <stdio.h>
+#include <string.h>
+
+CRProfilerStageStats CRProfiler::_stats[CRPROF_STAGE_COUNT];
+int CRProfiler::_depth[CRPROF_STAGE_COUNT];
+
+static const char * cr_profiler_stage_names[CRPROF_STAGE_COUNT] = {
+    "load_document",
+    "parse",
+    "render",
+    "init_styles",
+    "font_lookup",
+    "format_text",
+    "page_split",
+    "cache_save",
+    "cache_load",
+    "chunk_pack",
+    "chunk_unpack",
+};
+
+lInt64 CRProfiler::getTimeMicros()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    if ( freq.QuadPart==0 )
+        QueryPerformanceFrequency( &freq );
+    LARGE_INTEGER ts;
+    QueryPerformanceCounter( &ts );
+    return (lInt64)(ts.QuadPart * 1000000 / freq.QuadPart);
+#else
+    timeval ts;
+    gettimeofday( &ts, 0 );
+    return ((lInt64)ts.tv_sec)*1000000 + ts.tv_usec;
+#endif
+}
+
+const char * CRProfiler::getStageName( int stage )
+{
+    if ( stage<0 || stage>=CRPROF_STAGE_COUNT )
+        return "unknown";
+    return cr_profiler_stage_names[stage];
+}
+
+void CRProfiler::leave( int stage, bool outermost, lInt64 elapsedUs )
+{
+    _depth[stage]--;
+    if ( !outermost )
+        return;
+    CRProfilerStageStats & s = _stats[stage];
+    s.calls++;
+    s.totalUs += elapsedUs;
+    if ( s.maxUs < elapsedUs )
+        s.maxUs = elapsedUs;
+}
+
+void CRProfiler::reset()
+{
+    memset( _stats, 0, sizeof(_stats) );
+}
+
+lString8 CRProfiler::toJSON()
+{
+    lString8 res;
+    res << "{\"enabled\":" << (isEnabled() ? "true" : "false") << ",\"stages\":{";
+    char buf[256];
+    for ( int i=0; i<CRPROF_STAGE_COUNT; i++ ) {
+        const CRProfilerStageStats & s = _stats[i];
+        sprintf( buf, "%s\"%s\":{\"calls\":%lld,\"time_us\":%lld,\"max_us\":%lld,\"items\":%lld}",
+                 i>0 ? "," : "", cr_profiler_stage_names[i],
+                 (long long)s.calls, (long long)s.totalUs, (long long)s.maxUs, (long long)s.items );
+        res << buf;
+    }
+    res << "}}";
+    return res;
+}
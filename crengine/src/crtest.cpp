@@ -171,6 +171,15 @@ LVStreamRef LVCreateCompareTestStream( LVStreamRef stream1, LVStreamRef stream2
 
 // external tests declarations
 void testTxtSelector();
+void testBlendSpans();
+void testDrawBufDamage();
+void testScaledImageCache();
+void testSmoothImageScaling();
+void testImageDithering();
+void testDrawBufRotation();
+#if (USE_GIF==1)
+void testGifDecoding();
+#endif
 
 
 void runCRUnitTests()
@@ -179,5 +188,14 @@ void runCRUnitTests()
     //runCHMUnitTest();
     runTinyDomUnitTests();
     testTxtSelector();
+    testBlendSpans();
+    testDrawBufDamage();
+    testScaledImageCache();
+    testSmoothImageScaling();
+    testImageDithering();
+    testDrawBufRotation();
+#if (USE_GIF==1)
+    testGifDecoding();
+#endif
 #endif
 }
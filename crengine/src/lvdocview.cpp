@@ -27,6 +27,7 @@
 #include "../include/chmfmt.h"
 #include "../include/wordfmt.h"
 #include "../include/pdbfmt.h"
+#include "../include/gammatbl.h"
 /// to show page bounds rectangles
 //#define SHOW_PAGE_RECT
 
@@ -138,7 +139,9 @@ LVDocView::LVDocView(int bitsPerPixel) :
 #endif
 			, m_section_bounds_valid(false), m_doc_format(doc_format_none),
 			m_callback(NULL), m_swapDone(false), m_drawBufferBits(
-					GRAY_BACKBUFFER_BITS) {
+					GRAY_BACKBUFFER_BITS), m_imageGeneration(0), m_drawnGeneration(-1),
+			m_drawnPage(-1), m_drawnDx(0), m_drawnDy(0), m_headerDamaged(false),
+			m_drawnBpp(0), m_predecodeGeneration(-1), m_predecodePos(-1), m_predecodeIndex(0) {
 #if (COLOR_BACKBUFFER==1)
 	m_backgroundColor = 0xFFFFE0;
 	m_textColor = 0x000060;
@@ -152,6 +155,8 @@ LVDocView::LVDocView(int bitsPerPixel) :
 #endif
 #endif
 	m_statusColor = 0xFF000000;
+	m_imageDithering = (img_dithering_t)IMAGE_DITHERING_DEFAULT;
+	m_imageDitheringGamma = IMAGE_DITHERING_GAMMA_DEFAULT;
 	m_defaultFontFace = lString8(DEFAULT_FONT_NAME);
 	m_statusFontFace = lString8(DEFAULT_STATUS_FONT_NAME);
 	m_props = LVCreatePropsContainer();
@@ -420,6 +425,9 @@ void LVDocView::clearImageCache() {
 #if CR_ENABLE_PAGE_IMAGE_CACHE==1
 	m_imageCache.clear();
 #endif
+	m_imageGeneration++;
+	m_headerDamaged = false;
+	m_damagedDocRects.clear();
     m_section_bounds_valid = false;
 	if (m_callback != NULL)
 		m_callback->OnImageCacheClear();
@@ -579,6 +587,114 @@ void LVDocView::Draw(LVDrawBuf & drawbuf) {
 	//CRLog::trace("Draw() : calling Draw(buf(%d x %d), %d, %d, false)",
 	//		drawbuf.GetWidth(), drawbuf.GetHeight(), offset, p);
 	Draw(drawbuf, offset, p, false);
+	m_drawnGeneration = m_imageGeneration;
+	m_drawnPage = p;
+	m_drawnDx = drawbuf.GetWidth();
+	m_drawnDy = drawbuf.GetHeight();
+	m_headerDamaged = false;
+	m_damagedDocRects.clear();
+}
+
+/// update buffer drawn by last Draw(drawbuf) call redrawing only changed parts
+bool LVDocView::updatePageImage(LVDrawBuf & drawbuf) {
+	LVLock lock(getMutex());
+	checkPos();
+	if (m_drawnGeneration != m_imageGeneration || !canUpdatePageImage()
+			|| m_drawnPage != _page || drawbuf.GetWidth() != m_drawnDx
+			|| drawbuf.GetHeight() != m_drawnDy) {
+		Draw(drawbuf);
+		return false;
+	}
+	if (m_headerDamaged || m_damagedDocRects.length())
+		redrawPageDamage(drawbuf, _page, m_headerDamaged, m_damagedDocRects);
+	m_headerDamaged = false;
+	m_damagedDocRects.clear();
+	return true;
+}
+
+/// returns true if page header and marks changes may be applied to already drawn page images
+bool LVDocView::canUpdatePageImage() {
+	if (!isPageMode() || !m_is_rendered)
+		return false;
+#if CR_INTERNAL_PAGE_ORIENTATION==1
+	if (m_rotateAngle != CR_ROTATE_ANGLE_0)
+		return false;
+#endif
+	return true;
+}
+
+/// when number of changed document rectangles exceeds this value, they are merged into single bounding box
+#define MAX_DAMAGED_DOC_RECTS 16
+
+/// register changed parts of page: header and/or document rectangles
+void LVDocView::invalidatePageImage(bool header, const LVArray<lvRect> & docRects) {
+	if (!canUpdatePageImage()) {
+		clearImageCache();
+		return;
+	}
+	if (!header && docRects.empty())
+		return;
+	if (header)
+		m_headerDamaged = true;
+	m_damagedDocRects.add(docRects);
+	if (m_damagedDocRects.length() > MAX_DAMAGED_DOC_RECTS) {
+		lvRect bounds;
+		for (int i = 0; i < m_damagedDocRects.length(); i++)
+			bounds.extend(m_damagedDocRects[i]);
+		m_damagedDocRects.clear();
+		m_damagedDocRects.add(bounds);
+	}
+#if CR_ENABLE_PAGE_IMAGE_CACHE==1
+	{
+		// patch cached images instead of dropping them
+		LVLock lock(m_imageCache.getMutex());
+		for (int i = 0; i < 2; i++) {
+			int page = -1;
+			LVRef<LVDrawBuf> buf = m_imageCache.getSlotWithoutLock(i, page);
+			if (!buf.isNull() && page >= 0)
+				redrawPageDamage(*buf, page, header, docRects);
+		}
+	}
+#endif
+	if (m_callback != NULL)
+		m_callback->OnImageCacheClear();
+}
+
+/// request redraw of page header only (clock, battery state)
+void LVDocView::invalidatePageHeader() {
+	invalidatePageImage(true, LVArray<lvRect>());
+}
+
+/// redraw changed parts of page (and next page in two pages mode) to buffer containing its image
+void LVDocView::redrawPageDamage(LVDrawBuf & drawbuf, int page, bool header,
+		const LVArray<lvRect> & docRects) {
+	LVLock lock(getMutex());
+	if (page < 0 || page >= m_pages.length())
+		return;
+	drawbuf.SetBackgroundColor(m_backgroundColor);
+	drawbuf.SetTextColor(m_textColor);
+	lvRect bufRect(0, 0, drawbuf.GetWidth(), drawbuf.GetHeight());
+	int pc = getVisiblePageCount();
+	for (int i = 0; i < pc && page + i < m_pages.length(); i++) {
+		LVRendPageInfo & pageInfo = *m_pages[page + i];
+		if (pageInfo.type == PAGE_TYPE_COVER)
+			continue;
+		LVArray<lvRect> rects;
+		if (header && (m_pageHeaderInfo || !m_pageHeaderOverride.empty())) {
+			lvRect rc;
+			getPageHeaderRectangle(pageInfo.index, rc);
+			rects.add(rc);
+		}
+		getPageDamageRects(pageInfo, m_pageRects[i], docRects, rects);
+		for (int j = 0; j < rects.length(); j++) {
+			lvRect area = rects[j];
+			if (area.isEmpty() || !area.intersect(bufRect))
+				continue;
+			drawPageBackground(drawbuf, 0, 0, &area);
+			drawPageTo(&drawbuf, pageInfo, &m_pageRects[i], m_pages.length(), 1, &area);
+			drawbuf.invalidateRect(area);
+		}
+	}
 }
 
 #if CR_ENABLE_PAGE_IMAGE_CACHE==1
@@ -894,8 +1010,14 @@ void LVDocView::drawCoverTo(LVDrawBuf * drawBuf, lvRect & rc) {
 		if (dst_dy > rc.height() * 7 / 8)
 			dst_dy = imgrc.height();
 		//CRLog::trace("drawCoverTo() - drawing image");
+		img_scaling_option_t defImgScaling;
+		int quality = m_props->getIntDef(dst_dx > src_dx ? PROP_IMG_SCALING_ZOOMIN_BLOCK_QUALITY
+				: PROP_IMG_SCALING_ZOOMOUT_BLOCK_QUALITY, defImgScaling.quality);
+		img_scaling_quality_t oldQuality = drawBuf->getImageScalingQuality();
+		drawBuf->setImageScalingQuality((img_scaling_quality_t)quality);
 		drawBuf->Draw(imgsrc, imgrc.left + (imgrc.width() - dst_dx) / 2,
 				imgrc.top + (imgrc.height() - dst_dy) / 2, dst_dx, dst_dy);
+		drawBuf->setImageScalingQuality(oldQuality);
 		//fprintf( stderr, "Done.\n" );
 	} else if (!defcover.isNull()) {
 		if (h)
@@ -1381,7 +1503,7 @@ bool LVDocView::setBatteryState(int newState) {
 		return false;
 	CRLog::info("New battery state: %d", newState);
 	m_battery_state = newState;
-	clearImageCache();
+	invalidatePageHeader();
 	return true;
 }
 
@@ -1639,7 +1761,7 @@ void LVDocView::drawPageHeader(LVDrawBuf * drawbuf, const lvRect & headerRc,
 }
 
 void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
-		lvRect * pageRect, int pageCount, int basePage) {
+		lvRect * pageRect, int pageCount, int basePage, const lvRect * area) {
 	int start = page.start;
 	int height = page.height;
 	int headerHeight = getPageHeaderHeight();
@@ -1648,6 +1770,8 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 	if (!pageRect)
 		pageRect = &fullRect;
     drawbuf->setHidePartialGlyphs(getViewMode()==DVM_PAGES);
+    drawbuf->setImageDithering(m_imageDithering);
+    drawbuf->setImageDitheringGamma(m_imageDitheringGamma);
 	//int offset = (pageRect->height() - m_pageMargins.top - m_pageMargins.bottom - height) / 3;
 	//if (offset>16)
 	//    offset = 16;
@@ -1662,8 +1786,12 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 	clip.right = pageRect->left + pageRect->width() - m_pageMargins.right;
 	if (page.type == PAGE_TYPE_COVER)
 		clip.top = pageRect->top + m_pageMargins.top;
+	if (area && page.type == PAGE_TYPE_COVER)
+		return;
 	if ((m_pageHeaderInfo || !m_pageHeaderOverride.empty()) && page.type
 			!= PAGE_TYPE_COVER) {
+		lvRect info;
+		getPageHeaderRectangle(page.index, info);
 		int phi = m_pageHeaderInfo;
 		if (getVisiblePageCount() == 2) {
 			if (page.index & 1) {
@@ -1679,13 +1807,19 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 				phi &= ~PGHDR_CLOCK;
 			}
 		}
-		lvRect info;
-		getPageHeaderRectangle(page.index, info);
-		drawPageHeader(drawbuf, info, page.index - 1 + basePage, phi, pageCount
-				- 1 + basePage);
+		if (!area || lvRect(info).intersect(*area))
+			drawPageHeader(drawbuf, info, page.index - 1 + basePage, phi, pageCount
+					- 1 + basePage);
 		//clip.top = info.bottom;
 	}
-	drawbuf->SetClipRect(&clip);
+	lvRect textClip = clip;
+	if (area) {
+		// partial redraw: glyphs crossing area bounds are clipped, not hidden
+		drawbuf->setHidePartialGlyphs(false);
+		if (!textClip.intersect(*area))
+			textClip.clear();
+	}
+	drawbuf->SetClipRect(&textClip);
 	if (m_doc) {
 		if (page.type == PAGE_TYPE_COVER) {
 			lvRect rc = *pageRect;
@@ -1705,7 +1839,7 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
             if ( m_markRanges.length() )
                 CRLog::trace("Entering DrawDocument() : %d ranges", m_markRanges.length());
 			//CRLog::trace("Entering DrawDocument()");
-			if (page.height)
+			if (page.height && !textClip.isEmpty())
 				DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left
 						+ m_pageMargins.left, clip.top, pageRect->width()
 						- m_pageMargins.left - m_pageMargins.right, height, 0,
@@ -1724,17 +1858,19 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 				clip.left = pageRect->left + m_pageMargins.left;
 				clip.right = pageRect->right - m_pageMargins.right;
 				clip.bottom = fy + offset + fheight;
-				drawbuf->SetClipRect(&clip);
-				DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left
-						+ m_pageMargins.left, fy + offset, pageRect->width()
-						- m_pageMargins.left - m_pageMargins.right, fheight, 0,
-						-fstart + offset, m_dy, &m_markRanges);
+				if (!area || clip.intersect(*area)) {
+					drawbuf->SetClipRect(&clip);
+					DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left
+							+ m_pageMargins.left, fy + offset, pageRect->width()
+							- m_pageMargins.left - m_pageMargins.right, fheight, 0,
+							-fstart + offset, m_dy, &m_markRanges);
+				}
 				footnoteDrawed = true;
 				fy += fheight;
 			}
 			if (footnoteDrawed) { // && page.height
 				fny -= FOOTNOTE_MARGIN / 2;
-				drawbuf->SetClipRect(NULL);
+				drawbuf->SetClipRect(area);
                 lUInt32 cl = drawbuf->GetTextColor();
                 cl = (cl & 0xFFFFFF) | (0x55000000);
 				drawbuf->FillRect(pageRect->left + m_pageMargins.left, fny,
@@ -1744,6 +1880,8 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 		}
 	}
 	drawbuf->SetClipRect(NULL);
+	if (area)
+		drawbuf->setHidePartialGlyphs(getViewMode()==DVM_PAGES);
 #ifdef SHOW_PAGE_RECT
 	drawbuf->FillRect(pageRect->left, pageRect->top, pageRect->left+1, pageRect->bottom, 0xAAAAAA);
 	drawbuf->FillRect(pageRect->left, pageRect->top, pageRect->right, pageRect->top+1, 0xAAAAAA);
@@ -1761,6 +1899,42 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 #endif
 }
 
+/// add screen rectangle for part of docRect inside document band [start, start+height) shown at y
+static void addDamageBand(const lvRect & docRect, int start, int height, int y,
+		int left, int right, LVArray<lvRect> & screenRects) {
+	int top = docRect.top > start ? docRect.top : start;
+	int bottom = docRect.bottom < start + height ? docRect.bottom : start + height;
+	if (top >= bottom)
+		return;
+	lvRect rc(left, y + top - start, right, y + bottom - start);
+	if (docRect.left > 0)
+		rc.left = left + docRect.left;
+	if (docRect.right < right - left)
+		rc.right = left + docRect.right;
+	if (rc.left < rc.right)
+		screenRects.add(rc);
+}
+
+/// convert changed document rectangles to screen rectangles of page
+void LVDocView::getPageDamageRects(LVRendPageInfo & page, const lvRect & pageRect,
+		const LVArray<lvRect> & docRects, LVArray<lvRect> & screenRects) {
+	// same layout as in drawPageTo()
+	int left = pageRect.left + m_pageMargins.left;
+	int right = pageRect.right - m_pageMargins.right;
+	int top = pageRect.top + m_pageMargins.top + getPageHeaderHeight();
+	for (int i = 0; i < docRects.length(); i++) {
+		const lvRect & rc = docRects[i];
+		if (page.height)
+			addDamageBand(rc, page.start, page.height, top, left, right, screenRects);
+		int fy = top + (page.height ? page.height + FOOTNOTE_MARGIN : FOOTNOTE_MARGIN);
+		for (int fn = 0; fn < page.footnotes.length(); fn++) {
+			addDamageBand(rc, page.footnotes[fn].start, page.footnotes[fn].height,
+					fy, left, right, screenRects);
+			fy += page.footnotes[fn].height;
+		}
+	}
+}
+
 /// returns page count
 int LVDocView::getPageCount() {
 	return m_pages.length();
@@ -1892,7 +2066,7 @@ bool LVDocView::isTimeChanged() {
 	if ( m_pageHeaderInfo & PGHDR_CLOCK ) {
 		bool res = (m_last_clock != getTimeString());
 		if (res)
-			clearImageCache();
+			invalidatePageHeader();
 		return res;
 	}
 	return false;
@@ -1909,10 +2083,12 @@ static bool checkBufferSize( LVRef<LVColorDrawBuf> & buf, int dx, int dy ) {
 }
 
 /// clears page background
-void LVDocView::drawPageBackground( LVDrawBuf & drawbuf, int offsetX, int offsetY )
+void LVDocView::drawPageBackground( LVDrawBuf & drawbuf, int offsetX, int offsetY, const lvRect * area )
 {
     //CRLog::trace("drawPageBackground() called");
     drawbuf.SetBackgroundColor(m_backgroundColor);
+    if ( area )
+        drawbuf.SetClipRect(area);
     if ( !m_backgroundImage.isNull() ) {
         // texture
         int dx = drawbuf.GetWidth();
@@ -1975,7 +2151,10 @@ void LVDocView::drawPageBackground( LVDrawBuf & drawbuf, int offsetX, int offset
         }
     } else {
         // solid color
-        drawbuf.Clear(m_backgroundColor);
+        if ( area )
+            drawbuf.FillRect(*area, m_backgroundColor);
+        else
+            drawbuf.Clear(m_backgroundColor);
     }
     if (drawbuf.GetBitsPerPixel() == 32 && getVisiblePageCount() == 2) {
         int x = drawbuf.GetWidth() / 2;
@@ -1983,6 +2162,8 @@ void LVDocView::drawPageBackground( LVDrawBuf & drawbuf, int offsetX, int offset
         cl = ((cl & 0xFCFCFC) + 0x404040) >> 1;
         drawbuf.FillRect(x, 0, x + 1, drawbuf.GetHeight(), cl);
     }
+    if ( area )
+        drawbuf.SetClipRect(NULL);
 }
 
 /// draw to specified buffer
@@ -1994,6 +2175,9 @@ void LVDocView::Draw(LVDrawBuf & drawbuf, int position, int page, bool rotate) {
 	drawbuf.Resize(m_dx, m_dy);
 	drawbuf.SetBackgroundColor(m_backgroundColor);
 	drawbuf.SetTextColor(m_textColor);
+	drawbuf.setImageDithering(m_imageDithering);
+	drawbuf.setImageDitheringGamma(m_imageDitheringGamma);
+	m_drawnBpp = drawbuf.GetBitsPerPixel();
 	//CRLog::trace("Draw() : calling clear()", m_dx, m_dy);
 
 	if (!m_is_rendered)
@@ -2046,6 +2230,7 @@ void LVDocView::Draw(LVDrawBuf & drawbuf, int position, int page, bool rotate) {
 		//CRLog::trace("Rotate done. buf(%d, %d)", drawbuf.GetWidth(), drawbuf.GetHeight() );
 	}
 #endif
+	drawbuf.invalidateRect(lvRect(0, 0, drawbuf.GetWidth(), drawbuf.GetHeight()));
 }
 
 //void LVDocView::Draw()
@@ -2215,29 +2400,133 @@ int LVDocView::getCurrentPageCharCount()
     return count;
 }
 
+/// collects image elements of document range
+class LVImageNodeCollector : public ldomNodeCallback {
+    LVArray<ldomNode*> & _nodes;
+public:
+    LVImageNodeCollector( LVArray<ldomNode*> & nodes ) : _nodes(nodes) { }
+    /// called for each found text fragment in range
+    virtual void onText(ldomXRange *) { }
+    /// called for each found node in range
+    virtual bool onElement(ldomXPointerEx * ptr) {
+        lString16 nodeName = ptr->getNode()->getNodeName();
+        if (nodeName == L"img" || nodeName == L"image")
+            _nodes.add(ptr->getNode());
+        return true;
+    }
+};
+
 /// returns number of images on current page
 int LVDocView::getCurrentPageImageCount()
 {
     checkRender();
     LVRef<ldomXRange> range = getPageDocumentRange(-1);
-    class ImageCounter : public ldomNodeCallback {
-        int count;
-    public:
-        int get() { return count; }
-        ImageCounter() : count(0) { }
-        /// called for each found text fragment in range
-        virtual void onText(ldomXRange *) { }
-        /// called for each found node in range
-        virtual bool onElement(ldomXPointerEx * ptr) {
-            lString16 nodeName = ptr->getNode()->getNodeName();
-            if (nodeName == L"img" || nodeName == L"image")
-                count++;
+    if (range.isNull())
+        return 0;
+    LVArray<ldomNode*> images;
+    LVImageNodeCollector collector(images);
+    range->forEach(&collector);
+    return images.length();
+}
+
+/// builds list of final blocks with images on next and previous pages
+void LVDocView::buildImagePredecodeList() {
+    m_predecodeItems.clear();
+    m_predecodeIndex = 0;
+    m_predecodeGeneration = m_imageGeneration;
+    m_predecodePos = isPageMode() ? _page : _pos;
+    // document ranges of next pages first, then of previous ones
+    LVArray<lvPoint> ranges;
+    if (isPageMode()) {
+        int pc = getVisiblePageCount();
+        for (int i = 0; i < pc * 2; i++) {
+            int p = i < pc ? _page + pc + i : _page - pc + i - pc;
+            if (p < 0 || p >= m_pages.length() || m_pages[p]->type != PAGE_TYPE_NORMAL)
+                continue;
+            ranges.add(lvPoint(m_pages[p]->start, m_pages[p]->start + m_pages[p]->height));
         }
+    } else {
+        int fh = GetFullHeight();
+        if (_pos + m_dy < fh)
+            ranges.add(lvPoint(_pos + m_dy, _pos + m_dy * 2 < fh ? _pos + m_dy * 2 : fh - 1));
+        if (_pos > 0)
+            ranges.add(lvPoint(_pos > m_dy ? _pos - m_dy : 0, _pos));
+    }
+    for (int i = 0; i < ranges.length(); i++) {
+        ldomXPointer start = m_doc->createXPointer(lvPoint(0, ranges[i].x));
+        ldomXPointer end = m_doc->createXPointer(lvPoint(0, ranges[i].y), 1);
+        if (start.isNull() || end.isNull())
+            continue;
+        ldomXRange range(start, end);
+        LVArray<ldomNode*> images;
+        LVImageNodeCollector collector(images);
+        range.forEach(&collector);
+        int first = m_predecodeItems.length();
+        for (int j = 0; j < images.length(); j++) {
+            // images are drawn by formatted text of final block which contains them
+            ldomNode * node = images[j];
+            while (node && node->getRendMethod() != erm_final && node->getRendMethod() != erm_list_item
+                    && node->getRendMethod() != erm_table_caption)
+                node = node->getRendMethod() == erm_invisible ? NULL : node->getParentNode();
+            if (!node)
+                continue;
+            bool found = false;
+            for (int k = first; k < m_predecodeItems.length() && !found; k++)
+                found = m_predecodeItems[k].node == node;
+            if (found)
+                continue;
+            LVImagePredecodeItem item;
+            item.node = node;
+            item.top = ranges[i].x;
+            item.bottom = ranges[i].y;
+            m_predecodeItems.add(item);
+        }
+    }
+}
 
-    };
-    ImageCounter cnt;
-    range->forEach(&cnt);
-    return cnt.get();
+/// pre-decodes images of one block of work list, returns false if nothing left to do
+bool LVDocView::predecodeNextImages() {
+    LVLock lock(getMutex());
+    if (!m_is_rendered || !m_doc || m_drawnBpp <= 0 || LVScaledImageCache::getMaxSize() <= 0)
+        return false;
+    if (m_predecodeGeneration != m_imageGeneration || m_predecodePos != (isPageMode() ? _page : _pos))
+        buildImagePredecodeList(); // position is changed: drop work for old one
+    if (m_predecodeIndex >= m_predecodeItems.length())
+        return false;
+    if (m_predecodeBuf.isNull() || m_predecodeBuf->GetBitsPerPixel() != m_drawnBpp) {
+        if (m_drawnBpp == 32 || m_drawnBpp == 16)
+            m_predecodeBuf = LVRef<LVDrawBuf>(new LVColorDrawBuf(1, 1, m_drawnBpp));
+        else
+            m_predecodeBuf = LVRef<LVDrawBuf>(new LVGrayDrawBuf(1, 1, m_drawnBpp));
+    }
+    m_predecodeBuf->setImageDithering(m_imageDithering);
+    m_predecodeBuf->setImageDitheringGamma(m_imageDitheringGamma);
+    LVImagePredecodeItem & item = m_predecodeItems[m_predecodeIndex++];
+    ldomNode * node = item.node;
+    // same formatting width and text position as DrawDocument() uses
+    RenderRectAccessor fmt(node);
+    lvRect rc;
+    node->getAbsRect(rc);
+    int em = node->getFont()->getSize();
+    int width = fmt.getWidth();
+    int padding_left = lengthToPx(node->getStyle()->padding[0], width, em);
+    int padding_right = lengthToPx(node->getStyle()->padding[1], width, em);
+    int padding_top = lengthToPx(node->getStyle()->padding[2], width, em);
+    LFormattedTextRef txform;
+    node->renderFinalBlock(txform, &fmt, width - padding_left - padding_right);
+    int y0 = rc.top + padding_top;
+    txform->PrepareImages(m_predecodeBuf.get(), item.top - y0, item.bottom - y0);
+    return true;
+}
+
+/// decode and scale images of next and previous pages into image cache, with timeout option (call when reader is idle)
+ContinuousOperationResult LVDocView::predecodeImages(CRTimerUtil & maxTime)
+{
+    while (!maxTime.expired()) {
+        if (!predecodeNextImages())
+            return CR_DONE;
+    }
+    return CR_TIMEOUT;
 }
 
 /// get page text, -1 for current page
@@ -2276,6 +2565,7 @@ void LVDocView::setRenderProps(int dx, int dy) {
 
 void LVDocView::Render(int dx, int dy, LVRendPageList * pages) {
 	LVLock lock(getMutex());
+	CR_PROFILE_SCOPE(CRPROF_RENDER);
 	{
 		if (!m_doc || m_doc->getRootNode() == NULL)
 			return;
@@ -2742,14 +3032,40 @@ bool LVDocView::goForward() {
 	return navigateTo(s);
 }
 
+/// add document rectangles of marks from list which are missing in other list
+static void addChangedMarkRects(ldomMarkedRangeList & marks, LVArray<lvRect> & rects,
+		ldomMarkedRangeList & other, LVArray<lvRect> & damage) {
+	for (int i = 0; i < marks.length(); i++) {
+		ldomMarkedRange * mark = marks[i];
+		bool found = false;
+		for (int j = 0; j < other.length() && !found; j++) {
+			ldomMarkedRange * m = other[j];
+			found = m->start.x == mark->start.x && m->start.y == mark->start.y
+					&& m->end.x == mark->end.x && m->end.y == mark->end.y
+					&& m->flags == mark->flags;
+		}
+		if (found)
+			continue;
+		if (i < rects.length() && !rects[i].isEmpty())
+			damage.add(rects[i]);
+		else
+			damage.add(lvRect(0, 0, 0x3FFFFFFF, 0x3FFFFFFF)); // unknown: whole text
+	}
+}
+
 /// update selection ranges
 void LVDocView::updateSelections() {
 	checkRender();
-	clearImageCache();
+	LVArray<lvRect> damage;
+	{
 	LVLock lock(getMutex());
 	ldomXRangeList ranges(m_doc->getSelections(), true);
     CRLog::trace("updateSelections() : selection count = %d", m_doc->getSelections().length());
-	ranges.getRanges(m_markRanges);
+	ldomMarkedRangeList oldRanges(m_markRanges);
+	LVArray<lvRect> oldRects(m_markRects);
+	ranges.getRanges(m_markRanges, &m_markRects);
+	addChangedMarkRects(oldRanges, oldRects, m_markRanges, damage);
+	addChangedMarkRects(m_markRanges, m_markRects, oldRanges, damage);
 	if (m_markRanges.length() > 0) {
 		crtrace trace;
 		trace << "LVDocView::updateSelections() - " << "selections: "
@@ -2763,20 +3079,17 @@ void LVDocView::updateSelections() {
 					<< ") ";
 		}
 	}
+	}
+	invalidatePageImage(false, damage);
 }
 
 void LVDocView::updateBookMarksRanges()
 {
     checkRender();
     LVLock lock(getMutex());
-    clearImageCache();
     ldomXRangeList ranges;
     CRFileHistRecord * rec = m_bookmarksPercents.length() ? getCurrentFileHistRecord() : NULL;
-    if (!rec) {
-        m_bmkRanges.clear();
-        return;
-    }
-    int page_index = getCurPage();
+    int page_index = rec ? getCurPage() : -1;
     if (page_index >= 0 && page_index < m_bookmarksPercents.length()) {
         LVPtrVector < CRBookmark > &bookmarks = rec->getBookmarks();
         LVRef < ldomXRange > page = getPageDocumentRange();
@@ -2805,7 +3118,13 @@ void LVDocView::updateBookMarksRanges()
             }
         }
     }
-    ranges.getRanges(m_bmkRanges);
+    ldomMarkedRangeList oldRanges(m_bmkRanges);
+    LVArray<lvRect> oldRects(m_bmkRects);
+    ranges.getRanges(m_bmkRanges, &m_bmkRects);
+    LVArray<lvRect> damage;
+    addChangedMarkRects(oldRanges, oldRects, m_bmkRanges, damage);
+    addChangedMarkRects(m_bmkRanges, m_bmkRects, oldRanges, damage);
+    invalidatePageImage(false, damage);
 }
 
 /// set view mode (pages/scroll)
@@ -3161,6 +3480,7 @@ static void FileToArcProps(CRPropRef props) {
 bool LVDocView::LoadDocument(const lChar16 * fname) {
 	if (!fname || !fname[0])
 		return false;
+	CR_PROFILE_SCOPE(CRPROF_LOAD_DOCUMENT);
 
 	Clear();
 
@@ -3369,6 +3689,7 @@ void LVDocView::createDefaultDocument(lString16 title, lString16 message) {
 
 /// load document from stream
 bool LVDocView::LoadDocument(LVStreamRef stream) {
+	CR_PROFILE_SCOPE(CRPROF_LOAD_DOCUMENT);
 	m_swapDone = false;
 
 	setRenderProps(0, 0); // to allow apply styles and rend method while loading
@@ -3723,6 +4044,8 @@ void LVDocView::createEmptyDocument() {
 	m_cursorPos.clear();
 	m_markRanges.clear();
         m_bmkRanges.clear();
+	m_markRects.clear();
+	m_bmkRects.clear();
 	_posBookmark.clear();
 	m_section_bounds.clear();
 	m_section_bounds_valid = false;
@@ -3773,6 +4096,7 @@ void LVDocView::insertBookmarkPercentInfo(int start_page, int end_y, int percent
 }
 
 bool LVDocView::ParseDocument() {
+	CR_PROFILE_SCOPE(CRPROF_PARSE);
 
 	createEmptyDocument();
 
@@ -5038,7 +5362,8 @@ void LVDocView::propsUpdateDefaults(CRPropRef props) {
 	props->limitValueList(PROP_SHOW_TIME, bool_options_def_false, 2);
 	props->limitValueList(PROP_DISPLAY_INVERSE, bool_options_def_false, 2);
 	props->limitValueList(PROP_BOOKMARK_ICONS, bool_options_def_false, 2);
-	props->limitValueList(PROP_FONT_KERNING_ENABLED, bool_options_def_false, 2);
+	props->limitValueList(PROP_FONT_KERNING_ENABLED, bool_options_def_true, 2);
+	props->limitValueList(PROP_FONT_LIGATURES_ENABLED, bool_options_def_false, 2);
     //props->limitValueList(PROP_FLOATING_PUNCTUATION, bool_options_def_true, 2);
         props->limitValueList(PROP_HIGHLIGHT_COMMENT_BOOKMARKS, bool_options_def_true, 2);
     static int def_status_line[] = { 0, 1, 2 };
@@ -5091,6 +5416,14 @@ void LVDocView::propsUpdateDefaults(CRPropRef props) {
     props->setIntDef(PROP_IMG_SCALING_ZOOMOUT_INLINE_MODE, defImgScaling.mode);
     props->setIntDef(PROP_IMG_SCALING_ZOOMIN_BLOCK_MODE, defImgScaling.mode);
     props->setIntDef(PROP_IMG_SCALING_ZOOMIN_INLINE_MODE, defImgScaling.mode);
+    props->setIntDef(PROP_IMG_SCALING_ZOOMOUT_BLOCK_QUALITY, defImgScaling.quality);
+    props->setIntDef(PROP_IMG_SCALING_ZOOMOUT_INLINE_QUALITY, defImgScaling.quality);
+    props->setIntDef(PROP_IMG_SCALING_ZOOMIN_BLOCK_QUALITY, defImgScaling.quality);
+    props->setIntDef(PROP_IMG_SCALING_ZOOMIN_INLINE_QUALITY, defImgScaling.quality);
+    props->setIntDef(PROP_IMG_DITHERING, IMAGE_DITHERING_DEFAULT);
+    char gammaBuf[16];
+    sprintf(gammaBuf, "%g", cr_gamma_levels[IMAGE_DITHERING_GAMMA_DEFAULT]);
+    props->setStringDef(PROP_IMG_DITHERING_GAMMA, gammaBuf);
 
     int p = props->getIntDef(PROP_FORMAT_MIN_SPACE_CONDENSING_PERCENT, DEF_MIN_SPACE_CONDENSING_PERCENT);
     if (p<25)
@@ -5155,14 +5488,39 @@ CRPropRef LVDocView::propsApply(CRPropRef props) {
                 fontMan->SetGamma(gamma);
                 clearImageCache();
             }
+        } else if (name == PROP_IMG_DITHERING) {
+            int dithering = props->getIntDef(PROP_IMG_DITHERING, IMAGE_DITHERING_DEFAULT);
+            if (dithering < IMG_DITHERING_SIMPLE || dithering > IMG_DITHERING_ERROR_DIFFUSION)
+                dithering = IMG_DITHERING_SIMPLE;
+            m_imageDithering = (img_dithering_t)dithering;
+            clearImageCache();
+        } else if (name == PROP_IMG_DITHERING_GAMMA) {
+            double gamma = 1.0;
+            lString8 s8 = UnicodeToUtf8(props->getStringDef(PROP_IMG_DITHERING_GAMMA, "1.0"));
+            if ( sscanf(s8.c_str(), "%lf", &gamma)==1 ) {
+                // nearest gamma level from gammatbl.h
+                int index = 0;
+                for ( int i=1; i<GAMMA_LEVELS; i++ ) {
+                    double d = cr_gamma_levels[i] - gamma;
+                    double best = cr_gamma_levels[index] - gamma;
+                    if ( d*d < best*best )
+                        index = i;
+                }
+                m_imageDitheringGamma = index;
+                clearImageCache();
+            }
         } else if (name == PROP_LANDSCAPE_PAGES) {
 			int pages = props->getIntDef(PROP_LANDSCAPE_PAGES, 0);
 			setVisiblePageCount(pages);
 			requestRender();
 		} else if (name == PROP_FONT_KERNING_ENABLED) {
-			bool kerning = props->getBoolDef(PROP_FONT_KERNING_ENABLED, false);
+			bool kerning = props->getBoolDef(PROP_FONT_KERNING_ENABLED, true);
 			fontMan->setKerning(kerning);
 			requestRender();
+		} else if (name == PROP_FONT_LIGATURES_ENABLED) {
+			bool ligatures = props->getBoolDef(PROP_FONT_LIGATURES_ENABLED, false);
+			fontMan->setLigatures(ligatures);
+			requestRender();
 		} else if (name == PROP_FONT_WEIGHT_EMBOLDEN) {
 			bool embolden = props->getBoolDef(PROP_FONT_WEIGHT_EMBOLDEN, false);
 			int v = embolden ? STYLE_FONT_EMBOLD_MODE_EMBOLD
@@ -5180,6 +5538,8 @@ CRPropRef LVDocView::propsApply(CRPropRef props) {
                    || name == PROP_IMG_SCALING_ZOOMOUT_INLINE_SCALE || name == PROP_IMG_SCALING_ZOOMOUT_INLINE_MODE
                    || name == PROP_IMG_SCALING_ZOOMIN_BLOCK_SCALE || name == PROP_IMG_SCALING_ZOOMIN_BLOCK_MODE
                    || name == PROP_IMG_SCALING_ZOOMOUT_BLOCK_SCALE || name == PROP_IMG_SCALING_ZOOMOUT_BLOCK_MODE
+                   || name == PROP_IMG_SCALING_ZOOMIN_INLINE_QUALITY || name == PROP_IMG_SCALING_ZOOMOUT_INLINE_QUALITY
+                   || name == PROP_IMG_SCALING_ZOOMIN_BLOCK_QUALITY || name == PROP_IMG_SCALING_ZOOMOUT_BLOCK_QUALITY
                    ) {
             m_props->setString(name.c_str(), value);
             requestRender();
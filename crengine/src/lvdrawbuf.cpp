@@ -15,7 +15,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include "../include/lvdrawbuf.h"
+#include "../include/gammatbl.h"
+
+#if (CR_SIMD_BLEND_ENABLED==1) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define LVBLEND_NEON 1
+#include <arm_neon.h>
+#elif (CR_SIMD_BLEND_ENABLED==1) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2))
+#define LVBLEND_SSE2 1
+#include <emmintrin.h>
+#endif
 
 void LVDrawBuf::RoundRect( int x0, int y0, int x1, int y1, int borderWidth, int radius, lUInt32 color, int cornerFlags )
 {
@@ -26,6 +36,17 @@ void LVDrawBuf::RoundRect( int x0, int y0, int x1, int y1, int borderWidth, int
     // TODO: draw rounded corners
 }
 
+void LVDrawBuf::DrawGlyphRun( const LVDrawBufGlyph * glyphs, int count )
+{
+    lUInt32 oldColor = GetTextColor();
+    for ( int i=0; i<count; i++ ) {
+        const LVDrawBufGlyph & g = glyphs[i];
+        SetTextColor( g.color );
+        Draw( g.x, g.y, g.bitmap, g.width, g.height, NULL );
+    }
+    SetTextColor( oldColor );
+}
+
 static lUInt32 rgbToGray( lUInt32 color )
 {
     lUInt32 r = (0xFF0000 & color) >> 16;
@@ -79,19 +100,353 @@ static void ApplyAlphaRGB( lUInt32 &dst, lUInt32 src, lUInt32 alpha )
     }
 }
 
-static void ApplyAlphaGray( lUInt8 &dst, lUInt8 src, lUInt32 alpha, int bpp )
+/// scalar glyph span kernel for 8bpp gray buffer (or 3/4bpp with 1 pixel per byte)
+static void blendGlyphSpanGrayScalar( lUInt8 * dst, const lUInt8 * src, int count, lUInt8 color, lUInt8 mask )
 {
-    if ( alpha==0 )
-        dst = src;
-    else if ( alpha<255 ) {
-        int mask = ((1<<bpp)-1) << (8-bpp);
-        src &= mask;
-        lUInt32 opaque = 256 - alpha;
-        lUInt32 n1 = ((dst * alpha + src * opaque)>>8 ) & mask;
-        dst = (lUInt8)n1;
+    for ( ; count>0; count-- ) {
+        lUInt8 b = (*src++);
+        if ( b>=mask )
+            *dst = color;
+        else if ( b>1 ) // alpha 255 is ignored
+            *dst = (lUInt8)((((*dst) * (256 - b) + color * b)>>8) & mask);
+        dst++;
+    }
+}
+
+/// scalar glyph span kernel for RGB565 buffer, 16 coverage levels
+static void blendGlyphSpan565Scalar( lUInt16 * dst, const lUInt8 * src, int count, lUInt16 color )
+{
+    for ( ; count>0; count-- ) {
+        lUInt32 opaque = ((*(src++))>>4)&0x0F;
+        if ( opaque>=0xF )
+            *dst = color;
+        else if ( opaque>0 ) {
+            lUInt32 alpha = 0xF-opaque;
+            lUInt16 cl1 = (lUInt16)(((alpha*((*dst)&0xF81F) + opaque*(color&0xF81F))>>4) & 0xF81F);
+            lUInt16 cl2 = (lUInt16)(((alpha*((*dst)&0x07E0) + opaque*(color&0x07E0))>>4) & 0x07E0);
+            *dst = cl1 | cl2;
+        }
+        dst++;
     }
 }
 
+/// scalar glyph span kernel for 32bpp buffer, 128 coverage levels
+static void blendGlyphSpan32Scalar( lUInt32 * dst, const lUInt8 * src, int count, lUInt32 color )
+{
+    lUInt32 color1 = color & 0xFF00FF;
+    lUInt32 color2 = color & 0x00FF00;
+    for ( ; count>0; count-- ) {
+        lUInt32 opaque = ((*(src++))>>1)&0x7F;
+        if ( opaque>=0x78 )
+            *dst = color;
+        else if ( opaque>0 ) {
+            lUInt32 alpha = 0x7F-opaque;
+            lUInt32 cl1 = ((alpha*((*dst)&0xFF00FF) + opaque*color1)>>7) & 0xFF00FF;
+            lUInt32 cl2 = ((alpha*((*dst)&0x00FF00) + opaque*color2)>>7) & 0x00FF00;
+            *dst = cl1 | cl2;
+        }
+        dst++;
+    }
+}
+
+// Vector kernels below give bit-exact scalar results: packed channel arithmetic
+// of scalar kernels never carries between channels, so each channel is computed
+// in separate 16 bit lane as (alpha*dst + opaque*color)>>shift.
+// Blended 32bpp pixels get zero top byte, like in scalar code.
+
+#if (LVBLEND_SSE2==1)
+
+#define LVBLEND_SIMD_NAME "sse2"
+
+/// selects a where mask is set, otherwise b
+static inline __m128i blendSelect( __m128i mask, __m128i a, __m128i b )
+{
+    return _mm_or_si128( _mm_and_si128(mask, a), _mm_andnot_si128(mask, b) );
+}
+
+/// blends 16 gray pixels; skip must be set for coverage <= 1
+static inline __m128i blendGray16( __m128i d, __m128i b, __m128i skip, lUInt8 color, lUInt8 mask )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vcolor8 = _mm_set1_epi8( (char)color );
+    const __m128i vmask8 = _mm_set1_epi8( (char)mask );
+    const __m128i vcolor = _mm_set1_epi16( color );
+    const __m128i v256 = _mm_set1_epi16( 256 );
+    __m128i full = _mm_cmpeq_epi8( _mm_max_epu8(b, vmask8), b ); // b >= mask
+    __m128i blo = _mm_unpacklo_epi8( b, zero );
+    __m128i bhi = _mm_unpackhi_epi8( b, zero );
+    // dst*(256-b) + color*b <= 255*256, so 16 bit sum never overflows
+    __m128i rlo = _mm_add_epi16( _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(v256, blo)), _mm_mullo_epi16(vcolor, blo) );
+    __m128i rhi = _mm_add_epi16( _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(v256, bhi)), _mm_mullo_epi16(vcolor, bhi) );
+    __m128i r = _mm_and_si128( _mm_packus_epi16(_mm_srli_epi16(rlo, 8), _mm_srli_epi16(rhi, 8)), vmask8 );
+    r = blendSelect( full, vcolor8, r );
+    return blendSelect( skip, d, r );
+}
+
+static void blendGlyphSpanGray( lUInt8 * dst, const lUInt8 * src, int count, lUInt8 color, lUInt8 mask )
+{
+    const __m128i vone = _mm_set1_epi8( 1 );
+    for ( ; count>=16; count-=16, src+=16, dst+=16 ) {
+        __m128i b = _mm_loadu_si128( (const __m128i *)src );
+        __m128i skip = _mm_cmpeq_epi8( _mm_max_epu8(b, vone), vone ); // b <= 1
+        if ( _mm_movemask_epi8(skip)==0xFFFF )
+            continue;
+        __m128i d = _mm_loadu_si128( (const __m128i *)dst );
+        _mm_storeu_si128( (__m128i *)dst, blendGray16(d, b, skip, color, mask) );
+    }
+    if ( count>=8 ) {
+        // upper half is zero coverage, and is not stored
+        __m128i b = _mm_loadl_epi64( (const __m128i *)src );
+        __m128i skip = _mm_cmpeq_epi8( _mm_max_epu8(b, vone), vone );
+        if ( _mm_movemask_epi8(skip)!=0xFFFF ) {
+            __m128i d = _mm_loadl_epi64( (const __m128i *)dst );
+            _mm_storel_epi64( (__m128i *)dst, blendGray16(d, b, skip, color, mask) );
+        }
+        count -= 8;
+        src += 8;
+        dst += 8;
+    }
+    blendGlyphSpanGrayScalar( dst, src, count, color, mask );
+}
+
+static void blendGlyphSpan565( lUInt16 * dst, const lUInt8 * src, int count, lUInt16 color )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v15 = _mm_set1_epi16( 15 );
+    const __m128i v1F = _mm_set1_epi16( 0x1F );
+    const __m128i v3F = _mm_set1_epi16( 0x3F );
+    const __m128i vcolor = _mm_set1_epi16( (short)color );
+    const __m128i cr = _mm_set1_epi16( (color>>11) & 0x1F );
+    const __m128i cg = _mm_set1_epi16( (color>>5) & 0x3F );
+    const __m128i cb = _mm_set1_epi16( color & 0x1F );
+    for ( ; count>=8; count-=8, src+=8, dst+=8 ) {
+        __m128i opaque = _mm_srli_epi16( _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), zero), 4 );
+        __m128i none = _mm_cmpeq_epi16( opaque, zero );
+        if ( _mm_movemask_epi8(none)==0xFFFF )
+            continue;
+        __m128i full = _mm_cmpeq_epi16( opaque, v15 );
+        __m128i alpha = _mm_sub_epi16( v15, opaque );
+        __m128i d = _mm_loadu_si128( (const __m128i *)dst );
+        __m128i r = _mm_srli_epi16( _mm_add_epi16(_mm_mullo_epi16(alpha, _mm_srli_epi16(d, 11)), _mm_mullo_epi16(opaque, cr)), 4 );
+        __m128i g = _mm_srli_epi16( _mm_add_epi16(_mm_mullo_epi16(alpha, _mm_and_si128(_mm_srli_epi16(d, 5), v3F)), _mm_mullo_epi16(opaque, cg)), 4 );
+        __m128i b = _mm_srli_epi16( _mm_add_epi16(_mm_mullo_epi16(alpha, _mm_and_si128(d, v1F)), _mm_mullo_epi16(opaque, cb)), 4 );
+        __m128i res = _mm_or_si128( _mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b );
+        res = blendSelect( full, vcolor, res );
+        res = blendSelect( none, d, res );
+        _mm_storeu_si128( (__m128i *)dst, res );
+    }
+    blendGlyphSpan565Scalar( dst, src, count, color );
+}
+
+static void blendGlyphSpan32( lUInt32 * dst, const lUInt8 * src, int count, lUInt32 color )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v7F = _mm_set1_epi8( 0x7F );
+    const __m128i v77 = _mm_set1_epi8( 0x77 );
+    const __m128i v127 = _mm_set1_epi16( 127 );
+    const __m128i rgbMask = _mm_set1_epi32( 0x00FFFFFF );
+    const __m128i vcolor = _mm_set1_epi32( (int)color );
+    const __m128i clo = _mm_unpacklo_epi8( vcolor, zero );
+    for ( ; count>=4; count-=4, src+=4, dst+=4 ) {
+        lUInt32 s4 = src[0] | (src[1]<<8) | (src[2]<<16) | ((lUInt32)src[3]<<24);
+        if ( !(s4 & 0xFEFEFEFE) )
+            continue; // zero opaque for all 4 pixels
+        // opaque of each pixel repeated for all 4 channel bytes
+        __m128i opaque = _mm_and_si128( _mm_srli_epi16(_mm_cvtsi32_si128((int)s4), 1), v7F );
+        opaque = _mm_unpacklo_epi8( opaque, opaque );
+        opaque = _mm_unpacklo_epi16( opaque, opaque );
+        __m128i full = _mm_cmpgt_epi8( opaque, v77 ); // opaque >= 0x78
+        __m128i none = _mm_cmpeq_epi8( opaque, zero );
+        __m128i d = _mm_loadu_si128( (const __m128i *)dst );
+        __m128i olo = _mm_unpacklo_epi8( opaque, zero );
+        __m128i ohi = _mm_unpackhi_epi8( opaque, zero );
+        __m128i rlo = _mm_add_epi16( _mm_mullo_epi16(_mm_sub_epi16(v127, olo), _mm_unpacklo_epi8(d, zero)), _mm_mullo_epi16(olo, clo) );
+        __m128i rhi = _mm_add_epi16( _mm_mullo_epi16(_mm_sub_epi16(v127, ohi), _mm_unpackhi_epi8(d, zero)), _mm_mullo_epi16(ohi, clo) );
+        __m128i res = _mm_and_si128( _mm_packus_epi16(_mm_srli_epi16(rlo, 7), _mm_srli_epi16(rhi, 7)), rgbMask );
+        res = blendSelect( full, vcolor, res );
+        res = blendSelect( none, d, res );
+        _mm_storeu_si128( (__m128i *)dst, res );
+    }
+    blendGlyphSpan32Scalar( dst, src, count, color );
+}
+
+#elif (LVBLEND_NEON==1)
+
+#define LVBLEND_SIMD_NAME "neon"
+
+/// blends 16 gray pixels; skip must be set for coverage <= 1
+static inline uint8x16_t blendGray16( uint8x16_t d, uint8x16_t b, uint8x16_t skip, lUInt8 color, lUInt8 mask )
+{
+    const uint8x8_t vcolor = vdup_n_u8( color );
+    uint8x16_t full = vcgeq_u8( b, vdupq_n_u8(mask) );
+    // dst*(256-b) + color*b = (dst<<8) - dst*b + color*b, final sum fits into 16 bits
+    uint16x8_t rlo = vshll_n_u8( vget_low_u8(d), 8 );
+    uint16x8_t rhi = vshll_n_u8( vget_high_u8(d), 8 );
+    rlo = vmlal_u8( vmlsl_u8(rlo, vget_low_u8(d), vget_low_u8(b)), vcolor, vget_low_u8(b) );
+    rhi = vmlal_u8( vmlsl_u8(rhi, vget_high_u8(d), vget_high_u8(b)), vcolor, vget_high_u8(b) );
+    uint8x16_t r = vandq_u8( vcombine_u8(vshrn_n_u16(rlo, 8), vshrn_n_u16(rhi, 8)), vdupq_n_u8(mask) );
+    r = vbslq_u8( full, vdupq_n_u8(color), r );
+    return vbslq_u8( skip, d, r );
+}
+
+/// returns true if all bytes of mask are set
+static inline bool blendAllSet( uint8x16_t mask )
+{
+    uint64x2_t m = vreinterpretq_u64_u8( mask );
+    return (vgetq_lane_u64(m, 0) & vgetq_lane_u64(m, 1))==~(lUInt64)0;
+}
+
+static void blendGlyphSpanGray( lUInt8 * dst, const lUInt8 * src, int count, lUInt8 color, lUInt8 mask )
+{
+    const uint8x16_t vone = vdupq_n_u8( 1 );
+    for ( ; count>=16; count-=16, src+=16, dst+=16 ) {
+        uint8x16_t b = vld1q_u8( src );
+        uint8x16_t skip = vcleq_u8( b, vone );
+        if ( blendAllSet(skip) )
+            continue;
+        vst1q_u8( dst, blendGray16(vld1q_u8(dst), b, skip, color, mask) );
+    }
+    if ( count>=8 ) {
+        // upper half is zero coverage, and is not stored
+        uint8x16_t b = vcombine_u8( vld1_u8(src), vdup_n_u8(0) );
+        uint8x16_t skip = vcleq_u8( b, vone );
+        if ( !blendAllSet(skip) ) {
+            uint8x16_t d = vcombine_u8( vld1_u8(dst), vdup_n_u8(0) );
+            vst1_u8( dst, vget_low_u8(blendGray16(d, b, skip, color, mask)) );
+        }
+        count -= 8;
+        src += 8;
+        dst += 8;
+    }
+    blendGlyphSpanGrayScalar( dst, src, count, color, mask );
+}
+
+static void blendGlyphSpan565( lUInt16 * dst, const lUInt8 * src, int count, lUInt16 color )
+{
+    const uint16x8_t v15 = vdupq_n_u16( 15 );
+    const uint16x8_t v1F = vdupq_n_u16( 0x1F );
+    const uint16x8_t v3F = vdupq_n_u16( 0x3F );
+    const uint16x8_t vcolor = vdupq_n_u16( color );
+    const uint16x8_t cr = vdupq_n_u16( (color>>11) & 0x1F );
+    const uint16x8_t cg = vdupq_n_u16( (color>>5) & 0x3F );
+    const uint16x8_t cb = vdupq_n_u16( color & 0x1F );
+    for ( ; count>=8; count-=8, src+=8, dst+=8 ) {
+        uint8x8_t opaque8 = vshr_n_u8( vld1_u8(src), 4 );
+        if ( vget_lane_u64(vreinterpret_u64_u8(opaque8), 0)==0 )
+            continue;
+        uint16x8_t opaque = vmovl_u8( opaque8 );
+        uint16x8_t full = vceqq_u16( opaque, v15 );
+        uint16x8_t none = vceqq_u16( opaque, vdupq_n_u16(0) );
+        uint16x8_t alpha = vsubq_u16( v15, opaque );
+        uint16x8_t d = vld1q_u16( dst );
+        uint16x8_t r = vshrq_n_u16( vmlaq_u16(vmulq_u16(alpha, vshrq_n_u16(d, 11)), opaque, cr), 4 );
+        uint16x8_t g = vshrq_n_u16( vmlaq_u16(vmulq_u16(alpha, vandq_u16(vshrq_n_u16(d, 5), v3F)), opaque, cg), 4 );
+        uint16x8_t b = vshrq_n_u16( vmlaq_u16(vmulq_u16(alpha, vandq_u16(d, v1F)), opaque, cb), 4 );
+        uint16x8_t res = vorrq_u16( vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b );
+        res = vbslq_u16( full, vcolor, res );
+        res = vbslq_u16( none, d, res );
+        vst1q_u16( dst, res );
+    }
+    blendGlyphSpan565Scalar( dst, src, count, color );
+}
+
+static void blendGlyphSpan32( lUInt32 * dst, const lUInt8 * src, int count, lUInt32 color )
+{
+    static const lUInt8 spreadLo[8] = { 0, 0, 0, 0, 1, 1, 1, 1 };
+    static const lUInt8 spreadHi[8] = { 2, 2, 2, 2, 3, 3, 3, 3 };
+    const uint8x8_t idxLo = vld1_u8( spreadLo );
+    const uint8x8_t idxHi = vld1_u8( spreadHi );
+    const uint8x8_t v127 = vdup_n_u8( 127 );
+    const uint8x16_t vcolor = vreinterpretq_u8_u32( vdupq_n_u32(color) );
+    const uint8x8_t c = vget_low_u8( vcolor );
+    const uint8x16_t rgbMask = vreinterpretq_u8_u32( vdupq_n_u32(0x00FFFFFF) );
+    for ( ; count>=4; count-=4, src+=4, dst+=4 ) {
+        lUInt32 s4 = src[0] | (src[1]<<8) | (src[2]<<16) | ((lUInt32)src[3]<<24);
+        if ( !(s4 & 0xFEFEFEFE) )
+            continue; // zero opaque for all 4 pixels
+        // opaque of each pixel repeated for all 4 channel bytes
+        uint8x8_t opaque4 = vshr_n_u8( vreinterpret_u8_u32(vdup_n_u32(s4)), 1 );
+        uint8x8_t olo = vtbl1_u8( opaque4, idxLo );
+        uint8x8_t ohi = vtbl1_u8( opaque4, idxHi );
+        uint8x16_t opaque = vcombine_u8( olo, ohi );
+        uint8x16_t full = vcgeq_u8( opaque, vdupq_n_u8(0x78) );
+        uint8x16_t none = vceqq_u8( opaque, vdupq_n_u8(0) );
+        uint8x16_t d = vreinterpretq_u8_u32( vld1q_u32((const uint32_t *)dst) );
+        uint16x8_t rlo = vmlal_u8( vmull_u8(vsub_u8(v127, olo), vget_low_u8(d)), olo, c );
+        uint16x8_t rhi = vmlal_u8( vmull_u8(vsub_u8(v127, ohi), vget_high_u8(d)), ohi, c );
+        uint8x16_t res = vandq_u8( vcombine_u8(vshrn_n_u16(rlo, 7), vshrn_n_u16(rhi, 7)), rgbMask );
+        res = vbslq_u8( full, vcolor, res );
+        res = vbslq_u8( none, d, res );
+        vst1q_u32( (uint32_t *)dst, vreinterpretq_u32_u8(res) );
+    }
+    blendGlyphSpan32Scalar( dst, src, count, color );
+}
+
+#else
+
+#define LVBLEND_SIMD_NAME "none"
+
+static void blendGlyphSpanGray( lUInt8 * dst, const lUInt8 * src, int count, lUInt8 color, lUInt8 mask )
+{
+    blendGlyphSpanGrayScalar( dst, src, count, color, mask );
+}
+
+static void blendGlyphSpan565( lUInt16 * dst, const lUInt8 * src, int count, lUInt16 color )
+{
+    blendGlyphSpan565Scalar( dst, src, count, color );
+}
+
+static void blendGlyphSpan32( lUInt32 * dst, const lUInt8 * src, int count, lUInt32 color )
+{
+    blendGlyphSpan32Scalar( dst, src, count, color );
+}
+
+#endif
+
+/// clips glyph bitmap by clip rect; bx, by are set to offset of visible part inside bitmap; returns false if nothing to draw
+static bool clipGlyphBitmap( const lvRect & clip, int bufHeight, bool hidePartialGlyphs,
+                             int & x, int & y, int & width, int & height, int & bx, int & by )
+{
+    int initial_height = height;
+    bx = 0;
+    by = 0;
+    if (x<clip.left)
+    {
+        width += x-clip.left;
+        bx -= x-clip.left;
+        x = clip.left;
+        if (width<=0)
+            return false;
+    }
+    if (y<clip.top)
+    {
+        height += y-clip.top;
+        by -= y-clip.top;
+        y = clip.top;
+        if (hidePartialGlyphs && height<=initial_height/2) // HIDE PARTIAL VISIBLE GLYPHS
+            return false;
+        if (height<=0)
+            return false;
+    }
+    if (x + width > clip.right)
+    {
+        width = clip.right - x;
+    }
+    if (width<=0)
+        return false;
+    if (y + height > clip.bottom)
+    {
+        if (hidePartialGlyphs && height<=initial_height/2) // HIDE PARTIAL VISIBLE GLYPHS
+            return false;
+        int clip_bottom = clip.bottom;
+        if ( hidePartialGlyphs )
+            clip_bottom = bufHeight;
+        if ( y+height > clip_bottom)
+            height = clip_bottom - y;
+    }
+    return height>0;
+}
+
 static const short dither_2bpp_4x4[] = {
     5, 13,  8,  16,
     9,  1,  12,  4,
@@ -171,6 +526,119 @@ lUInt32 Dither1BitColor( lUInt32 color, lUInt32 x, lUInt32 y )
     return (cl >> 7) & 1;
 }
 
+/// max value of linear light used for gamma correct dithering
+#define DITHER_LINEAR_MAX 4095
+
+/// quantizes rows of gray pixels to 1..4 bpp with ordered (8x8 Bayer) or Floyd-Steinberg dithering
+/**
+    Gray values and levels of buffer are compared in linear light, converted using gamma level
+    from gammatbl.h, so that dithered area has the same brightness as source.
+    Results are pixel values of gray buffer: 0..1 for 1 bpp, 0..3 for 2 bpp,
+    higher bits of byte for 3 and 4 bpp (inverted if GRAY_INVERSE==1).
+*/
+class LVGrayRowDitherer
+{
+    img_dithering_t _mode;
+    int _maxLevel;
+    int _width;
+    int _linear[256];                       // gray value -> linear light
+    int _levelLinear[16];                   // level -> linear light
+    lUInt8 _pixel[16];                      // level -> buffer pixel value
+    lUInt8 _level[256];                     // ordered: level below gray value
+    lUInt8 _fraction[256];                  // ordered: distance from this level to next one, 0..64
+    lUInt8 _nearest[DITHER_LINEAR_MAX+1];   // error diffusion: nearest level for linear light value
+    int * _buffer;                          // error diffusion: errors for two rows
+    int * _errors;                          // errors for current row, *16
+    int * _nextErrors;                      // errors for next row, *16
+    bool _reverse;                          // error diffusion: serpentine scan direction
+public:
+    LVGrayRowDitherer( img_dithering_t mode, int bits, int gammaIndex, int width )
+        : _mode(mode), _maxLevel((1<<bits)-1), _width(width), _buffer(NULL), _errors(NULL), _nextErrors(NULL), _reverse(false)
+    {
+        if ( gammaIndex < 0 )
+            gammaIndex = 0;
+        if ( gammaIndex >= GAMMA_LEVELS )
+            gammaIndex = GAMMA_LEVELS - 1;
+        double gamma = cr_gamma_levels[gammaIndex];
+        for ( int v=0; v<256; v++ )
+            _linear[v] = (int)(pow( v / 255.0, gamma ) * DITHER_LINEAR_MAX + 0.5);
+        for ( int k=0; k<=_maxLevel; k++ ) {
+            _levelLinear[k] = _linear[(k * 255 + _maxLevel / 2) / _maxLevel];
+#if (GRAY_INVERSE==1)
+            int pixel = _maxLevel - k;
+#else
+            int pixel = k;
+#endif
+            _pixel[k] = (lUInt8)(bits > 2 ? pixel << (8 - bits) : pixel);
+        }
+        if ( _mode == IMG_DITHERING_ERROR_DIFFUSION ) {
+            int k = 0;
+            for ( int l=0; l<=DITHER_LINEAR_MAX; l++ ) {
+                while ( k < _maxLevel && _levelLinear[k+1] - l < l - _levelLinear[k] )
+                    k++;
+                _nearest[l] = (lUInt8)k;
+            }
+            _buffer = (int*)calloc( (width + 2) * 2, sizeof(int) );
+            _errors = _buffer;
+            _nextErrors = _buffer + width + 2;
+        } else {
+            for ( int v=0; v<256; v++ ) {
+                int k = 0;
+                while ( k < _maxLevel - 1 && _levelLinear[k+1] <= _linear[v] )
+                    k++;
+                int range = _levelLinear[k+1] - _levelLinear[k];
+                int fraction = range > 0 ? ((_linear[v] - _levelLinear[k]) * 64 + range / 2) / range : 64;
+                _level[v] = (lUInt8)k;
+                _fraction[v] = (lUInt8)(fraction < 0 ? 0 : (fraction > 64 ? 64 : fraction));
+            }
+        }
+    }
+    ~LVGrayRowDitherer()
+    {
+        if ( _buffer )
+            free( _buffer );
+    }
+    /// converts row of gray values 0..255 to buffer pixel values; pixels with negative gray value are skipped
+    void ditherRow( const int * gray, lUInt8 * pixels, int y )
+    {
+        if ( _mode != IMG_DITHERING_ERROR_DIFFUSION ) {
+            const short * matrix = dither_2bpp_8x8 + ((y & 7) << 3);
+            for ( int x=0; x<_width; x++ ) {
+                int v = gray[x];
+                if ( v < 0 )
+                    continue;
+                pixels[x] = _pixel[ _level[v] + (_fraction[v] > matrix[x & 7] ? 1 : 0) ];
+            }
+            return;
+        }
+        // errors are indexed from -1 to width
+        int * cur = _errors + 1;
+        int * next = _nextErrors + 1;
+        memset( _nextErrors, 0, (_width + 2) * sizeof(int) );
+        int dir = _reverse ? -1 : 1;
+        int x = _reverse ? _width - 1 : 0;
+        for ( int i=0; i<_width; i++, x += dir ) {
+            if ( gray[x] < 0 )
+                continue;
+            int v = _linear[gray[x]] + ((cur[x] + 8) >> 4);
+            if ( v < 0 )
+                v = 0;
+            else if ( v > DITHER_LINEAR_MAX )
+                v = DITHER_LINEAR_MAX;
+            int k = _nearest[v];
+            pixels[x] = _pixel[k];
+            int err = v - _levelLinear[k];
+            cur[x + dir] += err * 7;
+            next[x - dir] += err * 3;
+            next[x] += err * 5;
+            next[x + dir] += err;
+        }
+        _nextErrors = _errors;
+        _errors = next - 1;
+        _reverse = !_reverse;
+    }
+};
+
 static lUInt8 revByteBits1( lUInt8 b )
 {
     return ( (b&1)<<7 )
@@ -179,8 +647,8 @@ static lUInt8 revByteBits1( lUInt8 b )
         |  ( (b&8)<<1 )
         |  ( (b&16)>>1 )
         |  ( (b&32)>>3 )
-        |  ( (b&64)>>4 )
-        |  ( (b&128)>>5 );
+        |  ( (b&64)>>5 )
+        |  ( (b&128)>>7 );
 }
 
 lUInt8 revByteBits2( lUInt8 b )
@@ -191,6 +659,143 @@ lUInt8 revByteBits2( lUInt8 b )
         |  ( (b&0xC0)>>6 );
 }
 
+/// size of square tile for rotation by 90 degrees, in pixels (multiple of 8)
+#define ROTATE_TILE_SIZE 32
+/// buffers with at least this number of pixels are rotated by several threads
+#define ROTATE_THREAD_MIN_PIXELS 0x80000
+
+/// source and destination of rotation by 90 degrees
+struct LVRotateJob {
+    const lUInt8 * src;
+    int srcRowSize;
+    int dx;         ///< source width, destination height
+    int dy;         ///< source height, destination width
+    lUInt8 * dst;
+    int dstRowSize;
+    int bpp;        ///< 1, 2 (packed), 8 (one byte per pixel, for 3..8 bpp gray), 16 or 32
+    bool cw;        ///< dst(x, y) = src(y, dy-1-x) if true, src(dx-1-y, x) otherwise
+};
+
+/// rotates pixels of whole bytes, words or dwords into destination rows y0..y1-1, tile by tile
+template <class T> static void rotateTilesT( const LVRotateJob & job, int y0, int y1 )
+{
+    int step = job.cw ? -job.srcRowSize : job.srcRowSize;
+    for ( int ty=y0; ty<y1; ty+=ROTATE_TILE_SIZE ) {
+        int ty1 = ty + ROTATE_TILE_SIZE < y1 ? ty + ROTATE_TILE_SIZE : y1;
+        for ( int tx=0; tx<job.dy; tx+=ROTATE_TILE_SIZE ) {
+            int tx1 = tx + ROTATE_TILE_SIZE < job.dy ? tx + ROTATE_TILE_SIZE : job.dy;
+            int sy = job.cw ? job.dy - 1 - tx : tx;
+            for ( int y=ty; y<ty1; y++ ) {
+                int sx = job.cw ? y : job.dx - 1 - y;
+                const lUInt8 * s = job.src + job.srcRowSize * sy + sx * sizeof(T);
+                T * d = (T*)(job.dst + job.dstRowSize * y);
+                for ( int x=tx; x<tx1; x++ ) {
+                    d[x] = *(const T*)s;
+                    s += step;
+                }
+            }
+        }
+    }
+}
+
+/// rotates 1 or 2 bpp packed pixels into destination rows y0..y1-1, tile by tile; each destination byte is assembled at once
+static void rotateTilesPacked( const LVRotateJob & job, int y0, int y1 )
+{
+    int bpp = job.bpp;
+    int ppb = 8 / bpp;
+    lUInt8 topMask = (lUInt8)(0xFF << (8 - bpp));
+    int step = job.cw ? -job.srcRowSize : job.srcRowSize;
+    int dstBytes = (job.dy * bpp + 7) >> 3;
+    for ( int ty=y0; ty<y1; ty+=ROTATE_TILE_SIZE ) {
+        int ty1 = ty + ROTATE_TILE_SIZE < y1 ? ty + ROTATE_TILE_SIZE : y1;
+        for ( int tx=0; tx<dstBytes; tx+=ROTATE_TILE_SIZE/8 ) {
+            int tx1 = tx + ROTATE_TILE_SIZE/8 < dstBytes ? tx + ROTATE_TILE_SIZE/8 : dstBytes;
+            for ( int y=ty; y<ty1; y++ ) {
+                int sx = (job.cw ? y : job.dx - 1 - y) * bpp;
+                int shift = sx & 7;
+                lUInt8 * d = job.dst + job.dstRowSize * y;
+                for ( int x=tx; x<tx1; x++ ) {
+                    int px = x * ppb;
+                    int n = job.dy - px < ppb ? job.dy - px : ppb;
+                    int sy = job.cw ? job.dy - 1 - px : px;
+                    const lUInt8 * s = job.src + job.srcRowSize * sy + (sx >> 3);
+                    lUInt8 b = 0;
+                    for ( int i=0; i<n; i++ ) {
+                        b |= ((lUInt8)(*s << shift) & topMask) >> (i * bpp);
+                        s += step;
+                    }
+                    d[x] = b;
+                }
+            }
+        }
+    }
+}
+
+static void rotateRows( const LVRotateJob & job, int y0, int y1 )
+{
+    switch ( job.bpp ) {
+    case 1:
+    case 2:
+        rotateTilesPacked( job, y0, y1 );
+        break;
+    case 16:
+        rotateTilesT<lUInt16>( job, y0, y1 );
+        break;
+    case 32:
+        rotateTilesT<lUInt32>( job, y0, y1 );
+        break;
+    default:
+        rotateTilesT<lUInt8>( job, y0, y1 );
+        break;
+    }
+}
+
+#if (CR_USE_THREADS==1) && (CR_ROTATE_THREADS>1)
+/// rotates part of destination rows in separate thread
+class LVRotateThread : public LVThread
+{
+    const LVRotateJob & _job;
+    int _y0;
+    int _y1;
+protected:
+    virtual void run()
+    {
+        rotateRows( _job, _y0, _y1 );
+    }
+public:
+    LVRotateThread( const LVRotateJob & job, int y0, int y1 ) : _job(job), _y0(y0), _y1(y1) { }
+};
+#endif
+
+/// rotates by 90 degrees; large buffers are split by destination rows between CR_ROTATE_THREADS threads
+static void rotatePixels( const LVRotateJob & job )
+{
+#if (CR_USE_THREADS==1) && (CR_ROTATE_THREADS>1)
+    if ( job.dx * job.dy >= ROTATE_THREAD_MIN_PIXELS ) {
+        // parts are aligned to tiles
+        int tiles = (job.dx + ROTATE_TILE_SIZE - 1) / ROTATE_TILE_SIZE;
+        LVRotateThread * threads[CR_ROTATE_THREADS];
+        int y0[CR_ROTATE_THREADS + 1];
+        for ( int i=0; i<=CR_ROTATE_THREADS; i++ ) {
+            y0[i] = tiles * i / CR_ROTATE_THREADS * ROTATE_TILE_SIZE;
+            if ( y0[i] > job.dx )
+                y0[i] = job.dx;
+        }
+        for ( int i=1; i<CR_ROTATE_THREADS; i++ ) {
+            threads[i] = new LVRotateThread( job, y0[i], y0[i+1] );
+            threads[i]->start();
+        }
+        rotateRows( job, y0[0], y0[1] );
+        for ( int i=1; i<CR_ROTATE_THREADS; i++ ) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        return;
+    }
+#endif
+    rotateRows( job, 0, job.dx );
+}
+
 /// rotates buffer contents by specified angle
 void LVGrayDrawBuf::Rotate( cr_rotate_angle_t angle )
 {
@@ -223,32 +828,16 @@ void LVGrayDrawBuf::Rotate( cr_rotate_angle_t angle )
     int newrowsize = _bpp<=2 ? (_dy * _bpp + 7) / 8 : _dy;
     sz = (newrowsize * _dx);
     lUInt8 * dst = (lUInt8 *)malloc(sz);
-    memset( dst, 0, sz );
-    for ( int y=0; y<_dy; y++ ) {
-        lUInt8 * src = _data + _rowsize*y;
-        int dstx, dsty;
-        for ( int x=0; x<_dx; x++ ) {
-            if ( angle==CR_ROTATE_ANGLE_90 ) {
-                dstx = _dy-1-y;
-                dsty = x;
-            } else {
-                dstx = y;
-                dsty = _dx-1-x;
-            }
-            if ( _bpp==DRAW_BUF_1_BPP ) {
-                lUInt8 px = (src[ x >> 3 ] << (x&7)) & 0x80;
-                lUInt8 * dstrow = dst + newrowsize * dsty;
-                dstrow[ dstx >> 3 ] |= (px >> (dstx&7));
-            } else if (_bpp==DRAW_BUF_2_BPP ) {
-                lUInt8 px = (src[ x >> 2 ] << ((x&3)<<1)) & 0xC0;
-                lUInt8 * dstrow = dst + newrowsize * dsty;
-                dstrow[ dstx >> 2 ] |= (px >> ((dstx&3)<<1));
-            } else { // DRAW_BUF_3_BPP, DRAW_BUF_4_BPP, DRAW_BUF_8_BPP
-                lUInt8 * dstrow = dst + newrowsize * dsty;
-                dstrow[ dstx ] = src[ x ];
-            }
-        }
-    }
+    LVRotateJob job;
+    job.src = _data;
+    job.srcRowSize = _rowsize;
+    job.dx = _dx;
+    job.dy = _dy;
+    job.dst = dst;
+    job.dstRowSize = newrowsize;
+    job.bpp = _bpp<=2 ? _bpp : 8;
+    job.cw = angle==CR_ROTATE_ANGLE_90;
+    rotatePixels( job );
     free( _data );
     _data = dst;
     int tmp = _dx;
@@ -281,23 +870,16 @@ void LVColorDrawBuf::Rotate( cr_rotate_angle_t angle )
     #else
         bool cw = angle==CR_ROTATE_ANGLE_90;
     #endif
-        for ( int y=0; y<_dy; y++ ) {
-            lUInt16 * src = (lUInt16*)_data + _dx*y;
-            int nx, ny;
-            if ( cw ) {
-                nx = _dy - 1 - y;
-            } else {
-                nx = y;
-            }
-            for ( int x=0; x<_dx; x++ ) {
-                if ( cw ) {
-                    ny = x;
-                } else {
-                    ny = _dx - 1 - x;
-                }
-                dst[ _dy*ny + nx ] = src[ x ];
-            }
-        }
+        LVRotateJob job;
+        job.src = _data;
+        job.srcRowSize = _rowsize;
+        job.dx = _dx;
+        job.dy = _dy;
+        job.dst = (lUInt8*)dst;
+        job.dstRowSize = newrowsize;
+        job.bpp = 16;
+        job.cw = cw;
+        rotatePixels( job );
     #if !defined(__SYMBIAN32__) && defined(_WIN32)
         memcpy( _data, dst, sz );
         free( dst );
@@ -328,23 +910,16 @@ void LVColorDrawBuf::Rotate( cr_rotate_angle_t angle )
     #else
         bool cw = angle==CR_ROTATE_ANGLE_90;
     #endif
-        for ( int y=0; y<_dy; y++ ) {
-            lUInt32 * src = (lUInt32*)_data + _dx*y;
-            int nx, ny;
-            if ( cw ) {
-                nx = _dy - 1 - y;
-            } else {
-                nx = y;
-            }
-            for ( int x=0; x<_dx; x++ ) {
-                if ( cw ) {
-                    ny = x;
-                } else {
-                    ny = _dx - 1 - x;
-                }
-                dst[ _dy*ny + nx ] = src[ x ];
-            }
-        }
+        LVRotateJob job;
+        job.src = _data;
+        job.srcRowSize = _rowsize;
+        job.dx = _dx;
+        job.dy = _dy;
+        job.dst = (lUInt8*)dst;
+        job.dstRowSize = newrowsize;
+        job.bpp = 32;
+        job.cw = cw;
+        rotatePixels( job );
     #if !defined(__SYMBIAN32__) && defined(_WIN32)
         memcpy( _data, dst, sz );
         free( dst );
@@ -359,6 +934,381 @@ void LVColorDrawBuf::Rotate( cr_rotate_angle_t angle )
     }
 }
 
+#define IMAGE_SCALER_WEIGHT_BITS 14
+#define IMAGE_SCALER_WEIGHT_ONE (1<<IMAGE_SCALER_WEIGHT_BITS)
+#define IMAGE_SCALER_WEIGHT_HALF (1<<(IMAGE_SCALER_WEIGHT_BITS-1))
+
+/// resampling filter for one axis: source pixels contributing to each destination pixel;
+/// fixed point weights of each destination pixel sum up to IMAGE_SCALER_WEIGHT_ONE
+class LVImageScaleAxis
+{
+public:
+    LVArray<int> start;   ///< first contributing source pixel
+    LVArray<int> count;   ///< number of contributing source pixels
+    LVArray<int> offset;  ///< index of first weight of destination pixel
+    LVArray<int> weights;
+    /// area averaging for downscaling, bilinear interpolation for upscaling
+    void init( int srcLen, int dstLen )
+    {
+        start.clear();
+        count.clear();
+        offset.clear();
+        weights.clear();
+        for ( int i=0; i<dstLen; i++ ) {
+            int first = weights.length();
+            offset.add( first );
+            if ( dstLen < srcLen ) {
+                // destination pixel covers [left, right) of source, in 1/dstLen pixel units
+                lInt64 left = (lInt64)i * srcLen;
+                lInt64 right = left + srcLen;
+                int j0 = (int)(left / dstLen);
+                int j1 = (int)((right - 1) / dstLen);
+                int total = 0;
+                int maxIndex = first;
+                for ( int j=j0; j<=j1; j++ ) {
+                    lInt64 l = (lInt64)j * dstLen;
+                    lInt64 r = l + dstLen;
+                    if ( l < left )
+                        l = left;
+                    if ( r > right )
+                        r = right;
+                    int w = (int)(((r - l) * IMAGE_SCALER_WEIGHT_ONE + srcLen / 2) / srcLen);
+                    weights.add( w );
+                    total += w;
+                    if ( w > weights[maxIndex] )
+                        maxIndex = weights.length() - 1;
+                }
+                weights[maxIndex] += IMAGE_SCALER_WEIGHT_ONE - total; // rounding error
+                start.add( j0 );
+                count.add( j1 - j0 + 1 );
+            } else {
+                // source position of pixel center: (i + 0.5) * srcLen / dstLen - 0.5
+                lInt64 pos = ((lInt64)(2 * i + 1) * srcLen * IMAGE_SCALER_WEIGHT_ONE) / (2 * dstLen) - IMAGE_SCALER_WEIGHT_HALF;
+                int j = pos < 0 ? 0 : (int)(pos >> IMAGE_SCALER_WEIGHT_BITS);
+                int frac = pos < 0 ? 0 : (int)(pos & (IMAGE_SCALER_WEIGHT_ONE - 1));
+                if ( j >= srcLen - 1 ) {
+                    j = srcLen - 1;
+                    frac = 0;
+                }
+                start.add( j );
+                weights.add( IMAGE_SCALER_WEIGHT_ONE - frac );
+                if ( frac ) {
+                    weights.add( frac );
+                    count.add( 2 );
+                } else {
+                    count.add( 1 );
+                }
+            }
+        }
+    }
+};
+
+/// decoder callback which resamples image rows to destination size and passes them to another callback
+/**
+    Separable filter: each source row is scaled horizontally, then accumulated into destination rows
+    it contributes to; destination row is passed to target callback as soon as it's complete.
+    Transparent pixels are excluded from averaging of colors.
+    Rows should come in order (restart from row 0, like next pass of interlaced PNG, is allowed);
+    otherwise (interlaced GIF) nearest row is used for vertical scaling.
+*/
+class LVImageSmoothScaleCallback : public LVImageDecoderCallback
+{
+private:
+    LVImageDecoderCallback * target;
+    int src_dx;
+    int src_dy;
+    int dst_dx;
+    int dst_dy;
+    LVImageScaleAxis xaxis;
+    LVImageScaleAxis yaxis;
+    LVArray<lUInt32> hrow;  // horizontally scaled source row
+    LVArray<lUInt32> out;   // complete destination row
+    int window;             // max number of destination rows accumulated at the same time
+    LVArray<lUInt32> acc;   // per destination row slot: B, G, R, A sums for each pixel
+    LVArray<lUInt32> accOpacity; // per destination row slot: sums of weight*opacity for premultiplied slots
+    LVArray<int> slotWeight;
+    LVArray<lUInt8> slotPremultiplied;
+    int nextSrc;
+    int nextDst;
+    bool sequential;
+
+    void init( int srcWidth, int srcHeight )
+    {
+        src_dx = srcWidth;
+        src_dy = srcHeight;
+        if ( src_dx != dst_dx )
+            xaxis.init( src_dx, dst_dx );
+        hrow.clear();
+        hrow.addSpace( dst_dx );
+        out.clear();
+        out.addSpace( dst_dx );
+        window = 1;
+        if ( src_dy != dst_dy && src_dy > 0 ) {
+            yaxis.init( src_dy, dst_dy );
+            LVArray<int> active( src_dy + 1, 0 );
+            for ( int yy=0; yy<dst_dy; yy++ ) {
+                active[yaxis.start[yy]]++;
+                active[yaxis.start[yy] + yaxis.count[yy]]--;
+            }
+            int n = 0;
+            for ( int y=0; y<src_dy; y++ ) {
+                n += active[y];
+                if ( n > window )
+                    window = n;
+            }
+        }
+        acc = LVArray<lUInt32>( window * dst_dx * 4, 0 );
+        accOpacity = LVArray<lUInt32>( window * dst_dx, 0 );
+        slotWeight = LVArray<int>( window, 0 );
+        slotPremultiplied = LVArray<lUInt8>( window, 0 );
+        nextSrc = 0;
+        nextDst = 0;
+        sequential = true;
+    }
+
+    /// scales row horizontally into hrow, returns true if all pixels are opaque
+    bool scaleRow( const lUInt32 * data )
+    {
+        bool opaque = true;
+        for ( int x=0; x<src_dx; x++ ) {
+            if ( data[x] & 0xFF000000 ) {
+                opaque = false;
+                break;
+            }
+        }
+        lUInt32 * dst = hrow.get();
+        if ( src_dx == dst_dx ) {
+            memcpy( dst, data, dst_dx * sizeof(lUInt32) );
+            return opaque;
+        }
+        const int * start = xaxis.start.get();
+        const int * count = xaxis.count.get();
+        const int * offset = xaxis.offset.get();
+        const int * weights = xaxis.weights.get();
+        if ( opaque ) {
+            for ( int x=0; x<dst_dx; x++ ) {
+                const lUInt32 * p = data + start[x];
+                const int * w = weights + offset[x];
+                int n = count[x];
+#if (LVBLEND_SSE2==1)
+                __m128i zero = _mm_setzero_si128();
+                __m128i sum = _mm_setzero_si128();
+                for ( int k=0; k<n; k++ ) {
+                    __m128i px = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( (int)p[k] ), zero ), zero );
+                    sum = _mm_add_epi32( sum, _mm_madd_epi16( px, _mm_set1_epi32( w[k] ) ) );
+                }
+                sum = _mm_srli_epi32( _mm_add_epi32( sum, _mm_set1_epi32( IMAGE_SCALER_WEIGHT_HALF ) ), IMAGE_SCALER_WEIGHT_BITS );
+                sum = _mm_packs_epi32( sum, sum );
+                dst[x] = (lUInt32)_mm_cvtsi128_si32( _mm_packus_epi16( sum, sum ) );
+#else
+                lUInt32 r = IMAGE_SCALER_WEIGHT_HALF;
+                lUInt32 g = IMAGE_SCALER_WEIGHT_HALF;
+                lUInt32 b = IMAGE_SCALER_WEIGHT_HALF;
+                for ( int k=0; k<n; k++ ) {
+                    lUInt32 cl = p[k];
+                    r += ((cl >> 16) & 0xFF) * w[k];
+                    g += ((cl >> 8) & 0xFF) * w[k];
+                    b += (cl & 0xFF) * w[k];
+                }
+                dst[x] = ((r >> IMAGE_SCALER_WEIGHT_BITS) << 16) | ((g >> IMAGE_SCALER_WEIGHT_BITS) << 8) | (b >> IMAGE_SCALER_WEIGHT_BITS);
+#endif
+            }
+        } else {
+            // colors are weighted by opacity (255 - alpha)
+            for ( int x=0; x<dst_dx; x++ ) {
+                const lUInt32 * p = data + start[x];
+                const int * w = weights + offset[x];
+                int n = count[x];
+                lUInt32 a = IMAGE_SCALER_WEIGHT_HALF;
+                lUInt32 r = 0;
+                lUInt32 g = 0;
+                lUInt32 b = 0;
+                lUInt32 s = 0;
+                for ( int k=0; k<n; k++ ) {
+                    lUInt32 cl = p[k];
+                    lUInt32 alpha = cl >> 24;
+                    lUInt32 wo = w[k] * (255 - alpha);
+                    a += alpha * w[k];
+                    r += ((cl >> 16) & 0xFF) * wo;
+                    g += ((cl >> 8) & 0xFF) * wo;
+                    b += (cl & 0xFF) * wo;
+                    s += wo;
+                }
+                a >>= IMAGE_SCALER_WEIGHT_BITS;
+                if ( !s )
+                    dst[x] = 0xFFFFFFFF;
+                else
+                    dst[x] = (a << 24) | (((r + s / 2) / s) << 16) | (((g + s / 2) / s) << 8) | ((b + s / 2) / s);
+            }
+        }
+        return opaque;
+    }
+
+    /// adds horizontally scaled row with weight w to destination row slot
+    void accumulate( int slot, int w, bool opaque )
+    {
+        lUInt32 * sum = acc.get() + slot * dst_dx * 4;
+        lUInt32 * opacity = accOpacity.get() + slot * dst_dx;
+        const lUInt32 * row = hrow.get();
+        if ( !opaque && !slotPremultiplied[slot] ) {
+            // convert slot to premultiplied form: all rows before were opaque
+            for ( int x=0; x<dst_dx; x++ ) {
+                sum[x*4] *= 255;
+                sum[x*4+1] *= 255;
+                sum[x*4+2] *= 255;
+                opacity[x] = slotWeight[slot] * 255;
+            }
+            slotPremultiplied[slot] = 1;
+        }
+        slotWeight[slot] += w;
+        if ( slotPremultiplied[slot] ) {
+            for ( int x=0; x<dst_dx; x++ ) {
+                lUInt32 cl = row[x];
+                lUInt32 alpha = cl >> 24;
+                lUInt32 wo = w * (255 - alpha);
+                sum[x*4] += (cl & 0xFF) * wo;
+                sum[x*4+1] += ((cl >> 8) & 0xFF) * wo;
+                sum[x*4+2] += ((cl >> 16) & 0xFF) * wo;
+                sum[x*4+3] += alpha * w;
+                opacity[x] += wo;
+            }
+            return;
+        }
+        int x = 0;
+#if (LVBLEND_SSE2==1)
+        __m128i zero = _mm_setzero_si128();
+        __m128i wv = _mm_set1_epi32( w );
+        for ( ; x + 4 <= dst_dx; x += 4 ) {
+            __m128i px = _mm_loadu_si128( (const __m128i*)(row + x) );
+            __m128i lo = _mm_unpacklo_epi8( px, zero );
+            __m128i hi = _mm_unpackhi_epi8( px, zero );
+            __m128i * s = (__m128i*)(sum + x * 4);
+            _mm_storeu_si128( s, _mm_add_epi32( _mm_loadu_si128( s ), _mm_madd_epi16( _mm_unpacklo_epi16( lo, zero ), wv ) ) );
+            _mm_storeu_si128( s + 1, _mm_add_epi32( _mm_loadu_si128( s + 1 ), _mm_madd_epi16( _mm_unpackhi_epi16( lo, zero ), wv ) ) );
+            _mm_storeu_si128( s + 2, _mm_add_epi32( _mm_loadu_si128( s + 2 ), _mm_madd_epi16( _mm_unpacklo_epi16( hi, zero ), wv ) ) );
+            _mm_storeu_si128( s + 3, _mm_add_epi32( _mm_loadu_si128( s + 3 ), _mm_madd_epi16( _mm_unpackhi_epi16( hi, zero ), wv ) ) );
+        }
+#endif
+        for ( ; x<dst_dx; x++ ) {
+            lUInt32 cl = row[x];
+            sum[x*4] += (cl & 0xFF) * w;
+            sum[x*4+1] += ((cl >> 8) & 0xFF) * w;
+            sum[x*4+2] += ((cl >> 16) & 0xFF) * w;
+        }
+    }
+
+    /// converts accumulated slot to ARGB destination row and clears slot
+    void finish( int slot )
+    {
+        lUInt32 * sum = acc.get() + slot * dst_dx * 4;
+        lUInt32 * opacity = accOpacity.get() + slot * dst_dx;
+        lUInt32 * dst = out.get();
+        if ( slotPremultiplied[slot] ) {
+            for ( int x=0; x<dst_dx; x++ ) {
+                lUInt32 s = opacity[x];
+                lUInt32 a = (sum[x*4+3] + IMAGE_SCALER_WEIGHT_HALF) >> IMAGE_SCALER_WEIGHT_BITS;
+                if ( !s )
+                    dst[x] = 0xFFFFFFFF;
+                else
+                    dst[x] = (a << 24) | (((sum[x*4+2] + s / 2) / s) << 16) | (((sum[x*4+1] + s / 2) / s) << 8) | ((sum[x*4] + s / 2) / s);
+            }
+        } else {
+            int x = 0;
+#if (LVBLEND_SSE2==1)
+            __m128i half = _mm_set1_epi32( IMAGE_SCALER_WEIGHT_HALF );
+            for ( ; x + 4 <= dst_dx; x += 4 ) {
+                const __m128i * s = (const __m128i*)(sum + x * 4);
+                __m128i p0 = _mm_srli_epi32( _mm_add_epi32( _mm_loadu_si128( s ), half ), IMAGE_SCALER_WEIGHT_BITS );
+                __m128i p1 = _mm_srli_epi32( _mm_add_epi32( _mm_loadu_si128( s + 1 ), half ), IMAGE_SCALER_WEIGHT_BITS );
+                __m128i p2 = _mm_srli_epi32( _mm_add_epi32( _mm_loadu_si128( s + 2 ), half ), IMAGE_SCALER_WEIGHT_BITS );
+                __m128i p3 = _mm_srli_epi32( _mm_add_epi32( _mm_loadu_si128( s + 3 ), half ), IMAGE_SCALER_WEIGHT_BITS );
+                _mm_storeu_si128( (__m128i*)(dst + x), _mm_packus_epi16( _mm_packs_epi32( p0, p1 ), _mm_packs_epi32( p2, p3 ) ) );
+            }
+#endif
+            for ( ; x<dst_dx; x++ ) {
+                dst[x] = (((sum[x*4+2] + IMAGE_SCALER_WEIGHT_HALF) >> IMAGE_SCALER_WEIGHT_BITS) << 16)
+                        | (((sum[x*4+1] + IMAGE_SCALER_WEIGHT_HALF) >> IMAGE_SCALER_WEIGHT_BITS) << 8)
+                        | ((sum[x*4] + IMAGE_SCALER_WEIGHT_HALF) >> IMAGE_SCALER_WEIGHT_BITS);
+            }
+        }
+        clearSlot( slot );
+    }
+
+    void clearSlot( int slot )
+    {
+        memset( acc.get() + slot * dst_dx * 4, 0, dst_dx * 4 * sizeof(lUInt32) );
+        slotWeight[slot] = 0;
+        slotPremultiplied[slot] = 0;
+    }
+public:
+    LVImageSmoothScaleCallback( LVImageDecoderCallback * _target, int srcWidth, int srcHeight, int width, int height )
+    : target(_target), dst_dx(width), dst_dy(height)
+    {
+        init( srcWidth, srcHeight );
+    }
+    virtual ~LVImageSmoothScaleCallback()
+    {
+    }
+    virtual void OnStartDecode( LVImageSource * obj )
+    {
+        target->OnStartDecode( obj );
+    }
+    virtual void GetTargetSize( int & dx, int & dy )
+    {
+        dx = dst_dx;
+        dy = dst_dy;
+    }
+    virtual void OnDecodedSize( LVImageSource *, int dx, int dy )
+    {
+        // decoder has already downscaled image
+        init( dx, dy );
+    }
+    virtual bool OnLineDecoded( LVImageSource * obj, int y, lUInt32 * data )
+    {
+        if ( y < 0 || y >= src_dy )
+            return true;
+        bool opaque = scaleRow( data );
+        if ( src_dy == dst_dy )
+            return target->OnLineDecoded( obj, y, hrow.get() );
+        if ( y == 0 && nextSrc > 0 ) {
+            // next pass of interlaced image
+            for ( int i=0; i<window; i++ )
+                clearSlot( i );
+            nextSrc = 0;
+            nextDst = 0;
+            sequential = true;
+        }
+        bool res = true;
+        if ( !sequential || y != nextSrc ) {
+            sequential = false;
+            int yy = y * dst_dy / src_dy;
+            int yy2 = (y+1) * dst_dy / src_dy;
+            if ( yy2 > dst_dy )
+                yy2 = dst_dy;
+            for ( ; yy<yy2; yy++ )
+                res = target->OnLineDecoded( obj, yy, hrow.get() ) && res;
+            return res;
+        }
+        nextSrc = y + 1;
+        const int * start = yaxis.start.get();
+        const int * count = yaxis.count.get();
+        for ( int yy=nextDst; yy<dst_dy && start[yy]<=y; yy++ ) {
+            int slot = yy % window;
+            accumulate( slot, yaxis.weights[yaxis.offset[yy] + y - start[yy]], opaque );
+            if ( y == start[yy] + count[yy] - 1 ) {
+                finish( slot );
+                res = target->OnLineDecoded( obj, yy, out.get() ) && res;
+                nextDst = yy + 1;
+            }
+        }
+        return res;
+    }
+    virtual void OnEndDecode( LVImageSource * obj, bool errors )
+    {
+        target->OnEndDecode( obj, errors );
+    }
+};
+
 class LVImageScaledDrawCallback : public LVImageDecoderCallback
 {
 private:
@@ -373,6 +1323,9 @@ private:
     int * xmap;
     int * ymap;
     bool dither;
+    LVGrayRowDitherer * ditherer;
+    int * grayRow;
+    lUInt8 * pixelRow;
 public:
     static int * GenMap( int src_len, int dst_len )
     {
@@ -383,15 +1336,23 @@ public:
         }
         return map;
     }
-    LVImageScaledDrawCallback(LVBaseDrawBuf * dstbuf, LVImageSourceRef img, int x, int y, int width, int height, bool dith )
+    /// srcWidth, srcHeight: size of decoded lines, -1 to use image size
+    LVImageScaledDrawCallback(LVBaseDrawBuf * dstbuf, LVImageSourceRef img, int x, int y, int width, int height, bool dith, int srcWidth=-1, int srcHeight=-1 )
     : src(img), dst(dstbuf), dst_x(x), dst_y(y), dst_dx(width), dst_dy(height), xmap(0), ymap(0), dither(dith)
+    , ditherer(NULL), grayRow(NULL), pixelRow(NULL)
     {
-        src_dx = img->GetWidth();
-        src_dy = img->GetHeight();
+        src_dx = srcWidth >= 0 ? srcWidth : img->GetWidth();
+        src_dy = srcHeight >= 0 ? srcHeight : img->GetHeight();
         if ( src_dx != dst_dx )
             xmap = GenMap( src_dx, dst_dx );
         if ( src_dy != dst_dy )
             ymap = GenMap( src_dy, dst_dy );
+        int bpp = dst->GetBitsPerPixel();
+        if ( dither && bpp < 8 && dst->getImageDithering() != IMG_DITHERING_SIMPLE ) {
+            ditherer = new LVGrayRowDitherer( dst->getImageDithering(), bpp, dst->getImageDitheringGamma(), dst_dx );
+            grayRow = new int[ dst_dx ];
+            pixelRow = new lUInt8[ dst_dx ];
+        }
     }
     virtual ~LVImageScaledDrawCallback()
     {
@@ -399,10 +1360,89 @@ public:
             delete[] xmap;
         if (ymap)
             delete[] ymap;
+        if (ditherer) {
+            delete ditherer;
+            delete[] grayRow;
+            delete[] pixelRow;
+        }
+    }
+    /// draws row with ordered or error diffusion dithering, for gray buffers with less than 8 bpp;
+    /// clipped pixels are dithered too, so that result doesn't depend on clip rect
+    void drawDitheredRow( int yy, const lUInt32 * data, const lvRect & clip )
+    {
+        int bpp = dst->GetBitsPerPixel();
+        bool visible = yy+dst_y>=clip.top && yy+dst_y<clip.bottom;
+        lUInt8 * row = visible ? (lUInt8 *)dst->GetScanLine( yy + dst_y ) : NULL;
+        for (int x=0; x<dst_dx; x++)
+        {
+            lUInt32 cl = data[xmap ? xmap[x] : x];
+            int xx = x + dst_x;
+            lUInt32 alpha = (cl >> 24)&0xFF;
+            grayRow[x] = -1;
+            if ( bpp == 1 ? (alpha&0x80)!=0 : alpha==0xFF )
+                continue;
+            if ( alpha && bpp > 1 && visible && xx>=clip.left && xx<clip.right ) {
+                lUInt32 origColor;
+                if ( bpp == 2 ) {
+                    origColor = (row[ xx >> 2 ] >> ((3-(xx & 3))<<1)) & 3;
+                    origColor = origColor | (origColor<<2);
+                    origColor = origColor | (origColor<<4);
+                } else if ( bpp == 3 ) {
+                    origColor = row[xx] & 0xE0;
+                    origColor = origColor | (origColor>>3) | (origColor>>6);
+                } else {
+                    origColor = row[xx] & 0xF0;
+                    origColor = origColor | (origColor>>4);
+                }
+                origColor = origColor | (origColor<<8) | (origColor<<16);
+                ApplyAlphaRGB( origColor, cl, alpha );
+                cl = origColor;
+            }
+            grayRow[x] = rgbToGray( cl );
+        }
+        ditherer->ditherRow( grayRow, pixelRow, yy );
+        if ( !visible )
+            return;
+        for (int x=0; x<dst_dx; x++)
+        {
+            int xx = x + dst_x;
+            if ( grayRow[x] < 0 || xx<clip.left || xx>=clip.right )
+                continue;
+            if ( bpp > 2 ) {
+                row[xx] = pixelRow[x];
+            } else if ( bpp == 2 ) {
+                int byteindex = (xx >> 2);
+                int bitindex = (3-(xx & 3))<<1;
+                lUInt8 mask = 0xC0 >> (6 - bitindex);
+                row[ byteindex ] = (lUInt8)((row[ byteindex ] & (~mask)) | (pixelRow[x] << bitindex));
+            } else {
+                int byteindex = (xx >> 3);
+                int bitindex = ((xx & 7));
+                lUInt8 mask = 0x80 >> (bitindex);
+                row[ byteindex ] = (lUInt8)((row[ byteindex ] & (~mask)) | (pixelRow[x] << (7-bitindex)));
+            }
+        }
     }
     virtual void OnStartDecode( LVImageSource * )
     {
     }
+    virtual void GetTargetSize( int & dx, int & dy )
+    {
+        dx = dst_dx;
+        dy = dst_dy;
+    }
+    virtual void OnDecodedSize( LVImageSource *, int dx, int dy )
+    {
+        // decoder has already downscaled image
+        src_dx = dx;
+        src_dy = dy;
+        if (xmap)
+            delete[] xmap;
+        if (ymap)
+            delete[] ymap;
+        xmap = src_dx != dst_dx ? GenMap( src_dx, dst_dx ) : NULL;
+        ymap = src_dy != dst_dy ? GenMap( src_dy, dst_dy ) : NULL;
+    }
     virtual bool OnLineDecoded( LVImageSource *, int y, lUInt32 * data )
     {
         //fprintf( stderr, "l_%d ", y );
@@ -425,6 +1465,10 @@ public:
         dst->GetClipRect( &clip );
         for ( ;yy<yy2; yy++ )
         {
+            if ( ditherer ) {
+                drawDitheredRow( yy, data, clip );
+                continue;
+            }
             if ( yy+dst_y<clip.top || yy+dst_y>=clip.bottom )
                 continue;
             int bpp = dst->GetBitsPerPixel();
@@ -585,6 +1629,438 @@ public:
     }
 };
 
+/// decodes image directly into buffer, scaling it to width x height with buffer's resampling quality
+static void drawImageScaled( LVBaseDrawBuf * buf, LVImageSourceRef img, int x, int y, int width, int height, bool dither )
+{
+    if ( buf->getImageScalingQuality() == IMG_SCALING_QUALITY_SMOOTH
+         && (width != img->GetWidth() || height != img->GetHeight()) ) {
+        LVImageScaledDrawCallback drawcb( buf, img, x, y, width, height, dither, width, height );
+        LVImageSmoothScaleCallback scalecb( &drawcb, img->GetWidth(), img->GetHeight(), width, height );
+        img->Decode( &scalecb );
+        return;
+    }
+    LVImageScaledDrawCallback drawcb( buf, img, x, y, width, height, dither );
+    img->Decode( &drawcb );
+}
+
+/// decoded image scaled to drawing size, in pixel format of draw buffer
+class LVScaledImageCacheItem
+{
+public:
+    const void * owner;
+    lString16 name;
+    int dx;
+    int dy;
+    int bpp;
+    bool dither;
+    img_dithering_t dithering;
+    int ditheringGamma;
+    img_scaling_quality_t quality;
+    /// false if image cannot be decoded: it's drawn directly
+    bool cacheable;
+    /// true if data contains scaled ARGB pixels: for 24/32 bpp, and for images which need blending with background
+    bool argb;
+    /// pixels: 4 bytes ARGB, 2 bytes for 16 bpp, 1 byte (gray level) for 1..8 bpp
+    lUInt8 * data;
+    /// 1 for transparent pixels which should be skipped, NULL if image has no transparent pixels
+    lUInt8 * mask;
+    LVScaledImageCacheItem( const void * _owner, const lString16 & _name, int _dx, int _dy, int _bpp, bool _dither,
+                            img_dithering_t _dithering, int _ditheringGamma, img_scaling_quality_t _quality )
+    : owner(_owner), name(_name), dx(_dx), dy(_dy), bpp(_bpp), dither(_dither), dithering(_dithering), ditheringGamma(_ditheringGamma)
+    , quality(_quality), cacheable(false), argb(true), data(NULL), mask(NULL)
+    {
+    }
+    int getSize()
+    {
+        if ( !data )
+            return 0;
+        int bytesPerPixel = argb ? 4 : (bpp == 16 ? 2 : 1);
+        return dx * dy * (bytesPerPixel + (mask ? 1 : 0));
+    }
+    void freeData()
+    {
+        if ( data )
+            free( data );
+        if ( mask )
+            free( mask );
+        data = NULL;
+        mask = NULL;
+    }
+    /// converts ARGB pixels to pixel format of draw buffer, the same way LVImageScaledDrawCallback does;
+    /// keeps ARGB if some pixels need blending with background
+    void convert()
+    {
+        if ( bpp >= 24 || bpp < 1 || (bpp > 8 && bpp != 16) )
+            return;
+        int count = dx * dy;
+        lUInt8 * pixels = (lUInt8*)malloc( count * (bpp == 16 ? 2 : 1) );
+        lUInt8 * transparent = NULL;
+        if ( !pixels )
+            return;
+        LVGrayRowDitherer * ditherer = NULL;
+        int * grayRow = NULL;
+        if ( dither && bpp < 8 && dithering != IMG_DITHERING_SIMPLE ) {
+            ditherer = new LVGrayRowDitherer( dithering, bpp, ditheringGamma, dx );
+            grayRow = new int[ dx ];
+        }
+        bool blended = false;
+        const lUInt32 * src = (const lUInt32 *)data;
+        for ( int yy=0; yy<dy && !blended; yy++ ) {
+            for ( int x=0; x<dx; x++ ) {
+                int index = yy * dx + x;
+                lUInt32 cl = src[index];
+                lUInt32 alpha = (cl >> 24)&0xFF;
+                bool skip;
+                bool opaque;
+                if ( bpp == 16 ) {
+                    skip = alpha >= 0xF0;
+                    opaque = alpha < 16;
+                } else if ( bpp == 1 ) {
+                    skip = (alpha & 0x80) != 0;
+                    opaque = true;
+                } else {
+                    skip = alpha == 0xFF;
+                    opaque = alpha == 0;
+                }
+                if ( skip ) {
+                    if ( !transparent )
+                        transparent = (lUInt8*)calloc( count, 1 );
+                    transparent[index] = 1;
+                    if ( grayRow )
+                        grayRow[x] = -1;
+                    continue;
+                }
+                if ( !opaque ) {
+                    // result depends on background
+                    blended = true;
+                    break;
+                }
+                if ( ditherer ) {
+                    grayRow[x] = rgbToGray( cl );
+                    continue;
+                }
+                lUInt32 dcl;
+                if ( bpp == 16 ) {
+                    ((lUInt16*)pixels)[index] = rgb888to565( cl );
+                    continue;
+                } else if ( bpp == 1 ) {
+                    if ( dither ) {
+#if (GRAY_INVERSE==1)
+                        dcl = Dither1BitColor( cl, x, yy ) ^ 1;
+#else
+                        dcl = Dither1BitColor( cl, x, yy ) ^ 0;
+#endif
+                    } else {
+                        dcl = rgbToGrayMask( cl, 1 ) & 1;
+                    }
+                } else if ( bpp == 2 ) {
+                    if ( dither ) {
+#if (GRAY_INVERSE==1)
+                        dcl = Dither2BitColor( cl, x, yy ) ^ 3;
+#else
+                        dcl = Dither2BitColor( cl, x, yy );
+#endif
+                    } else {
+                        dcl = rgbToGrayMask( cl, 2 ) & 3;
+                    }
+                } else {
+                    if ( dither && bpp < 8 ) {
+#if (GRAY_INVERSE==1)
+                        dcl = (lUInt8)DitherNBitColor( cl^0xFFFFFF, x, yy, bpp );
+#else
+                        dcl = (lUInt8)DitherNBitColor( cl, x, yy, bpp );
+#endif
+                    } else {
+                        dcl = rgbToGray( cl, bpp );
+                    }
+                }
+                pixels[index] = (lUInt8)dcl;
+            }
+            if ( ditherer && !blended )
+                ditherer->ditherRow( grayRow, pixels + yy * dx, yy );
+        }
+        if ( ditherer ) {
+            delete ditherer;
+            delete[] grayRow;
+        }
+        if ( blended ) {
+            free( pixels );
+            if ( transparent )
+                free( transparent );
+            return;
+        }
+        free( data );
+        data = pixels;
+        mask = transparent;
+        argb = false;
+    }
+    ~LVScaledImageCacheItem()
+    {
+        freeData();
+    }
+};
+
+/// decodes image into scaled ARGB pixels of LVScaledImageCacheItem, using the same scaling as LVImageScaledDrawCallback
+class LVImageScaledCacheCallback : public LVImageDecoderCallback
+{
+private:
+    LVScaledImageCacheItem * item;
+    int src_dx;
+    int src_dy;
+    int * xmap;
+    lUInt8 * rowsDone;
+public:
+    /// srcWidth, srcHeight: size of decoded lines
+    LVImageScaledCacheCallback( LVScaledImageCacheItem * _item, int srcWidth, int srcHeight )
+    : item(_item), src_dx(srcWidth), src_dy(srcHeight), xmap(0)
+    {
+        if ( src_dx != item->dx )
+            xmap = LVImageScaledDrawCallback::GenMap( src_dx, item->dx );
+        rowsDone = (lUInt8*)calloc( item->dy, 1 );
+    }
+    virtual ~LVImageScaledCacheCallback()
+    {
+        if (xmap)
+            delete[] xmap;
+        free( rowsDone );
+    }
+    /// returns true if all rows are decoded
+    bool isComplete()
+    {
+        for ( int y=0; y<item->dy; y++ )
+            if ( !rowsDone[y] )
+                return false;
+        return true;
+    }
+    virtual void OnStartDecode( LVImageSource * )
+    {
+    }
+    virtual void GetTargetSize( int & dx, int & dy )
+    {
+        dx = item->dx;
+        dy = item->dy;
+    }
+    virtual void OnDecodedSize( LVImageSource *, int dx, int dy )
+    {
+        // decoder has already downscaled image
+        src_dx = dx;
+        src_dy = dy;
+        if (xmap)
+            delete[] xmap;
+        xmap = src_dx != item->dx ? LVImageScaledDrawCallback::GenMap( src_dx, item->dx ) : NULL;
+    }
+    virtual bool OnLineDecoded( LVImageSource *, int y, lUInt32 * data )
+    {
+        int dst_dx = item->dx;
+        int dst_dy = item->dy;
+        int yy = y;
+        int yy2 = y+1;
+        if ( src_dy != dst_dy ) {
+            yy = y * dst_dy / src_dy;
+            yy2 = (y+1) * dst_dy / src_dy;
+        }
+        if ( yy2 > dst_dy )
+            yy2 = dst_dy;
+        for ( ;yy<yy2; yy++ ) {
+            if ( yy<0 )
+                continue;
+            rowsDone[yy] = 1;
+            lUInt32 * row = (lUInt32 *)item->data + yy * dst_dx;
+            for (int x=0; x<dst_dx; x++)
+                row[x] = data[xmap ? xmap[x] : x];
+        }
+        return true;
+    }
+    virtual void OnEndDecode( LVImageSource *, bool )
+    {
+        // errors flag is not reliable (JPEG decoder always sets it): Decode() result and decoded rows are checked instead
+    }
+};
+
+LVPtrVector<LVScaledImageCacheItem> LVScaledImageCache::_items;
+int LVScaledImageCache::_maxSize = SCALED_IMAGE_CACHE_SIZE;
+int LVScaledImageCache::_size = 0;
+LVMutex LVScaledImageCache::_mutex;
+
+/// copies cached image to buffer, respecting clip rect
+static void drawScaledImageCacheItem( LVBaseDrawBuf * dst, LVImageSourceRef img, LVScaledImageCacheItem * item, int dst_x, int dst_y )
+{
+    lvRect clip;
+    dst->GetClipRect( &clip );
+    int bpp = item->bpp;
+    int x0 = clip.left > dst_x ? clip.left - dst_x : 0;
+    int x1 = clip.right < dst_x + item->dx ? clip.right - dst_x : item->dx;
+    int y0 = clip.top > dst_y ? clip.top - dst_y : 0;
+    int y1 = clip.bottom < dst_y + item->dy ? clip.bottom - dst_y : item->dy;
+    if ( item->argb ) {
+        // alpha blending or conversion is still necessary
+        LVImageScaledDrawCallback drawcb( dst, img, dst_x, dst_y, item->dx, item->dy, item->dither, item->dx, item->dy );
+        // rows above clip rect are needed for error diffusion dithering
+        if ( item->dithering == IMG_DITHERING_ERROR_DIFFUSION )
+            y0 = 0;
+        for ( int yy=y0; yy<y1; yy++ )
+            drawcb.OnLineDecoded( img.get(), yy, (lUInt32 *)item->data + yy * item->dx );
+        return;
+    }
+    for ( int yy=y0; yy<y1; yy++ ) {
+        int index = yy * item->dx;
+        const lUInt8 * mask = item->mask ? item->mask + index : NULL;
+        if ( bpp == 16 ) {
+            lUInt16 * row = (lUInt16 *)dst->GetScanLine( yy + dst_y ) + dst_x;
+            const lUInt16 * src = (const lUInt16 *)item->data + index;
+            if ( !mask ) {
+                memcpy( row + x0, src + x0, (x1 - x0) * sizeof(lUInt16) );
+                continue;
+            }
+            for ( int x=x0; x<x1; x++ )
+                if ( !mask[x] )
+                    row[x] = src[x];
+        } else if ( bpp > 2 ) {
+            lUInt8 * row = dst->GetScanLine( yy + dst_y ) + dst_x;
+            const lUInt8 * src = item->data + index;
+            if ( !mask ) {
+                memcpy( row + x0, src + x0, x1 - x0 );
+                continue;
+            }
+            for ( int x=x0; x<x1; x++ )
+                if ( !mask[x] )
+                    row[x] = src[x];
+        } else {
+            // 1, 2 bpp: pack pixels into bytes
+            lUInt8 * row = dst->GetScanLine( yy + dst_y );
+            const lUInt8 * src = item->data + index;
+            for ( int x=x0; x<x1; x++ ) {
+                if ( mask && mask[x] )
+                    continue;
+                int xx = x + dst_x;
+                if ( bpp == 2 ) {
+                    int byteindex = (xx >> 2);
+                    int bitindex = (3-(xx & 3))<<1;
+                    lUInt8 bmask = 0xC0 >> (6 - bitindex);
+                    row[ byteindex ] = (lUInt8)((row[ byteindex ] & (~bmask)) | (src[x] << bitindex));
+                } else {
+                    int byteindex = (xx >> 3);
+                    int bitindex = ((xx & 7));
+                    lUInt8 bmask = 0x80 >> (bitindex);
+                    row[ byteindex ] = (lUInt8)((row[ byteindex ] & (~bmask)) | (src[x] << (7-bitindex)));
+                }
+            }
+        }
+    }
+}
+
+/// returns cached item, decoding image and adding it to cache if necessary; returns NULL if image cannot be cached
+LVScaledImageCacheItem * LVScaledImageCache::getItem( LVBaseDrawBuf * buf, LVImageSourceRef img, int width, int height, bool dither )
+{
+    if ( _maxSize <= 0 || width <= 0 || height <= 0 )
+        return NULL;
+    const void * owner = img->GetCacheOwner();
+    if ( !owner )
+        return NULL;
+    int bpp = buf->GetBitsPerPixel();
+    if ( bpp >= 8 )
+        dither = false; // not used for these formats
+    img_dithering_t dithering = dither ? buf->getImageDithering() : IMG_DITHERING_SIMPLE;
+    int ditheringGamma = dithering != IMG_DITHERING_SIMPLE ? buf->getImageDitheringGamma() : 0;
+    img_scaling_quality_t quality = buf->getImageScalingQuality();
+    if ( width == img->GetWidth() && height == img->GetHeight() )
+        quality = IMG_SCALING_QUALITY_FAST; // not scaled
+    lString16 name = img->GetCacheName();
+    for ( int i=0; i<_items.length(); i++ ) {
+        LVScaledImageCacheItem * item = _items[i];
+        if ( item->owner != owner || item->dx != width || item->dy != height
+             || item->bpp != bpp || item->dither != dither || item->dithering != dithering || item->ditheringGamma != ditheringGamma
+             || item->quality != quality || item->name != name )
+            continue;
+        _items.move( 0, i );
+        return item->cacheable ? item : NULL;
+    }
+    if ( width > _maxSize / 4 / height )
+        return NULL; // too big
+    LVScaledImageCacheItem * item = new LVScaledImageCacheItem( owner, name, width, height, bpp, dither, dithering, ditheringGamma, quality );
+    item->data = (lUInt8*)malloc( width * height * 4 );
+    if ( item->data ) {
+        if ( quality == IMG_SCALING_QUALITY_SMOOTH ) {
+            LVImageScaledCacheCallback cb( item, width, height );
+            LVImageSmoothScaleCallback scalecb( &cb, img->GetWidth(), img->GetHeight(), width, height );
+            item->cacheable = img->Decode( &scalecb ) && cb.isComplete();
+        } else {
+            LVImageScaledCacheCallback cb( item, img->GetWidth(), img->GetHeight() );
+            item->cacheable = img->Decode( &cb ) && cb.isComplete();
+        }
+    }
+    if ( item->cacheable )
+        item->convert();
+    else
+        item->freeData(); // remember that this image is to be drawn directly
+    _items.insert( 0, item );
+    _size += item->getSize();
+    reduce( _maxSize );
+    return item->cacheable ? item : NULL;
+}
+
+/// draws image using cached copy, decodes and adds it to cache if necessary; returns false if image cannot be cached
+bool LVScaledImageCache::draw( LVBaseDrawBuf * buf, LVImageSourceRef img, int x, int y, int width, int height, bool dither )
+{
+    LVLock lock( _mutex );
+    LVScaledImageCacheItem * item = getItem( buf, img, width, height, dither );
+    if ( !item )
+        return false;
+    drawScaledImageCacheItem( buf, img, item, x, y );
+    return true;
+}
+
+/// decodes image and adds it to cache if it's not cached yet, using pixel format of buf; returns false if image cannot be cached
+bool LVScaledImageCache::prepare( LVBaseDrawBuf * buf, LVImageSourceRef img, int width, int height, bool dither )
+{
+    LVLock lock( _mutex );
+    return getItem( buf, img, width, height, dither ) != NULL;
+}
+
+/// removes least recently used items to fit into specified size
+void LVScaledImageCache::reduce( int maxSize )
+{
+    while ( _items.length() > 0 && (_size > maxSize || maxSize <= 0) ) {
+        LVScaledImageCacheItem * item = _items.remove( _items.length() - 1 );
+        _size -= item->getSize();
+        delete item;
+    }
+}
+
+/// sets byte budget of cache, 0 to disable caching
+void LVScaledImageCache::setMaxSize( int bytes )
+{
+    LVLock lock( _mutex );
+    _maxSize = bytes;
+    reduce( _maxSize );
+}
+
+/// removes all images of specified owner (call when document is closed)
+void LVScaledImageCache::removeOwner( const void * owner )
+{
+    LVLock lock( _mutex );
+    for ( int i=_items.length()-1; i>=0; i-- ) {
+        if ( _items[i]->owner == owner ) {
+            LVScaledImageCacheItem * item = _items.remove( i );
+            _size -= item->getSize();
+            delete item;
+        }
+    }
+}
+
+/// removes all images
+void LVScaledImageCache::clear()
+{
+    LVLock lock( _mutex );
+    _items.clear();
+    _size = 0;
+}
+
+
+bool LVBaseDrawBuf::PrepareImage( LVImageSourceRef img, int width, int height, bool dither )
+{
+    return LVScaledImageCache::prepare( this, img, width, height, dither );
+}
 
 int  LVBaseDrawBuf::GetWidth()
 { 
@@ -606,8 +2082,9 @@ void LVGrayDrawBuf::Draw( LVImageSourceRef img, int x, int y, int width, int hei
     //fprintf( stderr, "LVGrayDrawBuf::Draw( img(%d, %d), %d, %d, %d, %d\n", img->GetWidth(), img->GetHeight(), x, y, width, height );
     if ( width<=0 || height<=0 )
         return;
-    LVImageScaledDrawCallback drawcb( this, img, x, y, width, height, dither );
-    img->Decode( &drawcb );
+    if ( LVScaledImageCache::draw( this, img, x, y, width, height, dither ) )
+        return;
+    drawImageScaled( this, img, x, y, width, height, dither );
 }
 
 
@@ -904,51 +2381,16 @@ LVGrayDrawBuf::~LVGrayDrawBuf()
 void LVGrayDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * )
 {
     //int buf_width = _dx; /* 2bpp */
-    int initial_height = height;
-    int bx = 0;
-    int by = 0;
+    int bx;
+    int by;
     int xx;
     int bmp_width = width;
-    lUInt8 * dst;
-    lUInt8 * dstline;
-    const lUInt8 * src;
-    int      shift, shift0;
-
-    if (x<_clip.left)
-    {
-        width += x-_clip.left;
-        bx -= x-_clip.left;
-        x = _clip.left;
-        if (width<=0)
-            return;
-    }
-    if (y<_clip.top)
-    {
-        height += y-_clip.top;
-        by -= y-_clip.top;
-        y = _clip.top;
-        if (_hidePartialGlyphs && height<=initial_height/2) // HIDE PARTIAL VISIBLE GLYPHS
-            return;
-        if (height<=0)
-            return;
-    }
-    if (x + width > _clip.right)
-    {
-        width = _clip.right - x;
-    }
-    if (width<=0)
-        return;
-    if (y + height > _clip.bottom)
-    {
-        if (_hidePartialGlyphs && height<=initial_height/2) // HIDE PARTIAL VISIBLE GLYPHS
-            return;
-        int clip_bottom = _clip.bottom;
-        if ( _hidePartialGlyphs )
-            clip_bottom = this->_dy;
-        if ( y+height > clip_bottom)
-            height = clip_bottom - y;
-    }
-    if (height<=0)
+    lUInt8 * dst;
+    lUInt8 * dstline;
+    const lUInt8 * src;
+    int      shift, shift0;
+
+    if ( !clipGlyphBitmap( _clip, _dy, _hidePartialGlyphs, x, y, width, height, bx, by ) )
         return;
 
     int bytesPerRow = _rowsize;
@@ -1024,20 +2466,7 @@ void LVGrayDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int he
                 }
             }
         } else { // 3,4,8
-            int mask = ((1<<_bpp)-1)<<(8-_bpp);
-            for (xx = width; xx>0; --xx)
-            {
-                lUInt8 b = (*src++);
-                if ( b ) {
-                    if ( b>=mask )
-                        *dst = color;
-                    else {
-                        int alpha = 256 - b;
-                        ApplyAlphaGray( *dst, color, alpha, _bpp );
-                    }
-                }
-                dst++;
-            }
+            blendGlyphSpanGray( dst, src, width, color, (lUInt8)(((1<<_bpp)-1)<<(8-_bpp)) );
         }
         /* new dest line */
         bitmap += bmp_width;
@@ -1047,6 +2476,106 @@ void LVGrayDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int he
     }
 }
 
+/// draws glyph using table of 2bpp results for 16 coverage levels and 4 background levels
+static void drawGlyph2bpp( lUInt8 * dstline, int rowSize, int shift0, const lUInt8 * bitmap, int bmpWidth,
+                           int width, int height, const lUInt8 blend[16][4] )
+{
+    for ( ; height; height-- ) {
+        const lUInt8 * src = bitmap;
+        lUInt8 * dst = dstline;
+        int shift = shift0;
+        for ( int xx = width; xx>0; --xx ) {
+            lUInt8 opaque = (*src++) >> 4;
+            if ( opaque>0x3 ) {
+                int shift2i = 6 - (shift<<1);
+                lUInt8 bgcolor = ((*dst)>>shift2i) & 3;
+                *dst = (lUInt8)((*dst & ~(3<<shift2i)) | (blend[opaque][bgcolor]<<shift2i));
+            }
+            if ( ++shift==4 ) {
+                shift = 0;
+                dst++;
+            }
+        }
+        bitmap += bmpWidth;
+        dstline += rowSize;
+    }
+}
+
+/// draws glyph to 8bpp buffer, or to 3/4bpp buffer with 1 pixel per byte
+static void drawGlyph8bpp( lUInt8 * dstline, int rowSize, const lUInt8 * bitmap, int bmpWidth,
+                           int width, int height, lUInt8 color, int bpp )
+{
+    lUInt8 mask = (lUInt8)(((1<<bpp)-1)<<(8-bpp));
+    for ( ; height; height-- ) {
+        blendGlyphSpanGray( dstline, bitmap, width, color, mask );
+        bitmap += bmpWidth;
+        dstline += rowSize;
+    }
+}
+
+/// draws glyph to 1bpp buffer
+static void drawGlyph1bpp( lUInt8 * dstline, int rowSize, int shift0, const lUInt8 * bitmap, int bmpWidth,
+                           int width, int height )
+{
+    for ( ; height; height-- ) {
+        const lUInt8 * src = bitmap;
+        lUInt8 * dst = dstline;
+        int shift = shift0;
+        for ( int xx = width; xx>0; --xx ) {
+#if (GRAY_INVERSE==1)
+            *dst |= (( (*src++) & 0x80 ) >> ( shift ));
+#else
+            *dst &= ~(( ((*src++) & 0x80) ) >> ( shift ));
+#endif
+            if ( ++shift==8 ) {
+                shift = 0;
+                dst++;
+            }
+        }
+        bitmap += bmpWidth;
+        dstline += rowSize;
+    }
+}
+
+void LVGrayDrawBuf::DrawGlyphRun( const LVDrawBufGlyph * glyphs, int count )
+{
+    lUInt8 blend[16][4]; // 2bpp
+    lUInt8 color = 0;    // 3..8bpp
+    lUInt32 lastColor = 0;
+    bool colorReady = false;
+    for ( int i=0; i<count; i++ ) {
+        const LVDrawBufGlyph & g = glyphs[i];
+        int x = g.x;
+        int y = g.y;
+        int width = g.width;
+        int height = g.height;
+        int bx, by;
+        if ( !clipGlyphBitmap( _clip, _dy, _hidePartialGlyphs, x, y, width, height, bx, by ) )
+            continue;
+        if ( !colorReady || g.color!=lastColor ) {
+            // same results as Draw() gives for this text color
+            colorReady = true;
+            lastColor = g.color;
+            if ( _bpp==2 ) {
+                lUInt8 cl = (lUInt8)(rgbToGray(g.color) >> 6);
+                for ( int opaque=0; opaque<16; opaque++ )
+                    for ( int bgcolor=0; bgcolor<4; bgcolor++ )
+                        blend[opaque][bgcolor] = opaque>=0xC ? cl : (lUInt8)(((opaque*cl + (15-opaque)*bgcolor)>>4)&3);
+            } else {
+                color = rgbToGrayMask( g.color, _bpp );
+            }
+        }
+        const lUInt8 * bitmap = g.bitmap + bx + by*g.width;
+        lUInt8 * dstline = _data + _rowsize*y;
+        if ( _bpp==2 )
+            drawGlyph2bpp( dstline + (x >> 2), _rowsize, x & 3, bitmap, g.width, width, height, blend );
+        else if ( _bpp==1 )
+            drawGlyph1bpp( dstline + (x >> 3), _rowsize, x & 7, bitmap, g.width, width, height );
+        else
+            drawGlyph8bpp( dstline + x, _rowsize, bitmap, g.width, width, height, color, _bpp );
+    }
+}
+
 void LVBaseDrawBuf::SetClipRect( const lvRect * clipRect )
 {
     if (clipRect)
@@ -1070,6 +2599,42 @@ void LVBaseDrawBuf::SetClipRect( const lvRect * clipRect )
     }
 }
 
+/// when number of separate changed areas exceeds this value, they are merged into single bounding box
+#define MAX_DAMAGE_RECTS 16
+
+void LVBaseDrawBuf::invalidateRect( const lvRect & rc )
+{
+    lvRect r( rc );
+    if ( r.isEmpty() || !r.intersect( lvRect(0, 0, _dx, _dy) ) )
+        return;
+    for ( int i=_damage.length()-1; i>=0; i-- ) {
+        lvRect & d = _damage[i];
+        if ( d.isRectInside(r) )
+            return; // already damaged
+        if ( r.isRectInside(d) ) {
+            _damage.erase( i, 1 );
+        } else if ( d.left==r.left && d.right==r.right && d.top<=r.bottom && r.top<=d.bottom ) {
+            // adjacent or overlapping strips of the same width
+            r.extend( d );
+            _damage.erase( i, 1 );
+        }
+    }
+    _damage.add( r );
+    if ( _damage.length()>MAX_DAMAGE_RECTS ) {
+        getDamageBounds( r );
+        _damage.clear();
+        _damage.add( r );
+    }
+}
+
+bool LVBaseDrawBuf::getDamageBounds( lvRect & rc )
+{
+    rc.clear();
+    for ( int i=0; i<_damage.length(); i++ )
+        rc.extend( _damage[i] );
+    return !rc.isEmpty();
+}
+
 lUInt8 * LVGrayDrawBuf::GetScanLine( int y )
 {
     return _data + _rowsize*y;
@@ -1090,7 +2655,29 @@ void LVGrayDrawBuf::ConvertToBitmap(bool flgDither)
     int sz = GetRowSize();
     lUInt8 * bitmap = (lUInt8*) malloc( sizeof(lUInt8) * sz );
     memset( bitmap, 0, sz );
-    if (flgDither)
+    if (flgDither && _imageDithering != IMG_DITHERING_SIMPLE)
+    {
+        LVGrayRowDitherer ditherer( _imageDithering, 1, _imageDitheringGamma, _dx );
+        LVArray<int> gray( _dx, 0 );
+        LVArray<lUInt8> pixels( _dx, 0 );
+        for (int y=0; y<_dy; y++)
+        {
+            lUInt8 * src = GetScanLine(y);
+            lUInt8 * dst = bitmap + ((_dx+7)/8)*y;
+            for (int x=0; x<_dx; x++) {
+                int cl = (src[x>>2] >> (6-((x&3)*2)))&3;
+#if (GRAY_INVERSE==1)
+                cl ^= 3;
+#endif
+                gray[x] = cl * 85;
+            }
+            ditherer.ditherRow( gray.get(), pixels.get(), y );
+            for (int x=0; x<_dx; x++)
+                if (pixels[x])
+                    dst[x>>3] |= 0x80>>(x&7);
+        }
+    }
+    else if (flgDither)
     {
         static const lUInt8 cmap[4][4] = {
             { 0, 0, 0, 0},
@@ -1104,7 +2691,6 @@ void LVGrayDrawBuf::ConvertToBitmap(bool flgDither)
             lUInt8 * dst = bitmap + ((_dx+7)/8)*y;
             for (int x=0; x<_dx; x++) {
                 int cl = (src[x>>2] >> (6-((x&3)*2)))&3;
-                cl = cmap[cl][ (x&1) + ((y&1)<<1) ];
                 if (cmap[cl][ (x&1) + ((y&1)<<1) ])
                     dst[x>>3] |= 0x80>>(x&7);
             }
@@ -1147,8 +2733,9 @@ int  LVColorDrawBuf::GetBitsPerPixel()
 void LVColorDrawBuf::Draw( LVImageSourceRef img, int x, int y, int width, int height, bool dither )
 {
     //fprintf( stderr, "LVColorDrawBuf::Draw( img(%d, %d), %d, %d, %d, %d\n", img->GetWidth(), img->GetHeight(), x, y, width, height );
-    LVImageScaledDrawCallback drawcb( this, img, x, y, width, height, dither );
-    img->Decode( &drawcb );
+    if ( LVScaledImageCache::draw( this, img, x, y, width, height, dither ) )
+        return;
+    drawImageScaled( this, img, x, y, width, height, dither );
 }
 
 /// fills buffer with specified color
@@ -1333,120 +2920,65 @@ void LVColorDrawBuf::InvertRect(int x0, int y0, int x1, int y1)
 void LVColorDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * palette )
 {
     //int buf_width = _dx; /* 2bpp */
-    int initial_height = height;
-    int bx = 0;
-    int by = 0;
-    int xx;
+    int bx;
+    int by;
     int bmp_width = width;
     lUInt32 bmpcl = palette?palette[0]:GetTextColor();
-    const lUInt8 * src;
 
-    if (x<_clip.left)
-    {
-        width += x-_clip.left;
-        bx -= x-_clip.left;
-        x = _clip.left;
-        if (width<=0)
-            return;
-    }
-    if (y<_clip.top)
-    {
-        height += y-_clip.top;
-        by -= y-_clip.top;
-        y = _clip.top;
-        if (_hidePartialGlyphs && height<=initial_height/2) // HIDE PARTIAL VISIBLE GLYPHS
-            return;
-        if (height<=0)
-            return;
-    }
-    if (x + width > _clip.right)
-    {
-        width = _clip.right - x;
-    }
-    if (width<=0)
-        return;
-    if (y + height > _clip.bottom)
-    {
-        if (_hidePartialGlyphs && height<=initial_height/2) // HIDE PARTIAL VISIBLE GLYPHS
-            return;
-        int clip_bottom = _clip.bottom;
-        if (_hidePartialGlyphs )
-            clip_bottom = this->_dy;
-        if ( y+height > clip_bottom)
-            height = clip_bottom - y;
-    }
-    if (height<=0)
+    if ( !clipGlyphBitmap( _clip, _dy, _hidePartialGlyphs, x, y, width, height, bx, by ) )
         return;
 
-    xx = width;
-
     bitmap += bx + by*bmp_width;
 
     if ( _bpp==16 ) {
 
         lUInt16 bmpcl16 = rgb888to565(bmpcl);
 
-        lUInt16 * dst;
-        lUInt16 * dstline;
-
-
         for (;height;height--)
         {
-            src = bitmap;
-            dstline = ((lUInt16*)GetScanLine(y++)) + x;
-            dst = dstline;
-
-            for (xx = width; xx>0; --xx)
-            {
-                lUInt32 opaque = ((*(src++))>>4)&0x0F;
-                if ( opaque>=0xF )
-                    *dst = bmpcl16;
-                else if ( opaque>0 ) {
-                    lUInt32 alpha = 0xF-opaque;
-                    lUInt16 cl1 = (lUInt16)(((alpha*((*dst)&0xF81F) + opaque*(bmpcl16&0xF81F))>>4) & 0xF81F);
-                    lUInt16 cl2 = (lUInt16)(((alpha*((*dst)&0x07E0) + opaque*(bmpcl16&0x07E0))>>4) & 0x07E0);
-                    *dst = cl1 | cl2;
-                }
-                /* next pixel */
-                dst++;
-            }
+            blendGlyphSpan565( ((lUInt16*)GetScanLine(y++)) + x, bitmap, width, bmpcl16 );
             /* new dest line */
             bitmap += bmp_width;
         }
 
     } else {
 
-
-        lUInt32 * dst;
-        lUInt32 * dstline;
-
-
         for (;height;height--)
         {
-            src = bitmap;
-            dstline = ((lUInt32*)GetScanLine(y++)) + x;
-            dst = dstline;
-
-            for (xx = width; xx>0; --xx)
-            {
-                lUInt32 opaque = ((*(src++))>>1)&0x7F;
-                if ( opaque>=0x78 )
-                    *dst = bmpcl;
-                else if ( opaque>0 ) {
-                    lUInt32 alpha = 0x7F-opaque;
-                    lUInt32 cl1 = ((alpha*((*dst)&0xFF00FF) + opaque*(bmpcl&0xFF00FF))>>7) & 0xFF00FF;
-                    lUInt32 cl2 = ((alpha*((*dst)&0x00FF00) + opaque*(bmpcl&0x00FF00))>>7) & 0x00FF00;
-                    *dst = cl1 | cl2;
-                }
-                /* next pixel */
-                dst++;
-            }
+            blendGlyphSpan32( ((lUInt32*)GetScanLine(y++)) + x, bitmap, width, bmpcl );
             /* new dest line */
             bitmap += bmp_width;
         }
     }
 }
 
+void LVColorDrawBuf::DrawGlyphRun( const LVDrawBufGlyph * glyphs, int count )
+{
+    for ( int i=0; i<count; i++ ) {
+        const LVDrawBufGlyph & g = glyphs[i];
+        int x = g.x;
+        int y = g.y;
+        int width = g.width;
+        int height = g.height;
+        int bx, by;
+        if ( !clipGlyphBitmap( _clip, _dy, _hidePartialGlyphs, x, y, width, height, bx, by ) )
+            continue;
+        const lUInt8 * bitmap = g.bitmap + bx + by*g.width;
+        if ( _bpp==16 ) {
+            lUInt16 bmpcl16 = rgb888to565(g.color);
+            for ( ; height; height-- ) {
+                blendGlyphSpan565( ((lUInt16*)GetScanLine(y++)) + x, bitmap, width, bmpcl16 );
+                bitmap += g.width;
+            }
+        } else {
+            for ( ; height; height-- ) {
+                blendGlyphSpan32( ((lUInt32*)GetScanLine(y++)) + x, bitmap, width, g.color );
+                bitmap += g.width;
+            }
+        }
+    }
+}
+
 #if !defined(__SYMBIAN32__) && defined(_WIN32)
 /// draws buffer content to DC doing color conversion if necessary
 void LVGrayDrawBuf::DrawTo( HDC dc, int x, int y, int options, lUInt32 * palette )
@@ -1600,166 +3132,114 @@ void LVColorDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
     lvRect clip;
     buf->GetClipRect(&clip);
     int bpp = buf->GetBitsPerPixel();
-    for (int yy=0; yy<_dy; yy++)
+    // visible part of this buffer, clip check is not needed inside row loops
+    int xx0 = clip.left > x ? clip.left - x : 0;
+    int xx1 = clip.right - x < _dx ? clip.right - x : _dx;
+    int yy0 = clip.top > y ? clip.top - y : 0;
+    int yy1 = clip.bottom - y < _dy ? clip.bottom - y : _dy;
+    if ( xx0 >= xx1 )
+        return;
+    int count = xx1 - xx0;
+    for (int yy=yy0; yy<yy1; yy++)
     {
-        if (y+yy >= clip.top && y+yy < clip.bottom)
-        {
-            if ( _bpp==16 ) {
-                lUInt16 * src = (lUInt16 *)GetScanLine(yy);
-                if (bpp==1)
+        if ( _bpp==16 ) {
+            lUInt16 * src = (lUInt16 *)GetScanLine(yy) + xx0;
+            if (bpp==1)
+            {
+                int shift = (x + xx0) & 7;
+                lUInt8 * dst = buf->GetScanLine(y+yy) + ((x + xx0)>>3);
+                for (int xx=0; xx<count; xx++)
                 {
-                    int shift = x & 7;
-                    lUInt8 * dst = buf->GetScanLine(y+yy) + (x>>3);
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            //lUInt8 mask = ~((lUInt8)0xC0>>shift);
     #if (GRAY_INVERSE==1)
-                            lUInt8 cl = (((lUInt8)(*src)&0x8000)^0x8000) >> (shift+8);
+                    lUInt8 cl = (((lUInt8)(*src)&0x8000)^0x8000) >> (shift+8);
     #else
-                            lUInt8 cl = (((lUInt8)(*src)&0x8000)) >> (shift+8);
+                    lUInt8 cl = (((lUInt8)(*src)&0x8000)) >> (shift+8);
     #endif
-                            *dst |= cl;
-                        }
-                        if ( !(shift = (shift+1)&7) )
-                            dst++;
-                        src++;
-                    }
+                    *dst |= cl;
+                    if ( !(shift = (shift+1)&7) )
+                        dst++;
+                    src++;
                 }
-                else if (bpp==2)
+            }
+            else if (bpp==2)
+            {
+                int shift = (x + xx0) & 3;
+                lUInt8 * dst = buf->GetScanLine(y+yy) + ((x + xx0)>>2);
+                for (int xx=0; xx<count; xx++)
                 {
-                    int shift = x & 3;
-                    lUInt8 * dst = buf->GetScanLine(y+yy) + (x>>2);
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            //lUInt8 mask = ~((lUInt8)0xC0>>shift);
     #if (GRAY_INVERSE==1)
-                            lUInt8 cl = (((lUInt8)(*src)&0xC000)^0xC000) >> ((shift<<1) + 8);
+                    lUInt8 cl = (((lUInt8)(*src)&0xC000)^0xC000) >> ((shift<<1) + 8);
     #else
-                            lUInt8 cl = (((lUInt8)(*src)&0xC000)) >> ((shift<<1) + 8);
+                    lUInt8 cl = (((lUInt8)(*src)&0xC000)) >> ((shift<<1) + 8);
     #endif
-                            *dst |= cl;
-                        }
-                        if ( !(shift = (shift+1)&3) )
-                            dst++;
-                        src++;
-                    }
-                }
-                else if (bpp<=8)
-                {
-                    lUInt8 * dst = buf->GetScanLine(y+yy) + x;
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            //lUInt8 mask = ~((lUInt8)0xC0>>shift);
-                            *dst = (lUInt8)(*src >> 8);
-                        }
-                        dst++;
-                        src++;
-                    }
-                }
-                else if (bpp==16)
-                {
-                    lUInt16 * dst = ((lUInt16 *)buf->GetScanLine(y+yy)) + x;
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            *dst = *src;
-                        }
-                        dst++;
-                        src++;
-                    }
-                }
-                else if (bpp==32)
-                {
-                    lUInt32 * dst = ((lUInt32 *)buf->GetScanLine(y+yy)) + x;
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            *dst = rgb565to888( *src );
-                        }
+                    *dst |= cl;
+                    if ( !(shift = (shift+1)&3) )
                         dst++;
-                        src++;
-                    }
+                    src++;
                 }
-            } else {
-                lUInt32 * src = (lUInt32 *)GetScanLine(yy);
-                if (bpp==1)
+            }
+            else if (bpp<=8)
+            {
+                lUInt8 * dst = buf->GetScanLine(y+yy) + x + xx0;
+                for (int xx=0; xx<count; xx++)
+                    dst[xx] = (lUInt8)(src[xx] >> 8);
+            }
+            else if (bpp==16)
+            {
+                memcpy( ((lUInt16 *)buf->GetScanLine(y+yy)) + x + xx0, src, count * sizeof(lUInt16) );
+            }
+            else if (bpp==32)
+            {
+                lUInt32 * dst = ((lUInt32 *)buf->GetScanLine(y+yy)) + x + xx0;
+                for (int xx=0; xx<count; xx++)
+                    dst[xx] = rgb565to888( src[xx] );
+            }
+        } else {
+            lUInt32 * src = (lUInt32 *)GetScanLine(yy) + xx0;
+            if (bpp==1)
+            {
+                int shift = (x + xx0) & 7;
+                lUInt8 * dst = buf->GetScanLine(y+yy) + ((x + xx0)>>3);
+                for (int xx=0; xx<count; xx++)
                 {
-                    int shift = x & 7;
-                    lUInt8 * dst = buf->GetScanLine(y+yy) + (x>>3);
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            //lUInt8 mask = ~((lUInt8)0xC0>>shift);
     #if (GRAY_INVERSE==1)
-                            lUInt8 cl = (((lUInt8)(*src)&0x80)^0x80) >> (shift);
+                    lUInt8 cl = (((lUInt8)(*src)&0x80)^0x80) >> (shift);
     #else
-                            lUInt8 cl = (((lUInt8)(*src)&0x80)) >> (shift);
+                    lUInt8 cl = (((lUInt8)(*src)&0x80)) >> (shift);
     #endif
-                            *dst |= cl;
-                        }
-                        if ( !(shift = (shift+1)&7) )
-                            dst++;
-                        src++;
-                    }
+                    *dst |= cl;
+                    if ( !(shift = (shift+1)&7) )
+                        dst++;
+                    src++;
                 }
-                else if (bpp==2)
+            }
+            else if (bpp==2)
+            {
+                int shift = (x + xx0) & 3;
+                lUInt8 * dst = buf->GetScanLine(y+yy) + ((x + xx0)>>2);
+                for (int xx=0; xx<count; xx++)
                 {
-                    int shift = x & 3;
-                    lUInt8 * dst = buf->GetScanLine(y+yy) + (x>>2);
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            //lUInt8 mask = ~((lUInt8)0xC0>>shift);
     #if (GRAY_INVERSE==1)
-                            lUInt8 cl = (((lUInt8)(*src)&0xC0)^0xC0) >> (shift<<1);
+                    lUInt8 cl = (((lUInt8)(*src)&0xC0)^0xC0) >> (shift<<1);
     #else
-                            lUInt8 cl = (((lUInt8)(*src)&0xC0)) >> (shift<<1);
+                    lUInt8 cl = (((lUInt8)(*src)&0xC0)) >> (shift<<1);
     #endif
-                            *dst |= cl;
-                        }
-                        if ( !(shift = (shift+1)&3) )
-                            dst++;
-                        src++;
-                    }
-                }
-                else if (bpp<=8)
-                {
-                    lUInt8 * dst = buf->GetScanLine(y+yy) + x;
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            //lUInt8 mask = ~((lUInt8)0xC0>>shift);
-                            *dst = (lUInt8)*src;
-                        }
-                        dst++;
-                        src++;
-                    }
-                }
-                else if (bpp==32)
-                {
-                    lUInt32 * dst = ((lUInt32 *)buf->GetScanLine(y+yy)) + x;
-                    for (int xx=0; xx<_dx; xx++)
-                    {
-                        if ( x+xx >= clip.left && x+xx < clip.right )
-                        {
-                            *dst = *src;
-                        }
+                    *dst |= cl;
+                    if ( !(shift = (shift+1)&3) )
                         dst++;
-                        src++;
-                    }
+                    src++;
                 }
             }
+            else if (bpp<=8)
+            {
+                lUInt8 * dst = buf->GetScanLine(y+yy) + x + xx0;
+                for (int xx=0; xx<count; xx++)
+                    dst[xx] = (lUInt8)src[xx];
+            }
+            else if (bpp==32)
+            {
+                memcpy( ((lUInt32 *)buf->GetScanLine(y+yy)) + x + xx0, src, count * sizeof(lUInt32) );
+            }
         }
     }
 }
@@ -1840,3 +3320,374 @@ void LVColorDrawBuf::ConvertToBitmap(bool flgDither)
 {
 }
 
+
+#ifdef _DEBUG
+#include "../include/crtest.h"
+
+/// compares glyph span kernels with scalar implementation bit for bit
+void testBlendSpans()
+{
+    CRLog::info("testBlendSpans(), vector kernels: %s", LVBLEND_SIMD_NAME);
+    // coverage values around thresholds of all kernels, and some noise
+    static const lUInt8 edges[] = { 0, 1, 2, 3, 0x0F, 0x10, 0x11, 0x7F, 0xDF, 0xE0, 0xE1, 0xEF, 0xF0, 0xF1, 0xFE, 0xFF };
+    const int maxLen = 67;
+    lUInt8 src[maxLen + 16];
+    lUInt8 gray1[maxLen + 16], gray2[maxLen + 16];
+    lUInt16 rgb16a[maxLen + 16], rgb16b[maxLen + 16];
+    lUInt32 rgb32a[maxLen + 16], rgb32b[maxLen + 16];
+    static const lUInt32 colors[] = { 0x000000, 0xFFFFFF, 0xFF000000, 0x123456, 0xFFFEFDFC, 0x80FF7F01 };
+    lUInt32 seed = 12345;
+    for ( int pass=0; pass<200; pass++ ) {
+        for ( int i=0; i<maxLen + 16; i++ ) {
+            seed = seed * 1103515245 + 12345;
+            lUInt32 rnd = seed >> 8;
+            src[i] = (pass & 1) ? edges[rnd & 15] : (lUInt8)(rnd >> 4);
+            if ( pass % 7 == 3 && (rnd & 0x300) )
+                src[i] = 0; // mostly empty spans
+            gray1[i] = gray2[i] = (lUInt8)(rnd >> 12);
+            rgb16a[i] = rgb16b[i] = (lUInt16)(rnd >> 3);
+            rgb32a[i] = rgb32b[i] = (rnd << 9) ^ seed;
+        }
+        lUInt32 color = colors[pass % 6];
+        int offset = pass % 16;
+        int len = pass % (maxLen + 1 - offset);
+        for ( int bpp=3; bpp<=8; bpp += (bpp==4 ? 4 : 1) ) {
+            lUInt8 mask = (lUInt8)(((1<<bpp)-1)<<(8-bpp));
+            lUInt8 grayColor = rgbToGrayMask( color, bpp );
+            blendGlyphSpanGrayScalar( gray1 + offset, src + offset, len, grayColor, mask );
+            blendGlyphSpanGray( gray2 + offset, src + offset, len, grayColor, mask );
+            MYASSERT( !memcmp(gray1, gray2, sizeof(gray1)), "gray span" );
+        }
+        blendGlyphSpan565Scalar( rgb16a + offset, src + offset, len, rgb888to565(color) );
+        blendGlyphSpan565( rgb16b + offset, src + offset, len, rgb888to565(color) );
+        MYASSERT( !memcmp(rgb16a, rgb16b, sizeof(rgb16a)), "rgb565 span" );
+        blendGlyphSpan32Scalar( rgb32a + offset, src + offset, len, color );
+        blendGlyphSpan32( rgb32b + offset, src + offset, len, color );
+        MYASSERT( !memcmp(rgb32a, rgb32b, sizeof(rgb32a)), "rgb32 span" );
+    }
+    CRLog::info("testBlendSpans() finished");
+}
+
+void testDrawBufDamage()
+{
+    CRLog::info("testDrawBufDamage()");
+    LVGrayDrawBuf buf( 100, 200, 2 );
+    lvRect rc;
+    MYASSERT( !buf.getDamageBounds( rc ), "no damage initially" );
+    buf.invalidateRect( lvRect(10, 10, 90, 20) );
+    buf.invalidateRect( lvRect(10, 20, 90, 30) ); // adjacent strip is merged
+    buf.invalidateRect( lvRect(20, 12, 30, 18) ); // covered
+    MYASSERT( buf.getDamageRects().length()==1 && buf.getDamageRects()[0]==lvRect(10, 10, 90, 30), "merge strips" );
+    buf.invalidateRect( lvRect(-5, 150, 50, 250) ); // clipped to buffer
+    MYASSERT( buf.getDamageRects().length()==2 && buf.getDamageRects()[1]==lvRect(0, 150, 50, 200), "clip" );
+    buf.invalidateRect( lvRect(0, 0, 100, 100) ); // covers first rect
+    MYASSERT( buf.getDamageRects().length()==2 && buf.getDamageBounds( rc ) && rc==lvRect(0, 0, 100, 200), "cover" );
+    buf.clearDamage();
+    for ( int i=0; i<40; i++ )
+        buf.invalidateRect( lvRect(i, i*4, i+2, i*4+2) );
+    MYASSERT( buf.getDamageRects().length()<=MAX_DAMAGE_RECTS, "too many rects collapsed" );
+    MYASSERT( buf.getDamageBounds( rc ) && rc==lvRect(0, 0, 41, 158), "bounds kept" );
+    CRLog::info("testDrawBufDamage() finished");
+}
+
+/// generated image with optional transparent pixels, counts Decode() calls
+class LVTestCacheImageSource : public LVImageSource
+{
+    int _dx;
+    int _dy;
+    lUInt32 _transparency;
+public:
+    int decodeCount;
+    LVTestCacheImageSource( int dx, int dy, lUInt32 transparency ) : _dx(dx), _dy(dy), _transparency(transparency), decodeCount(0) { }
+    virtual ldomNode * GetSourceNode() { return NULL; }
+    virtual LVStream * GetSourceStream() { return NULL; }
+    virtual void Compact() { }
+    virtual int GetWidth() { return _dx; }
+    virtual int GetHeight() { return _dy; }
+    virtual const void * GetCacheOwner() { return this; }
+    virtual lString16 GetCacheName() { return lString16(L"test"); }
+    virtual bool Decode( LVImageDecoderCallback * callback )
+    {
+        decodeCount++;
+        LVArray<lUInt32> row( _dx, 0 );
+        callback->OnStartDecode( this );
+        for ( int y=0; y<_dy; y++ ) {
+            for ( int x=0; x<_dx; x++ )
+                row[x] = ((x * 37 + y * 11) * 0x010305) & 0xFFFFFF;
+            if ( y & 1 )
+                row[y % _dx] |= _transparency;
+            callback->OnLineDecoded( this, y, row.get() );
+        }
+        callback->OnEndDecode( this, false );
+        return true;
+    }
+};
+
+/// compares images drawn from LVScaledImageCache with directly decoded ones
+void testScaledImageCache()
+{
+    CRLog::info("testScaledImageCache()");
+    int oldMaxSize = LVScaledImageCache::getMaxSize();
+    static const int bpps[] = { 1, 2, 3, 4, 8, 16, 32 };
+    static const lUInt32 transparency[] = { 0, 0xFF000000, 0x80000000 };
+    for ( int t=0; t<3; t++ ) {
+        for ( int b=0; b<7; b++ ) {
+            int bpp = bpps[b];
+            for ( int dither=0; dither<2+2; dither++ ) {
+                // 2, 3: ordered and error diffusion dithering
+                LVTestCacheImageSource * src = new LVTestCacheImageSource( 23, 17, transparency[t] );
+                LVImageSourceRef img( src );
+                LVDrawBuf * direct = bpp >= 16 ? (LVDrawBuf*)new LVColorDrawBuf( 64, 48, bpp ) : (LVDrawBuf*)new LVGrayDrawBuf( 64, 48, bpp );
+                LVDrawBuf * cached = bpp >= 16 ? (LVDrawBuf*)new LVColorDrawBuf( 64, 48, bpp ) : (LVDrawBuf*)new LVGrayDrawBuf( 64, 48, bpp );
+                if ( dither >= 2 ) {
+                    direct->setImageDithering( dither == 2 ? IMG_DITHERING_ORDERED : IMG_DITHERING_ERROR_DIFFUSION );
+                    cached->setImageDithering( dither == 2 ? IMG_DITHERING_ORDERED : IMG_DITHERING_ERROR_DIFFUSION );
+                }
+                direct->Clear( 0x808080 );
+                cached->Clear( 0x808080 );
+                lvRect clip( 5, 3, 60, 40 );
+                direct->SetClipRect( &clip );
+                cached->SetClipRect( &clip );
+                LVScaledImageCache::setMaxSize( 0 );
+                direct->Draw( img, 3, 2, 40, 30, dither!=0 );
+                direct->Draw( img, 29, 17, 20, 13, dither!=0 );
+                LVScaledImageCache::setMaxSize( 0x10000 );
+                // pre-decoded item is used by following draws
+                MYASSERT( cached->PrepareImage( img, 20, 13, dither!=0 ) && LVScaledImageCache::getItemCount()==1, "prepare image" );
+                MYASSERT( cached->PrepareImage( img, 20, 13, dither!=0 ) && src->decodeCount==2+1, "prepare cached image" );
+                for ( int pass=0; pass<2; pass++ ) {
+                    cached->Draw( img, 3, 2, 40, 30, dither!=0 );
+                    cached->Draw( img, 29, 17, 20, 13, dither!=0 );
+                    if ( pass==0 ) {
+                        cached->Clear( 0x808080 ); // resets clip rect
+                        cached->SetClipRect( &clip );
+                    }
+                }
+                MYASSERT( LVScaledImageCache::getItemCount()==2, "cache items" );
+                MYASSERT( src->decodeCount==2+2, "decode count" );
+                int rowSize = direct->GetRowSize();
+                for ( int y=0; y<48; y++ )
+                    MYASSERT( !memcmp(direct->GetScanLine(y), cached->GetScanLine(y), rowSize), "cached image pixels" );
+                LVScaledImageCache::removeOwner( src );
+                MYASSERT( LVScaledImageCache::getItemCount()==0 && LVScaledImageCache::getSize()==0, "remove owner" );
+                delete direct;
+                delete cached;
+            }
+        }
+    }
+    LVScaledImageCache::setMaxSize( oldMaxSize );
+    CRLog::info("testScaledImageCache() finished");
+}
+
+/// checks area averaging and bilinear interpolation of smooth image scaling
+void testSmoothImageScaling()
+{
+    CRLog::info("testSmoothImageScaling()");
+    LVColorDrawBuf dst( 200, 200, 32 );
+    dst.setImageScalingQuality( IMG_SCALING_QUALITY_SMOOTH );
+    // flat color is kept for any scale
+    LVColorDrawBuf * flat = new LVColorDrawBuf( 61, 47, 32 );
+    flat->Clear( 0x336699 );
+    LVImageSourceRef img = LVCreateDrawBufImageSource( flat, true );
+    static const int sizes[4][2] = { {20, 13}, {61, 15}, {150, 47}, {137, 190} };
+    for ( int i=0; i<4; i++ ) {
+        dst.Clear( 0 );
+        dst.Draw( img, 0, 0, sizes[i][0], sizes[i][1], false );
+        for ( int y=0; y<sizes[i][1]; y++ )
+            for ( int x=0; x<sizes[i][0]; x++ )
+                MYASSERT( (((lUInt32*)dst.GetScanLine(y))[x] & 0xFFFFFF)==0x336699, "flat color" );
+    }
+    // zoom out: average of 4 source pixels
+    LVColorDrawBuf * gradient = new LVColorDrawBuf( 40, 1, 32 );
+    for ( int x=0; x<40; x++ )
+        ((lUInt32*)gradient->GetScanLine(0))[x] = (x * 6) * 0x010101;
+    img = LVCreateDrawBufImageSource( gradient, true );
+    dst.Clear( 0 );
+    dst.Draw( img, 0, 0, 10, 1, false );
+    for ( int x=0; x<10; x++ )
+        MYASSERT( (((lUInt32*)dst.GetScanLine(0))[x] & 0xFFFFFF)==(lUInt32)(24 * x + 9) * 0x010101, "area averaging" );
+    // zoom in: interpolation between pixel centers, edges are clamped
+    LVColorDrawBuf * pair = new LVColorDrawBuf( 2, 1, 32 );
+    ((lUInt32*)pair->GetScanLine(0))[0] = 0x000000;
+    ((lUInt32*)pair->GetScanLine(0))[1] = 0xFFFFFF;
+    img = LVCreateDrawBufImageSource( pair, true );
+    dst.Clear( 0 );
+    dst.Draw( img, 0, 0, 8, 1, false );
+    static const int expected[8] = { 0, 0, 32, 96, 159, 223, 255, 255 };
+    for ( int x=0; x<8; x++ ) {
+        int v = ((lUInt32*)dst.GetScanLine(0))[x] & 0xFF;
+        MYASSERT( v >= expected[x] - 1 && v <= expected[x] + 1, "bilinear interpolation" );
+    }
+    // color of transparent pixel doesn't affect result
+    LVColorDrawBuf * transparent = new LVColorDrawBuf( 4, 4, 32 );
+    for ( int y=0; y<4; y++ )
+        for ( int x=0; x<4; x++ )
+            ((lUInt32*)transparent->GetScanLine(y))[x] = ((x + y) & 1) ? 0xFF000000 : 0xFFFFFF;
+    img = LVCreateDrawBufImageSource( transparent, true );
+    dst.Clear( 0xFFFFFF );
+    dst.Draw( img, 0, 0, 2, 2, false );
+    for ( int y=0; y<2; y++ )
+        for ( int x=0; x<2; x++ )
+            MYASSERT( (((lUInt32*)dst.GetScanLine(y))[x] & 0xFFFFFF)==0xFFFFFF, "transparent pixels" );
+    CRLog::info("testSmoothImageScaling() finished");
+}
+
+/// renders fixture images with ordered and error diffusion dithering on 1, 2 and 4 bpp gray buffers
+void testImageDithering()
+{
+    CRLog::info("testImageDithering()");
+    int oldMaxSize = LVScaledImageCache::getMaxSize();
+    LVScaledImageCache::setMaxSize( 0 );
+    static const img_dithering_t modes[2] = { IMG_DITHERING_ORDERED, IMG_DITHERING_ERROR_DIFFUSION };
+    static const int bpps[3] = { 1, 2, 4 };
+    static const int gammas[2] = { GAMMA_LEVELS/2, GAMMA_LEVELS-1 };
+    // flat gray: brightness of dithered area in linear light is the same as of source
+    for ( int m=0; m<2; m++ ) {
+        for ( int b=0; b<3; b++ ) {
+            for ( int g=0; g<2; g++ ) {
+                int bpp = bpps[b];
+                int maxLevel = (1<<bpp) - 1;
+                double gamma = cr_gamma_levels[gammas[g]];
+                LVGrayDrawBuf dst( 64, 64, bpp );
+                dst.setImageDithering( modes[m] );
+                dst.setImageDitheringGamma( gammas[g] );
+                for ( int gray=0; gray<256; gray+=5 ) {
+                    LVColorDrawBuf * flat = new LVColorDrawBuf( 8, 8, 32 );
+                    flat->Clear( gray * 0x010101 );
+                    LVImageSourceRef img = LVCreateDrawBufImageSource( flat, true );
+                    dst.Clear( 0 );
+                    dst.Draw( img, 0, 0, 64, 64, true );
+                    double sum = 0;
+                    int minLevel = maxLevel;
+                    int maxUsed = 0;
+                    for ( int y=0; y<64; y++ ) {
+                        for ( int x=0; x<64; x++ ) {
+                            int level = dst.GetPixel( x, y ) >> (bpp > 2 ? 8 - bpp : 0);
+#if (GRAY_INVERSE==1)
+                            level = maxLevel - level;
+#endif
+                            sum += pow( (double)level / maxLevel, gamma );
+                            if ( minLevel > level )
+                                minLevel = level;
+                            if ( maxUsed < level )
+                                maxUsed = level;
+                        }
+                    }
+                    double diff = sum / (64 * 64) - pow( gray / 255.0, gamma );
+                    MYASSERT( diff > -0.02 && diff < 0.02, "dithered brightness" );
+                    if ( modes[m] == IMG_DITHERING_ORDERED )
+                        MYASSERT( maxUsed - minLevel <= 1, "only two nearest levels are used" );
+                    if ( (gray * maxLevel) % 255 == 0 )
+                        MYASSERT( maxUsed == minLevel, "gray equal to buffer level is not dithered" );
+                }
+            }
+        }
+    }
+#if (GRAY_INVERSE==0)
+    // visual regression: ramp and radial gradient fixture rendered with default gamma
+    static const lUInt32 expected[2][3] = {
+        { 0x0dd30e94, 0x56041bf8, 0xad695d23 }, // ordered: 1, 2, 4 bpp
+        { 0x07a8d6fd, 0xbddef4bd, 0x2ef315bf }, // error diffusion
+    };
+    LVColorDrawBuf * fixture = new LVColorDrawBuf( 64, 32, 32 );
+    for ( int y=0; y<32; y++ ) {
+        for ( int x=0; x<64; x++ ) {
+            int gray = y < 16 ? x * 255 / 63 : ((x - 32) * (x - 32) + (y - 24) * (y - 24) * 4) * 255 / (32 * 32 + 8 * 8 * 4);
+            ((lUInt32*)fixture->GetScanLine(y))[x] = gray * 0x010101;
+        }
+    }
+    LVImageSourceRef img = LVCreateDrawBufImageSource( fixture, true );
+    for ( int m=0; m<2; m++ ) {
+        for ( int b=0; b<3; b++ ) {
+            LVGrayDrawBuf dst( 64, 32, bpps[b] );
+            dst.setImageDithering( modes[m] );
+            dst.setImageDitheringGamma( IMAGE_DITHERING_GAMMA_DEFAULT );
+            dst.Draw( img, 0, 0, 64, 32, true );
+            lUInt32 crc = 0;
+            for ( int y=0; y<32; y++ )
+                crc = lStr_crc32( crc, dst.GetScanLine(y), dst.GetRowSize() );
+            CRLog::debug("dithering %d, %d bpp: crc=%08x", (int)modes[m], bpps[b], crc);
+            MYASSERT( crc == expected[m][b], "rendered fixture" );
+        }
+    }
+#endif
+    LVScaledImageCache::setMaxSize( oldMaxSize );
+    CRLog::info("testImageDithering() finished");
+}
+
+/// checks rotation by 90, 180 and 270 degrees and color buffer DrawTo with clipping
+void testDrawBufRotation()
+{
+    CRLog::info("testDrawBufRotation()");
+    static const int bpps[7] = { 1, 2, 3, 4, 8, 16, 32 };
+    // odd sizes, not multiple of tile and byte; the last one is big enough to be split between threads
+    static const int sizes[3][2] = { {37, 23}, {70, 45}, {1000, 600} };
+    lUInt32 seed = 12345;
+    for ( int b=0; b<7; b++ ) {
+        for ( int s=0; s<3; s++ ) {
+            for ( int angle=1; angle<4; angle++ ) {
+                int dx = sizes[s][0];
+                int dy = sizes[s][1];
+                LVDrawBuf * buf = bpps[b] <= 8 ? (LVDrawBuf*)new LVGrayDrawBuf( dx, dy, bpps[b] ) : (LVDrawBuf*)new LVColorDrawBuf( dx, dy, bpps[b] );
+                for ( int y=0; y<dy; y++ ) {
+                    lUInt8 * row = buf->GetScanLine(y);
+                    for ( int i=0; i<buf->GetRowSize(); i++ ) {
+                        seed = seed * 1103515245 + 12345;
+                        row[i] = (lUInt8)(seed >> 16);
+                    }
+                }
+                LVArray<lUInt32> pixels( dx * dy, 0 );
+                for ( int y=0; y<dy; y++ )
+                    for ( int x=0; x<dx; x++ )
+                        pixels[y * dx + x] = buf->GetPixel( x, y );
+                buf->Rotate( (cr_rotate_angle_t)angle );
+                int ndx = (angle & 1) ? dy : dx;
+                int ndy = (angle & 1) ? dx : dy;
+                MYASSERT( buf->GetWidth()==ndx && buf->GetHeight()==ndy, "rotated size" );
+                for ( int y=0; y<ndy; y++ ) {
+                    for ( int x=0; x<ndx; x++ ) {
+                        int sx = x;
+                        int sy = y;
+                        if ( angle==CR_ROTATE_ANGLE_90 ) {
+                            sx = y;
+                            sy = dy - 1 - x;
+                        } else if ( angle==CR_ROTATE_ANGLE_270 ) {
+                            sx = dx - 1 - y;
+                            sy = x;
+                        } else if ( bpps[b] > 2 || (dx * bpps[b]) % 8 == 0 ) {
+                            // 180 degrees rotation of packed pixels keeps row padding bits in place
+                            sx = dx - 1 - x;
+                            sy = dy - 1 - y;
+                        } else {
+                            continue;
+                        }
+                        MYASSERT( buf->GetPixel( x, y )==pixels[sy * dx + sx], "rotated pixel" );
+                    }
+                }
+                delete buf;
+            }
+        }
+    }
+    // color buffer drawn to the same format buffer, partially clipped
+    static const int bpps2[2] = { 16, 32 };
+    for ( int b=0; b<2; b++ ) {
+        LVColorDrawBuf src( 50, 40, bpps2[b] );
+        for ( int y=0; y<40; y++ )
+            for ( int x=0; x<50; x++ )
+                src.FillRect( x, y, x+1, y+1, (x * 5) * 0x10000 + (y * 6) * 0x100 + 0x80 );
+        LVColorDrawBuf dst( 64, 64, bpps2[b] );
+        dst.Clear( 0 );
+        lvRect clip( 5, 10, 60, 64 );
+        dst.SetClipRect( &clip );
+        src.DrawTo( &dst, -7, 30, 0, NULL );
+        for ( int y=0; y<64; y++ ) {
+            for ( int x=0; x<64; x++ ) {
+                bool inside = x >= clip.left && x < clip.right && y >= clip.top && y < clip.bottom && x+7 < 50 && y >= 30;
+                lUInt32 expected = inside ? src.GetPixel( x+7, y-30 ) : 0;
+                MYASSERT( dst.GetPixel( x, y )==expected, "DrawTo pixel" );
+            }
+        }
+    }
+    CRLog::info("testDrawBufRotation() finished");
+}
+#endif
@@ -23,6 +23,7 @@
 #include "../include/lvdrawbuf.h"
 #include "../include/lvstyles.h"
 #include "../include/lvthread.h"
+#include "../include/lvhashtable.h"
 
 // define to filter out all fonts except .ttf
 //#define LOAD_TTF_FONTS_ONLY
@@ -45,11 +46,15 @@
 #ifdef ANDROID
 #include "freetype/config/ftheader.h"
 #include "freetype/freetype.h"
+#include "freetype/tttables.h"
+#include "freetype/tttags.h"
 #else
 
 #include <freetype/config/ftheader.h>
 //#include FT_FREETYPE_H
 #include <freetype/freetype.h>
+#include <freetype/tttables.h>
+#include <freetype/tttags.h>
 #endif
 
 #if (USE_FONTCONFIG==1)
@@ -282,13 +287,38 @@ public:
     { }
 };
 
+/// key of font lookup: properties of LVFontDef used by CalcMatch()
+struct LVFontIndexKey
+{
+    int size;
+    int weight;
+    int italic;
+    css_font_family_t family;
+    lString8 typeface;
+    LVFontIndexKey( const LVFontDef & def )
+    : size(def.getSize()), weight(def.getWeight()), italic(def.getItalic() ? (def.isRealItalic() ? 1 : 2) : 0)
+    , family(def.getFamily()), typeface(def.getTypeFace())
+    { }
+    bool operator == ( const LVFontIndexKey & v ) const
+    {
+        return size==v.size && weight==v.weight && italic==v.italic && family==v.family && typeface==v.typeface;
+    }
+};
+
+inline lUInt32 getHash( const LVFontIndexKey & key )
+{
+    return ((((lUInt32)key.size * 31 + key.weight) * 31 + key.italic) * 31 + key.family) * 31 + key.typeface.getHash();
+}
+
 /// font cache
 class LVFontCache
 {
     LVPtrVector< LVFontCacheItem > _registered_list;
     LVPtrVector< LVFontCacheItem > _instance_list;
+    /// resolved results of find(), valid until registered or instance list is changed
+    LVHashTable< LVFontIndexKey, LVFontCacheItem * > _index;
 public:
-    void clear() { _registered_list.clear(); _instance_list.clear(); }
+    void clear() { _registered_list.clear(); _instance_list.clear(); _index.clear(); }
     void gc(); // garbage collector
     void update( const LVFontDef * def, LVFontRef ref );
     int  length() { return _registered_list.length(); }
@@ -321,7 +351,7 @@ public:
             _registered_list[i]->getFont()->setFallbackFont(LVFontRef());
         }
     }
-    LVFontCache( )
+    LVFontCache( ) : _index(256)
     { }
     virtual ~LVFontCache() { }
 };
@@ -330,59 +360,460 @@ public:
 #if (USE_FREETYPE==1)
 
 
+/// char widths of font instance, read without locking
+/// char advance widths of font, in 26.6 fixed point (1/64 pixel), 0xFFFF if not known
 class LVFontGlyphWidthCache
 {
 private:
-    lUInt8 * ptrs[128];
+    lUInt16 * volatile ptrs[128];
 public:
-    lUInt8 get( lChar16 ch )
+    lUInt16 get( lChar16 ch )
     {
         int inx = (ch>>9) & 0x7f;
-        lUInt8 * ptr = ptrs[inx];
+        lUInt16 * ptr = ptrs[inx];
         if ( !ptr )
-            return 0xFF;
+            return 0xFFFF;
         return ptr[ch & 0x1FF ];
     }
-    void put( lChar16 ch, lUInt8 w )
+    void put( lChar16 ch, lUInt16 w )
     {
         int inx = (ch>>9) & 0x7f;
-        lUInt8 * ptr = ptrs[inx];
+        lUInt16 * ptr = ptrs[inx];
         if ( !ptr ) {
-            ptr = new lUInt8[512];
-            ptrs[inx] = ptr;
-            memset( ptr, 0xFF, sizeof(lUInt8) * 512 );
+            ptr = new lUInt16[512];
+            memset( ptr, 0xFF, sizeof(lUInt16) * 512 );
+            crMemoryBarrier();
+            if ( !crAtomicCasPtr( (void * volatile *)&ptrs[inx], NULL, ptr ) ) {
+                // page is published by another thread
+                delete [] ptr;
+                ptr = ptrs[inx];
+            }
         }
         ptr[ ch & 0x1FF ] = w;
     }
+    /// reset all widths; pages are kept, as they may be accessed by concurrent readers
     void clear()
     {
         for ( int i=0; i<128; i++ ) {
             if ( ptrs[i] )
-                delete [] ptrs[i];
-            ptrs[i] = NULL;
+                memset( ptrs[i], 0xFF, sizeof(lUInt16) * 512 );
         }
     }
     LVFontGlyphWidthCache()
     {
-        memset( ptrs, 0, 128*sizeof(lUInt8*) );
+        memset( (void*)ptrs, 0, 128*sizeof(lUInt16*) );
     }
     ~LVFontGlyphWidthCache()
     {
-        clear();
+        for ( int i=0; i<128; i++ ) {
+            if ( ptrs[i] )
+                delete [] ptrs[i];
+        }
+    }
+};
+
+/// temporary 8 bit coverage bitmap for glyph rendering and unpacking
+class LVGlyphBitmapBuffer
+{
+    lUInt8 _static[1024];
+    lUInt8 * _buf;
+    int _size;
+public:
+    LVGlyphBitmapBuffer() : _buf(_static), _size(sizeof(_static)) { }
+    ~LVGlyphBitmapBuffer()
+    {
+        if ( _buf != _static )
+            free( _buf );
+    }
+    lUInt8 * get( int size )
+    {
+        if ( size > _size ) {
+            if ( _buf != _static )
+                free( _buf );
+            _buf = (lUInt8 *)malloc( size );
+            _size = size;
+        }
+        return _buf;
+    }
+    /// returns 8 bit coverage of glyph
+    const lUInt8 * getBitmap( const LVFontGlyphCacheItem * item )
+    {
+#if (GLYPH_CACHE_BPP==8)
+        return item->bmp;
+#else
+        return item->getBitmap( get( item->bmp_width * item->bmp_height ) );
+#endif
+    }
+};
+
+#define KERNING_CACHE_UNKNOWN 0x7FFF
+
+/// kerning offsets of char pairs, in 26.6; pairs of Latin and Cyrillic chars are kept in dense rows read without locking
+class LVFontKerningCache
+{
+    lInt16 * volatile _rows[256];
+    LVHashTable<lUInt32, int> _pairs; // other pairs, accessed with font mutex locked
+
+    static int denseIndex( lChar16 ch )
+    {
+        if ( ch < 0x80 )
+            return ch;
+        if ( ch >= 0x400 && ch < 0x480 )
+            return ch - 0x400 + 0x80;
+        return -1;
+    }
+public:
+    /// returns cached offset of dense pair, KERNING_CACHE_UNKNOWN if pair is not cached
+    int getDense( lChar16 ch1, lChar16 ch2 )
+    {
+        int i1 = denseIndex( ch1 );
+        int i2 = denseIndex( ch2 );
+        if ( i1 < 0 || i2 < 0 )
+            return KERNING_CACHE_UNKNOWN;
+        lInt16 * row = _rows[i1];
+        return row ? row[i2] : KERNING_CACHE_UNKNOWN;
+    }
+    /// returns cached offset, KERNING_CACHE_UNKNOWN if pair is not cached; to be called with font mutex locked
+    int get( lChar16 ch1, lChar16 ch2 )
+    {
+        if ( denseIndex( ch1 ) >= 0 && denseIndex( ch2 ) >= 0 )
+            return getDense( ch1, ch2 );
+        int k;
+        if ( _pairs.get( ((lUInt32)ch1 << 16) | ch2, k ) )
+            return k;
+        return KERNING_CACHE_UNKNOWN;
+    }
+    /// stores offset; to be called with font mutex locked
+    void put( lChar16 ch1, lChar16 ch2, int k )
+    {
+        if ( k >= KERNING_CACHE_UNKNOWN )
+            k = KERNING_CACHE_UNKNOWN - 1;
+        else if ( k < -KERNING_CACHE_UNKNOWN )
+            k = -KERNING_CACHE_UNKNOWN;
+        int i1 = denseIndex( ch1 );
+        int i2 = denseIndex( ch2 );
+        if ( i1 < 0 || i2 < 0 ) {
+            _pairs.set( ((lUInt32)ch1 << 16) | ch2, k );
+            return;
+        }
+        lInt16 * row = _rows[i1];
+        if ( !row ) {
+            row = new lInt16[256];
+            for ( int i=0; i<256; i++ )
+                row[i] = KERNING_CACHE_UNKNOWN;
+            row[i2] = (lInt16)k;
+            crMemoryBarrier();
+            _rows[i1] = row;
+            return;
+        }
+        row[i2] = (lInt16)k;
+    }
+    LVFontKerningCache() : _pairs(256)
+    {
+        memset( (void*)_rows, 0, sizeof(_rows) );
+    }
+    ~LVFontKerningCache()
+    {
+        for ( int i=0; i<256; i++ )
+            if ( _rows[i] )
+                delete [] _rows[i];
+    }
+};
+
+/** \brief pair adjustments of 'kern' feature of OpenType GPOS table
+
+    Used for fonts which have no old style 'kern' table. Only horizontal advance
+    of first glyph is applied; lookups of all scripts and languages are used.
+*/
+class LVFontGposKerning
+{
+    lUInt8 * _data;
+    int _size;
+    LVArray<int> _subtables; // offsets of PairPos subtables
+    LVArray<int> _lookups;   // index of first subtable of each lookup, followed by subtables count
+
+    int u16( int offset ) const
+    {
+        if ( offset < 0 || offset + 2 > _size )
+            return 0;
+        return (_data[offset] << 8) | _data[offset + 1];
+    }
+    lUInt32 u32( int offset ) const
+    {
+        return ((lUInt32)u16( offset ) << 16) | (lUInt32)u16( offset + 2 );
     }
+    /// returns size of ValueRecord of specified ValueFormat
+    static int valueRecordSize( int format )
+    {
+        int size = 0;
+        for ( int i=0; i<8; i++ )
+            if ( format & (1 << i) )
+                size += 2;
+        return size;
+    }
+    /// returns XAdvance of ValueRecord
+    int xAdvance( int format, int rec ) const
+    {
+        if ( !(format & 4) )
+            return 0;
+        return (lInt16)u16( rec + ((format & 1) ? 2 : 0) + ((format & 2) ? 2 : 0) );
+    }
+    /// returns coverage index of glyph, -1 if not covered
+    int findCoverage( int coverage, int glyph ) const
+    {
+        int format = u16( coverage );
+        int a = 0;
+        int b = u16( coverage + 2 ) - 1;
+        while ( a <= b ) {
+            int m = (a + b) / 2;
+            if ( format == 1 ) {
+                int g = u16( coverage + 4 + m * 2 );
+                if ( g == glyph )
+                    return m;
+                if ( g < glyph )
+                    a = m + 1;
+                else
+                    b = m - 1;
+            } else if ( format == 2 ) {
+                int rec = coverage + 4 + m * 6;
+                if ( glyph < u16( rec ) )
+                    b = m - 1;
+                else if ( glyph > u16( rec + 2 ) )
+                    a = m + 1;
+                else
+                    return u16( rec + 4 ) + glyph - u16( rec );
+            } else {
+                break;
+            }
+        }
+        return -1;
+    }
+    /// returns class of glyph from ClassDef table
+    int findClass( int classDef, int glyph ) const
+    {
+        int format = u16( classDef );
+        if ( format == 1 ) {
+            int start = u16( classDef + 2 );
+            if ( glyph >= start && glyph < start + u16( classDef + 4 ) )
+                return u16( classDef + 6 + (glyph - start) * 2 );
+        } else if ( format == 2 ) {
+            int a = 0;
+            int b = u16( classDef + 2 ) - 1;
+            while ( a <= b ) {
+                int m = (a + b) / 2;
+                int rec = classDef + 4 + m * 6;
+                if ( glyph < u16( rec ) )
+                    b = m - 1;
+                else if ( glyph > u16( rec + 2 ) )
+                    a = m + 1;
+                else
+                    return u16( rec + 4 );
+            }
+        }
+        return 0;
+    }
+    /// reads pair adjustment from PairPos subtable, returns false if subtable is not applicable to pair
+    bool getPairValue( int subtable, int left, int right, int & value ) const
+    {
+        int coverage = findCoverage( subtable + u16( subtable + 2 ), left );
+        if ( coverage < 0 )
+            return false;
+        int format1 = u16( subtable + 4 );
+        int format2 = u16( subtable + 6 );
+        int size1 = valueRecordSize( format1 );
+        int size2 = valueRecordSize( format2 );
+        switch ( u16( subtable ) ) {
+        case 1:
+            {
+                // pair sets of individual glyphs, sorted by second glyph
+                if ( coverage >= u16( subtable + 8 ) )
+                    return false;
+                int pairSet = subtable + u16( subtable + 10 + coverage * 2 );
+                int recSize = 2 + size1 + size2;
+                int a = 0;
+                int b = u16( pairSet ) - 1;
+                while ( a <= b ) {
+                    int m = (a + b) / 2;
+                    int rec = pairSet + 2 + m * recSize;
+                    int g = u16( rec );
+                    if ( g == right ) {
+                        value = xAdvance( format1, rec + 2 );
+                        return true;
+                    }
+                    if ( g < right )
+                        a = m + 1;
+                    else
+                        b = m - 1;
+                }
+            }
+            return false;
+        case 2:
+            {
+                // matrix of glyph classes
+                int class1 = findClass( subtable + u16( subtable + 8 ), left );
+                int class2 = findClass( subtable + u16( subtable + 10 ), right );
+                int class2Count = u16( subtable + 14 );
+                if ( class1 >= u16( subtable + 12 ) || class2 >= class2Count )
+                    return false;
+                value = xAdvance( format1, subtable + 16 + (class1 * class2Count + class2) * (size1 + size2) );
+            }
+            return true;
+        default:
+            return false;
+        }
+    }
+public:
+    LVFontGposKerning() : _data(NULL), _size(0) { }
+    ~LVFontGposKerning()
+    {
+        if ( _data )
+            free( _data );
+    }
+    /// reads GPOS table of face, returns false if there are no pair adjustments in 'kern' feature
+    bool load( FT_Face face )
+    {
+        FT_ULong length = 0;
+        if ( FT_Load_Sfnt_Table( face, TTAG_GPOS, 0, NULL, &length ) || length < 10 )
+            return false;
+        _data = (lUInt8 *)malloc( length );
+        _size = (int)length;
+        if ( FT_Load_Sfnt_Table( face, TTAG_GPOS, 0, _data, &length ) )
+            return false;
+        int featureList = u16( 6 );
+        int lookupList = u16( 8 );
+        if ( !featureList || !lookupList )
+            return false;
+        // lookups referenced by 'kern' features of any script
+        int lookupCount = u16( lookupList );
+        LVArray<lUInt8> used( lookupCount, 0 );
+        int featureCount = u16( featureList );
+        for ( int i=0; i<featureCount; i++ ) {
+            int rec = featureList + 2 + i * 6;
+            if ( u32( rec ) != TTAG_kern )
+                continue;
+            int feature = featureList + u16( rec + 4 );
+            int count = u16( feature + 2 );
+            for ( int j=0; j<count; j++ ) {
+                int index = u16( feature + 4 + j * 2 );
+                if ( index < lookupCount )
+                    used[index] = 1;
+            }
+        }
+        for ( int i=0; i<lookupCount; i++ ) {
+            if ( !used[i] )
+                continue;
+            int lookup = lookupList + u16( lookupList + 2 + i * 2 );
+            int type = u16( lookup );
+            int count = u16( lookup + 4 );
+            int first = _subtables.length();
+            for ( int j=0; j<count; j++ ) {
+                int subtable = lookup + u16( lookup + 6 + j * 2 );
+                if ( type == 9 ) {
+                    // extension subtable with 32 bit offset
+                    if ( u16( subtable ) != 1 || u16( subtable + 2 ) != 2 )
+                        continue;
+                    subtable += (int)u32( subtable + 4 );
+                } else if ( type != 2 ) {
+                    continue;
+                }
+                _subtables.add( subtable );
+            }
+            if ( _subtables.length() > first ) {
+                _lookups.add( first );
+                _lookups.add( _subtables.length() - first );
+            }
+        }
+        return _subtables.length() > 0;
+    }
+    /// returns sum of horizontal adjustments of glyph pair, in font units
+    int get( int left, int right ) const
+    {
+        int res = 0;
+        for ( int i=0; i<_lookups.length(); i+=2 ) {
+            // first applicable subtable of each lookup is used
+            for ( int j=0; j<_lookups[i+1]; j++ ) {
+                int value;
+                if ( getPairValue( _subtables[_lookups[i] + j], left, right, value ) ) {
+                    res += value;
+                    break;
+                }
+            }
+        }
+        return res;
+    }
+};
+
+/// common Latin ligatures, longer sequences first
+static const struct {
+    lChar16 chars[4];
+    lChar16 ligature;
+} lvfont_ligatures[] = {
+    { { 'f', 'f', 'i', 0 }, 0xFB03 },
+    { { 'f', 'f', 'l', 0 }, 0xFB04 },
+    { { 'f', 'f', 0 }, 0xFB00 },
+    { { 'f', 'i', 0 }, 0xFB01 },
+    { { 'f', 'l', 0 }, 0xFB02 },
 };
 
+#define LVFONT_LIGATURE_COUNT (int)(sizeof(lvfont_ligatures) / sizeof(lvfont_ligatures[0]))
+
+/// returns number of chars of ligature at start of text, 0 if not found; mask has bits of ligatures present in font
+static int findLigature( const lChar16 * text, int len, int mask, lChar16 & lig )
+{
+    if ( len < 2 || text[0] != 'f' )
+        return 0;
+    for ( int i=0; i<LVFONT_LIGATURE_COUNT; i++ ) {
+        if ( !(mask & (1 << i)) )
+            continue;
+        const lChar16 * chars = lvfont_ligatures[i].chars;
+        int n = 0;
+        while ( chars[n] && n < len && text[n] == chars[n] )
+            n++;
+        if ( !chars[n] ) {
+            lig = lvfont_ligatures[i].ligature;
+            return n;
+        }
+    }
+    return 0;
+}
+
+/// synthetic bold: dilates 8 bit coverage bitmap by hShift pixels to the right and vShift pixels down
+static void emboldenCoverage( const lUInt8 * src, int w, int h, int hShift, int vShift, lUInt8 * dst )
+{
+    int dx = w ? w + hShift : 0;
+    int dy = h ? h + vShift : 0;
+    for ( int y=0; y<dy; y++ ) {
+        lUInt8 * row = dst + y*dx;
+        for ( int x=0; x<dx; x++ ) {
+            int s = 0;
+            for ( int yy=-vShift; yy<=0; yy++ ) {
+                int srcy = y+yy;
+                if ( srcy<0 || srcy>=h )
+                    continue;
+                const lUInt8 * srcrow = src + srcy*w;
+                for ( int xx=-hShift; xx<=0; xx++ ) {
+                    int srcx = x+xx;
+                    if ( srcx>=0 && srcx<w && srcrow[srcx] > s )
+                        s = srcrow[srcx];
+                }
+            }
+            row[x] = s;
+        }
+    }
+}
+
 class LVFreeTypeFace;
-static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lChar16 ch, FT_GlyphSlot slot ) // , bool drawMonochrome
+/// converts bitmap of rendered FreeType slot to 8 bit gamma corrected coverage
+static const lUInt8 * getSlotCoverage( FT_GlyphSlot slot, LVGlyphBitmapBuffer & coverage )
 {
     FT_Bitmap*  bitmap = &slot->bitmap;
     lUInt8 w = (lUInt8)(bitmap->width);
     lUInt8 h = (lUInt8)(bitmap->rows);
-    LVFontGlyphCacheItem * item = LVFontGlyphCacheItem::newItem(local_cache, ch, w, h );
+    lUInt8 * bmp = coverage.get( w*h );
     if ( bitmap->pixel_mode==FT_PIXEL_MODE_MONO ) { //drawMonochrome
         lUInt8 mask = 0x80;
         const lUInt8 * ptr = (const lUInt8 *)bitmap->buffer;
-        lUInt8 * dst = item->bmp;
+        lUInt8 * dst = bmp;
         //int rowsize = ((w + 15) / 16) * 2;
         for ( int y=0; y<h; y++ ) {
             const lUInt8 * row = ptr;
@@ -398,141 +829,281 @@ static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lCha
             ptr += bitmap->pitch;//rowsize;
         }
     } else {
-#if 0
-        if ( bitmap->pixel_mode==FT_PIXEL_MODE_MONO ) {
-            memset( item->bmp, 0, w*h );
-            lUInt8 * srcrow = bitmap->buffer;
-            lUInt8 * dstrow = item->bmp;
-            for ( int y=0; y<h; y++ ) {
-                lUInt8 * src = srcrow;
-                for ( int x=0; x<w; x++ ) {
-                    dstrow[x] =  ( (*src)&(0x80>>(x&7)) ) ? 255 : 0;
-                    if ((x&7)==7)
-                        src++;
-                }
-                srcrow += bitmap->pitch;
-                dstrow += w;
-            }
-        } else {
-#endif
-            memcpy( item->bmp, bitmap->buffer, w*h );
-            // correct gamma
-            if ( gammaIndex!=GAMMA_LEVELS/2 )
-                cr_correct_gamma_buf(item->bmp, w*h, gammaIndex);
-//            }
+        memcpy( bmp, bitmap->buffer, w*h );
+        // correct gamma
+        if ( gammaIndex!=GAMMA_LEVELS/2 )
+            cr_correct_gamma_buf(bmp, w*h, gammaIndex);
     }
+    return bmp;
+}
+
+/// creates glyph item from rendered FreeType slot, to be called with global cache mutex locked
+static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lChar16 ch, FT_GlyphSlot slot ) // , bool drawMonochrome
+{
+    LVFontGlyphCacheItem * item = LVFontGlyphCacheItem::newItem(local_cache, ch, (lUInt8)slot->bitmap.width, (lUInt8)slot->bitmap.rows );
+    LVGlyphBitmapBuffer coverage;
+    item->setBitmap( getSlotCoverage( slot, coverage ) );
     item->origin_x =   (lInt8)slot->bitmap_left;
     item->origin_y =   (lInt8)slot->bitmap_top;
     item->advance =    (lUInt8)(slot->metrics.horiAdvance >> 6);
     return item;
 }
 
-void LVFontLocalGlyphCache::clear()
+void LVFontGlyphCacheItem::setBitmap( const lUInt8 * coverage )
 {
-    while ( head ) {
-        LVFontGlyphCacheItem * ptr = head;
-        remove( ptr );
-        global_cache->remove( ptr );
-        LVFontGlyphCacheItem::freeItem( ptr );
+#if (GLYPH_CACHE_BPP==4)
+    int rowSize = getRowSize( bmp_width );
+    for ( int y=0; y<bmp_height; y++ ) {
+        const lUInt8 * src = coverage + y * bmp_width;
+        lUInt8 * dst = bmp + y * rowSize;
+        for ( int x=0; x<bmp_width; x+=2 ) {
+            lUInt8 b = src[x] & 0xF0;
+            if ( x+1 < bmp_width )
+                b |= src[x+1] >> 4;
+            *dst++ = b;
+        }
     }
+#else
+    memcpy( bmp, coverage, bmp_width * bmp_height );
+#endif
 }
 
-LVFontGlyphCacheItem * LVFontLocalGlyphCache::get( lUInt16 ch )
+const lUInt8 * LVFontGlyphCacheItem::getBitmap( lUInt8 * buf ) const
 {
-    LVFontGlyphCacheItem * ptr = head;
-    for ( ; ptr; ptr = ptr->next_local ) {
-        if ( ptr->ch == ch ) {
-            global_cache->refresh( ptr );
-            return ptr;
+#if (GLYPH_CACHE_BPP==4)
+    int rowSize = getRowSize( bmp_width );
+    lUInt8 * dst = buf;
+    for ( int y=0; y<bmp_height; y++ ) {
+        const lUInt8 * src = bmp + y * rowSize;
+        for ( int x=0; x<bmp_width; x++ ) {
+            lUInt8 b = (x & 1) ? (src[x>>1] & 0x0F) : (src[x>>1] >> 4);
+            *dst++ = b | (b << 4);
         }
     }
-    return NULL;
+    return buf;
+#else
+    return bmp;
+#endif
 }
 
-void LVFontLocalGlyphCache::put( LVFontGlyphCacheItem * item )
+LVFontLocalGlyphCache::~LVFontLocalGlyphCache()
 {
-    global_cache->put( item );
-    item->next_local = head;
-    if ( head )
-        head->prev_local = item;
-    if ( !tail )
-        tail = item;
-    head = item;
+    clear();
+    for ( int i=0; i<GLYPH_INDEX_PAGE_COUNT; i++ )
+        if ( char_index[i] )
+            delete[] char_index[i];
+}
+
+void LVFontLocalGlyphCache::clear()
+{
+    LVLock lock( global_cache->getMutex() );
+    // items stay in atlas slabs until slab is dropped
+    for ( int i=0; i<GLYPH_INDEX_PAGE_COUNT; i++ ) {
+        LVFontGlyphCacheItem ** page = char_index[i];
+        if ( !page )
+            continue;
+        for ( int j=0; j<GLYPH_INDEX_PAGE_SIZE; j++ ) {
+            if ( page[j] ) {
+                page[j]->local_cache = NULL;
+                page[j] = NULL;
+            }
+        }
+    }
+}
+
+LVFontGlyphCacheItem * LVFontLocalGlyphCache::put( LVFontGlyphCacheItem * item )
+{
+    LVLock lock( global_cache->getMutex() );
+    int pageIndex = item->ch >> GLYPH_INDEX_PAGE_SHIFT;
+    LVFontGlyphCacheItem ** page = char_index[pageIndex];
+    if ( !page ) {
+        page = new LVFontGlyphCacheItem * [GLYPH_INDEX_PAGE_SIZE];
+        memset( page, 0, sizeof(LVFontGlyphCacheItem *) * GLYPH_INDEX_PAGE_SIZE );
+        crMemoryBarrier();
+        char_index[pageIndex] = page;
+    }
+    LVFontGlyphCacheItem * existing = page[ item->ch & (GLYPH_INDEX_PAGE_SIZE-1) ];
+    if ( existing ) {
+        // rendered concurrently by another thread: new item is left unused in atlas
+        item->local_cache = NULL;
+        return existing;
+    }
+    item->local_cache = this;
+    // item must be completely initialized before it becomes visible for lock free readers
+    crMemoryBarrier();
+    page[ item->ch & (GLYPH_INDEX_PAGE_SIZE-1) ] = item;
+    return item;
 }
 
-/// remove from list, but don't delete
 void LVFontLocalGlyphCache::remove( LVFontGlyphCacheItem * item )
 {
-    if ( item==head )
-        head = item->next_local;
-    if ( item==tail )
-        tail = item->prev_local;
-    if ( !head || !tail )
-        return;
-    if ( item->prev_local )
-        item->prev_local->next_local = item->next_local;
-    if ( item->next_local )
-        item->next_local->prev_local = item->prev_local;
-    item->next_local = NULL;
-    item->prev_local = NULL;
+    LVFontGlyphCacheItem ** slot = getSlot( item->ch );
+    if ( *slot==item )
+        *slot = NULL;
+    item->local_cache = NULL;
+}
+
+void LVFontLocalGlyphCache::replace( LVFontGlyphCacheItem * item, LVFontGlyphCacheItem * copy )
+{
+    copy->local_cache = this;
+    crMemoryBarrier();
+    *getSlot( item->ch ) = copy;
+    item->local_cache = NULL;
+}
+
+LVFontGlobalGlyphCache::~LVFontGlobalGlyphCache()
+{
+    clear();
+    readers = 0;
+    freeRetired();
 }
 
-void LVFontGlobalGlyphCache::refresh( LVFontGlyphCacheItem * item )
+LVFontGlyphCacheItem * LVFontGlobalGlyphCache::allocItem( lChar16 ch, int w, int h )
 {
-    if ( tail!=item ) {
-        //move to head
-        remove( item );
-        put( item );
+    int sz = LVFontGlyphCacheItem::getItemSize( w, h );
+    if ( !newest || newest->used + sz > newest->size ) {
+        // start new slab; large glyph gets dedicated one
+        int slabSize = sz > slab_size ? sz : slab_size;
+        LVFontGlyphSlab * slab = (LVFontGlyphSlab *)malloc( sizeof(LVFontGlyphSlab) + slabSize );
+        slab->next = NULL;
+        slab->size = slabSize;
+        slab->used = 0;
+        if ( newest )
+            newest->next = slab;
+        else
+            oldest = slab;
+        newest = slab;
+        size += slabSize;
+    }
+    LVFontGlyphCacheItem * item = (LVFontGlyphCacheItem *)(newest->data() + newest->used);
+    newest->used += sz;
+    item->local_cache = NULL;
+    item->ch = ch;
+    item->bmp_width = (lUInt8)w;
+    item->bmp_height = (lUInt8)h;
+    item->origin_x = 0;
+    item->origin_y = 0;
+    item->advance = 0;
+    item->used = 0;
+    // drop oldest slabs; new item is in newest one and is never affected
+    while ( size > max_size && oldest != newest )
+        evictSlab();
+    freeRetired();
+    return item;
+}
+
+void LVFontGlobalGlyphCache::evictSlab()
+{
+    LVFontGlyphSlab * slab = oldest;
+    oldest = slab->next;
+    size -= slab->size;
+    for ( int pos = 0; pos < slab->used; ) {
+        LVFontGlyphCacheItem * item = (LVFontGlyphCacheItem *)(slab->data() + pos);
+        int sz = item->getSize();
+        pos += sz;
+        if ( !item->local_cache )
+            continue; // not indexed anymore
+        if ( item->used && newest->used + sz <= newest->size ) {
+            // second chance: move glyph used since previous pass to newest slab
+            LVFontGlyphCacheItem * copy = (LVFontGlyphCacheItem *)(newest->data() + newest->used);
+            newest->used += sz;
+            memcpy( copy, item, sz );
+            copy->used = 0;
+            item->local_cache->replace( item, copy );
+        } else {
+            item->local_cache->remove( item );
+        }
     }
+    slab->next = retired;
+    retired = slab;
 }
 
-void LVFontGlobalGlyphCache::put( LVFontGlyphCacheItem * item )
+void LVFontGlobalGlyphCache::freeRetired()
 {
-    int sz = item->getSize();
-    // remove extra items from tail
-    while ( sz + size > max_size ) {
-        LVFontGlyphCacheItem * removed_item = tail;
-        if ( !removed_item )
-            break;
-        remove( removed_item );
-        removed_item->local_cache->remove( removed_item );
-        LVFontGlyphCacheItem::freeItem( removed_item );
-    }
-    // add new item to head
-    item->next_global = head;
-    if ( head )
-        head->prev_global = item;
-    head = item;
-    if ( !tail )
-        tail = item;
-    size += sz;
-}
-
-void LVFontGlobalGlyphCache::remove( LVFontGlyphCacheItem * item )
-{
-    if ( item==head )
-        head = item->next_global;
-    if ( item==tail )
-        tail = item->prev_global;
-    if ( !head || !tail )
+    // slabs are not reachable from indexes anymore: safe to free when nobody reads
+    crMemoryBarrier();
+    if ( readers )
         return;
-    if ( item->prev_global )
-        item->prev_global->next_global = item->next_global;
-    if ( item->next_global )
-        item->next_global->prev_global = item->prev_global;
-    item->next_global = NULL;
-    item->prev_global = NULL;
-    size -= item->getSize();
+    while ( retired ) {
+        LVFontGlyphSlab * slab = retired;
+        retired = slab->next;
+        free( slab );
+    }
+}
+
+void LVFontGlobalGlyphCache::endRead()
+{
+    if ( crAtomicAdd( &readers, -1 )==0 && retired ) {
+        LVLock lock( mutex );
+        freeRetired();
+    }
 }
 
 void LVFontGlobalGlyphCache::clear()
 {
-    while ( head ) {
-        LVFontGlyphCacheItem * ptr = head;
-        remove( ptr );
-        ptr->local_cache->remove( ptr );
-        LVFontGlyphCacheItem::freeItem( ptr );
+    LVLock lock( mutex );
+    while ( oldest ) {
+        LVFontGlyphSlab * slab = oldest;
+        oldest = slab->next;
+        for ( int pos = 0; pos < slab->used; ) {
+            LVFontGlyphCacheItem * item = (LVFontGlyphCacheItem *)(slab->data() + pos);
+            pos += item->getSize();
+            if ( item->local_cache )
+                item->local_cache->remove( item );
+        }
+        slab->next = retired;
+        retired = slab;
     }
+    newest = NULL;
+    size = 0;
+    freeRetired();
+}
+
+void LVFontGlyphRun::add( LVFontGlobalGlyphCache * cache, LVFontGlyphCacheItem * glyph, int x, int y, lUInt32 color )
+{
+    if ( !glyph->bmp_width || !glyph->bmp_height )
+        return; // space
+    if ( _cache!=cache ) {
+        // glyphs of another cache (should not happen with single font manager)
+        flush();
+        _cache = cache;
+        _cache->beginRead();
+    }
+    LVDrawBufGlyph g;
+    g.x = x;
+    g.y = y;
+    g.width = glyph->bmp_width;
+    g.height = glyph->bmp_height;
+    g.color = color;
+#if (GLYPH_CACHE_BPP==8)
+    g.bitmap = glyph->bmp;
+#else
+    // unpacked now, pointer is set in flush() when buffer is not growing anymore
+    int size = g.width * g.height;
+    int offset = _bitmaps.length();
+    if ( offset + size > _bitmaps.size() )
+        _bitmaps.reserve( (offset + size) * 2 );
+    glyph->getBitmap( _bitmaps.addSpace( size ) );
+    g.bitmap = NULL;
+    _offsets.add( offset );
+#endif
+    _glyphs.add( g );
+}
+
+void LVFontGlyphRun::flush()
+{
+    if ( !_cache )
+        return;
+#if (GLYPH_CACHE_BPP!=8)
+    for ( int i=0; i<_glyphs.length(); i++ )
+        _glyphs[i].bitmap = _bitmaps.ptr() + _offsets[i];
+    _bitmaps.erase( 0, _bitmaps.length() );
+    _offsets.erase( 0, _offsets.length() );
+#endif
+    _buf->DrawGlyphRun( _glyphs.ptr(), _glyphs.length() );
+    _glyphs.erase( 0, _glyphs.length() );
+    _cache->endRead();
+    _cache = NULL;
 }
 
 lString8 familyName( FT_Face face )
@@ -580,9 +1151,17 @@ protected:
     int            _italic;
     LVFontGlyphWidthCache _wcache;
     LVFontLocalGlyphCache _glyph_cache;
+    LVFontLocalGlyphCache * volatile _phase_cache[GLYPH_SUBPIXEL_MAX_PHASES-1]; // glyphs shifted by 1..phases-1 subpixel steps
+    int           _subpixelPhases;
     bool          _drawMonochrome;
     bool          _allowKerning;
-    bool          _fallbackFontIsSet;
+    bool          _allowLigatures;
+    int           _ligatureMask; // bits of lvfont_ligatures present in font
+    LVFontKerningCache _kerningCache;
+    LVFontGposKerning * _gposKerning;
+    volatile int  _kerningSource; // -1 if not checked yet, 0 if font has no kerning, 1 for 'kern' table, 2 for GPOS
+    lUInt8        _blocks[32]; // bit per block of 256 chars which has at least one glyph in font cmap
+    volatile bool _fallbackFontIsSet;
     LVFontRef     _fallbackFont;
 public:
 
@@ -599,6 +1178,7 @@ public:
             return _fallbackFont.get();
         if ( fontMan->GetFallbackFontFace()!=_faceName ) // to avoid circular link, disable fallback for fallback font
             _fallbackFont = fontMan->GetFallbackFont(_size);
+        crMemoryBarrier();
         _fallbackFontIsSet = true;
         return _fallbackFont.get();
     }
@@ -616,8 +1196,11 @@ public:
     LVFreeTypeFace( LVMutex &mutex, FT_Library  library, LVFontGlobalGlyphCache * globalCache )
     : _mutex(mutex), _fontFamily(css_ff_sans_serif), _library(library), _face(NULL), _size(0), _hyphen_width(0), _baseline(0)
     , _weight(400), _italic(0)
-    , _glyph_cache(globalCache), _drawMonochrome(false), _allowKerning(false), _fallbackFontIsSet(false)
+    , _glyph_cache(globalCache), _subpixelPhases(1), _drawMonochrome(false), _allowKerning(false)
+    , _allowLigatures(false), _ligatureMask(0), _gposKerning(NULL), _kerningSource(-1), _fallbackFontIsSet(false)
     {
+        memset( (void*)_phase_cache, 0, sizeof(_phase_cache) );
+        memset( _blocks, 0, sizeof(_blocks) );
         _matrix.xx = 0x10000;
         _matrix.yy = 0x10000;
         _matrix.xy = 0;
@@ -627,6 +1210,22 @@ public:
     virtual ~LVFreeTypeFace()
     {
         Clear();
+        for ( int i=0; i<GLYPH_SUBPIXEL_MAX_PHASES-1; i++ )
+            if ( _phase_cache[i] )
+                delete _phase_cache[i];
+        if ( _gposKerning )
+            delete _gposKerning;
+    }
+
+    /// clears rendered glyphs and widths, after rendering mode change
+    void clearGlyphs()
+    {
+        _glyph_cache.clear();
+        for ( int i=0; i<GLYPH_SUBPIXEL_MAX_PHASES-1; i++ )
+            if ( _phase_cache[i] )
+                _phase_cache[i]->clear();
+        _wcache.clear();
+        _hyphen_width = 0;
     }
 
     virtual int getHyphenWidth()
@@ -642,6 +1241,74 @@ public:
     /// get kerning mode: true==ON, false=OFF
     virtual void setKerning( bool kerningEnabled ) { _allowKerning = kerningEnabled; }
 
+    /// returns kerning offset to add before ch2 following ch1, in 1/64 pixels
+    virtual int getKerningOffset( lChar16 ch1, lChar16 ch2 )
+    {
+#if (ALLOW_KERNING==1)
+        if ( !_allowKerning || !_kerningSource || _face==NULL )
+            return 0;
+        // cached pairs are read without locking, misses read font under lock
+        int k = _kerningCache.getDense( ch1, ch2 );
+        if ( k==KERNING_CACHE_UNKNOWN ) {
+            LVLock lock(_mutex);
+            k = _kerningCache.get( ch1, ch2 );
+            if ( k==KERNING_CACHE_UNKNOWN ) {
+                k = loadKerning( ch1, ch2 );
+                _kerningCache.put( ch1, ch2, k );
+            }
+        }
+        // without subpixel positioning whole pixels are floored, as kerning >> 6 always was
+        return getSubpixelPhases() > 1 ? k : (k & ~63);
+#else
+        return 0;
+#endif
+    }
+
+    /// reads kerning of char pair from font, in 1/64 pixels; to be called with mutex locked
+    int loadKerning( lChar16 ch1, lChar16 ch2 )
+    {
+        if ( _kerningSource<0 ) {
+            // 'kern' table is read by FreeType, GPOS kerning is loaded on first use
+            int source = 0;
+            if ( FT_HAS_KERNING( _face ) ) {
+                source = 1;
+            } else {
+                _gposKerning = new LVFontGposKerning();
+                if ( _gposKerning->load( _face ) ) {
+                    source = 2;
+                } else {
+                    delete _gposKerning;
+                    _gposKerning = NULL;
+                }
+            }
+            _kerningSource = source;
+        }
+        if ( !_kerningSource )
+            return 0;
+        FT_UInt left = getCharIndex( ch1, 0 );
+        FT_UInt right = getCharIndex( ch2, 0 );
+        if ( !left || !right )
+            return 0;
+        if ( _kerningSource==2 )
+            return (int)FT_MulFix( _gposKerning->get( left, right ), _face->size->metrics.x_scale );
+        FT_Vector delta;
+        if ( FT_Get_Kerning( _face, left, right, FT_KERNING_DEFAULT, &delta ) )
+            return 0;
+        return (int)delta.x;
+    }
+
+    /// get ligatures mode: true==ON, false=OFF
+    virtual bool getLigatures() const { return _allowLigatures; }
+    /// set ligatures mode: true==ON, false=OFF
+    virtual void setLigatures( bool ligaturesEnabled ) { _allowLigatures = ligaturesEnabled; }
+    /// returns number of chars at start of text to be drawn as single ligature glyph
+    virtual int getLigature( const lChar16 * text, int len, lChar16 & lig )
+    {
+        if ( !_allowLigatures || !_ligatureMask )
+            return 0;
+        return findLigature( text, len, _ligatureMask, lig );
+    }
+
     /// get bitmap mode (true=bitmap, false=antialiased)
     virtual bool getBitmapMode() { return _drawMonochrome; }
     /// set bitmap mode (true=bitmap, false=antialiased)
@@ -650,8 +1317,29 @@ public:
         if ( _drawMonochrome == drawBitmap )
             return;
         _drawMonochrome = drawBitmap;
-        _glyph_cache.clear();
-        _wcache.clear();
+        clearGlyphs();
+    }
+
+    /// returns number of subpixel glyph positions used (1 if glyphs are aligned to whole pixels)
+    virtual int getSubpixelPhases() const { return _drawMonochrome ? 1 : _subpixelPhases; }
+    /// set number of subpixel glyph positions (1, 2 or 4)
+    virtual void setSubpixelPhases( int phases )
+    {
+        if ( phases!=2 && phases!=4 )
+            phases = 1;
+        if ( _subpixelPhases == phases )
+            return;
+        _subpixelPhases = phases;
+        clearGlyphs();
+    }
+
+    /// returns FreeType hinting flags for current rendering mode
+    int getLoadTarget()
+    {
+        if ( _drawMonochrome )
+            return FT_LOAD_TARGET_MONO;
+        // subpixel positioned glyphs are hinted vertically only
+        return _subpixelPhases>1 ? FT_LOAD_TARGET_LIGHT : FT_LOAD_TARGET_NORMAL;
     }
 
     bool loadFromFile( const char * fname, int index, int size, css_font_family_t fontFamily, bool monochrome, bool italicize )
@@ -706,6 +1394,18 @@ public:
         _baseline = _height + (_face->size->metrics.descender >> 6);
         _weight = _face->style_flags & FT_STYLE_FLAG_BOLD ? 700 : 400;
         _italic = _face->style_flags & FT_STYLE_FLAG_ITALIC ? 1 : 0;
+        _ligatureMask = 0;
+        for ( int i=0; i<LVFONT_LIGATURE_COUNT; i++ )
+            if ( FT_Get_Char_Index( _face, lvfont_ligatures[i].ligature ) )
+                _ligatureMask |= 1 << i;
+        // coverage map: first char of each covered block, then skip to the next block
+        memset( _blocks, 0, sizeof(_blocks) );
+        FT_UInt gindex = 0;
+        FT_ULong code = FT_Get_First_Char( _face, &gindex );
+        while ( gindex && code < 0x10000 ) {
+            _blocks[code >> 11] |= (lUInt8)(1 << ((code >> 8) & 7));
+            code = FT_Get_Next_Char( _face, code | 0xFF, &gindex );
+        }
 
         if ( !error && italicize && !_italic ) {
             _matrix.xy = 0x10000*3/10;
@@ -721,6 +1421,12 @@ public:
     }
 
 
+    /// returns true if there is no glyph for char in font, checked without locking using coverage map of 256 char blocks
+    bool isCharBlockMissing( lChar16 code )
+    {
+        return !(_blocks[code >> 11] & (1 << ((code >> 8) & 7))) && !getReplacementChar( code ) && code!='\t';
+    }
+
     FT_UInt getCharIndex( lChar16 code, lChar16 def_char ) {
         if ( code=='\t' )
             code = ' ';
@@ -803,21 +1509,21 @@ public:
                         bool allow_hyphenation = true
                      )
     {
-        LVLock lock(_mutex);
         if ( len <= 0 || _face==NULL )
             return 0;
-        int error;
 
-#if (ALLOW_KERNING==1)
-        int use_kerning = _allowKerning && FT_HAS_KERNING( _face );
-#endif
         if ( letter_spacing<0 || letter_spacing>50 )
             letter_spacing = 0;
 
-        //int i;
-
-        FT_UInt previous = 0;
+        // widths and kerning of cached chars are read without locking, misses lock in loadCharAdvance() and getKerningOffset()
+        lChar16 previous = 0;
         lUInt16 prev_width = 0;
+        int pos = 0; // pen position, 26.6
+        int prev_pos = 0;
+        int ligLen = 0; // number of chars of current ligature
+        int ligRest = 0; // ligature chars not measured yet
+        int ligPos = 0;
+        int ligWidth = 0;
         int nchars = 0;
         int lastFitChar = 0;
         updateTransform();
@@ -825,52 +1531,48 @@ public:
         for ( nchars=0; nchars<len; nchars++) {
             lChar16 ch = text[nchars];
             bool isHyphen = (ch==UNICODE_SOFT_HYPHEN_CODE);
-            FT_UInt ch_glyph_index = (FT_UInt)-1;
-            int kerning = 0;
-#if (ALLOW_KERNING==1)
-            if ( use_kerning && previous>0  ) {
-                if ( ch_glyph_index==(FT_UInt)-1 )
-                    ch_glyph_index = getCharIndex( ch, def_char );
-                if ( ch_glyph_index != 0 ) {
-                    FT_Vector delta;
-                    error = FT_Get_Kerning( _face,          /* handle to face object */
-                                  previous,          /* left glyph index      */
-                                  ch_glyph_index,         /* right glyph index     */
-                                  FT_KERNING_DEFAULT,  /* kerning mode          */
-                                  &delta );    /* target vector         */
-                    if ( !error )
-                        kerning = delta.x;
-                }
-            }
-#endif
 
             flags[nchars] = GET_CHAR_FLAGS(ch); //calcCharFlags( ch );
 
-            /* load glyph image into the slot (erase previous one) */
-            int w = _wcache.get(ch);
-            if ( w==0xFF ) {
-                glyph_info_t glyph;
-                if ( getGlyphInfo( ch, &glyph, def_char ) ) {
-                    w = glyph.width;
+            if ( ligRest>0 ) {
+                // ligature advance is divided between its chars
+                ligRest--;
+                pos = ligPos + ligWidth * (ligLen - ligRest) / ligLen;
+            } else {
+                lChar16 lig = 0;
+                ligLen = letter_spacing ? 0 : getLigature( text + nchars, len - nchars, lig );
+                if ( ligLen )
+                    ch = lig;
+                int kerning = previous ? getKerningOffset( previous, ch ) : 0;
+
+                /* load glyph image into the slot (erase previous one) */
+                int w = _wcache.get(ch);
+                if ( w==0xFFFF ) {
+                    w = loadCharAdvance( ch, def_char );
+                    if ( w<0 ) {
+                        widths[nchars] = prev_width;
+                        ligLen = 0;
+                        continue;  /* ignore errors */
+                    }
                     _wcache.put(ch, w);
+                }
+                if ( ligLen ) {
+                    ligRest = ligLen - 1;
+                    ligPos = prev_pos + kerning;
+                    ligWidth = w;
+                    pos = ligPos + w / ligLen;
                 } else {
-                    widths[nchars] = prev_width;
-                    continue;  /* ignore errors */
+                    // positions are accumulated with subpixel precision and rounded, to avoid drift
+                    pos = prev_pos + w + kerning + (letter_spacing << 6);
                 }
-                if ( ch_glyph_index==(FT_UInt)-1 )
-                    ch_glyph_index = getCharIndex( ch, 0 );
-//                error = FT_Load_Glyph( _face,          /* handle to face object */
-//                        ch_glyph_index,                /* glyph index           */
-//                        FT_LOAD_DEFAULT );             /* load flags, see below */
-//                if ( error ) {
-//                    widths[nchars] = prev_width;
-//                    continue;  /* ignore errors */
-//                }
+                if ( !isHyphen )
+                    previous = ch;
             }
-            widths[nchars] = prev_width + w + (kerning >> 6) + letter_spacing;
-            previous = ch_glyph_index;
-            if ( !isHyphen ) // avoid soft hyphens inside text string
+            widths[nchars] = (lUInt16)((pos + 32) >> 6);
+            if ( !isHyphen ) { // avoid soft hyphens inside text string
                 prev_width = widths[nchars];
+                prev_pos = pos;
+            }
             if ( prev_width > max_width ) {
                 if ( lastFitChar < nchars + 7)
                     break;
@@ -912,9 +1614,8 @@ public:
                         const lChar16 * text, int len
         )
     {
-        LVLock lock(_mutex);
-        static lUInt16 widths[MAX_LINE_CHARS+1];
-        static lUInt8 flags[MAX_LINE_CHARS+1];
+        lUInt16 widths[MAX_LINE_CHARS+1];
+        lUInt8 flags[MAX_LINE_CHARS+1];
         if ( len>MAX_LINE_CHARS )
             len = MAX_LINE_CHARS;
         if ( len<=0 )
@@ -945,6 +1646,38 @@ public:
         \return glyph pointer if glyph was found, NULL otherwise
     */
     virtual LVFontGlyphCacheItem * getGlyph(lUInt16 ch, lChar16 def_char=0) {
+        return getGlyph( ch, def_char, 0 );
+    }
+
+    /** \brief get glyph item rendered with subpixel offset
+        \param phase is offset in 1/getSubpixelPhases() pixel units
+        \return glyph pointer if glyph was found, NULL otherwise
+    */
+    LVFontGlyphCacheItem * getGlyph(lUInt16 ch, lChar16 def_char, int phase) {
+        LVFontLocalGlyphCache * cache = &_glyph_cache;
+        if ( phase>0 ) {
+            cache = _phase_cache[phase-1];
+            if ( !cache ) {
+                LVLock lock(_mutex);
+                cache = _phase_cache[phase-1];
+                if ( !cache ) {
+                    cache = new LVFontLocalGlyphCache( _glyph_cache.getGlobalCache() );
+                    crMemoryBarrier();
+                    _phase_cache[phase-1] = cache;
+                }
+            }
+        }
+        LVFontGlyphCacheItem * item = cache->get( ch );
+        if ( item )
+            return item;
+        if ( _fallbackFontIsSet && isCharBlockMissing( ch ) ) {
+            // whole block is missing in font: resolved fallback font is used without locking
+            LVFont * fallback = _fallbackFont.get();
+            if ( fallback )
+                return fallback->getGlyph(ch, def_char);
+        }
+        // miss: FreeType calls need lock
+        LVLock lock(_mutex);
         FT_UInt ch_glyph_index = getCharIndex( ch, 0 );
         if ( ch_glyph_index==0 ) {
             LVFont * fallback = getFallbackFont();
@@ -958,25 +1691,66 @@ public:
                 return fallback->getGlyph(ch, def_char);
             }
         }
-        LVFontGlyphCacheItem * item = _glyph_cache.get( ch );
-        if ( !item ) {
+        {
 
-            int rend_flags = FT_LOAD_RENDER | ( !_drawMonochrome ? FT_LOAD_TARGET_NORMAL : (FT_LOAD_TARGET_MONO) ); //|FT_LOAD_MONOCHROME|FT_LOAD_FORCE_AUTOHINT
+            int rend_flags = FT_LOAD_RENDER | getLoadTarget(); //|FT_LOAD_MONOCHROME|FT_LOAD_FORCE_AUTOHINT
             /* load glyph image into the slot (erase previous one) */
 
             updateTransform();
+            if ( phase>0 ) {
+                // outline is shifted right before rendering
+                FT_Vector delta;
+                delta.x = phase * 64 / getSubpixelPhases();
+                delta.y = 0;
+                FT_Set_Transform( _face, &_matrix, &delta );
+            }
             int error = FT_Load_Glyph( _face,          /* handle to face object */
                     ch_glyph_index,                /* glyph index           */
                     rend_flags );             /* load flags, see below */
+            if ( phase>0 )
+                FT_Set_Transform( _face, &_matrix, NULL );
             if ( error ) {
                 return false;  /* ignore errors */
             }
-            item = newItem( &_glyph_cache, ch, _slot ); //, _drawMonochrome
-            _glyph_cache.put( item );
+            LVLock cacheLock( _glyph_cache.getGlobalCache()->getMutex() );
+            item = newItem( cache, ch, _slot ); //, _drawMonochrome
+            item = cache->put( item );
         }
         return item;
     }
 
+    /// renders glyph present in this font and dilates it into glyph cache of synthetic bold font
+    virtual LVFontGlyphCacheItem * getEmboldenedGlyph( LVFontLocalGlyphCache * cache, lUInt16 ch, int hShift, int vShift )
+    {
+        if ( isCharBlockMissing( ch ) )
+            return NULL;
+        LVLock lock(_mutex);
+        // missing glyphs are taken from fallback font or replaced with def_char by caller
+        FT_UInt ch_glyph_index = getCharIndex( ch, 0 );
+        if ( ch_glyph_index==0 )
+            return NULL;
+        updateTransform();
+        int error = FT_Load_Glyph( _face, ch_glyph_index, FT_LOAD_RENDER | getLoadTarget() );
+        if ( error )
+            return NULL;
+        LVGlyphBitmapBuffer coverage;
+        const lUInt8 * bmp = getSlotCoverage( _slot, coverage );
+        int w = _slot->bitmap.width;
+        int h = _slot->bitmap.rows;
+        int dx = w ? w + hShift : 0;
+        int dy = h ? h + vShift : 0;
+        LVGlyphBitmapBuffer emboldened;
+        lUInt8 * newbmp = emboldened.get( dx*dy );
+        emboldenCoverage( bmp, w, h, hShift, vShift, newbmp );
+        LVLock cacheLock( cache->getGlobalCache()->getMutex() );
+        LVFontGlyphCacheItem * item = LVFontGlyphCacheItem::newItem( cache, ch, dx, dy );
+        item->advance = (lUInt8)(_slot->metrics.horiAdvance >> 6) + hShift;
+        item->origin_x = (lInt8)_slot->bitmap_left;
+        item->origin_y = (lInt8)_slot->bitmap_top;
+        item->setBitmap( newbmp );
+        return cache->put( item );
+    }
+
 //    /** \brief get glyph image in 1 byte per pixel format
 //        \param code is unicode character
 //        \param buf is buffer [width*height] to place glyph data
@@ -1010,20 +1784,53 @@ public:
 
     /// returns char width
     virtual int getCharWidth( lChar16 ch, lChar16 def_char='?' )
+    {
+        return (getCharAdvance( ch, def_char ) + 32) >> 6;
+    }
+
+    /// returns char advance width, in 1/64 pixels
+    virtual int getCharAdvance( lChar16 ch, lChar16 def_char=0 )
     {
         int w = _wcache.get(ch);
-        if ( w==0xFF ) {
-            glyph_info_t glyph;
-            if ( getGlyphInfo( ch, &glyph, def_char ) ) {
-                w = glyph.width;
-            } else {
+        if ( w==0xFFFF ) {
+            w = loadCharAdvance( ch, def_char );
+            if ( w<0 )
                 w = 0;
-            }
             _wcache.put(ch, w);
         }
         return w;
     }
 
+    /// reads char advance width from font, in 1/64 pixels, returns -1 if there is no glyph
+    int loadCharAdvance( lChar16 ch, lChar16 def_char )
+    {
+        LVLock lock(_mutex);
+        int glyph_index = getCharIndex( ch, 0 );
+        if ( glyph_index==0 ) {
+            LVFont * fallback = getFallbackFont();
+            if ( !fallback ) {
+                // No fallback
+                glyph_index = getCharIndex( ch, def_char );
+                if ( glyph_index==0 )
+                    return -1;
+            } else {
+                // Fallback
+                return fallback->getCharAdvance( ch, def_char );
+            }
+        }
+        updateTransform();
+        bool subpixel = getSubpixelPhases() > 1;
+        int error = FT_Load_Glyph(
+            _face,          /* handle to face object */
+            glyph_index,   /* glyph index           */
+            subpixel ? FT_LOAD_TARGET_LIGHT : FT_LOAD_DEFAULT );  /* load flags, see below */
+        if ( error )
+            return -1;
+        // unhinted advance is used for subpixel positioning, 16.16 -> 26.6
+        int w = subpixel ? (int)((_slot->linearHoriAdvance + 512) >> 10) : (int)(_slot->metrics.horiAdvance & ~63);
+        return w < 0xFFFF ? w : 0xFFFE;
+    }
+
     /// retrieves font handle
     virtual void * GetHandle()
     {
@@ -1047,9 +1854,27 @@ public:
                        const lChar16 * text, int len, 
                        lChar16 def_char, lUInt32 * palette, bool addHyphen, lUInt32 flags, int letter_spacing )
     {
-        LVLock lock(_mutex);
+        LVFontGlyphRun run( buf );
+        drawTextRun( &run, x, y, text, len, def_char, palette ? palette[0] : buf->GetTextColor(), addHyphen, flags, letter_spacing );
+    }
+
+    /// adds glyphs of text string to glyph run
+    virtual void DrawTextRun( LVFontGlyphRun * run, int x, int y,
+                       const lChar16 * text, int len,
+                       lChar16 def_char, bool addHyphen, lUInt32 flags, int letter_spacing )
+    {
+        drawTextRun( run, x, y, text, len, def_char, run->getDrawBuf()->GetTextColor(), addHyphen, flags, letter_spacing );
+    }
+
+    void drawTextRun( LVFontGlyphRun * run, int x, int y,
+                       const lChar16 * text, int len,
+                       lChar16 def_char, lUInt32 color, bool addHyphen, lUInt32 flags, int letter_spacing )
+    {
         if ( len <= 0 || _face==NULL )
             return;
+        // cached glyphs and kerning pairs are read without locking, misses lock in getGlyph() and getKerningOffset()
+        LVDrawBuf * buf = run->getDrawBuf();
+        LVFontGlyphCacheReadScope readScope( _glyph_cache.getGlobalCache() );
         if ( letter_spacing<0 || letter_spacing>50 )
             letter_spacing = 0;
         lvRect clip;
@@ -1058,66 +1883,60 @@ public:
         if ( y + _height < clip.top || y >= clip.bottom )
             return;
 
-        int error;
-
-#if (ALLOW_KERNING==1)
-        int use_kerning = _allowKerning && FT_HAS_KERNING( _face );
-#endif
         int i;
 
-        FT_UInt previous = 0;
+        lChar16 previous = 0;
         //lUInt16 prev_width = 0;
         lChar16 ch;
         // measure character widths
         bool isHyphen = false;
         int x0 = x;
+        int phases = getSubpixelPhases();
+        int pos = x << 6; // pen position, 26.6
         for ( i=0; i<=len; i++) {
             if ( i==len && (!addHyphen || isHyphen) )
                 break;
+            int ligLen = 0;
             if ( i<len ) {
                 ch = text[i];
                 if ( ch=='\t' )
                     ch = ' ';
                 isHyphen = (ch==UNICODE_SOFT_HYPHEN_CODE) && (i<len-1);
+                lChar16 lig = 0;
+                ligLen = letter_spacing ? 0 : getLigature( text + i, len - i, lig );
+                if ( ligLen )
+                    ch = lig;
             } else {
                 ch = UNICODE_SOFT_HYPHEN_CODE;
                 isHyphen = 0;
             }
-            FT_UInt ch_glyph_index = getCharIndex( ch, def_char );
-            int kerning = 0;
-#if (ALLOW_KERNING==1)
-            if ( use_kerning && previous>0 && ch_glyph_index>0 ) {
-                FT_Vector delta;
-                error = FT_Get_Kerning( _face,          /* handle to face object */
-                              previous,          /* left glyph index      */
-                              ch_glyph_index,         /* right glyph index     */
-                              FT_KERNING_DEFAULT,  /* kerning mode          */
-                              &delta );    /* target vector         */
-                if ( !error )
-                    kerning = delta.x;
-            }
-#endif
-
-
-            LVFontGlyphCacheItem * item = getGlyph(ch, def_char);
-                    _glyph_cache.get( ch );
+            int kerning = previous ? getKerningOffset( previous, ch ) : 0;
+
+            // glyph is rendered with offset nearest to fractional part of pen position
+            int glyphPos = pos + kerning;
+            int phase = ((glyphPos & 63) * phases + 32) >> 6;
+            int glyphX = (glyphPos >> 6) + phase / phases;
+            phase %= phases;
+            LVFontGlyphCacheItem * item = getGlyph(ch, def_char, phase);
             if ( !item )
                 continue;
             if ( (item && !isHyphen) || i>=len-1 ) { // avoid soft hyphens inside text string
-                int w = item->advance + (kerning >> 6);
-                buf->Draw( x + (kerning>>6) + item->origin_x,
-                    y + _baseline - item->origin_y, 
-                    item->bmp,
-                    item->bmp_width,
-                    item->bmp_height,
-                    palette);
-
-                x  += w + letter_spacing;
-                previous = ch_glyph_index;
+                run->add( _glyph_cache.getGlobalCache(), item,
+                    glyphX + item->origin_x,
+                    y + _baseline - item->origin_y,
+                    color );
+
+                // advance is taken from width cache to match measureText()
+                pos = glyphPos + getCharAdvance( ch, def_char ) + (letter_spacing << 6);
+                previous = ch;
+                if ( ligLen )
+                    i += ligLen - 1;
             }
         }
+        x = (pos + 32) >> 6;
         if ( flags & LTEXT_TD_MASK ) {
-            // text decoration: underline, etc.
+            // text decoration: underline, etc.; drawn over glyphs
+            run->flush();
             int h = _size > 30 ? 2 : 1;
             lUInt32 cl = buf->GetTextColor();
             if ( flags & LTEXT_TD_UNDERLINE || flags & LTEXT_TD_BLINK ) {
@@ -1262,8 +2081,8 @@ public:
                         const lChar16 * text, int len
         )
     {
-        static lUInt16 widths[MAX_LINE_CHARS+1];
-        static lUInt8 flags[MAX_LINE_CHARS+1];
+        lUInt16 widths[MAX_LINE_CHARS+1];
+        lUInt8 flags[MAX_LINE_CHARS+1];
         if ( len>MAX_LINE_CHARS )
             len = MAX_LINE_CHARS;
         if ( len<=0 )
@@ -1291,6 +2110,13 @@ public:
         if ( item )
             return item;
 
+        // glyph is rendered and dilated by base font, without keeping regular glyph in cache
+        item = _baseFont->getEmboldenedGlyph( &_glyph_cache, ch, _hShift, _vShift );
+        if ( item )
+            return item;
+
+        // keep base glyph alive while copying
+        LVFontGlyphCacheReadScope readScope( _glyph_cache.getGlobalCache() );
         LVFontGlyphCacheItem * olditem = _baseFont->getGlyph( ch, def_char );
         if ( !olditem )
             return NULL;
@@ -1300,33 +2126,20 @@ public:
         int dx = oldx ? oldx + _hShift : 0;
         int dy = oldy ? oldy + _vShift : 0;
 
+        LVGlyphBitmapBuffer oldbuf;
+        const lUInt8 * oldbmp = oldbuf.getBitmap( olditem );
+        LVGlyphBitmapBuffer newbuf;
+        lUInt8 * newbmp = newbuf.get( dx*dy );
+        emboldenCoverage( oldbmp, oldx, oldy, _hShift, _vShift, newbmp );
+
+        // base font is not locked here: atlas lock is always taken after font manager lock
+        LVLock cacheLock( _glyph_cache.getGlobalCache()->getMutex() );
         item = LVFontGlyphCacheItem::newItem( &_glyph_cache, ch, dx, dy ); //, _drawMonochrome
         item->advance = olditem->advance + _hShift;
         item->origin_x = olditem->origin_x;
         item->origin_y = olditem->origin_y;
-
-        if ( dx && dy ) {
-            for ( int y=0; y<dy; y++ ) {
-                lUInt8 * dst = item->bmp + y*dx;
-                for ( int x=0; x<dx; x++ ) {
-                    int s = 0;
-                    for ( int yy=-_vShift; yy<=0; yy++ ) {
-                        int srcy = y+yy;
-                        if ( srcy<0 || srcy>=oldy )
-                            continue;
-                        lUInt8 * src = olditem->bmp + srcy*oldx;
-                        for ( int xx=-_hShift; xx<=0; xx++ ) {
-                            int srcx = x+xx;
-                            if ( srcx>=0 && srcx<oldx && src[srcx] > s )
-                                s = src[srcx];
-                        }
-                    }
-                    dst[x] = s;
-                }
-            }
-        }
-        _glyph_cache.put( item );
-        return item;
+        item->setBitmap( newbmp );
+        return _glyph_cache.put( item );
     }
 
     /** \brief get glyph image in 1 byte per pixel format
@@ -1409,6 +2222,17 @@ public:
         return w;
     }
 
+    /// returns char advance width, in 1/64 pixels
+    virtual int getCharAdvance( lChar16 ch, lChar16 def_char=0 )
+    {
+        return _baseFont->getCharAdvance( ch, def_char ) + (_hShift << 6);
+    }
+
+    /// returns number of subpixel glyph positions used by base font
+    virtual int getSubpixelPhases() const { return _baseFont->getSubpixelPhases(); }
+    /// set number of subpixel glyph positions of base font
+    virtual void setSubpixelPhases( int phases ) { _baseFont->setSubpixelPhases( phases ); }
+
     /// retrieves font handle
     virtual void * GetHandle()
     {
@@ -1432,54 +2256,88 @@ public:
                        const lChar16 * text, int len,
                        lChar16 def_char, lUInt32 * palette, bool addHyphen,
                        lUInt32 flags=0, int letter_spacing=0 )
+    {
+        LVFontGlyphRun run( buf );
+        drawTextRun( &run, x, y, text, len, def_char, palette ? palette[0] : buf->GetTextColor(), addHyphen, flags, letter_spacing );
+    }
+
+    /// adds glyphs of text string to glyph run
+    virtual void DrawTextRun( LVFontGlyphRun * run, int x, int y,
+                       const lChar16 * text, int len,
+                       lChar16 def_char, bool addHyphen, lUInt32 flags, int letter_spacing )
+    {
+        drawTextRun( run, x, y, text, len, def_char, run->getDrawBuf()->GetTextColor(), addHyphen, flags, letter_spacing );
+    }
+
+    void drawTextRun( LVFontGlyphRun * run, int x, int y,
+                       const lChar16 * text, int len,
+                       lChar16 def_char, lUInt32 color, bool addHyphen, lUInt32 flags, int letter_spacing )
     {
         if ( len <= 0 )
             return;
         if ( letter_spacing<0 || letter_spacing>50 )
             letter_spacing = 0;
+        LVDrawBuf * buf = run->getDrawBuf();
         lvRect clip;
         buf->GetClipRect( &clip );
         if ( y + _height < clip.top || y >= clip.bottom )
             return;
+        LVFontGlyphCacheReadScope readScope( _glyph_cache.getGlobalCache() );
 
         //int error;
 
         int i;
 
+        lChar16 previous = 0;
         //lUInt16 prev_width = 0;
         lChar16 ch;
         // measure character widths
         bool isHyphen = false;
         int x0 = x;
+        int pos = x << 6; // pen position, 26.6
         for ( i=0; i<=len; i++) {
             if ( i==len && (!addHyphen || isHyphen) )
                 break;
+            int ligLen = 0;
             if ( i<len ) {
                 ch = text[i];
                 isHyphen = (ch==UNICODE_SOFT_HYPHEN_CODE) && (i<len-1);
+                lChar16 lig = 0;
+                ligLen = letter_spacing ? 0 : _baseFont->getLigature( text + i, len - i, lig );
+                if ( ligLen )
+                    ch = lig;
             } else {
                 ch = UNICODE_SOFT_HYPHEN_CODE;
                 isHyphen = 0;
             }
+            if ( previous && !isHyphen )
+                pos += _baseFont->getKerningOffset( previous, ch );
 
             LVFontGlyphCacheItem * item = getGlyph(ch, def_char);
             int w  = 0;
             if ( item ) {
                 // avoid soft hyphens inside text string
-                w = item->advance;
+                w = getCharAdvance( ch, def_char );
                 if ( item->bmp_height && item->bmp_height && (!isHyphen || i>=len-1) ) {
-                    buf->Draw( x + item->origin_x,
+                    run->add( _glyph_cache.getGlobalCache(), item,
+                        ((pos + 32) >> 6) + item->origin_x,
                         y + _baseline - item->origin_y,
-                        item->bmp,
-                        item->bmp_width,
-                        item->bmp_height,
-                        palette);
+                        color );
+                }
+                if ( !isHyphen )
+                    previous = ch;
+                if ( ligLen ) {
+                    // measureText() adds embolden shift to each char of ligature
+                    w += (ligLen - 1) * (_hShift << 6);
+                    i += ligLen - 1;
                 }
             }
-            x  += w + letter_spacing;
+            pos += w + (letter_spacing << 6);
         }
+        x = (pos + 32) >> 6;
         if ( flags & LTEXT_TD_MASK ) {
-            // text decoration: underline, etc.
+            // text decoration: underline, etc.; drawn over glyphs
+            run->flush();
             int h = _size > 30 ? 2 : 1;
             lUInt32 cl = buf->GetTextColor();
             if ( flags & LTEXT_TD_UNDERLINE || flags & LTEXT_TD_BLINK ) {
@@ -1515,6 +2373,16 @@ public:
     /// get kerning mode: true==ON, false=OFF
     virtual void setKerning( bool b ) { _baseFont->setKerning( b ); }
 
+    /// returns kerning offset of base font
+    virtual int getKerningOffset( lChar16 ch1, lChar16 ch2 ) { return _baseFont->getKerningOffset( ch1, ch2 ); }
+
+    /// get ligatures mode: true==ON, false=OFF
+    virtual bool getLigatures() const { return _baseFont->getLigatures(); }
+    /// set ligatures mode: true==ON, false=OFF
+    virtual void setLigatures( bool b ) { _baseFont->setLigatures( b ); }
+    /// returns ligature of base font
+    virtual int getLigature( const lChar16 * text, int len, lChar16 & lig ) { return _baseFont->getLigature( text, len, lig ); }
+
     /// returns true if font is empty
     virtual bool IsNull() const
     {
@@ -1550,6 +2418,144 @@ static LVFontRef dumpFontRef( LVFontRef fnt ) {
     return fnt;
 };
 
+#define FONT_REGISTRY_MAGIC "CRFONTS1"
+
+/// font face properties read from font file
+struct LVFontRegistryFace
+{
+    int weight;
+    bool italic;
+    css_font_family_t family;
+    lString8 typeface;
+};
+
+/// registerable faces of single font file
+struct LVFontRegistryEntry
+{
+    lString8 fileName;
+    lUInt32 size;
+    lUInt32 modTime;
+    bool used; // registered in this session
+    LVPtrVector<LVFontRegistryFace> faces; // empty if file cannot be registered
+};
+
+/** \brief persistent cache of font file properties
+
+    Allows registering fonts without opening them with FreeType, until font file
+    is changed (file size and modification time are checked).
+*/
+class LVFontRegistryCache
+{
+    lString16 _fileName;
+    LVPtrVector<LVFontRegistryEntry> _entries;
+    LVHashTable<lString8, LVFontRegistryEntry *> _index;
+    bool _changed;
+public:
+    LVFontRegistryCache() : _index(256), _changed(false) { }
+    bool isChanged() { return _changed; }
+    /// sets cache file and loads it; entries added before are kept
+    bool open( lString16 fileName )
+    {
+        _fileName = fileName;
+        LVStreamRef stream = LVOpenFileStream( fileName.c_str(), LVOM_READ );
+        if ( stream.isNull() )
+            return false;
+        LVStreamBufferRef sb = stream->GetReadBuffer( 0, stream->GetSize() );
+        if ( !sb )
+            return false;
+        SerialBuf buf( sb->getReadOnly(), sb->getSize() );
+        if ( !buf.checkMagic( FONT_REGISTRY_MAGIC ) )
+            return false;
+        lUInt32 start = buf.pos();
+        lUInt32 count = 0;
+        buf >> count;
+        LVPtrVector<LVFontRegistryEntry> entries;
+        for ( lUInt32 i=0; i<count && !buf.error(); i++ ) {
+            LVFontRegistryEntry * entry = new LVFontRegistryEntry();
+            entries.add( entry );
+            lUInt32 faceCount = 0;
+            buf >> entry->fileName >> entry->size >> entry->modTime >> faceCount;
+            for ( lUInt32 j=0; j<faceCount && !buf.error(); j++ ) {
+                LVFontRegistryFace * face = new LVFontRegistryFace();
+                entry->faces.add( face );
+                lUInt16 weight = 0;
+                lUInt8 family = 0;
+                buf >> weight >> face->italic >> family >> face->typeface;
+                face->weight = weight;
+                face->family = (css_font_family_t)family;
+            }
+        }
+        if ( buf.error() || !buf.checkCRC( buf.pos() - start ) ) {
+            CRLog::error( "Font registry cache file %s is corrupted", LCSTR(fileName) );
+            return false;
+        }
+        while ( entries.length() ) {
+            LVFontRegistryEntry * entry = entries.remove( 0 );
+            if ( _index.get( entry->fileName ) ) {
+                delete entry;
+                continue;
+            }
+            entry->used = false;
+            _entries.add( entry );
+            _index.set( entry->fileName, entry );
+        }
+        CRLog::info( "Font registry cache: %d font files", _entries.length() );
+        return true;
+    }
+    /// writes entries used in this session to cache file
+    bool save()
+    {
+        if ( _fileName.empty() )
+            return false;
+        _changed = false;
+        SerialBuf buf( 16384, true );
+        buf.putMagic( FONT_REGISTRY_MAGIC );
+        lUInt32 start = buf.pos();
+        lUInt32 count = 0;
+        for ( int i=0; i<_entries.length(); i++ )
+            if ( _entries[i]->used )
+                count++;
+        buf << count;
+        for ( int i=0; i<_entries.length(); i++ ) {
+            LVFontRegistryEntry * entry = _entries[i];
+            if ( !entry->used )
+                continue;
+            buf << entry->fileName << entry->size << entry->modTime << (lUInt32)entry->faces.length();
+            for ( int j=0; j<entry->faces.length(); j++ ) {
+                LVFontRegistryFace * face = entry->faces[j];
+                buf << (lUInt16)face->weight << face->italic << (lUInt8)face->family << face->typeface;
+            }
+        }
+        buf.putCRC( buf.pos() - start );
+        LVStreamRef stream = LVOpenFileStream( _fileName.c_str(), LVOM_WRITE );
+        if ( stream.isNull() || buf.error() || stream->Write( buf.buf(), buf.pos(), NULL )!=LVERR_OK ) {
+            CRLog::error( "Cannot write font registry cache file %s", LCSTR(_fileName) );
+            return false;
+        }
+        return true;
+    }
+    /// returns entry if font file is not changed since it's been cached
+    LVFontRegistryEntry * find( const lString8 & fileName, lUInt32 size, lUInt32 modTime )
+    {
+        LVFontRegistryEntry * entry = _index.get( fileName );
+        if ( !entry || entry->size!=size || entry->modTime!=modTime )
+            return NULL;
+        entry->used = true;
+        return entry;
+    }
+    /// adds or replaces entry, takes ownership
+    void add( LVFontRegistryEntry * entry )
+    {
+        LVFontRegistryEntry * old = _index.get( entry->fileName );
+        if ( old )
+            delete _entries.remove( old );
+        entry->used = true;
+        _entries.add( entry );
+        _index.set( entry->fileName, entry );
+        _changed = true;
+    }
+};
+
 class LVFreeTypeFontManager : public LVFontManager
 {
 private:
@@ -1558,6 +2564,7 @@ private:
     LVFontCache _cache;
     FT_Library  _library;
     LVFontGlobalGlyphCache _globalCache;
+    LVFontRegistryCache _registry;
     lString16 _requiredChars;
     #if (DEBUG_FONT_MAN==1)
     FILE * _log;
@@ -1643,6 +2650,32 @@ public:
             fonts->get(i)->getFont()->setKerning( kerning );
         }
     }
+
+    /// set ligatures mode
+    virtual void setLigatures( bool ligatures )
+    {
+        _allowLigatures = ligatures;
+        gc();
+        clearGlyphCache();
+        LVPtrVector< LVFontCacheItem > * fonts = _cache.getInstances();
+        for ( int i=0; i<fonts->length(); i++ ) {
+            fonts->get(i)->getFont()->setLigatures( ligatures );
+        }
+    }
+
+    /// set number of subpixel glyph positions
+    virtual void SetSubpixelPhases( int phases )
+    {
+        if ( phases!=2 && phases!=4 )
+            phases = 1;
+        _subpixelPhases = phases;
+        gc();
+        clearGlyphCache();
+        LVPtrVector< LVFontCacheItem > * fonts = _cache.getInstances();
+        for ( int i=0; i<fonts->length(); i++ ) {
+            fonts->get(i)->getFont()->setSubpixelPhases( phases );
+        }
+    }
     /// clear glyph cache
     virtual void clearGlyphCache()
     {
@@ -1881,6 +2914,8 @@ public:
 
     virtual ~LVFreeTypeFontManager() 
     {
+        if ( _registry.isChanged() )
+            _registry.save();
         _globalCache.clear();
         _cache.clear();
         if ( _library )
@@ -1930,6 +2965,9 @@ public:
 
     virtual LVFontRef GetFont(int size, int weight, bool italic, css_font_family_t family, lString8 typeface )
     {
+        // fonts are usually registered at startup before first font is requested
+        if ( _registry.isChanged() )
+            _registry.save();
     #if (DEBUG_FONT_MAN==1)
         if ( _log ) {
              fprintf(_log, "GetFont(size=%d, weight=%d, italic=%d, family=%d, typeface='%s')\n",
@@ -2012,6 +3050,8 @@ public:
             //    item->getDef()->getTypeFace().c_str(), item->getDef()->getSize() );
             LVFontRef ref(font);
             font->setKerning( getKerning() );
+            font->setLigatures( getLigatures() );
+            font->setSubpixelPhases( GetSubpixelPhases() );
             font->setFaceName( item->getDef()->getTypeFace() );
             newDef.setSize( size );
             //item->setFont( ref );
@@ -2091,22 +3131,11 @@ public:
     }
     */
 
-    virtual bool RegisterFont( lString8 name )
+    /// reads properties of registerable faces of font file using FreeType
+    LVFontRegistryEntry * readFontFile( lString8 name, lString8 fname )
     {
-#ifdef LOAD_TTF_FONTS_ONLY
-        if ( name.pos( lString8(".ttf") ) < 0 && name.pos( lString8(".TTF") ) < 0 )
-            return false; // load ttf fonts only
-#endif
-        lString8 fname = makeFontFileName( name );
-    #if (DEBUG_FONT_MAN==1)
-        if ( _log ) {
-            fprintf(_log, "RegisterFont( %s ) path=%s\n",
-                name.c_str(), fname.c_str()
-            );
-        }
-    #endif
-        bool res = false;
-
+        LVFontRegistryEntry * entry = new LVFontRegistryEntry();
+        entry->fileName = fname;
         int index = 0;
 
         FT_Face face = NULL;
@@ -2142,13 +3171,62 @@ public:
             if ( familyName=="Times" || familyName=="Times New Roman" )
                 fontFamily = css_ff_serif;
 
+            LVFontRegistryFace * item = new LVFontRegistryFace();
+            item->weight = ( face->style_flags & FT_STYLE_FLAG_BOLD ) ? 700 : 400;
+            item->italic = ( face->style_flags & FT_STYLE_FLAG_ITALIC ) ? true : false;
+            item->family = fontFamily;
+            item->typeface = familyName;
+            entry->faces.add( item );
+
+            if ( face ) {
+                FT_Done_Face( face );
+                face = NULL;
+            }
+
+            if ( index>=num_faces-1 )
+                break;
+        }
+        return entry;
+    }
+
+    virtual bool RegisterFont( lString8 name )
+    {
+#ifdef LOAD_TTF_FONTS_ONLY
+        if ( name.pos( lString8(".ttf") ) < 0 && name.pos( lString8(".TTF") ) < 0 )
+            return false; // load ttf fonts only
+#endif
+        lString8 fname = makeFontFileName( name );
+    #if (DEBUG_FONT_MAN==1)
+        if ( _log ) {
+            fprintf(_log, "RegisterFont( %s ) path=%s\n",
+                name.c_str(), fname.c_str()
+            );
+        }
+    #endif
+        bool res = false;
+
+        // faces of font file which is not changed since previous run are taken from registry cache
+        lvsize_t fileSize = 0;
+        lUInt32 modTime = 0;
+        bool fileInfo = LVGetFileInfo( LocalToUnicode(fname), fileSize, modTime );
+        LVFontRegistryEntry * entry = fileInfo ? _registry.find( fname, (lUInt32)fileSize, modTime ) : NULL;
+        if ( !entry ) {
+            entry = readFontFile( name, fname );
+            entry->size = (lUInt32)fileSize;
+            entry->modTime = modTime;
+            if ( fileInfo )
+                _registry.add( entry );
+        }
+
+        for ( int index=0; index<entry->faces.length(); index++ ) {
+            LVFontRegistryFace * face = entry->faces[index];
             LVFontDef def(
                 name,
                 -1, // height==-1 for scalable fonts
-                ( face->style_flags & FT_STYLE_FLAG_BOLD ) ? 700 : 400,
-                ( face->style_flags & FT_STYLE_FLAG_ITALIC ) ? true : false,
-                fontFamily,
-                familyName,
+                face->weight,
+                face->italic,
+                face->family,
+                face->typeface,
                 index
             );
     #if (DEBUG_FONT_MAN==1)
@@ -2158,29 +3236,34 @@ public:
             );
         }
     #endif
-            if ( _cache.findDuplicate( &def ) )
-                return false;
+            if ( _cache.findDuplicate( &def ) ) {
+                res = false;
+                break;
+            }
             _cache.update( &def, LVFontRef(NULL) );
-            if ( scal && !def.getItalic() ) {
+            if ( !def.getItalic() ) {
                 LVFontDef newDef( def );
                 newDef.setItalic(2); // can italicize
                 if ( !_cache.findDuplicate( &newDef ) )
                     _cache.update( &newDef, LVFontRef(NULL) );
             }
             res = true;
-
-            if ( face ) {
-                FT_Done_Face( face );
-                face = NULL;
-            }
-
-            if ( index>=num_faces-1 )
-                break;
         }
+        if ( !fileInfo )
+            delete entry;
 
         return res;
     }
 
+    /// sets file to keep registered font files properties in; fonts registered before are written to it
+    virtual bool SetRegistryCacheFile( lString16 fileName )
+    {
+        bool res = _registry.open( fileName );
+        if ( _registry.isChanged() )
+            _registry.save();
+        return res;
+    }
+
     virtual bool Init( lString8 path )
     {
         _path = path;
@@ -2509,6 +3592,17 @@ LVFontRef LoadFontFromFile( const char * fname )
 
 #endif
 
+static lString16 fontRegistryCacheFile;
+
+void SetFontRegistryCacheFile( lString16 fileName )
+{
+    if ( fontRegistryCacheFile == fileName )
+        return; // already set before fonts registration
+    fontRegistryCacheFile = fileName;
+    if ( fontMan )
+        fontMan->SetRegistryCacheFile( fileName );
+}
+
 bool InitFontManager( lString8 path )
 {
     if ( fontMan ) {
@@ -2521,6 +3615,8 @@ bool InitFontManager( lString8 path )
 #else
     fontMan = new LVBitmapFontManager;
 #endif
+    if ( !fontRegistryCacheFile.empty() )
+        fontMan->SetRegistryCacheFile( fontRegistryCacheFile );
     return fontMan->Init( path );
 }
 
@@ -2601,6 +3697,7 @@ void LVBaseFont::DrawTextString( LVDrawBuf * buf, int x, int y,
 {
     static lUInt8 glyph_buf[16384];
     LVFont::glyph_info_t info;
+    LVGlyphBitmapBuffer glyphBuf;
     int baseline = getBaseline();
     while (len>=(addHyphen?0:1))
     {
@@ -2616,7 +3713,7 @@ void LVBaseFont::DrawTextString( LVDrawBuf * buf, int x, int y,
               if ( item->bmp_height && item->bmp_height ) {
                   buf->Draw( x + item->origin_x,
                       y + baseline - item->origin_y,
-                      item->bmp,
+                      glyphBuf.getBitmap( item ),
                       item->bmp_width,
                       item->bmp_height,
                       palette);
@@ -2781,6 +3878,10 @@ LVFontCacheItem * LVFontCache::findFallback( lString8 face, int size )
 
 LVFontCacheItem * LVFontCache::find( const LVFontDef * fntdef )
 {
+    LVFontIndexKey key( *fntdef );
+    LVFontCacheItem * res = NULL;
+    if ( _index.get( key, res ) )
+        return res;
     int best_index = -1;
     int best_match = -1;
     int best_instance_index = -1;
@@ -2817,8 +3918,11 @@ LVFontCacheItem * LVFontCache::find( const LVFontDef * fntdef )
     if (best_index<0)
         return NULL;
     if (best_instance_match >= best_match)
-        return _instance_list[best_instance_index];
-    return _registered_list[best_index];
+        res = _instance_list[best_instance_index];
+    else
+        res = _registered_list[best_index];
+    _index.set( key, res );
+    return res;
 }
 
 void LVFontCache::addInstance( const LVFontDef * def, LVFontRef ref )
@@ -2828,6 +3932,7 @@ void LVFontCache::addInstance( const LVFontDef * def, LVFontRef ref )
     LVFontCacheItem * item = new LVFontCacheItem(*def);
     item->_fnt = ref;
     _instance_list.add( item );
+    _index.clear();
 }
 
 void LVFontCache::update( const LVFontDef * def, LVFontRef ref )
@@ -2865,6 +3970,7 @@ void LVFontCache::update( const LVFontDef * def, LVFontRef ref )
         LVFontCacheItem * item;
         item = new LVFontCacheItem(*def);
         _registered_list.add( item );
+        _index.clear();
     }
 }
 
@@ -2881,6 +3987,7 @@ void LVFontCache::gc()
                 CRLog::trace("dropping font instance %s[%d] by gc()", _instance_list[i]->getDef()->getTypeFace().c_str(), _instance_list[i]->getDef()->getSize() );
             _instance_list.erase(i,1);
             droppedCount++;
+            _index.clear();
         } else {
             usedCount++;
         }
@@ -3540,6 +4647,7 @@ bool operator == (const LVFont & r1, const LVFont & r2)
             && r1.getItalic()==r2.getItalic()
             && r1.getFontFamily()==r2.getFontFamily()
             && r1.getTypeFace()==r2.getTypeFace()
-            && r1.getKerning()==r2.getKerning();
+            && r1.getKerning()==r2.getKerning()
+            && r1.getLigatures()==r2.getLigatures();
 }
 
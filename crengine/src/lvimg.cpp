@@ -64,6 +64,8 @@ public:
     virtual int    GetWidth() { return _width; }
     virtual int    GetHeight() { return _height; }
     virtual bool   Decode( LVImageDecoderCallback * callback ) = 0;
+    /// sets image size read from file header, to avoid decoder initialization when only size is needed
+    void SetSize( int dx, int dy ) { _width = dx; _height = dy; }
     virtual ~LVNodeImageSource() {}
 };
 
@@ -333,6 +335,10 @@ public:
     virtual void   Compact();
     virtual bool   Decode( LVImageDecoderCallback * callback );
     static bool CheckPattern( const lUInt8 * buf, int len );
+    static bool ReadSize( const lUInt8 * buf, int len, int & dx, int & dy );
+protected:
+    /// decodes image from the beginning of stream and passes rows starting from firstRow to callback
+    bool DecodeRows( LVImageDecoderCallback * callback, int & firstRow );
 };
 
 
@@ -587,12 +593,27 @@ public:
                  */
                 cinfo.out_color_space = JCS_RGB;
 
+                int targetWidth = 0;
+                int targetHeight = 0;
+                callback->GetTargetSize( targetWidth, targetHeight );
+                if ( targetWidth > 0 && targetHeight > 0 ) {
+                    // let IDCT downscale by 1/2, 1/4 or 1/8 while result is not less than target size
+                    int denom = 8;
+                    while ( denom > 1 && ( (_width + denom - 1) / denom < targetWidth
+                                           || (_height + denom - 1) / denom < targetHeight ) )
+                        denom >>= 1;
+                    cinfo.scale_num = 1;
+                    cinfo.scale_denom = denom;
+                }
+
                 /* Step 5: Start decompressor */
 
                 (void) jpeg_start_decompress(&cinfo);
                 /* We can ignore the return value since suspension is not possible
                  * with the stdio data source.
                  */
+                if ( (int)cinfo.output_width != _width || (int)cinfo.output_height != _height )
+                    callback->OnDecodedSize( this, cinfo.output_width, cinfo.output_height );
                 buffer = new lUInt8 [ cinfo.output_width * cinfo.output_components ];
                 row = new lUInt32 [ cinfo.output_width ];
                 /* Step 6: while (scan lines remain to be read) */
@@ -633,6 +654,44 @@ public:
         //check for SOI marker at beginning of file
         return (buf[0]==0xFF && buf[1]==0xD8);
     }
+    /// reads image size from SOFn frame header, skipping other marker segments by length
+    static bool ReadSize( LVStream * stream, int & dx, int & dy )
+    {
+        lvpos_t size = stream->GetSize();
+        lvpos_t pos = 2; // after SOI
+        lUInt8 buf[5];
+        lvsize_t bytesRead = 0;
+        while ( pos + 4 <= size ) {
+            if ( stream->SetPos( pos )!=pos || stream->Read( buf, 4, &bytesRead )!=LVERR_OK || bytesRead!=4 )
+                return false;
+            if ( buf[0]!=0xFF )
+                return false;
+            int marker = buf[1];
+            if ( marker==0xFF ) {
+                pos++; // fill byte
+                continue;
+            }
+            if ( marker==0x01 || (marker>=0xD0 && marker<=0xD7) ) {
+                pos += 2; // TEM, RSTn: no parameters
+                continue;
+            }
+            if ( marker==0xD9 || marker==0xDA )
+                return false; // EOI or SOS before frame header
+            int len = (buf[2]<<8) | buf[3];
+            if ( len<2 )
+                return false;
+            // SOF0..SOF15, except DHT, JPG and DAC which share this range
+            if ( marker>=0xC0 && marker<=0xCF && marker!=0xC4 && marker!=0xC8 && marker!=0xCC ) {
+                if ( len<8 || stream->Read( buf, 5, &bytesRead )!=LVERR_OK || bytesRead!=5 )
+                    return false;
+                dy = (buf[1]<<8) | buf[2];
+                dx = (buf[3]<<8) | buf[4];
+                return dx>0 && dy>0 && dx<=JPEG_MAX_DIMENSION && dy<=JPEG_MAX_DIMENSION;
+            }
+            pos += 2 + len;
+        }
+        return false;
+    }
 };
 
 #endif
@@ -647,6 +706,19 @@ LVPngImageSource::LVPngImageSource( ldomNode * node, LVStreamRef stream )
 LVPngImageSource::~LVPngImageSource() {}
 void LVPngImageSource::Compact() { }
 bool LVPngImageSource::Decode( LVImageDecoderCallback * callback )
+{
+    // interlaced image is decoded several times, window by window, to avoid unpacking of whole image
+    int firstRow = 0;
+    do {
+        if ( !DecodeRows( callback, firstRow ) )
+            return false;
+    } while ( callback && firstRow < _height );
+    return true;
+}
+
+/// all rows of non-interlaced image, or next window of rows of interlaced one, are passed to callback;
+/// firstRow is updated to point to the first row which is not decoded yet
+bool LVPngImageSource::DecodeRows( LVImageDecoderCallback * callback, int & firstRow )
 {
     png_structp png_ptr = NULL;
     png_infop info_ptr = NULL;
@@ -688,11 +760,10 @@ bool LVPngImageSource::Decode( LVImageDecoderCallback * callback )
     _width = width;
     _height = height;
 
-    row = new lUInt32[ width ];
-
     if ( callback )
     {
-        callback->OnStartDecode(this);
+        if ( firstRow==0 )
+            callback->OnStartDecode(this);
 
         //int png_transforms = PNG_TRANSFORM_STRIP_16 | PNG_TRANSFORM_INVERT_ALPHA;
             //PNG_TRANSFORM_PACKING|
@@ -740,18 +811,52 @@ bool LVPngImageSource::Decode( LVImageDecoderCallback * callback )
         //    color_type == PNG_COLOR_TYPE_RGB_ALPHA)
         png_set_bgr(png_ptr);
 
-            for (int pass = 0; pass < number_passes; pass++)
-        {
-                for (lUInt32 y = 0; y < height; y++)
+        if ( number_passes==1 ) {
+            row = new lUInt32[ width ];
+            for (lUInt32 y = 0; y < height; y++)
             {
                 png_read_rows(png_ptr, (unsigned char **)&row, NULL, 1);
                 callback->OnLineDecoded( this, y, row );
             }
+            firstRow = height;
+        } else {
+            // Adam7: every pass adds pixels to rows, so row is complete only after the last pass;
+            // only rows of window [firstRow, lastRow) are kept, other rows are read into scratch line
+            int windowRows = PNG_INTERLACED_DECODE_BUFFER_SIZE / (width * sizeof(lUInt32));
+            if ( windowRows < 8 )
+                windowRows = 8;
+#if (PNG_INTERLACED_DECODE_MAX_PASSES>0)
+            // every window decodes whole stream again: for wide images memory limit is exceeded to bound decoding time
+            int minWindowRows = ((int)height + PNG_INTERLACED_DECODE_MAX_PASSES - 1) / PNG_INTERLACED_DECODE_MAX_PASSES;
+            if ( windowRows < minWindowRows )
+                windowRows = minWindowRows;
+#endif
+            int lastRow = firstRow + windowRows;
+            if ( lastRow > (int)height )
+                lastRow = height;
+            row = new lUInt32[ width * (lastRow - firstRow + 1) ];
+            memset( row, 0, width * (lastRow - firstRow + 1) * sizeof(lUInt32) );
+            lUInt32 * window = row + width;
+            for (int pass = 0; pass < number_passes; pass++)
+            {
+                for (int y = 0; y < (int)height; y++)
+                {
+                    // rows after window are not needed after the last pass
+                    if ( pass==number_passes-1 && y>=lastRow )
+                        break;
+                    lUInt32 * p = (y>=firstRow && y<lastRow) ? window + (y - firstRow) * width : row;
+                    png_read_rows(png_ptr, (unsigned char **)&p, NULL, 1);
+                }
+            }
+            for ( int y = firstRow; y < lastRow; y++ )
+                callback->OnLineDecoded( this, y, window + (y - firstRow) * width );
+            firstRow = lastRow;
         }
 
-        png_read_end(png_ptr, info_ptr);
-
-        callback->OnEndDecode(this, false);
+        if ( firstRow >= (int)height ) {
+            png_read_end(png_ptr, info_ptr);
+            callback->OnEndDecode(this, false);
+        }
     }
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
@@ -764,6 +869,21 @@ bool LVPngImageSource::CheckPattern( const lUInt8 * buf, int )
     return( !png_sig_cmp((unsigned char *)buf, (png_size_t)0, 4) );
 }
 
+/// reads image size from IHDR chunk, which must immediately follow PNG signature
+bool LVPngImageSource::ReadSize( const lUInt8 * buf, int len, int & dx, int & dy )
+{
+    if ( len<24 || buf[12]!='I' || buf[13]!='H' || buf[14]!='D' || buf[15]!='R' )
+        return false;
+    lUInt32 w = ((lUInt32)buf[16]<<24) | ((lUInt32)buf[17]<<16) | ((lUInt32)buf[18]<<8) | buf[19];
+    lUInt32 h = ((lUInt32)buf[20]<<24) | ((lUInt32)buf[21]<<16) | ((lUInt32)buf[22]<<8) | buf[23];
+    // same limits as default libpng user limits
+    if ( w<1 || h<1 || w>1000000 || h>1000000 )
+        return false;
+    dx = (int)w;
+    dy = (int)h;
+    return true;
+}
+
 #endif
 
 // GIF support
@@ -781,7 +901,7 @@ protected:
     unsigned char m_version;
     unsigned char m_bpp;     //
     unsigned char m_flg_gtc; // GTC (gobal table of colors) flag
-    unsigned char m_transparent_color; // index
+    int m_transparent_color; // index from graphic control extension, -1 if there are no transparent pixels
 
     lUInt32 * m_global_color_table;
 public:
@@ -805,6 +925,16 @@ public:
             return false; // bad version
         return true;
     }
+    /// reads image size from logical screen descriptor, with the same limits as Decode()
+    static bool ReadSize( LVStream * stream, const lUInt8 * buf, int len, int & dx, int & dy )
+    {
+        lvsize_t sz = stream->GetSize();
+        if ( sz<32 || sz>0x80000 || len<10 )
+            return false;
+        dx = buf[6] + (buf[7]<<8);
+        dy = buf[8] + (buf[9]<<8);
+        return dx>=1 && dy>=1 && dx<4096 && dy<4096;
+    }
     virtual void   Compact()
     {
         // TODO: implement compacting
@@ -838,7 +968,10 @@ protected:
     LVGifImageSource * m_pImage;
     lUInt32 *    m_local_color_table;
 
+    /// palette indexes of frame pixels, rows in stream order (by passes for interlaced frame)
     unsigned char * m_buffer;
+    /// number of decoded pixels in m_buffer, rest of frame is transparent
+    int m_decoded;
 public:
     int DecodeFromBuffer( unsigned char * buf, int buf_size, int &bytes_read );
     LVGifFrame(LVGifImageSource * pImage);
@@ -857,39 +990,52 @@ public:
         if ( w<=0 || w>4096 || h<=0 || h>4096 )
             return; // wrong image width
         callback->OnStartDecode( m_pImage );
-        lUInt32 * line = new lUInt32[w];
-        int transp_color = m_pImage->m_transparent_color;
+        // palette with transparency applied: one lookup per pixel
+        lUInt32 colors[256];
         lUInt32 * pColorTable = GetColorTable();
-        int interlacePos = 0;
-        int interlaceTable[] = {8, 0, 8, 4, 4, 2, 2, 1, 1, 1}; // pairs: step, offset
-        int dy = interlaceTable[interlacePos];
-        int y = 0;
-        for ( int i=0; i<h; i++ ) {
-            for ( int j=0; j<w; j++ ) {
-                line[j] = 0xFFFFFFFF; // transparent
+        int colorCount = 1 << m_bpp;
+        for ( int i=0; i<256; i++ )
+            colors[i] = i < colorCount ? pColorTable[i] : 0;
+        if ( m_pImage->m_transparent_color >= 0 )
+            colors[m_pImage->m_transparent_color] = 0xFFFFFFFF;
+        // row of m_buffer for each frame row: interlaced frames are stored by passes
+        int * srcRows = new int[m_cy];
+        int n = 0;
+        static const int interlaceStart[] = { 0, 4, 2, 1 };
+        static const int interlaceStep[] = { 8, 8, 4, 2 };
+        for ( int pass=0; pass<4; pass++ ) {
+            if ( !m_flg_interlaced ) {
+                for ( int y=0; y<m_cy; y++ )
+                    srcRows[y] = y;
+                break;
             }
-            if ( i >= m_top  && i < m_top+m_cy ) {
-                unsigned char * p_line = m_buffer + (i-m_top)*m_cx;
-                for ( int x=0; x<m_cx; x++ ) {
-                    unsigned char b = p_line[x];
-                    if (b!=transp_color) {
-                        line[x + m_left] = pColorTable[b];
-                    }
-                }
+            for ( int y=interlaceStart[pass]; y<m_cy; y+=interlaceStep[pass] )
+                srcRows[y] = n++;
+        }
+        lUInt32 * line = new lUInt32[w];
+        for ( int i=0; i<w; i++ )
+            line[i] = 0xFFFFFFFF; // transparent
+        for ( int y=0; y<h; y++ ) {
+            if ( y >= m_top && y < m_top+m_cy ) {
+                int start = srcRows[y-m_top] * m_cx;
+                const unsigned char * p_line = m_buffer + start;
+                lUInt32 * dst = line + m_left;
+                int count = m_decoded - start;
+                if ( count > m_cx )
+                    count = m_cx;
+                int x = 0;
+                for ( ; x<count; x++ )
+                    dst[x] = colors[p_line[x]];
+                for ( ; x<m_cx; x++ )
+                    dst[x] = 0xFFFFFFFF;
+            } else if ( y == m_top+m_cy ) {
+                for ( int x=0; x<m_cx; x++ )
+                    line[m_left + x] = 0xFFFFFFFF;
             }
             callback->OnLineDecoded( m_pImage, y, line );
-            if ( m_flg_interlaced ) {
-                y += dy;
-                if ( y>=m_cy ) {
-                    interlacePos += 2;
-                    dy = interlaceTable[interlacePos];
-                    y = interlaceTable[interlacePos+1];
-                }
-            } else {
-                y++;
-            }
         }
         delete[] line;
+        delete[] srcRows;
         callback->OnEndDecode( m_pImage, false );
     }
 };
@@ -930,7 +1076,7 @@ int LVGifImageSource::DecodeFromBuffer(unsigned char *buf, int buf_size, LVImage
     _height = p[2] + (p[3]<<8);
     m_bpp = (p[4]&7)+1;
     m_flg_gtc = (p[4]&0x80)?1:0;
-    m_transparent_color = p[5];
+    m_transparent_color = -1; // p[5] is background color index: it's opaque
 
     if ( !(_width>=1 && _height>=1 && _width<4096 && _height<4096 ) )
         return false;
@@ -957,21 +1103,32 @@ int LVGifImageSource::DecodeFromBuffer(unsigned char *buf, int buf_size, LVImage
         p+=(m_color_count * 3);
     }
 
+    // skip extension blocks up to first image descriptor ','; the rest of file (animation frames) is not read
     bool res = false;
-    if (p - buf < buf_size ) {
-        // search for delimiter char ','
-        while (*p != ',' && p-buf<buf_size)
-            p++;
-        if (*p==',') {
-            // found image descriptor!
-            LVGifFrame * pFrame = new LVGifFrame(this);
-            int cbRead = 0;
-            if (pFrame->DecodeFromBuffer(p, buf_size-(p-buf), cbRead) ) {
-                res = true;
-                pFrame->Draw( callback );
-            }
-            delete pFrame;
+    unsigned char * end = buf + buf_size;
+    while ( p < end && *p == '!' ) {
+        if ( end - p < 3 )
+            return 0;
+        int label = p[1];
+        p += 2;
+        if ( label == 0xF9 && p[0] >= 4 && end - p > 5 && (p[1] & 1) ) {
+            // graphic control extension of first frame: transparent color index
+            m_transparent_color = p[4];
+        }
+        // data sub-blocks
+        while ( p < end && *p )
+            p += *p + 1;
+        p++;
+    }
+    if ( p < end && *p==',' ) {
+        // found image descriptor!
+        LVGifFrame * pFrame = new LVGifFrame(this);
+        int cbRead = 0;
+        if (pFrame->DecodeFromBuffer(p, end - p, cbRead) ) {
+            res = true;
+            pFrame->Draw( callback );
         }
+        delete pFrame;
     }
 
     return res;
@@ -998,220 +1155,119 @@ void LVGifImageSource::Clear()
 }
 
 #define LSWDECODER_MAX_TABLE_SIZE 4096
+/// GIF LZW decoder
+/**
+    String table is kept as prefix code + last byte, with length and first byte of each
+    string, so each code is expanded right to left directly into output buffer,
+    without intermediate stack. Output is limited by buffer size.
+*/
 class CLZWDecoder
 {
 protected:
+    lUInt16 str_prefix[LSWDECODER_MAX_TABLE_SIZE];
+    lUInt16 str_length[LSWDECODER_MAX_TABLE_SIZE];
+    unsigned char str_suffix[LSWDECODER_MAX_TABLE_SIZE];
+    unsigned char str_first[LSWDECODER_MAX_TABLE_SIZE];
 
-    // in_stream
-    const unsigned char * p_in_stream;
-    int          in_stream_size;
-    int          in_bit_pos;
-
-    // out_stream
-    unsigned char * p_out_stream;
-    int          out_stream_size;
-
-    int  clearcode;
-    int  eoicode;
-    int  bits;
-    int  lastadd;
-    /* // old implementation
-    unsigned char * * str_table;
-    int             * str_size;
-    */
-    unsigned char str_table[LSWDECODER_MAX_TABLE_SIZE];
-    unsigned char last_table[LSWDECODER_MAX_TABLE_SIZE];
-    unsigned char rev_buf[LSWDECODER_MAX_TABLE_SIZE/2];
-    short         str_nextchar[LSWDECODER_MAX_TABLE_SIZE];
-    //int           str_size;
+    /// writes string of code, truncated to avail bytes
+    inline void WriteString( int code, unsigned char * out, int len, int avail )
+    {
+        int i = len - 1;
+        // skip tail which does not fit
+        for ( ; i >= avail; i-- )
+            code = str_prefix[code];
+        for ( ; i > 0; i-- ) {
+            out[i] = str_suffix[code];
+            code = str_prefix[code];
+        }
+        out[0] = (unsigned char)code;
+    }
 public:
-
-    void SetInputStream (const unsigned char * p, int sz ) {
-        p_in_stream = p;
-        in_stream_size = sz;
-        in_bit_pos = 0;
-    };
-
-    void SetOutputStream (unsigned char * p, int sz ) {
-        p_out_stream = p;
-        out_stream_size = sz;
-    };
-
-    int WriteOutChar( unsigned char b ) {
-        if (--out_stream_size>=0) {
-            *p_out_stream++ = b;
-            return 1;
-        } else {
+    /// decodes LZW raster data; returns number of bytes written to out, 0 on error
+    int Decode( int sizecode, const unsigned char * in, int in_size, unsigned char * out, int out_size )
+    {
+        if ( sizecode < 1 || sizecode > 8 )
             return 0;
+        int clearcode = 1 << sizecode;
+        int eoicode = clearcode + 1;
+        for ( int i=0; i<clearcode; i++ ) {
+            str_suffix[i] = (unsigned char)i;
+            str_first[i] = (unsigned char)i;
+            str_length[i] = 1;
         }
-
-    };
-
-    int WriteOutString( int code ) {
-        int pos = 0;
-        do {
-            rev_buf[pos++] = str_table[code];
-            code = str_nextchar[code];
-        } while (code>=0);
-        while (--pos>=0) {
-            if (!WriteOutChar(rev_buf[pos]))
-                return 0;
-        }
-        return 1;
-    };
-
-    void FillRestOfOutStream( unsigned char b ) {
-        for (; out_stream_size>0; out_stream_size--) {
-            *p_out_stream++ = b;
-        }
-    }
-
-    int ReadInCode() {
-        int code = (p_in_stream[0])+
-            (p_in_stream[1]<<8)+
-            (p_in_stream[2]<<16);
-        code >>= in_bit_pos;
-        code &= (1<<bits)-1;
-        in_bit_pos += bits;
-        if (in_bit_pos>8) {
-            p_in_stream++;
-            in_stream_size--;
-            in_bit_pos -= 8;
-            if (in_bit_pos>8) {
-                p_in_stream++;
-                in_stream_size--;
-                in_bit_pos -= 8;
+        int bits = sizecode + 1;
+        int mask = (1 << bits) - 1;
+        int next = eoicode + 1;
+        int oldcode = -1;
+        lUInt32 acc = 0;
+        int accbits = 0;
+        const unsigned char * in_end = in + in_size;
+        unsigned char * dst = out;
+        unsigned char * dst_end = out + out_size;
+        while ( dst < dst_end ) {
+            while ( accbits < bits ) {
+                if ( in >= in_end )
+                    return dst - out; // truncated data: keep decoded part
+                acc |= (lUInt32)(*in++) << accbits;
+                accbits += 8;
             }
-        }
-        if (in_stream_size<0)
-            return -1;
-        else
-            return code;
-    };
-
-    int AddString( int OldCode, unsigned char NewChar ) {
-        if (lastadd == LSWDECODER_MAX_TABLE_SIZE)
-            return -1;
-        if (lastadd == (1<<bits)-1) {
-            // increase table size
-            bits++;
-            //ResizeTable(1<<bits);
-        }
-
-        str_table[lastadd] = NewChar;
-        str_nextchar[lastadd] = OldCode;
-        last_table[lastadd] = last_table[OldCode];
-
-
-        lastadd++;
-        return lastadd-1;
-    };
-
-    CLZWDecoder() {
-        /* // ld implementation
-        str_table = NULL;
-        str_size = NULL;
-        */
-        lastadd=0;
-    };
-
-    void Clear() {
-        /* // old implementation
-        for (int i=0; i<lastadd; i++) {
-            if (str_table[i])
-                delete str_table[i];
-        }
-        */
-        lastadd=0;
-    };
-
-
-    ~CLZWDecoder() {
-        Clear();
-    };
-
-    void Init(int sizecode) {
-        bits = sizecode + 1;
-        // init table
-        Clear();
-        //ResizeTable(1<<bits);
-        for (int i=(1<<sizecode)-1; i>=0; i--) {
-            str_table[i] = i;
-            last_table[i] = i;
-            str_nextchar[i] = -1;
-        }
-        // init codes
-        clearcode = (1<<sizecode);
-        str_table[clearcode] = 0;
-        str_nextchar[clearcode] = -1;
-        eoicode = clearcode + 1;
-        str_table[eoicode] = 0;
-        str_nextchar[eoicode] = -1;
-        //str_table[eoicode] = NULL;
-        lastadd = eoicode + 1;
-    };
-    int  CodeExists(int code) {
-        return (code<lastadd);
-    };
-
-    int  Decode( int init_code_size ) {
-
-        int code, oldcode;
-
-        Init( init_code_size );
-
-        code = ReadInCode(); // == 256, ignore
-        if (code<0 || code>lastadd)
-            return 0;
-
-        while (1) { // 3
-
-            code = ReadInCode();
-            if (code<0 || code>lastadd)
-                return 0;
-
-            if (!WriteOutString(code))
-                return 0;
-
-            while (1) { // 5
-
-                oldcode = code;
-
-                code = ReadInCode();
-                if (code<0 || code>lastadd)
+            int code = acc & mask;
+            acc >>= bits;
+            accbits -= bits;
+            if ( code == clearcode ) {
+                bits = sizecode + 1;
+                mask = (1 << bits) - 1;
+                next = eoicode + 1;
+                oldcode = -1;
+                continue;
+            }
+            if ( code == eoicode )
+                break;
+            int avail = dst_end - dst;
+            if ( oldcode < 0 ) {
+                // first code after clear
+                if ( code > clearcode )
                     return 0;
-
-                if (CodeExists(code)) {
-                    if (code==eoicode)
-                        return 1;
-                    else if (code==clearcode)
-                        break; // clear & goto 3
-
-                    // write  code
-                    if (!WriteOutString(code))
-                        return 0;
-
-                    // add  old + code[0]
-                    if (AddString(oldcode, last_table[code])<0)
-                        return 0; // table overflow
-
-
-                } else {
-                    // write  old + old[0]
-                    if (!WriteOutString(oldcode))
-                        return 0;
-                    if (!WriteOutChar(last_table[oldcode]))
-                        return 0;
-
-                    // add  old + old[0]
-                    if (AddString(oldcode, last_table[oldcode])<0)
-                        return 0; // table overflow
+                *dst++ = (unsigned char)code;
+                oldcode = code;
+                continue;
+            }
+            int len;
+            unsigned char first;
+            if ( code < next ) {
+                len = str_length[code];
+                if ( len == 1 )
+                    *dst = (unsigned char)code;
+                else
+                    WriteString( code, dst, len, avail );
+                first = str_first[code];
+            } else if ( code == next ) {
+                // string of old code + its first byte
+                first = str_first[oldcode];
+                len = str_length[oldcode] + 1;
+                WriteString( oldcode, dst, len - 1, avail );
+                if ( len <= avail )
+                    dst[len - 1] = first;
+            } else {
+                return 0; // wrong code
+            }
+            if ( next < LSWDECODER_MAX_TABLE_SIZE ) {
+                // add old string + first byte of current one
+                str_prefix[next] = (lUInt16)oldcode;
+                str_suffix[next] = first;
+                str_first[next] = str_first[oldcode];
+                str_length[next] = str_length[oldcode] + 1;
+                next++;
+                if ( next == (1 << bits) && bits < 12 ) {
+                    bits++;
+                    mask = (1 << bits) - 1;
                 }
             }
-
-            Init( init_code_size );
+            oldcode = code;
+            dst += len < avail ? len : avail;
         }
-    };
+        return dst - out;
+    }
 };
 
 bool LVGifImageSource::Decode( LVImageDecoderCallback * callback )
@@ -1254,12 +1310,8 @@ int LVGifFrame::DecodeFromBuffer( unsigned char * buf, int buf_size, int &bytes_
 
     m_flg_ltc = (p[8]&0x80)?1:0;
     m_flg_interlaced = (p[8]&0x40)?1:0;
-    m_bpp = (p[8]&0x7) + 1;
-
-    if (m_bpp==1)
-        m_bpp = m_pImage->m_bpp;
-    else if (m_bpp!=m_pImage->m_bpp && !m_flg_ltc)
-        return 0; // wrong color table
+    // color table size bits are used only with local color table
+    m_bpp = m_flg_ltc ? (p[8]&0x7) + 1 : m_pImage->m_bpp;
 
     // next
     p+=9;
@@ -1279,6 +1331,8 @@ int LVGifFrame::DecodeFromBuffer( unsigned char * buf, int buf_size, int &bytes_
         // next
         p+=(m_color_count * 3);
     }
+    if ( !GetColorTable() )
+        return 0; // error: no color table
 
     // unpack image
     unsigned char * stream_buffer = NULL;
@@ -1296,22 +1350,28 @@ int LVGifFrame::DecodeFromBuffer( unsigned char * buf, int buf_size, int &bytes_
         i+=block_size+1;
     }
 
-    if (!stream_buffer_size || i>rest_buf_size)
+    if (!stream_buffer_size)
         return 0; // error
+    if (i>rest_buf_size) {
+        // last block is truncated
+        stream_buffer_size -= i - rest_buf_size;
+        i = rest_buf_size;
+    }
 
     // set read bytes count
     bytes_read = (p-buf) + i;
 
     // create stream buffer
-    stream_buffer = new unsigned char[stream_buffer_size+3];
+    stream_buffer = new unsigned char[stream_buffer_size];
     // copy data to stream buffer
     int sb_index = 0;
-    for (i=0; p[i]; ) {
+    for (i=0; sb_index<stream_buffer_size; ) {
         // next block
         int block_size = p[i];
-        for (int j=1; j<=block_size; j++) {
-            stream_buffer[sb_index++] = p[i+j];
-        }
+        if ( block_size > stream_buffer_size - sb_index )
+            block_size = stream_buffer_size - sb_index;
+        memcpy( stream_buffer + sb_index, p + i + 1, block_size );
+        sb_index += block_size;
         i+=block_size+1;
     }
 
@@ -1320,21 +1380,16 @@ int LVGifFrame::DecodeFromBuffer( unsigned char * buf, int buf_size, int &bytes_
     m_buffer = new unsigned char [m_cx*m_cy];
 
     // decode image to buffer
-    CLZWDecoder decoder;
-    decoder.SetInputStream( stream_buffer, stream_buffer_size );
-    decoder.SetOutputStream( m_buffer, m_cx*m_cy );
+    CLZWDecoder * decoder = new CLZWDecoder();
+    m_decoded = decoder->Decode( size_code, stream_buffer, stream_buffer_size, m_buffer, m_cx*m_cy );
+    delete decoder;
 
-    int res=0;
-
-    if (decoder.Decode(size_code)) {
-        // decoded Ok
-        // fill rest with transparent color
-        decoder.FillRestOfOutStream( m_pImage->m_transparent_color );
-        res = 1;
-    } else {
+    int res = 1;
+    if ( !m_decoded ) {
         // error
         delete[] m_buffer;
         m_buffer = NULL;
+        res = 0;
     }
 
     // cleanup
@@ -1352,6 +1407,8 @@ LVGifFrame::LVGifFrame(LVGifImageSource * pImage)
     m_cy = 0;
     m_flg_ltc = 0; // GTC (gobal table of colors) flag
     m_local_color_table = NULL;
+    m_buffer = NULL;
+    m_decoded = 0;
 }
 
 LVGifFrame::~LVGifFrame()
@@ -1371,6 +1428,62 @@ void LVGifFrame::Clear()
     }
 }
 
+
+#ifdef _DEBUG
+#include "../include/crtest.h"
+
+/// collects decoded rows of 16x16 image
+class LVGifTestCallback : public LVImageDecoderCallback
+{
+public:
+    lUInt32 pixels[16*16];
+    int nextRow;
+    bool ordered;
+    bool started;
+    bool ended;
+    LVGifTestCallback() : nextRow(0), ordered(true), started(false), ended(false) { }
+    virtual void OnStartDecode( LVImageSource * ) { started = true; }
+    virtual bool OnLineDecoded( LVImageSource *, int y, lUInt32 * data )
+    {
+        if ( y!=nextRow++ || y<0 || y>=16 ) {
+            ordered = false;
+            return true;
+        }
+        memcpy( pixels + y * 16, data, 16 * sizeof(lUInt32) );
+        return true;
+    }
+    virtual void OnEndDecode( LVImageSource *, bool ) { ended = true; }
+};
+
+/// decodes interlaced GIF with transparency, comment and second frame which should be ignored
+void testGifDecoding()
+{
+    CRLog::info("testGifDecoding()");
+    // 16x16, colors black, red, green, blue; pixel (x,y) is color (x*y+x)%4, color 3 is transparent
+    static const lUInt8 gif[] = {
+        0x47, 0x49, 0x46, 0x38, 0x39, 0x61, 0x10, 0x00, 0x10, 0x00, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0x00, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00, 0xff, 0x21, 0xfe, 0x03, 0x2c, 0x2c, 0x2c, 0x00,
+        0x21, 0xf9, 0x04, 0x01, 0x00, 0x00, 0x03, 0x00, 0x2c, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x10,
+        0x00, 0x40, 0x02, 0x33, 0x44, 0x34, 0x86, 0x9a, 0xd7, 0xeb, 0x98, 0x8c, 0x14, 0xda, 0x87, 0xe5,
+        0x10, 0x01, 0xec, 0xfe, 0x79, 0x9c, 0x08, 0x8e, 0xe1, 0x69, 0xa6, 0xe5, 0x4a, 0xb6, 0xa1, 0x00,
+        0xc0, 0x72, 0x4c, 0xcf, 0xc0, 0x8d, 0xe7, 0x7a, 0xcd, 0xcf, 0xf6, 0x0e, 0xbc, 0xf9, 0x7a, 0xbc,
+        0x60, 0x70, 0x88, 0xa4, 0x19, 0x77, 0x05, 0x00, 0x2c, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
+        0x00, 0x00, 0x02, 0x02, 0x4c, 0x01, 0x00, 0x3b,
+    };
+    static const lUInt32 colors[4] = { 0x000000, 0xFF0000, 0x00FF00, 0xFFFFFFFF };
+    LVImageSourceRef img = LVCreateStreamCopyImageSource( LVCreateMemoryStream( (void*)gif, sizeof(gif) ) );
+    MYASSERT( !img.isNull(), "GIF image source" );
+    MYASSERT( img->GetWidth()==16 && img->GetHeight()==16, "GIF image size" );
+    LVGifTestCallback callback;
+    MYASSERT( img->Decode( &callback ), "GIF decode" );
+    MYASSERT( callback.started && callback.ended && callback.ordered && callback.nextRow==16, "GIF rows are passed top to bottom" );
+    for ( int y=0; y<16; y++ )
+        for ( int x=0; x<16; x++ )
+            MYASSERT( callback.pixels[y * 16 + x]==colors[(x*y+x)%4], "GIF pixel" );
+    CRLog::info("testGifDecoding() finished");
+}
+#endif
+
 #endif
 // ======= end of GIF support
 
@@ -1399,27 +1512,41 @@ LVImageSourceRef LVCreateStreamImageSource( ldomNode * node, LVStreamRef stream
     stream->SetPos( 0 );
 
 
+    // image size is taken from format header when possible: decoder is not initialized until drawing
     LVImageSource * img = NULL;
+    int dx = 0;
+    int dy = 0;
+    bool sizeKnown = false;
 #if (USE_LIBPNG==1)
-    if ( LVPngImageSource::CheckPattern( hdr, (lUInt32)bytesRead ) )
-        img = new LVPngImageSource( node, stream );
-    else
+    if ( LVPngImageSource::CheckPattern( hdr, (lUInt32)bytesRead ) ) {
+        LVPngImageSource * png = new LVPngImageSource( node, stream );
+        if ( (sizeKnown = LVPngImageSource::ReadSize( hdr, (int)bytesRead, dx, dy )) )
+            png->SetSize( dx, dy );
+        img = png;
+    } else
 #endif
 #if (USE_LIBJPEG==1)
-    if ( LVJpegImageSource::CheckPattern( hdr, (lUInt32)bytesRead ) )
-        img = new LVJpegImageSource( node, stream );
-    else
+    if ( LVJpegImageSource::CheckPattern( hdr, (lUInt32)bytesRead ) ) {
+        LVJpegImageSource * jpeg = new LVJpegImageSource( node, stream );
+        if ( (sizeKnown = LVJpegImageSource::ReadSize( stream.get(), dx, dy )) )
+            jpeg->SetSize( dx, dy );
+        img = jpeg;
+    } else
 #endif
 #if (USE_GIF==1)
-    if ( LVGifImageSource::CheckPattern( hdr, (lUInt32)bytesRead ) )
-        img = new LVGifImageSource( node, stream );
-    else
+    if ( LVGifImageSource::CheckPattern( hdr, (lUInt32)bytesRead ) ) {
+        LVGifImageSource * gif = new LVGifImageSource( node, stream );
+        if ( (sizeKnown = LVGifImageSource::ReadSize( stream.get(), hdr, (int)bytesRead, dx, dy )) )
+            gif->SetSize( dx, dy );
+        img = gif;
+    } else
 #endif
         img = new LVDummyImageSource( node, 50, 50 );
     if ( !img )
         return ref;
     ref = LVImageSourceRef( img );
-    if ( !img->Decode( NULL ) )
+    stream->SetPos( 0 );
+    if ( !sizeKnown && !img->Decode( NULL ) )
     {
         return LVImageSourceRef();
     }
@@ -12,6 +12,7 @@
 
 #include "../include/lvpagesplitter.h"
 #include "../include/lvtinydom.h"
+#include "../include/crprofiler.h"
 #include <time.h>
 
 
@@ -399,7 +400,10 @@ void LVRendPageContext::split()
 
 void LVRendPageContext::Finalize()
 {
+    CR_PROFILE_SCOPE( CRPROF_PAGE_SPLIT );
     split();
+    if ( page_list )
+        CR_PROFILE_ITEMS( CRPROF_PAGE_SPLIT, page_list->length() );
     lines.clear();
     footNotes.clear();
 }
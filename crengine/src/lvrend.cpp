@@ -16,6 +16,7 @@
 #include "../include/lvtinydom.h"
 #include "../include/fb2def.h"
 #include "../include/lvrend.h"
+#include "../include/crprofiler.h"
 
 
 //#define DEBUG_TREE_DRAW 3
@@ -831,6 +832,7 @@ int LVRendGetFontEmbolden()
 
 LVFontRef getFont( css_style_rec_t * style )
 {
+    CR_PROFILE_SCOPE( CRPROF_FONT_LOOKUP );
     int sz = style->font_size.value;
     if ( style->font_size.type != css_val_px && style->font_size.type != css_val_percent )
         sz >>= 8;
@@ -1599,6 +1601,23 @@ int renderBlockElement( LVRendPageContext & context, ldomNode * enode, int x, in
     return 0;
 }
 
+/// returns index of first child of erm_block node which ends below top (in parent coordinates)
+/// children of block are laid out by renderBlockElement() one after another, so rects are in Y order
+static int findFirstVisibleBlockChild( ldomNode * enode, int cnt, int top )
+{
+    int a = 0;
+    int b = cnt;
+    while ( a < b ) {
+        int c = (a + b) / 2;
+        RenderRectAccessor fmt( enode->getChildNode( c ) );
+        if ( fmt.getY() + fmt.getHeight() <= top )
+            a = c + 1;
+        else
+            b = c;
+    }
+    return a;
+}
+
 void DrawDocument( LVDrawBuf & drawbuf, ldomNode * enode, int x0, int y0, int dx, int dy, int doc_x, int doc_y, int page_height, ldomMarkedRangeList * marks,
                    ldomMarkedRangeList *bookmarks)
 {
@@ -1650,10 +1669,23 @@ void DrawDocument( LVDrawBuf & drawbuf, ldomNode * enode, int x0, int y0, int dx
             {
                 // recursive draw all sub-blocks for blocks
                 int cnt = enode->getChildCount();
-                for (int i=0; i<cnt; i++)
-                {
-                    ldomNode * child = enode->getChildNode( i );
-                    DrawDocument( drawbuf, child, x0, y0, dx, dy, doc_x, doc_y, page_height, marks, bookmarks ); //+fmt->getX() +fmt->getY()
+                if ( enode->getRendMethod()==erm_block ) {
+                    // skip children above visible range, stop after last visible one
+                    for (int i=findFirstVisibleBlockChild( enode, cnt, -doc_y ); i<cnt; i++)
+                    {
+                        ldomNode * child = enode->getChildNode( i );
+                        RenderRectAccessor cfmt( child );
+                        if ( doc_y + cfmt.getY() > dy )
+                            break; // below visible range
+                        DrawDocument( drawbuf, child, x0, y0, dx, dy, doc_x, doc_y, page_height, marks, bookmarks );
+                    }
+                } else {
+                    // table row and row group rects are not reliable (see range check above): visit all
+                    for (int i=0; i<cnt; i++)
+                    {
+                        ldomNode * child = enode->getChildNode( i );
+                        DrawDocument( drawbuf, child, x0, y0, dx, dy, doc_x, doc_y, page_height, marks, bookmarks ); //+fmt->getX() +fmt->getY()
+                    }
                 }
 #if (DEBUG_TREE_DRAW!=0)
                 drawbuf.FillRect( doc_x+x0, doc_y+y0, doc_x+x0+fmt.getWidth(), doc_y+y0+1, color );
@@ -4275,6 +4275,30 @@ bool LVFileExists( const lString16 & pathName )
 #endif
 }
 
+/// gets size and last modification time (seconds since epoch) of file, returns false if file does not exist
+bool LVGetFileInfo( const lString16 & pathName, lvsize_t & size, lUInt32 & modTime )
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attrs;
+    if ( !GetFileAttributesExW( pathName.c_str(), GetFileExInfoStandard, &attrs ) )
+        return false;
+    if ( attrs.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        return false;
+    size = (lvsize_t)attrs.nFileSizeLow;
+    // FILETIME is in 100ns units since 1601
+    lUInt64 t = ((lUInt64)attrs.ftLastWriteTime.dwHighDateTime << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+    modTime = (lUInt32)(t / 10000000 - 11644473600LL);
+    return true;
+#else
+    struct stat st;
+    if ( stat( UnicodeToLocal(pathName).c_str(), &st ) || !S_ISREG(st.st_mode) )
+        return false;
+    size = (lvsize_t)st.st_size;
+    modTime = (lUInt32)st.st_mtime;
+    return true;
+#endif
+}
+
 /// returns true if specified directory exists
 bool LVDirectoryExists( const lString16 & pathName )
 {
@@ -1267,6 +1267,7 @@ LVCssSelector::LVCssSelector( LVCssSelector & v )
 void LVStyleSheet::set(LVPtrVector<LVCssSelector> & v  )
 {
     _selectors.clear();
+    changed();
     if ( !v.size() )
         return;
     _selectors.reserve( v.size() );
@@ -1280,51 +1281,206 @@ void LVStyleSheet::set(LVPtrVector<LVCssSelector> & v  )
 }
 
 LVStyleSheet::LVStyleSheet( LVStyleSheet & sheet )
-:   _doc( sheet._doc )
+:   _doc( sheet._doc ), _generation( sheet._generation )
 {
     set( sheet._selectors );
 }
 
+LVCssSelectorIndex::LVCssSelectorIndex( LVCssSelector * chain, bool universal )
+: _classBuckets(32), _idBuckets(32)
+{
+    int pos = 0;
+    for ( LVCssSelector * p = chain; p; p = p->getNext(), pos++ ) {
+        LVCssSelectorIndexItem item;
+        item.selector = p;
+        item.order = ((lInt64)p->getSpecificity() << 32) | (universal ? 0x80000000 : 0) | pos;
+        const lString16 * classValue = NULL;
+        const lString16 * idValue = NULL;
+        bool self = true; // rules before first combinator check element itself
+        for ( LVCssSelectorRule * rule = p->getRules(); rule; rule = rule->getNext() ) {
+            switch ( rule->getType() ) {
+            case cssrt_parent:
+            case cssrt_ancessor:
+                // every element name in chain after E > F or E F must be an ancestor
+                if ( rule->getId() )
+                    item.ancestors.add( rule->getId() );
+                self = false;
+                break;
+            case cssrt_predecessor:
+                self = false;
+                break;
+            case cssrt_class:
+                if ( self && !classValue )
+                    classValue = &rule->getValue();
+                break;
+            case cssrt_id:
+                if ( self && !idValue )
+                    idValue = &rule->getValue();
+                break;
+            default:
+                break;
+            }
+        }
+        if ( idValue )
+            add( _idBuckets, *idValue, item );
+        else if ( classValue )
+            add( _classBuckets, *classValue, item );
+        else
+            _generic.add( item );
+    }
+}
+
+void LVCssSelectorIndex::add( LVHashTable<lString16, int> & map, const lString16 & key, LVCssSelectorIndexItem & item )
+{
+    int index = map.get( key );
+    if ( !index ) {
+        _buckets.add( new LVCssSelectorIndexList() );
+        index = _buckets.length();
+        map.set( key, index );
+    }
+    _buckets[index - 1]->add( item );
+}
+
+const LVCssSelectorIndexList * LVCssSelectorIndex::find( LVHashTable<lString16, int> & map, const lString16 & key )
+{
+    int index = map.get( key );
+    return index ? _buckets[index - 1] : NULL;
+}
+
+LVCssSelectorIndex * LVStyleSheet::getIndex( lUInt16 id )
+{
+    LVCssSelectorIndex * index = id < _index.length() ? _index[id] : NULL;
+    if ( !index ) {
+        index = new LVCssSelectorIndex( _selectors[id], id==0 );
+        _index.set( id, index );
+    }
+    return index;
+}
+
 void LVStyleSheet::apply( const ldomNode * node, css_style_rec_t * style )
 {
     if (!_selectors.length())
         return; // no rules!
         
     lUInt16 id = node->getNodeId();
-    
-    LVCssSelector * selector_0 = _selectors[0];
-    LVCssSelector * selector_id = id>0 && id<_selectors.length() ? _selectors[id] : NULL;
 
-    for (;;)
-    {
-        if (selector_0!=NULL)
-        {
-            if (selector_id==NULL || selector_0->getSpecificity() < selector_id->getSpecificity() )
-            {
-                // step by sel_0
-                selector_0->apply( node, style );
-                selector_0 = selector_0->getNext();
+    LVCssSelectorIndex * indexes[2];
+    indexes[0] = id>0 && id<_selectors.length() && _selectors[id] ? getIndex( id ) : NULL;
+    indexes[1] = _selectors[0] ? getIndex( 0 ) : NULL;
+
+    // candidate selectors: generic, class and id buckets of element and universal chains
+    const LVCssSelectorIndexList * lists[6];
+    int listCount = 0;
+    lString16 classValue;
+    lString16 idValue;
+    bool classFetched = false;
+    bool idFetched = false;
+    for ( int i=0; i<2; i++ ) {
+        LVCssSelectorIndex * index = indexes[i];
+        if ( !index )
+            continue;
+        if ( index->getGeneric().length() )
+            lists[listCount++] = &index->getGeneric();
+        if ( index->hasClassBuckets() ) {
+            if ( !classFetched ) {
+                classValue = node->getAttributeValue( attr_class );
+                classValue.lowercase();
+                classFetched = true;
             }
-            else
-            {
-                // step by sel_id
-                selector_id->apply( node, style );
-                selector_id = selector_id->getNext();
+            const LVCssSelectorIndexList * list = index->findClass( classValue );
+            if ( list )
+                lists[listCount++] = list;
+        }
+        if ( index->hasIdBuckets() ) {
+            if ( !idFetched ) {
+                idValue = node->getAttributeValue( attr_id );
+                idFetched = true;
             }
+            const LVCssSelectorIndexList * list = index->findId( idValue );
+            if ( list )
+                lists[listCount++] = list;
         }
-        else if (selector_id!=NULL)
-        {
-            // step by sel_id
-            selector_id->apply( node, style );
-            selector_id = selector_id->getNext();
+    }
+
+    // merge lists by application order, the same as order of stylesheet chains
+    int pos[6] = { 0, 0, 0, 0, 0, 0 };
+    LVCssAncestorFilter ancestors;
+    bool ancestorsReady = false;
+    for (;;)
+    {
+        const LVCssSelectorIndexItem * item = NULL;
+        int best = -1;
+        for ( int i=0; i<listCount; i++ ) {
+            if ( pos[i] >= lists[i]->length() )
+                continue;
+            const LVCssSelectorIndexItem * p = lists[i]->ptr() + pos[i];
+            if ( !item || p->order < item->order ) {
+                item = p;
+                best = i;
+            }
         }
-        else
-        {
+        if ( !item )
             break; // end of chains
+        pos[best]++;
+        if ( !item->ancestors.empty() ) {
+            if ( !ancestorsReady ) {
+                for ( ldomNode * p = node->getParentNode(); p && !p->isNull(); p = p->getParentNode() )
+                    ancestors.add( p->getNodeId() );
+                ancestorsReady = true;
+            }
+            if ( !ancestors.mayContainAll( item->ancestors ) )
+                continue; // some of required ancestors is definitely missing
         }
+        item->selector->apply( node, style );
     }
 }
 
+static void addElementDeps( LVCssElementDeps * deps, LVCssSelector * selector )
+{
+    for ( ; selector; selector = selector->getNext() ) {
+        // rules are stored starting from element itself; after first
+        // combinator, rest of chain checks other elements
+        for ( LVCssSelectorRule * rule = selector->getRules(); rule; rule = rule->getNext() ) {
+            LVCssSelectorRuleType type = rule->getType();
+            if ( type==cssrt_parent || type==cssrt_ancessor ) {
+                deps->flags |= CSS_DEP_ANCESTORS;
+                break;
+            }
+            if ( type==cssrt_predecessor ) {
+                deps->flags |= CSS_DEP_SIBLINGS;
+                break;
+            }
+            lUInt16 attrid = rule->getAttrId();
+            if ( type==cssrt_id )
+                attrid = attr_id;
+            else if ( type==cssrt_class )
+                attrid = attr_class;
+            else if ( type==cssrt_universal )
+                continue;
+            bool found = false;
+            for ( int i=0; i<deps->attrs.length() && !found; i++ )
+                found = deps->attrs[i]==attrid;
+            if ( !found )
+                deps->attrs.add( attrid );
+        }
+    }
+}
+
+/// returns what rules for element name depend on, besides element name itself
+const LVCssElementDeps * LVStyleSheet::getElementDeps( lUInt16 id )
+{
+    LVCssElementDeps * deps = id < _deps.length() ? _deps[id] : NULL;
+    if ( deps )
+        return deps;
+    deps = new LVCssElementDeps();
+    if ( _selectors.length() > 0 )
+        addElementDeps( deps, _selectors[0] );
+    if ( id>0 && id<_selectors.length() )
+        addElementDeps( deps, _selectors[id] );
+    _deps.set( id, deps );
+    return deps;
+}
+
 lUInt32 LVCssSelectorRule::getHash()
 {
     lUInt32 hash = 0;
@@ -1366,6 +1522,7 @@ bool LVStyleSheet::parse( const char * str )
     LVCssSelector * prev_selector;
     int err_count = 0;
     int rule_count = 0;
+    changed();
     for (;*str;)
     {
         // new rule
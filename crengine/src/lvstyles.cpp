@@ -29,6 +29,7 @@ lUInt32 calcHash(font_ref_t & f)
     v = v * 31 + (lUInt32)f->getWeight();
     v = v * 31 + (lUInt32)f->getItalic();
     v = v * 31 + (lUInt32)f->getKerning();
+    v = v * 31 + (lUInt32)f->getLigatures();
     v = v * 31 + (lUInt32)f->getBitmapMode();
     v = v * 31 + (lUInt32)f->getTypeFace().getHash();
     v = v * 31 + (lUInt32)f->getBaseline();
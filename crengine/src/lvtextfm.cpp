@@ -22,6 +22,7 @@
 #ifdef __cplusplus
 #include "../include/lvimg.h"
 #include "../include/lvtinydom.h"
+#include "../include/crprofiler.h"
 #endif
 
 #define MIN_SPACE_CONDENSING_PERCENT 50
@@ -122,6 +123,11 @@ formatted_text_fragment_t * lvtextAllocFormatter( lUInt16 width )
     pbuffer->img_zoom_out_scale_block = defMult; /**< max scale for block images zoom out: 1, 2, 3 */
     pbuffer->img_zoom_out_mode_inline = defMode; /**< can zoom out inline images: 0=disabled, 1=integer scale, 2=free scale */
     pbuffer->img_zoom_out_scale_inline = defMult; /**< max scale for inline images zoom out: 1, 2, 3 */
+    int defQuality = (SMOOTH_IMAGE_SCALING_DEFAULT==1) ? IMG_SCALING_QUALITY_SMOOTH : IMG_SCALING_QUALITY_FAST;
+    pbuffer->img_zoom_in_quality_block = defQuality;
+    pbuffer->img_zoom_in_quality_inline = defQuality;
+    pbuffer->img_zoom_out_quality_block = defQuality;
+    pbuffer->img_zoom_out_quality_inline = defQuality;
     pbuffer->min_space_condensing_percent = MIN_SPACE_CONDENSING_PERCENT; // 50%
     return pbuffer;
 }
@@ -1101,9 +1107,12 @@ lUInt32 LFormattedText::Format(lUInt16 width, lUInt16 page_height)
     m_pbuffer->height = 0;
     m_pbuffer->page_height = page_height;
     // format text
+    CR_PROFILE_SCOPE( CRPROF_FORMAT_TEXT );
     LVFormatter formatter( m_pbuffer );
 
-    return formatter.format();
+    lUInt32 h = formatter.format();
+    CR_PROFILE_ITEMS( CRPROF_FORMAT_TEXT, m_pbuffer->frmlinecount );
+    return h;
 }
 
 void LFormattedText::setImageScalingOptions( img_scaling_options_t * options )
@@ -1116,6 +1125,10 @@ void LFormattedText::setImageScalingOptions( img_scaling_options_t * options )
     m_pbuffer->img_zoom_out_scale_block = options->zoom_out_block.max_scale;
     m_pbuffer->img_zoom_out_mode_inline = options->zoom_out_inline.mode;
     m_pbuffer->img_zoom_out_scale_inline = options->zoom_out_inline.max_scale;
+    m_pbuffer->img_zoom_in_quality_block = options->zoom_in_block.quality;
+    m_pbuffer->img_zoom_in_quality_inline = options->zoom_in_inline.quality;
+    m_pbuffer->img_zoom_out_quality_block = options->zoom_out_block.quality;
+    m_pbuffer->img_zoom_out_quality_inline = options->zoom_out_inline.quality;
 }
 
 void LFormattedText::setMinSpaceCondensingPercent(int minSpaceWidthPercent)
@@ -1124,6 +1137,46 @@ void LFormattedText::setMinSpaceCondensingPercent(int minSpaceWidthPercent)
         m_pbuffer->min_space_condensing_percent = minSpaceWidthPercent;
 }
 
+/// returns resampling quality for object image of specified drawing and source width
+static img_scaling_quality_t getObjectImageQuality( formatted_text_fragment_t * pbuffer, int width, int imgWidth )
+{
+    // image is inline if paragraph has something besides it, see LVFormatter::resizeImage()
+    bool isInline = pbuffer->srctextlen > 1;
+    bool zoomIn = width > imgWidth;
+    int quality = zoomIn ? (isInline ? pbuffer->img_zoom_in_quality_inline : pbuffer->img_zoom_in_quality_block)
+                         : (isInline ? pbuffer->img_zoom_out_quality_inline : pbuffer->img_zoom_out_quality_block);
+    return (img_scaling_quality_t)quality;
+}
+
+/// decodes images of lines intersecting [top, bottom) into image cache of buf, with the same size and quality as Draw() uses
+int LFormattedText::PrepareImages( LVDrawBuf * buf, int top, int bottom )
+{
+    int count = 0;
+    img_scaling_quality_t oldQuality = buf->getImageScalingQuality();
+    for ( lUInt32 i=0; i<m_pbuffer->frmlinecount; i++ ) {
+        formatted_line_t * frmline = m_pbuffer->frmlines[i];
+        int line_y = frmline->y;
+        if ( line_y >= bottom )
+            break;
+        if ( line_y + frmline->height < top )
+            continue;
+        for ( lUInt32 j=0; j<frmline->word_count; j++ ) {
+            formatted_word_t * word = &frmline->words[j];
+            if ( !(word->flags & LTEXT_WORD_IS_OBJECT) )
+                continue;
+            ldomNode * node = (ldomNode *) m_pbuffer->srctext[word->src_text_index].object;
+            LVImageSourceRef img = node->getObjectImageSource();
+            if ( img.isNull() )
+                continue;
+            buf->setImageScalingQuality( getObjectImageQuality( m_pbuffer, word->width, img->GetWidth() ) );
+            if ( buf->PrepareImage( img, word->width, word->o.height ) )
+                count++;
+        }
+    }
+    buf->setImageScalingQuality( oldQuality );
+    return count;
+}
+
 void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList * marks, ldomMarkedRangeList *bookmarks )
 {
     lUInt32 i, j;
@@ -1135,6 +1188,8 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
     buf->GetClipRect( &clip );
     const lChar16 * str;
     int line_y = y;
+    // glyphs of all words are drawn at once; flushed before anything else is drawn over them
+    LVFontGlyphRun run( buf );
     for (i=0; i<m_pbuffer->frmlinecount; i++)
     {
         if (line_y>=clip.bottom)
@@ -1164,8 +1219,10 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
                     lUInt32 bgcl = srcline->bgcolor;
                     if ( lastWordColor!=bgcl || lastWordStart==-1 ) {
                         if ( lastWordStart!=-1 )
-                            if ( ((lastWordColor>>24) & 0xFF) < 128 )
+                            if ( ((lastWordColor>>24) & 0xFF) < 128 ) {
+                                run.flush();
                                 buf->FillRect( lastWordStart, y + frmline->y, lastWordEnd, y + frmline->y + frmline->height, lastWordColor );
+                            }
                         lastWordColor=bgcl;
                         lastWordStart = x+frmline->x+word->x;
                     }
@@ -1173,12 +1230,15 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
                 }
             }
             if ( lastWordStart!=-1 )
-                if ( ((lastWordColor>>24) & 0xFF) < 128 )
+                if ( ((lastWordColor>>24) & 0xFF) < 128 ) {
+                    run.flush();
                     buf->FillRect( lastWordStart, y + frmline->y, lastWordEnd, y + frmline->y + frmline->height, lastWordColor );
+                }
 
             // process marks
 #ifndef CR_USE_INVERT_FOR_SELECTION_MARKS
             if ( marks!=NULL && marks->length()>0 ) {
+                run.flush();
                 lvRect lineRect( frmline->x, frmline->y, frmline->x + frmline->width, frmline->y + frmline->height );
                 for ( int i=0; i<marks->length(); i++ ) {
                     lvRect mark;
@@ -1193,6 +1253,7 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
 #ifdef CR_USE_INVERT_FOR_SELECTION_MARKS
             // process bookmarks
             if ( bookmarks != NULL && bookmarks->length() > 0 ) {
+                run.flush();
                 lvRect lineRect( frmline->x, frmline->y, frmline->x + frmline->width, frmline->y + frmline->height );
                 for ( int i=0; i<bookmarks->length(); i++ ) {
                     lvRect bookmark_rc;
@@ -1215,7 +1276,11 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
                         img = LVCreateDummyImageSource( node, word->width, word->o.height );
                     int xx = x + frmline->x + word->x;
                     int yy = line_y + frmline->baseline - word->o.height + word->y;
+                    run.flush();
+                    img_scaling_quality_t oldQuality = buf->getImageScalingQuality();
+                    buf->setImageScalingQuality( getObjectImageQuality( m_pbuffer, word->width, img->GetWidth() ) );
                     buf->Draw( img, xx, yy, word->width, word->o.height );
+                    buf->setImageScalingQuality( oldQuality );
                     //buf->FillRect( xx, yy, xx+word->width, yy+word->height, 1 );
                 }
                 else
@@ -1246,14 +1311,13 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
                         buf->SetTextColor( cl );
                     if ( bgcl!=0xFFFFFFFF )
                         buf->SetBackgroundColor( bgcl );
-                    font->DrawTextString(
-                        buf,
+                    font->DrawTextRun(
+                        &run,
                         x + frmline->x + word->x,
                         line_y + (frmline->baseline - font->getBaseline()) + word->y,
                         str,
                         word->t.len,
                         '?',
-                        NULL,
                         flgHyphen,
                         srcline->flags & 0x0F00,
                         srcline->letter_spacing);
@@ -1267,6 +1331,7 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
 #ifdef CR_USE_INVERT_FOR_SELECTION_MARKS
             // process marks
             if ( marks!=NULL && marks->length()>0 ) {
+                run.flush();
                 lvRect lineRect( frmline->x, frmline->y, frmline->x + frmline->width, frmline->y + frmline->height );
                 for ( int i=0; i<marks->length(); i++ ) {
                     lvRect mark;
@@ -12,7 +12,7 @@
 *******************************************************/
 
 /// change in case of incompatible changes in swap/cache file format to avoid using incompatible swap file
-#define CACHE_FILE_FORMAT_VERSION "3.04.06"
+#define CACHE_FILE_FORMAT_VERSION "3.04.08"
 
 #ifndef DOC_DATA_COMPRESSION_LEVEL
 /// data compression level (0=no compression, 1=fast compressions, 3=normal compression)
@@ -91,6 +91,7 @@
 
 #define STYLE_HASH_TABLE_SIZE     512
 #define FONT_HASH_TABLE_SIZE      256
+#define STYLE_MEMO_MAX_SIZE       4096
 
 
 static const char CACHE_FILE_MAGIC[] = "CoolReader 3 Cache"
@@ -137,6 +138,7 @@ enum CacheFileBlockType {
 #include "../include/chmfmt.h"
 #endif
 #include "../include/crtest.h"
+#include "../include/crprofiler.h"
 #include <stddef.h>
 #include <math.h>
 #include <zlib.h>
@@ -272,7 +274,11 @@ lUInt32 calcGlobalSettingsHash()
     lUInt32 hash = 0;
     if ( fontMan->getKerning() )
         hash += 127365;
+    if ( fontMan->getLigatures() )
+        hash = hash * 75 + 2946;
     hash = hash * 31 + fontMan->GetFontListHash();
+    if ( fontMan->GetSubpixelPhases() > 1 )
+        hash = hash * 75 + fontMan->GetSubpixelPhases();
     if ( LVRendGetFontEmbolden() )
         hash = hash * 75 + 2384761;
     if ( gFlgFloatingPunctuationEnabled )
@@ -1462,6 +1468,8 @@ tinyNodeCollection::tinyNodeCollection()
 ,_docProps(LVCreatePropsContainer())
 ,_docFlags(DOC_FLAG_DEFAULTS)
 ,_fontMap(113)
+,_styleMemo(STYLE_HASH_TABLE_SIZE)
+,_styleMemoGeneration(0)
 {
     memset( _textList, 0, sizeof(_textList) );
     memset( _elemList, 0, sizeof(_elemList) );
@@ -1493,6 +1501,8 @@ tinyNodeCollection::tinyNodeCollection( tinyNodeCollection & v )
 ,_docFlags(v._docFlags)
 ,_stylesheet(v._stylesheet)
 ,_fontMap(113)
+,_styleMemo(STYLE_HASH_TABLE_SIZE)
+,_styleMemoGeneration(0)
 {
     _docIndex = ldomNode::registerDocument((ldomDocument*)this);
 }
@@ -2556,6 +2566,8 @@ lString8 ldomTextStorageChunk::getText( int offset )
 /// pack data from _buf to _compbuf
 bool ldomPack( const lUInt8 * buf, int bufsize, lUInt8 * &dstbuf, lUInt32 & dstsize )
 {
+    CR_PROFILE_SCOPE( CRPROF_CHUNK_PACK );
+    CR_PROFILE_ITEMS( CRPROF_CHUNK_PACK, bufsize );
     lUInt8 tmp[PACK_BUF_SIZE]; // 64K buffer for compressed data
     int ret;
     z_stream z;
@@ -2586,6 +2598,7 @@ bool ldomPack( const lUInt8 * buf, int bufsize, lUInt8 * &dstbuf, lUInt32 & dsts
 /// unpack data from _compbuf to _buf
 bool ldomUnpack( const lUInt8 * compbuf, int compsize, lUInt8 * &dstbuf, lUInt32 & dstsize  )
 {
+    CR_PROFILE_SCOPE( CRPROF_CHUNK_UNPACK );
     lUInt8 tmp[UNPACK_BUF_SIZE]; // 64K buffer for compressed data
     int ret;
     z_stream z;
@@ -2610,6 +2623,7 @@ bool ldomUnpack( const lUInt8 * compbuf, int compsize, lUInt8 * &dstbuf, lUInt32
     dstsize = have;
     dstbuf = (lUInt8 *)malloc(have);
     memcpy( dstbuf, tmp, have );
+    CR_PROFILE_ITEMS( CRPROF_CHUNK_UNPACK, have );
     return true;
 }
 
@@ -2773,6 +2787,7 @@ lxmlDocBase::lxmlDocBase( int dataBufSize )
 , _attrValueTable( DOC_STRING_HASH_SIZE )
 ,_idNodeMap(8192)
 ,_urlImageMap(1024)
+,_imageSizeMap(256)
 ,_idAttrId(0)
 ,_nameAttrId(0)
 #if BUILD_LITE!=1
@@ -2878,6 +2893,7 @@ lxmlDocBase::lxmlDocBase( lxmlDocBase & doc )
 ,   _attrValueTable(doc._attrValueTable)
 ,   _idNodeMap(doc._idNodeMap)
 ,   _urlImageMap(1024)
+,   _imageSizeMap(256)
 ,   _idAttrId(doc._idAttrId) // Id for "id" attribute name
 //,   _docFlags(doc._docFlags)
 #if BUILD_LITE!=1
@@ -3011,6 +3027,7 @@ bool ldomDocument::saveToStream( LVStreamRef stream, const char *, bool treeLayo
 ldomDocument::~ldomDocument()
 {
 #if BUILD_LITE!=1
+    LVScaledImageCache::removeOwner( this );
     updateMap();
 #endif
 }
@@ -3096,6 +3113,7 @@ bool ldomDocument::setRenderProps( int width, int dy, bool showCover, int y0, fo
 
 void tinyNodeCollection::dropStyles()
 {
+    _styleMemo.clear();
     _styles.clear(-1);
     _fonts.clear(-1);
     resetNodeNumberingProps();
@@ -3348,6 +3366,7 @@ static const char * attr_id_map_magic = "ATTR";
 static const char * attr_value_map_magic = "ATTV";
 static const char * ns_id_map_magic =   "NMSP";
 static const char * node_by_id_map_magic = "NIDM";
+static const char * image_size_map_magic = "IMGS";
 
 /// serialize to byte array (pointer will be incremented by number of bytes written)
 void lxmlDocBase::serializeMaps( SerialBuf & buf )
@@ -3390,6 +3409,18 @@ void lxmlDocBase::serializeMaps( SerialBuf & buf )
     buf.putMagic( node_by_id_map_magic );
     buf.putCRC( buf.pos() - start );
 
+    start = buf.pos();
+    buf.putMagic( image_size_map_magic );
+    buf << (lUInt32)_imageSizeMap.length();
+    {
+        LVHashTable<lString16,lvPoint>::iterator ii = _imageSizeMap.forwardIterator();
+        for ( LVHashTable<lString16,lvPoint>::pair * p = ii.next(); p!=NULL; p = ii.next() ) {
+            buf << p->key << (lUInt32)p->value.x << (lUInt32)p->value.y;
+        }
+    }
+    buf.putMagic( image_size_map_magic );
+    buf.putCRC( buf.pos() - start );
+
     buf.putCRC( buf.pos() - pos );
 }
 
@@ -3466,6 +3497,28 @@ bool lxmlDocBase::deserializeMaps( SerialBuf & buf )
         return false;
     }
 
+    start = buf.pos();
+    buf.checkMagic( image_size_map_magic );
+    lUInt32 imgcount;
+    buf >> imgcount;
+    _imageSizeMap.clear();
+    for ( unsigned i=0; i<imgcount; i++ ) {
+        lString16 url;
+        lUInt32 dx;
+        lUInt32 dy;
+        buf >> url >> dx >> dy;
+        if ( buf.error() )
+            break;
+        _imageSizeMap.set( url, lvPoint( dx, dy ) );
+    }
+    buf.checkMagic( image_size_map_magic );
+    buf.checkCRC( buf.pos() - start );
+
+    if ( buf.error() ) {
+        CRLog::error("Error while deserialization of image size map");
+        return false;
+    }
+
     buf.checkCRC( buf.pos() - pos );
 
     return !buf.error();
@@ -3486,8 +3539,79 @@ bool IsEmptySpace( const lChar16 * text, int len )
 
 static bool IS_FIRST_BODY = false;
 
+// base64 decode table
+static const signed char base64_decode_table[] = {
+   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //0..15
+   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //16..31   10
+   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63, //32..47   20
+   52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-1,-1,-1, //48..63   30
+   -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14, //64..79   40
+   15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1, //80..95   50
+   -1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, //INDEX2..111  60
+   41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1  //112..127 70
+};
+
+/// decodes base64 text passed in chunks
+class ldomBase64Decoder
+{
+    lUInt32 _value;
+    int _iteration;
+    bool _finished;
+public:
+    LVArray<lUInt8> data;
+    ldomBase64Decoder() : _value(0), _iteration(0), _finished(false) { }
+    void decode( const lChar16 * text, int len )
+    {
+        for ( int i=0; i<len && !_finished; i++ ) {
+            lChar16 ch = text[i];
+            if ( ch >= 128 )
+                continue;
+            if ( ch == '=' ) {
+                // end of data
+                if ( _iteration == 2 ) {
+                    data.add( (lUInt8)((_value>>4) & 0xFF) );
+                } else if ( _iteration == 3 ) {
+                    data.add( (lUInt8)((_value>>10) & 0xFF) );
+                    data.add( (lUInt8)((_value>>2) & 0xFF) );
+                }
+                _finished = true;
+                break;
+            }
+            int k = base64_decode_table[ch];
+            if ( k & 0x80 )
+                continue;
+            _value = (_value << 6) | k;
+            if ( ++_iteration == 4 ) {
+                data.add( (lUInt8)((_value>>16) & 0xFF) );
+                data.add( (lUInt8)((_value>>8) & 0xFF) );
+                data.add( (lUInt8)(_value & 0xFF) );
+                _iteration = 0;
+                _value = 0;
+            }
+        }
+    }
+};
+
+/// returns name of blob with decoded content of FB2 binary element
+static lString16 binaryBlobName( ldomNode * element )
+{
+    lString16 id = element->getAttributeValue( attr_id );
+    if ( id.empty() )
+        return id;
+    return lString16(L"#") + id;
+}
+
+/// saves decoded content of FB2 binary element to blob cache
+void ldomElementWriter::onBinaryEnd()
+{
+    lString16 name = binaryBlobName( _element );
+    if ( name.empty() || _base64->data.empty() )
+        return;
+    _document->addBlob( name, _base64->data.get(), _base64->data.length() );
+}
+
 ldomElementWriter::ldomElementWriter(ldomDocument * document, lUInt16 nsid, lUInt16 id, ldomElementWriter * parent)
-    : _parent(parent), _document(document), _tocItem(NULL), _isBlock(true), _isSection(false), _stylesheetIsSet(false), _bodyEnterCalled(false)
+    : _parent(parent), _document(document), _tocItem(NULL), _isBlock(true), _isSection(false), _stylesheetIsSet(false), _bodyEnterCalled(false), _base64(NULL)
 {
     //logfile << "{c";
     _typeDef = _document->getElementTypePtr( id );
@@ -3501,6 +3625,8 @@ ldomElementWriter::ldomElementWriter(ldomDocument * document, lUInt16 nsid, lUIn
     else
         _element = _document->getRootNode(); //->insertChildElement( (lUInt32)-1, nsid, id );
     //CRLog::trace("ldomElementWriter created for element 0x%04x %s", _element->getDataIndex(), LCSTR(_element->getNodeName()));
+    if ( id==el_binary && _parent )
+        _base64 = new ldomBase64Decoder();
     if ( IS_FIRST_BODY && id==el_body ) {
         _tocItem = _document->getToc();
         //_tocItem->clear();
@@ -3981,6 +4107,11 @@ void ldomElementWriter::onBodyExit()
 void ldomElementWriter::onText( const lChar16 * text, int len, lUInt32 )
 {
     //logfile << "{t";
+    if ( _base64 ) {
+        // binary object: decode now instead of storing base64 text
+        _base64->decode( text, len );
+        return;
+    }
     {
         // normal mode: store text copy
         // add text node, if not first empty space string of block node
@@ -4075,6 +4206,10 @@ ldomElementWriter::~ldomElementWriter()
     //CRLog::trace("~ldomElementWriter for element 0x%04x %s", _element->getDataIndex(), LCSTR(_element->getNodeName()));
     //getElement()->persist();
     onBodyExit();
+    if ( _base64 ) {
+        onBinaryEnd();
+        delete _base64;
+    }
 }
 
 
@@ -4279,18 +4414,6 @@ bool FindNextNode( ldomNode * & node, ldomNode * root )
     return false;
 }
 
-// base64 decode table
-static const signed char base64_decode_table[] = {
-   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //0..15
-   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //16..31   10
-   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63, //32..47   20
-   52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-1,-1,-1, //48..63   30
-   -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14, //64..79   40
-   15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1, //80..95   50
-   -1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, //INDEX2..111  60
-   41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1  //112..127 70
-};
-
 #define BASE64_BUF_SIZE 128
 class LVBase64NodeStream : public LVNamedStream
 {
@@ -4538,6 +4661,7 @@ img_scaling_option_t::img_scaling_option_t()
 {
     mode = (MAX_IMAGE_SCALE_MUL>1) ? (ARBITRARY_IMAGE_SCALE_ENABLED==1 ? IMG_FREE_SCALING : IMG_INTEGER_SCALING) : IMG_NO_SCALE;
     max_scale = (MAX_IMAGE_SCALE_MUL>1) ? MAX_IMAGE_SCALE_MUL : 1;
+    quality = (SMOOTH_IMAGE_SCALING_DEFAULT==1) ? IMG_SCALING_QUALITY_SMOOTH : IMG_SCALING_QUALITY_FAST;
 }
 
 img_scaling_options_t::img_scaling_options_t()
@@ -4558,9 +4682,11 @@ static bool updateScalingOption( img_scaling_option_t & v, CRPropRef props, int
     propName << (isInline ? "inline." : "block.");
     lString8 propNameMode = propName + "mode";
     lString8 propNameScale = propName + "scale";
+    lString8 propNameQuality = propName + "quality";
     img_scaling_option_t def;
     int currMode = props->getIntDef(propNameMode.c_str(), (int)def.mode);
     int currScale = props->getIntDef(propNameScale.c_str(), (int)def.max_scale);
+    int currQuality = props->getIntDef(propNameQuality.c_str(), (int)def.quality);
     if ( currScale==0 ) {
         if ( fontSize>=FONT_SIZE_VERY_BIG )
             currScale = 3;
@@ -4580,8 +4706,10 @@ static bool updateScalingOption( img_scaling_option_t & v, CRPropRef props, int
         updated = true;
         v.mode = (img_scaling_mode_t)currMode;
     }
+    v.quality = (img_scaling_quality_t)currQuality; // doesn't change layout
     props->setIntDef(propNameMode.c_str(), currMode);
     props->setIntDef(propNameScale.c_str(), currScale);
+    props->setIntDef(propNameQuality.c_str(), currQuality);
     return updated;
 }
 
@@ -5692,10 +5820,30 @@ bool ldomXRange::findText( lString16 pattern, bool caseInsensitive, bool reverse
     return words.length() > 0;
 }
 
+/// returns padding of final block containing pointer: marks are drawn shifted by it relative to caret rectangles
+static lvPoint getFinalBlockPadding( const ldomXPointer & p )
+{
+    ldomNode * node = p.getNode();
+    if ( node && !node->isElement() )
+        node = node->getParentNode();
+    for ( ; node; node = node->getParentNode() ) {
+        if ( node->getRendMethod() == erm_final ) {
+            RenderRectAccessor fmt( node );
+            int em = node->getFont()->getSize();
+            css_style_ref_t style = node->getStyle();
+            return lvPoint( lengthToPx( style->padding[0], fmt.getWidth(), em ),
+                            lengthToPx( style->padding[2], fmt.getWidth(), em ) );
+        }
+    }
+    return lvPoint( 0, 0 );
+}
+
 /// fill marked ranges list
-void ldomXRangeList::getRanges( ldomMarkedRangeList &dst )
+void ldomXRangeList::getRanges( ldomMarkedRangeList &dst, LVArray<lvRect> * rects )
 {
     dst.clear();
+    if ( rects )
+        rects->clear();
     if ( empty() )
         return;
     for ( int i=0; i<length(); i++ ) {
@@ -5705,9 +5853,20 @@ void ldomXRangeList::getRanges( ldomMarkedRangeList &dst )
 //        // LVE:DEBUG
 //        CRLog::trace("selectRange( %d,%d : %d,%d : %s, %s )", ptStart.x, ptStart.y, ptEnd.x, ptEnd.y, LCSTR(range->getStart().toString()), LCSTR(range->getEnd().toString()) );
         ldomMarkedRange * item = new ldomMarkedRange( ptStart, ptEnd, range->getFlags() );
-        if ( !item->empty() )
+        if ( !item->empty() ) {
             dst.add( item );
-        else
+            if ( rects ) {
+                lvRect rc;
+                if ( range->getRect( rc ) ) {
+                    lvPoint pad = getFinalBlockPadding( range->getEnd() );
+                    rc.right += pad.x;
+                    rc.bottom += pad.y;
+                } else {
+                    rc.clear();
+                }
+                rects->add( rc );
+            }
+        } else
             delete item;
     }
 }
@@ -7710,6 +7869,7 @@ void ldomDocument::clear()
 #if BUILD_LITE!=1
 bool ldomDocument::openFromCache( CacheLoadingCallback * formatCallback )
 {
+    CR_PROFILE_SCOPE( CRPROF_CACHE_LOAD );
     if ( !openCacheFile() ) {
         CRLog::info("Cannot open document from cache. Need to read fully");
         clear();
@@ -7866,6 +8026,7 @@ static const char * styles_magic = "CRSTYLES";
 /// saves changes to cache file, limited by time interval (can be called again to continue after TIMEOUT)
 ContinuousOperationResult ldomDocument::saveChanges( CRTimerUtil & maxTime )
 {
+    CR_PROFILE_SCOPE( CRPROF_CACHE_SAVE );
     if ( !_cacheFile )
         return CR_DONE;
 
@@ -8650,6 +8811,10 @@ bool ldomDocCache::init( lString16 cacheDir, lvsize_t maxSize )
         _cacheInstance = NULL;
         return false;
     }
+    // font file properties are cached in the same directory
+    lString16 fontRegistryFile( cacheDir );
+    LVAppendPathDelimiter( fontRegistryFile );
+    SetFontRegistryCacheFile( fontRegistryFile + L"cr3fonts.inx" );
     return true;
 }
 
@@ -9775,7 +9940,9 @@ static void updateStyleDataRecursive( ldomNode * node )
 /// init render method for the whole subtree
 void ldomNode::initNodeStyleRecursive()
 {
+    CR_PROFILE_SCOPE( CRPROF_INIT_STYLES );
     getDocument()->_fontMap.clear();
+    getDocument()->_styleMemo.clear();
     updateStyleDataRecursive( this );
     //recurseElements( updateStyleData );
 }
@@ -10034,12 +10201,38 @@ bool ldomNode::initNodeFont()
     return true;
 }
 
+/// fills signature of element for computed styles memo, returns false if style cannot be memoized
+static bool makeStyleMemoKey( ldomNode * node, ldomNode * parent, lUInt16 parentStyle, ldomStyleMemoKey & key )
+{
+    ldomDocument * doc = node->getDocument();
+    if ( doc->getDocFlag(DOC_FLAG_ENABLE_INTERNAL_STYLES) && node->hasAttribute( LXML_NS_ANY, attr_style ) )
+        return false;
+    lUInt16 id = node->getNodeId();
+    const LVCssElementDeps * deps = doc->getStyleSheet()->getElementDeps( id );
+    if ( deps->flags & CSS_DEP_SIBLINGS )
+        return false;
+    key.id = id;
+    key.parentStyle = parentStyle;
+    // parent element with its ancestors chain is the same for all its children
+    key.parentNode = (deps->flags & CSS_DEP_ANCESTORS) ? parent->getDataIndex() : 0;
+    for ( int i=0; i<deps->attrs.length(); i++ ) {
+        lUInt16 attrid = deps->attrs[i];
+        if ( node->hasAttribute( attrid ) ) {
+            key.attrs += (lChar16)1;
+            key.attrs += node->getAttributeValue( attrid );
+        }
+        key.attrs += (lChar16)2;
+    }
+    return true;
+}
+
 void ldomNode::initNodeStyle()
 {
     // assume all parent styles already initialized
     if ( !getDocument()->isDefStyleSet() )
         return;
     if ( isElement() ) {
+        CR_PROFILE_ITEMS( CRPROF_INIT_STYLES, 1 );
         if ( isRoot() || getParentNode()->isRoot() )
         {
             setNodeStyle( this,
@@ -10072,10 +10265,33 @@ void ldomNode::initNodeStyle()
                 style = parent->getStyle();
             }
 #endif
+            ldomDocument * doc = getDocument();
+            ldomStyleMemoKey key;
+            bool memoize = makeStyleMemoKey( this, parent, doc->getNodeStyleIndex( parent->getDataIndex() ), key );
+            if ( memoize ) {
+                lUInt32 generation = doc->getStyleSheet()->getGeneration();
+                if ( doc->_styleMemoGeneration != generation || doc->_styleMemo.length() >= STYLE_MEMO_MAX_SIZE ) {
+                    doc->_styleMemo.clear();
+                    doc->_styleMemoGeneration = generation;
+                }
+                ldomStyleMemoValue item;
+                if ( doc->_styleMemo.get( key, item ) && item.parentStyle.get() == style.get() ) {
+                    // same signature and parent style: skip selectors matching
+                    setStyle( item.style );
+                    initNodeFont();
+                    return;
+                }
+            }
             setNodeStyle( this,
                 style,
                 font
                 );
+            if ( memoize ) {
+                ldomStyleMemoValue item;
+                item.parentStyle = style;
+                item.style = getStyle();
+                doc->_styleMemo.set( key, item );
+            }
 #if DEBUG_DOM_STORAGE==1
             if ( this->getStyle().isNull() ) {
                 CRLog::error("NULL style is set for <%s>", LCSTR(getNodeName()) );
@@ -10446,6 +10662,13 @@ LVStreamRef ldomNode::createBase64Stream()
     ASSERT_NODE_NOT_NULL;
     if ( !isElement() )
         return LVStreamRef();
+    if ( getNodeId()==el_binary ) {
+        // decoded during parsing
+        lString16 name = binaryBlobName( this );
+        LVStreamRef blob = name.empty() ? LVStreamRef() : getDocument()->getBlob( name );
+        if ( !blob.isNull() )
+            return blob;
+    }
 #define DEBUG_BASE64_IMAGE 0
 #if DEBUG_BASE64_IMAGE==1
     lString16 fname = getAttributeValue( attr_id );
@@ -10506,6 +10729,14 @@ public:
             return false;
         return img->Decode(callback);
     }
+    virtual const void * GetCacheOwner()
+    {
+        return _node->getDocument();
+    }
+    virtual lString16 GetCacheName()
+    {
+        return _refName;
+    }
     virtual ~NodeImageProxy()
     {
 
@@ -10572,10 +10803,20 @@ LVImageSourceRef ldomNode::getObjectImageSource()
     LVImageSourceRef ref;
     if ( refName.empty() )
         return ref;
+    if ( getDocument()->_urlImageMap.get( refName, ref ) && !ref.isNull() )
+        return ref; // don't reopen stream just to get image size
+    lvPoint sz;
+    if ( getDocument()->_imageSizeMap.get( refName, sz ) ) {
+        // size is known from previous open (possibly loaded from cache file): stream is opened only for drawing
+        ref = LVImageSourceRef( new NodeImageProxy(this, refName, sz.x, sz.y) );
+        getDocument()->_urlImageMap.set( refName, ref );
+        return ref;
+    }
     ref = getDocument()->getObjectImageSource( refName );
     if ( !ref.isNull() ) {
         int dx = ref->GetWidth();
         int dy = ref->GetHeight();
+        getDocument()->_imageSizeMap.set( refName, lvPoint( dx, dy ) );
         ref = LVImageSourceRef( new NodeImageProxy(this, refName, dx, dy) );
     } else {
         CRLog::error("ObjectImageSource cannot be opened by name %s", LCSTR(refName));